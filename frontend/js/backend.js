@@ -46,16 +46,47 @@ export async function BackendFetchUserRoots() {
     return response.json();
 }
 
-//Returns a directory object with an array of entries.
+// dirLookup is a POST - the browser never caches it, so unchanged pages are revalidated here by their ETag.
+// Keyed by the request body, which is part of the ETag - the oldest page is dropped once full.
+const DIR_LOOKUP_MAX_PAGES = 256;
+const dirLookupPages = new Map();
+
+//Returns an array of all entries - large directories are fetched page by page.
 export async function BackendDirLookup(directoryId) {
-    const response = await fetchWithErrorHandling('/api/filesystem/dirLookup', {
-        method: 'POST',
-        headers: {
-            'Content-Type': 'application/json',
-        },
-        body: JSON.stringify({directory: directoryId})
-    });
-    return response.json();
+    let entries = [];
+    let cursor = "";
+    do {
+        const body = JSON.stringify({directory: directoryId, cursor: cursor});
+        const cached = dirLookupPages.get(body);
+        const headers = {'Content-Type': 'application/json'};
+        if (cached) {
+            headers['If-None-Match'] = cached.etag;
+        }
+
+        const response = await fetch('/api/filesystem/dirLookup', {method: 'POST', headers: headers, body: body});
+        let page = cached;
+        if (response.status !== 304 || !cached) {
+            if (!response.ok) {
+                throw new Error(await response.text());
+            }
+            // A 304 only carries the ETag - the next cursor is kept with the page
+            page = {
+                etag: response.headers.get('ETag'),
+                entries: await response.json(),
+                next: response.headers.get('Next-Cursor') ?? ""
+            };
+            dirLookupPages.delete(body);
+            if (page.etag) {
+                if (dirLookupPages.size >= DIR_LOOKUP_MAX_PAGES) {
+                    dirLookupPages.delete(dirLookupPages.keys().next().value);
+                }
+                dirLookupPages.set(body, page);
+            }
+        }
+        entries = entries.concat(page.entries);
+        cursor = page.next;
+    } while (cursor !== "");
+    return entries;
 }
 
 export async function BackendDirCreate(directory, name) {
@@ -103,6 +103,7 @@ AuthStatus Authenticator::userRemove(const UserID actor, const UserID user)
         LOG_EVENT_AUTH(actor, FAIL_UNSPECIFIED, AuthenticationEventData{});
         return AuthStatus::ERR_UNSUCCESSFUL;
     }
+    userNameVersion.fetch_add(1, std::memory_order_release);
 
     LOG_EVENT_AUTH(actor, INFO_SUCCESS, AuthenticationEventData{});
     return AuthStatus::OK;
@@ -125,6 +126,7 @@ AuthStatus Authenticator::userChangeCredentials(const UserID actor, const UserNa
         LOG_EVENT_AUTH(actor, FAIL_UNSPECIFIED, AuthenticationEventData{});
         return AuthStatus::ERR_UNSUCCESSFUL;
     }
+    userNameVersion.fetch_add(1, std::memory_order_release);
 
     LOG_EVENT_AUTH(actor, INFO_SUCCESS, AuthenticationEventData{});
     return AuthStatus::OK;
@@ -218,6 +220,11 @@ AuthStatus Authenticator::getUserName(const UserID user, UserName& out)
     return AuthStatus::OK;
 }
 
+uint64_t Authenticator::getUserNameVersion() const
+{
+    return userNameVersion.load(std::memory_order_acquire);
+}
+
 AuthStatus Authenticator::getIsAdmin(UserID user)
 {
     // TODO
@@ -63,6 +63,10 @@ struct Authenticator final
     // Assigns the username on success
     AuthStatus getUserName(UserID user, UserName& out);
 
+    // Increased whenever a user is renamed or removed - listings naming users change with it
+    // Lock-free
+    [[nodiscard]] uint64_t getUserNameVersion() const;
+
     // Returns OK if given user is admin
     AuthStatus getIsAdmin(UserID user);
 
@@ -75,6 +79,7 @@ struct Authenticator final
     Spinlock authLock;           // Makes all operations atomic
     SessionStorage sessionStore; // Saves all sessions and tokens
     UserStorage userStore;       // Saves all userdata
+    std::atomic<uint64_t> userNameVersion{0};
     TPUNKT_MACROS_STRUCT(Authenticator);
 };
 
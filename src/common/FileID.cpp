@@ -38,6 +38,15 @@ FileID FileID::Root(EndpointID endpoint)
     return fid;
 }
 
+void FileID::ReserveUID(const uint32_t uid)
+{
+    SpinlockGuard lock{ID_LOCK};
+    if(uid != UINT32_MAX && uid >= UID)
+    {
+        UID = uid + 1;
+    }
+}
+
 FileID::FileID(EndpointID endpoint, const bool isDirectory) : endpoint(endpoint), directory(isDirectory)
 {
     SpinlockGuard lock{ID_LOCK};
@@ -13,6 +13,10 @@ struct FileID final
     static FixedString<32> ToString(FileID fid);
 
     static FileID Root(EndpointID endpoint);
+
+    // Makes sure all new ids are bigger than the given one - used when restoring persisted ids
+    static void ReserveUID(uint32_t uid);
+
     FileID() = default;
     FileID(EndpointID endpoint, bool isDirectory);
 
@@ -11,6 +11,9 @@ constexpr size_t TPUNKT_CRYPTO_SESSION_ID_LEN = 32;
 
 constexpr size_t TPUNKT_CRYPTO_KEY_LEN = 32;
 
+// Random master key created at the first start - all persisted keys are derived from it, losing it loses the data
+constexpr auto* TPUNKT_CRYPTO_MASTER_KEY_FILE = "./master.key";
+
 constexpr size_t TPUNKT_INSTANCE_SECRET_MAX_LEN = 32;
 
 //===== Authentication =====//
@@ -40,16 +43,89 @@ constexpr size_t TPUNKT_STORAGE_USER_LEN = 16;
 // Max concurrent readers per datastore
 constexpr size_t TPUNKT_STORAGE_DATASTORE_MAX_READERS = 25;
 
+// Submission queue entries of io_uring datastores - the completion queue is twice as big
+constexpr size_t TPUNKT_STORAGE_DATASTORE_URING_ENTRIES = 256U;
+
+// Registered read buffer per reader of io_uring datastores - bigger reads are split
+constexpr size_t TPUNKT_STORAGE_DATASTORE_URING_READ_SIZE = 128U * 1024U;
+
 // Default limit for the count of files and directories EACH across all endpoints
 constexpr size_t TPUNKT_STORAGE_MAX_DEFAULT_FILE_DIR_LIMIT = 50'000U;
 
+// Directories with more files (or dirs) than this keep a name index - dropped again below half of it
+constexpr size_t TPUNKT_STORAGE_VFS_NAME_INDEX_THRESHOLD = 64U;
+
+// Unused bytes in the name arena of a filesystem after which it's compacted (if at least half is unused)
+constexpr size_t TPUNKT_STORAGE_VFS_NAME_COMPACT_MIN = 64U * 1024U;
+
+// Nodes per encrypted chunk of the filesystem snapshot
+constexpr size_t TPUNKT_STORAGE_VFS_SNAPSHOT_CHUNK = 256U;
+
+// Journal records after which the filesystem journal is compacted into a new snapshot
+constexpr size_t TPUNKT_STORAGE_VFS_JOURNAL_COMPACT_LIMIT = 50'000U;
+
+// Interval in microseconds in which appended journal records are written and synced together
+// A crash loses at most the changes of the last interval
+constexpr size_t TPUNKT_STORAGE_VFS_JOURNAL_SYNC_INTERVAL = 10'000U;
+
+// Changes per filesystem kept for incremental sync - older changes need a full resync
+constexpr size_t TPUNKT_STORAGE_VFS_CHANGE_LOG_SIZE = 16U * 1024U;
+
+// Nodes removed per batch when deleting a directory in the background - the endpoint lock is released in between
+constexpr size_t TPUNKT_STORAGE_VFS_RECLAIM_BATCH = 4096U;
+
 // Chunk size for reading files
 constexpr size_t TPUNKT_STORAGE_FILE_CHUNK_SIZE = 1024U * 512U;
 
+// Max resumable uploads per endpoint
+constexpr size_t TPUNKT_STORAGE_UPLOAD_MAX_SESSIONS = 256U;
+
+// Min, average and max size of content defined chunks of deduplicating datastores - average must be a power of two
+// Changing them changes all boundaries - stored chunks are not found again
+constexpr size_t TPUNKT_STORAGE_DEDUP_CHUNK_MIN = 16U * 1024U;
+constexpr size_t TPUNKT_STORAGE_DEDUP_CHUNK_AVG = 64U * 1024U;
+constexpr size_t TPUNKT_STORAGE_DEDUP_CHUNK_MAX = 256U * 1024U;
+
+// Unused chunks removed per garbage collection task - queues itself again until all are removed
+constexpr size_t TPUNKT_STORAGE_DEDUP_GC_BATCH = 4096U;
+
+// Max parts of a resumable upload - each part can be written by its own connection
+constexpr size_t TPUNKT_STORAGE_UPLOAD_MAX_PARTS = 4096U;
+
+// Min size of the parts of an upload split into more than one
+constexpr size_t TPUNKT_STORAGE_UPLOAD_MIN_PART_SIZE = 1024U * 1024U;
+
+// Seconds after the last chunk until a resumable upload expires - its file is removed
+constexpr size_t TPUNKT_STORAGE_UPLOAD_TIMEOUT = 12U * 60U * 60U;
+
+// Seconds between two sweeps for expired uploads of an endpoint
+constexpr size_t TPUNKT_STORAGE_UPLOAD_SWEEP_INTERVAL = 5U * 60U;
+
 //===== Server =====//
 
 constexpr size_t TPUNKT_SERVER_CHUNK_SIZE = 85'000;
 
+// Max bytes of an upload request copied into writes that are not completed yet - receiving pauses above it
+constexpr size_t TPUNKT_SERVER_UPLOAD_MAX_PENDING = 4U * 1024U * 1024U;
+
+// Max entries returned per directory lookup - bigger directories are paged
+constexpr size_t TPUNKT_SERVER_DIR_LOOKUP_MAX_ENTRIES = 1000;
+
+// Max length of a listing cursor - two numbers, separators and the hex encoded name of the last entry
+constexpr size_t TPUNKT_SERVER_CURSOR_LEN = 2 * 20 + 3 + 2 * TPUNKT_STORAGE_FILE_LEN;
+
+// Max paths resolved per request
+constexpr size_t TPUNKT_SERVER_PATH_RESOLVE_MAX_PATHS = 256;
+
+// Max entries returned per search - more matches are paged
+constexpr size_t TPUNKT_SERVER_SEARCH_MAX_ENTRIES = 100;
+
+// Max changes returned per change feed request - more changes are paged
+constexpr size_t TPUNKT_SERVER_CHANGES_MAX_ENTRIES = 1000;
+
+// Max ranges served per download - requests with more get the whole file
+constexpr size_t TPUNKT_SERVER_DOWNLOAD_MAX_RANGES = 16;
+
 // Size of static file buffer
 constexpr size_t TPUNKT_SERVER_STATIC_FILES_LEN = 32;
 
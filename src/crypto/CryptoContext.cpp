@@ -4,8 +4,12 @@
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
 #include <sodium.h>
+#include <sys/stat.h>
 #include <thread>
+#include <unistd.h>
 #include "crypto/CryptoContext.h"
 #include "datastructures/FixedString.h"
 #include "instance/InstanceConfig.h"
@@ -26,14 +30,77 @@ static CryptoContext* CryptoContext;
 CryptoContext::CryptoContext()
 {
     TPUNKT_MACROS_GLOBAL_ASSIGN(CryptoContext);
-    // TODO init tpm or ephemeral key
+    isMasterKeyLoaded = loadMasterKey();
+    if(!isMasterKeyLoaded)
+    {
+        LOG_ERROR("No master key - encrypted persistence is disabled");
+    }
 }
 
 CryptoContext::~CryptoContext()
 {
+    masterKey.clear();
     TPUNKT_MACROS_GLOBAL_RESET(CryptoContext);
 }
 
+bool CryptoContext::loadMasterKey()
+{
+    int file = open(TPUNKT_CRYPTO_MASTER_KEY_FILE, O_RDONLY);
+    if(file == -1 && errno == ENOENT) // First start
+    {
+        file = open(TPUNKT_CRYPTO_MASTER_KEY_FILE, O_CREAT | O_EXCL | O_WRONLY, S_IRUSR | S_IWUSR);
+        if(file == -1)
+        {
+            LOG_ERROR("Creating master key failed: %s", strerror(errno));
+            return false;
+        }
+
+        randombytes_buf(masterKey.udata(), TPUNKT_CRYPTO_KEY_LEN);
+        const bool isWritten = write(file, masterKey.udata(), TPUNKT_CRYPTO_KEY_LEN) ==
+                                   static_cast<ssize_t>(TPUNKT_CRYPTO_KEY_LEN) &&
+                               fsync(file) == 0;
+        (void)close(file);
+        if(!isWritten)
+        {
+            LOG_ERROR("Writing master key failed: %s", strerror(errno));
+            (void)unlink(TPUNKT_CRYPTO_MASTER_KEY_FILE); // Created again at the next start
+            masterKey.clear();
+            return false;
+        }
+        LOG_INFO("Created new master key");
+        return true;
+    }
+
+    if(file == -1)
+    {
+        LOG_ERROR("Opening master key failed: %s", strerror(errno));
+        return false;
+    }
+
+    struct stat keyStat{};
+    if(fstat(file, &keyStat) == 0 && (keyStat.st_mode & (S_IRWXG | S_IRWXO)) != 0)
+    {
+        LOG_WARNING("Master key was accessible by other users - restricting it");
+        (void)fchmod(file, S_IRUSR | S_IWUSR);
+    }
+
+    const bool isRead = read(file, masterKey.udata(), TPUNKT_CRYPTO_KEY_LEN) ==
+                        static_cast<ssize_t>(TPUNKT_CRYPTO_KEY_LEN);
+    (void)close(file);
+    if(!isRead)
+    {
+        LOG_ERROR("Master key is damaged");
+        masterKey.clear();
+        return false;
+    }
+    return true;
+}
+
+bool CryptoContext::hasMasterKey() const
+{
+    return isMasterKeyLoaded;
+}
+
 void CryptoContext::encrypt(void* data, const size_t len)
 {
     (void)data;
@@ -46,6 +113,17 @@ void CryptoContext::decrypt(void* data, const size_t len)
     (void)len;
 }
 
+CipherKey CryptoContext::deriveKey(const char* context, const uint64_t id) const
+{
+    static_assert(TPUNKT_CRYPTO_KEY_LEN == crypto_kdf_KEYBYTES, "Update key length");
+    CipherKey key;
+    if(crypto_kdf_derive_from_key(key.udata(), key.capacity(), id, context, masterKey.u_str()) != 0)
+    {
+        LOG_CRITICAL("Failed to derive key");
+    }
+    return key;
+}
+
 TOTPCode CryptoContext::getTOTPCode(const TOTPKey& key) const
 {
     unsigned char hmac[ crypto_auth_hmacsha512_BYTES ];
@@ -18,12 +18,23 @@ struct CryptoContext
     void encrypt(void* data, size_t len);
     void decrypt(void* data, size_t len);
 
+    // Returns true if the master key was loaded or created - nothing may be persisted encrypted without it
+    [[nodiscard]] bool hasMasterKey() const;
+
+    // Derives a key bound to the given context (8 chars) and id - stays the same across restarts
+    [[nodiscard]] CipherKey deriveKey(const char* context, uint64_t id) const;
+
     [[nodiscard]] TOTPCode getTOTPCode(const TOTPKey& key) const;
     [[nodiscard]] TOTPInfo getTOTPCreationString(const UserName& name, const TOTPKey& key) const;
     [[nodiscard]] TOTPKey generateTOTPKey() const;
     [[nodiscard]] bool verifyTOTP(const TOTPKey& key, const TOTPCode& userCode) const;
 
   private:
+    // Reads the master key file - creates it with a random key at the first start
+    bool loadMasterKey();
+
+    CipherKey masterKey; // Only readable by the instance user - zeroed on shutdown
+    bool isMasterKeyLoaded = false;
     TPUNKT_MACROS_STRUCT(CryptoContext);
 };
 
@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TPUNKT_NODE_ARENA_H
+#define TPUNKT_NODE_ARENA_H
+
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+#include <sys/mman.h>
+#include "util/Logging.h"
+#include "util/Memory.h"
+
+namespace tpunkt
+{
+
+// Identifies an element inside a NodeArena - stays valid until the element is destroyed
+enum class NodeHandle : uint32_t
+{
+    INVALID = UINT32_MAX,
+};
+
+// Chunked successor of the BlockAllocator - total size doesn't need to be known upfront
+// Properties:
+//      - Pointer Stability - chunks are never moved or freed while the arena lives
+//      - 32-bit handles instead of pointers (chunk index + offset inside the chunk)
+//      - Free list through the freed slots - holes are filled before the arena grows
+//      - Elements are continuous inside a chunk (cache locality when traversing)
+//
+// Cons:
+//      - Handles are reused after an element is destroyed - the owner needs to make sure none are left
+// Not synced == NOT threadsafe
+template <typename T, uint32_t chunkSize = 512>
+struct NodeArena final
+{
+    static_assert(chunkSize >= 64 && std::has_single_bit(chunkSize), "Chunk size must be a power of two");
+    static_assert(sizeof(T) >= sizeof(uint32_t), "Freed slots hold the free list");
+
+    NodeArena() = default;
+
+    NodeArena(NodeArena&& other) noexcept
+        : chunks(std::move(other.chunks)), live(std::move(other.live)), used(other.used), count(other.count),
+          freeHead(other.freeHead)
+    {
+        other.chunks.clear();
+        other.live.clear();
+        other.used = 0;
+        other.count = 0;
+        other.freeHead = UINT32_MAX;
+    }
+
+    NodeArena& operator=(NodeArena&& other) noexcept
+    {
+        if(this != &other)
+        {
+            std::swap(chunks, other.chunks);
+            std::swap(live, other.live);
+            std::swap(used, other.used);
+            std::swap(count, other.count);
+            std::swap(freeHead, other.freeHead);
+        }
+        return *this;
+    }
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    ~NodeArena()
+    {
+        forEach([ this ](const NodeHandle handle, T& /**/) { std::destroy_at(slot(static_cast<uint32_t>(handle))); });
+        for(T* chunk : chunks)
+        {
+            TPUNKT_MUNMAP(chunk, sizeof(T) * chunkSize);
+        }
+    }
+
+    //===== Elements =====//
+
+    // Constructs a new element - reuses freed slots first
+    template <typename... Args>
+    NodeHandle create(Args&&... args)
+    {
+        uint32_t index = freeHead;
+        if(index != UINT32_MAX)
+        {
+            freeHead = *std::launder(reinterpret_cast<uint32_t*>(slot(index)));
+        }
+        else
+        {
+            if(used == static_cast<uint32_t>(NodeHandle::INVALID)) [[unlikely]]
+            {
+                LOG_FATAL("Node arena is full");
+            }
+            if(used == chunks.size() * chunkSize)
+            {
+                grow();
+            }
+            index = used++;
+        }
+
+        ::new(static_cast<void*>(slot(index))) T(std::forward<Args>(args)...);
+        live[ index / 64 ] |= uint64_t{1} << (index % 64);
+        ++count;
+        return NodeHandle{index};
+    }
+
+    // Destroys the element - the handle (and pointers to it) are invalid afterward
+    void destroy(const NodeHandle handle)
+    {
+        if(!contains(handle)) [[unlikely]]
+        {
+            LOG_ERROR("Destroying invalid node");
+            return;
+        }
+
+        const auto index = static_cast<uint32_t>(handle);
+        std::destroy_at(slot(index));
+        ::new(static_cast<void*>(slot(index))) uint32_t{freeHead};
+        freeHead = index;
+        live[ index / 64 ] &= ~(uint64_t{1} << (index % 64));
+        --count;
+    }
+
+    //===== Access =====//
+
+    [[nodiscard]] bool contains(const NodeHandle handle) const
+    {
+        const auto index = static_cast<uint32_t>(handle);
+        return index < used && (live[ index / 64 ] & (uint64_t{1} << (index % 64))) != 0;
+    }
+
+    // Returns nullptr if the handle doesn't identify a live element
+    T* get(const NodeHandle handle)
+    {
+        return contains(handle) ? slot(static_cast<uint32_t>(handle)) : nullptr;
+    }
+
+    const T* get(const NodeHandle handle) const
+    {
+        return contains(handle) ? slot(static_cast<uint32_t>(handle)) : nullptr;
+    }
+
+    // Unchecked - only for handles known to be live (e.g. intrusive links)
+    T& operator[](const NodeHandle handle)
+    {
+        return *slot(static_cast<uint32_t>(handle));
+    }
+
+    const T& operator[](const NodeHandle handle) const
+    {
+        return *slot(static_cast<uint32_t>(handle));
+    }
+
+    // Calls func(handle, element) for every live element - in memory order
+    template <typename Func>
+    void forEach(Func&& func)
+    {
+        for(uint32_t word = 0; word < live.size(); ++word)
+        {
+            uint64_t bits = live[ word ];
+            while(bits != 0)
+            {
+                const auto index = (word * 64) + static_cast<uint32_t>(std::countr_zero(bits));
+                bits &= bits - 1;
+                func(NodeHandle{index}, *slot(index));
+            }
+        }
+    }
+
+    template <typename Func>
+    void forEach(Func&& func) const
+    {
+        for(uint32_t word = 0; word < live.size(); ++word)
+        {
+            uint64_t bits = live[ word ];
+            while(bits != 0)
+            {
+                const auto index = (word * 64) + static_cast<uint32_t>(std::countr_zero(bits));
+                bits &= bits - 1;
+                func(NodeHandle{index}, static_cast<const T&>(*slot(index)));
+            }
+        }
+    }
+
+    //===== Info =====//
+
+    // Live elements
+    [[nodiscard]] uint32_t size() const
+    {
+        return count;
+    }
+
+    // Elements that fit without growing
+    [[nodiscard]] uint32_t capacity() const
+    {
+        return static_cast<uint32_t>(chunks.size()) * chunkSize;
+    }
+
+  private:
+    T* slot(const uint32_t index) const
+    {
+        return chunks[ index / chunkSize ] + (index % chunkSize);
+    }
+
+    void grow()
+    {
+        T* chunk = TPUNKT_MMAP(chunk, sizeof(T) * chunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS);
+        chunks.push_back(chunk);
+        live.resize(live.size() + (chunkSize / 64), 0);
+    }
+
+    std::vector<T*> chunks;      // Never moved once allocated
+    std::vector<uint64_t> live;  // Bit per slot - set if the slot holds an element
+    uint32_t used = 0;           // Slots handed out at least once
+    uint32_t count = 0;          // Live elements
+    uint32_t freeHead = UINT32_MAX;
+};
+
+} // namespace tpunkt
+
+#endif // TPUNKT_NODE_ARENA_H
@@ -45,41 +45,70 @@ SpinlockGuard::~SpinlockGuard()
     lock.unlock();
 }
 
+namespace
+{
+constexpr uint32_t COOP_MASK = 0xFFFFU;          // Readers holding the lock
+constexpr uint32_t WAITING_ONE = 1U << 16U;      // Writers waiting for the lock
+constexpr uint32_t WAITING_MASK = 0x7FFFU << 16U;
+constexpr uint32_t EXCLUSIVE_BIT = 1U << 31U;    // Writer holding the lock
+} // namespace
+
+bool CooperativeSpinlock::isLocked() const
+{
+    return (state.load(std::memory_order_acquire) & (COOP_MASK | EXCLUSIVE_BIT)) != 0;
+}
+
 void CooperativeSpinlock::coopAdd()
 {
-    while(exclusiveCount.load(std::memory_order_acquire) > 0)
-    {
-        sched_yield();
-    }
+    uint32_t current = state.load(std::memory_order_relaxed);
+    while(true)
     {
-        SpinlockGuard guard{unique};
-        coopCount.fetch_add(1, std::memory_order_acquire);
+        // Waiting writers go first - readers can't starve them
+        if((current & (EXCLUSIVE_BIT | WAITING_MASK)) != 0)
+        {
+            state.wait(current, std::memory_order_relaxed);
+            current = state.load(std::memory_order_relaxed);
+            continue;
+        }
+        if(state.compare_exchange_weak(current, current + 1, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            return;
+        }
     }
 }
 
 void CooperativeSpinlock::coopRemove()
 {
-    coopCount.fetch_sub(1, std::memory_order_release);
+    const uint32_t previous = state.fetch_sub(1, std::memory_order_release);
+    if((previous & COOP_MASK) == 1 && (previous & WAITING_MASK) != 0)
+    {
+        state.notify_all(); // Last reader lets the writers in
+    }
 }
 
 void CooperativeSpinlock::exclusiveAdd()
 {
+    uint32_t current = state.fetch_add(WAITING_ONE, std::memory_order_relaxed) + WAITING_ONE;
+    while(true)
     {
-        SpinlockGuard guard{unique};
-        exclusiveCount.fetch_add(1, std::memory_order_release);
-    }
-
-    while(coopCount.load(std::memory_order_acquire) > 0)
-    {
-        sched_yield();
+        if((current & (EXCLUSIVE_BIT | COOP_MASK)) != 0)
+        {
+            state.wait(current, std::memory_order_relaxed);
+            current = state.load(std::memory_order_relaxed);
+            continue;
+        }
+        if(state.compare_exchange_weak(current, (current - WAITING_ONE) | EXCLUSIVE_BIT, std::memory_order_acquire,
+                                       std::memory_order_relaxed))
+        {
+            return;
+        }
     }
-    exclusive.lock();
 }
 
 void CooperativeSpinlock::exclusiveRemove()
 {
-    exclusive.unlock();
-    exclusiveCount.fetch_sub(1, std::memory_order_release);
+    state.fetch_and(~EXCLUSIVE_BIT, std::memory_order_release);
+    state.notify_all();
 }
 
 } // namespace tpunkt
@@ -41,6 +41,7 @@ struct SpinlockGuard final
 // Used for readers and writers
 // Allows multiple readers but only 1 writer
 // If a writer is waiting don't allow new readers
+// Waiters spin shortly and then sleep on the state (futex) until it changes
 struct CooperativeSpinlock final
 {
     CooperativeSpinlock() = default;
@@ -49,16 +50,16 @@ struct CooperativeSpinlock final
     CooperativeSpinlock(CooperativeSpinlock&&) = delete;
     CooperativeSpinlock& operator=(CooperativeSpinlock&&) = delete;
 
+    [[nodiscard]] bool isLocked() const;
+
   private:
     void coopAdd();
     void coopRemove();
     void exclusiveAdd();
     void exclusiveRemove();
 
-    std::atomic<int> coopCount{0};
-    std::atomic<int> exclusiveCount{0};
-    Spinlock exclusive;
-    Spinlock unique;
+    // Readers | waiting writers | writer bit - a single word, so every change can be waited on
+    std::atomic<uint32_t> state{0};
     friend struct CooperativeSpinlockGuard;
 };
 
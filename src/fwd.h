@@ -36,6 +36,7 @@ struct VirtualDirectory;
 template <typename T>
 struct Collector;
 struct DataStore;
+struct DedupFileSystemDatastore;
 struct ReadFileTransaction;
 struct StorageTransaction;
 struct WriteFileTransaction;
@@ -45,6 +46,9 @@ struct VirtualFile;
 struct FileInfo;
 struct StorageEndpoint;
 struct FileStats;
+struct VirtualNodeState;
+struct VirtualFilesystemPersistence;
+struct DirectorySnapshot;
 
 namespace DTO
 {
@@ -54,6 +58,7 @@ struct RequestUserSignupPassword;
 struct RequestUserSignupPasskey;
 struct ResponseDirectoryInfo;
 struct ResponseDirectoryEntry;
+struct UserNameCache;
 struct SessionInfo;
 struct FileDownload;
 
@@ -107,6 +112,11 @@ enum class GroupID : uint16_t
     INVALID = 0
 };
 
+enum class UploadID : uint64_t
+{
+    INVALID = 0
+};
+
 
 } // namespace tpunkt
 
@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <algorithm>
 #include <cfloat>
 #include <mutex>
 #include "instance/InstanceConfig.h"
@@ -34,16 +35,8 @@ TaskManager::~TaskManager()
 {
     auto getUnfinishedTasks = [ & ]
     {
-        uint32_t unfinishedTasks = 0;
         SpinlockGuard guard{taskLock};
-        for(const auto& task : tasks)
-        {
-            if(!task.status.isDone)
-            {
-                ++unfinishedTasks;
-            }
-        }
-        return unfinishedTasks;
+        return static_cast<uint32_t>(tasks.size()); // Finished tasks are removed
     };
 
     const uint32_t unfinishedTasks = getUnfinishedTasks();
@@ -85,23 +78,32 @@ void TaskManager::workerTask(const ThreadID tid, TaskManager* manager)
         SpinlockGuard guard{manager->taskLock};
         for(auto& task : manager->tasks)
         {
-            if(!task.status.isProcessing || task.status.isDone)
+            // Periodic tasks stay queued between their runs
+            if(!task->status.isProcessing && !task->status.isDone && task->task->shouldBeInvoked())
             {
-                task.status.isProcessing = true;
-                task.status.worker = tid;
-                task.status.start = Timestamp::Now();
-                return &task;
+                task->status.isProcessing = true;
+                task->status.worker = tid;
+                task->status.start = Timestamp::Now();
+                return task.get();
             }
         }
         return nullptr;
     };
 
-    auto removeTask = [ & ](TaskData& task)
+    auto finishTask = [ & ](TaskData& task)
     {
         SpinlockGuard guard{manager->taskLock};
         task.status.isProcessing = false;
-        task.status.isDone = true;
         task.status.done = Timestamp::Now();
+        if(!task.task->shouldBeRemoved())
+        {
+            return;
+        }
+
+        task.status.isDone = true;
+        delete task.task;
+        task.task = nullptr;
+        std::erase_if(manager->tasks, [ & ](const std::unique_ptr<TaskData>& data) { return data.get() == &task; });
     };
 
     while(manager->isRunning && status.isEmployed)
@@ -110,21 +112,15 @@ void TaskManager::workerTask(const ThreadID tid, TaskManager* manager)
         if(taskData != nullptr)
         {
             status.isWorking = true;
-            if(taskData->task->shouldBeInvoked())
-            {
-                auto start = Timestamp::Now();
-                taskData->status.start = start;
+            auto start = Timestamp::Now();
+            taskData->status.start = start;
 
-                taskData->task->invoke();
+            taskData->task->invoke();
 
-                auto diff = Timestamp::Now() - start;
-                ++status.tasksExecutedTotal;
-                status.totalTaskTimeNanos += diff.getNanos();
-            }
-            if(taskData->task->shouldBeRemoved())
-            {
-                removeTask(*taskData);
-            }
+            auto diff = Timestamp::Now() - start;
+            ++status.tasksExecutedTotal;
+            status.totalTaskTimeNanos += diff.getNanos();
+            finishTask(*taskData); // Task data is gone after
             status.isWorking = false;
         }
         usleep(1000U);
@@ -176,8 +172,9 @@ bool TaskManager::infoTasks(UserID actor, std::vector<DTO::TaskInfo>& collector)
 {
     // TODO add logging
     SpinlockGuard guard{taskLock};
-    for(auto& val : tasks)
+    for(auto& task : tasks)
     {
+        const TaskData& val = *task;
         DTO::TaskInfo info;
         info.name = val.name;
         info.addedUnixNanos = val.added.getNanos();
@@ -204,20 +201,38 @@ bool TaskManager::taskRemove(const TaskID task)
 {
     // TODO add admin check and actor (if actor is not autor)
     SpinlockGuard guard{taskLock};
-    for(auto& val : tasks)
+    for(auto it = tasks.begin(); it != tasks.end(); ++it)
     {
+        TaskData& val = **it;
         if(val.taskId == task)
         {
+            if(val.status.isProcessing) // The worker still uses it
+            {
+                return false;
+            }
             delete val.task;
             val.task = nullptr;
-            val = tasks.back();
-            tasks.pop_back();
+            tasks.erase(it);
             return true;
         }
     }
     return false;
 }
 
+void TaskManager::taskCancel(const TaskID task)
+{
+    while(taskExists(task) && !taskRemove(task))
+    {
+        usleep(1000U);
+    }
+}
+
+bool TaskManager::taskExists(const TaskID task)
+{
+    SpinlockGuard guard{taskLock};
+    return std::ranges::any_of(tasks, [ & ](const std::unique_ptr<TaskData>& data) { return data->taskId == task; });
+}
+
 TaskID TaskManager::implTaskAdd(const UserID actor, const TaskName& name, Task& task)
 {
     SpinlockGuard guard{taskLock};
@@ -231,7 +246,7 @@ TaskID TaskManager::implTaskAdd(const UserID actor, const TaskName& name, Task&
     data.added = Timestamp::Now();
     data.autor = actor;
 
-    tasks.push_back(data);
+    tasks.push_back(std::make_unique<TaskData>(data));
     return data.taskId;
 }
 
@@ -4,9 +4,11 @@
 #define TPUNKT_TASKMANAGER_H
 
 #include <atomic>
+#include <memory>
 #include <thread>
 #include <vector>
 #include "datastructures/FixedString.h"
+#include "datastructures/Spinlock.h"
 #include "instance/Task.h"
 #include "server/DTO.h"
 
@@ -28,9 +30,23 @@ struct TaskManager final
         return implTaskAdd(actor, name, *task);
     }
 
+    // Runs the function every interval until the task is removed
+    template <typename Callable>
+    TaskID taskAddPeriodic(const UserID actor, const TaskName& name, const uint32_t intervalMicros, Callable&& func)
+    {
+        auto* task = new PeriodicTask(std::forward<Callable>(func), intervalMicros, UINT32_MAX);
+        return implTaskAdd(actor, name, *task);
+    }
+
     // Returns true if the task was found and removed - only works if task was added but not yet started
     bool taskRemove(TaskID task);
 
+    // Removes the task - waits for its current run to finish if it's running
+    void taskCancel(TaskID task);
+
+    // Returns true if the task is still queued or running
+    bool taskExists(TaskID task);
+
     //===== Thread Management =====//
 
     // Returns true if new thread was added - requires admin
@@ -93,7 +109,7 @@ struct TaskManager final
         UserID autor;
     };
 
-    std::vector<TaskData> tasks;
+    std::vector<std::unique_ptr<TaskData>> tasks; // Workers keep a pointer while running - entries don't move
     std::vector<ThreadData> threads;
     Spinlock taskLock;
     Spinlock threadLock;
@@ -58,6 +58,22 @@ const char* tpunkt::GetEventActionStr(EventAction action)
             return "FilesystemDirCreate";
         case EventAction::FilesystemDirLookup:
             return "FilesystemDirLookup";
+        case EventAction::FilesystemPathResolve:
+            return "FilesystemPathResolve";
+        case EventAction::FilesystemSearch:
+            return "FilesystemSearch";
+        case EventAction::FilesystemFileRename:
+            return "FilesystemFileRename";
+        case EventAction::FilesystemFileMove:
+            return "FilesystemFileMove";
+        case EventAction::FilesystemDirRename:
+            return "FilesystemDirRename";
+        case EventAction::FilesystemDirMove:
+            return "FilesystemDirMove";
+        case EventAction::FilesystemChanges:
+            return "FilesystemChanges";
+        case EventAction::FilesystemTreeHashes:
+            return "FilesystemTreeHashes";
         case EventAction::ThreadAdd:
             return "ThreadAdd";
         case EventAction::ThreadRemove:
@@ -70,6 +86,14 @@ const char* tpunkt::GetEventActionStr(EventAction action)
             return "FileSystemDirDelete";
         case EventAction::FilesystemFileInfo:
             return "FileSystemFileInfo";
+        case EventAction::FilesystemUploadCreate:
+            return "FilesystemUploadCreate";
+        case EventAction::FilesystemUploadWrite:
+            return "FilesystemUploadWrite";
+        case EventAction::FilesystemUploadInfo:
+            return "FilesystemUploadInfo";
+        case EventAction::FilesystemUploadFinish:
+            return "FilesystemUploadFinish";
         default:
             return "UNKNOWN";
     }
@@ -54,7 +54,19 @@ enum class EventAction : uint8_t
     FilesystemDirCreate,
     FileSystemDirDelete,
     FilesystemDirLookup,
+    FilesystemPathResolve,
+    FilesystemSearch,
+    FilesystemFileRename,
+    FilesystemFileMove,
+    FilesystemDirRename,
+    FilesystemDirMove,
+    FilesystemChanges,
+    FilesystemTreeHashes,
     FilesystemFileInfo,
+    FilesystemUploadCreate,
+    FilesystemUploadWrite,
+    FilesystemUploadInfo,
+    FilesystemUploadFinish,
     // TaskManager
     ThreadAdd,
     ThreadRemove,
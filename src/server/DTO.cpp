@@ -7,53 +7,85 @@
 namespace tpunkt::DTO
 {
 
-ResponseDirectoryInfo ResponseDirectoryInfo::FromDir(const VirtualDirectory& dir)
+namespace
+{
+void GetUserName(const UserID user, UserName& name, UserNameCache& users)
+{
+    const auto iter = users.names.find(user);
+    if(iter != users.names.end())
+    {
+        name = iter->second;
+        return;
+    }
+
+    if(Authenticator::GetInstance().getUserName(user, name) == AuthStatus::OK)
+    {
+        users.names.emplace(user, name);
+    }
+}
+} // namespace
+
+ResponseDirectoryInfo ResponseDirectoryInfo::FromDir(const VirtualDirectory& dir, const std::string_view name)
 {
     ResponseDirectoryInfo info{};
-    info.name = dir.info.base.name;
+    info.name = name;
     info.fid = dir.fid;
     return info;
 }
 
-ResponseDirectoryEntry ResponseDirectoryEntry::FromFile(const VirtualFile& file)
+ResponseDirectoryEntry ResponseDirectoryEntry::FromFile(const VirtualFile& file, const std::string_view name)
+{
+    UserNameCache users;
+    return FromFile(file, name, users);
+}
+
+ResponseDirectoryEntry ResponseDirectoryEntry::FromDir(const VirtualDirectory& dir, const std::string_view name)
+{
+    UserNameCache users;
+    return FromDir(dir, name, users);
+}
+
+ResponseDirectoryEntry ResponseDirectoryEntry::FromFile(const VirtualFile& file, const std::string_view name,
+                                                        UserNameCache& users)
 {
     ResponseDirectoryEntry entry{};
-    entry.name = file.info.name;
+    const NodeInfo& info = file.getInfo();
+    const FileStats& stats = file.getStats();
+
+    entry.name = name;
     entry.fid = file.fid;
     entry.isFile = true;
 
-    const FileInfo& info = file.info;
-    const FileStats& stats = file.stats;
-
-    auto& auth = Authenticator::GetInstance();
-    auth.getUserName(info.creator, entry.creator);
-    auth.getUserName(info.owner, entry.owner);
+    GetUserName(info.creator, entry.creator, users);
+    GetUserName(info.owner, entry.owner, users);
 
     entry.unixLastEdit = stats.modified.getSeconds();
-    entry.unixLastAccess = stats.accessed.getSeconds();
+    entry.unixLastAccess = stats.getAccessed().getSeconds();
     entry.unixCreation = stats.created.getSeconds();
+    entry.lastEditUnixNanos = stats.modified.getNanos();
 
     entry.sizeBytes = stats.size;
     return entry;
 }
 
-ResponseDirectoryEntry ResponseDirectoryEntry::FromDir(const VirtualDirectory& dir)
+ResponseDirectoryEntry ResponseDirectoryEntry::FromDir(const VirtualDirectory& dir, const std::string_view name,
+                                                       UserNameCache& users)
 {
     ResponseDirectoryEntry entry{};
-    entry.name = dir.info.base.name;
+    entry.name = name;
     entry.fid = dir.fid;
     entry.isFile = false;
 
-    const FileInfo& info = dir.info.base;
+    const NodeInfo& info = dir.info.base;
     const FileStats& stats = dir.stats.base;
 
-    auto& auth = Authenticator::GetInstance();
-    auth.getUserName(info.creator, entry.creator);
-    auth.getUserName(info.owner, entry.owner);
+    GetUserName(info.creator, entry.creator, users);
+    GetUserName(info.owner, entry.owner, users);
 
     entry.unixLastEdit = stats.modified.getSeconds();
-    entry.unixLastAccess = stats.accessed.getSeconds();
+    entry.unixLastAccess = stats.getAccessed().getSeconds();
     entry.unixCreation = stats.created.getSeconds();
+    entry.lastEditUnixNanos = stats.modified.getNanos();
 
     entry.sizeBytes = dir.stats.getTotalSize();
     return entry;
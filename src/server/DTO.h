@@ -3,6 +3,9 @@
 #ifndef TPUNKT_DTO_H
 #define TPUNKT_DTO_H
 
+#include <string>
+#include <vector>
+#include <ankerl/unordered_dense.h>
 #include "datastructures/FixedString.h"
 #include "fwd.h"
 
@@ -52,11 +55,30 @@ struct RequestUserSignupPasskey final
 struct RequestDirectoryInfo final
 {
     FileID directory;
+    FixedString<TPUNKT_SERVER_CURSOR_LEN> cursor; // Empty for the first page
+    uint32_t limit = 0;                           // Max entries - 0 for the server maximum
+    FixedString<16> sortBy;                       // Empty (insertion order), "name", "modified" or "size"
+    bool descending = false;                      // Only for sorted orders
+};
+
+struct RequestPathResolve final
+{
+    FileID directory;               // Paths are resolved below this directory - e.g. the root of the endpoint
+    std::vector<std::string> paths; // "/" separated names - a trailing "/" only matches directories
+};
+
+struct RequestSearch final
+{
+    FileID directory;       // Searches everything below - e.g. the root of the endpoint
+    FileName query;         // Case-insensitive - substring queries need 3 characters, prefix queries 2
+    bool prefix = false;    // Names have to start with the query - otherwise contain it
+    FixedString<24> cursor; // Empty for the first page
+    uint32_t limit = 0;     // Max entries - 0 for the server maximum
 };
 
 struct ResponseDirectoryInfo
 {
-    static ResponseDirectoryInfo FromDir(const VirtualDirectory& dir);
+    static ResponseDirectoryInfo FromDir(const VirtualDirectory& dir, std::string_view name);
 
     FileName name;
     FileID fid;
@@ -73,15 +95,81 @@ struct RequestDelete final
     FileID file;
 };
 
+struct RequestRename final
+{
+    FileID file; // File or dir
+    FileName name;
+};
+
+struct RequestMove final
+{
+    FileID file;      // File or dir
+    FileID directory; // New parent - in the same endpoint
+};
+
+struct RequestChanges final
+{
+    FileID directory;   // Root of the endpoint
+    uint64_t after = 0; // Last sequence the client knows
+    uint32_t limit = 0; // Max changes - 0 for the server maximum
+};
+
+struct RequestTreeHashes final
+{
+    FileID directory;
+};
+
 struct RequestFileDownload final
 {
     FileID file;
 };
 
+// Uploads of a known size can be split into parts - each can be sent over its own connection
+struct RequestCreateUpload final
+{
+    FileName name;
+    FileID directory;
+    uint64_t size = 0;     // Zero if not known - the upload is a single part
+    uint64_t partSize = 0; // Zero for a single part
+};
+
+struct RequestUpload final
+{
+    FileID file;
+    FixedString<24> upload; // See GetUploadIDStr()
+};
+
+// Chunks of part i are sent to offsets[i]
+struct ResponseUpload final
+{
+    FixedString<24> upload;
+    FileID file;
+    uint64_t partSize = 0;         // Part i starts at i * partSize
+    std::vector<uint64_t> offsets; // Committed offset of each part
+};
+
+// Next chunk of the part is sent to the offset
+struct ResponseUploadPart final
+{
+    uint32_t part = 0;
+    uint64_t offset = 0;
+};
+
+// User names resolved while building one listing - never kept past it
+struct UserNameCache final
+{
+    ankerl::unordered_dense::map<UserID, UserName> names;
+};
+
 struct ResponseDirectoryEntry final
 {
-    static ResponseDirectoryEntry FromFile(const VirtualFile& file);
-    static ResponseDirectoryEntry FromDir(const VirtualDirectory& dir);
+    // Names are interned in the filesystem - see VirtualFilesystem::getName()
+    static ResponseDirectoryEntry FromFile(const VirtualFile& file, std::string_view name);
+    static ResponseDirectoryEntry FromDir(const VirtualDirectory& dir, std::string_view name);
+
+    // Resolves each user once per cache - for listings naming the same few users over and over
+    static ResponseDirectoryEntry FromFile(const VirtualFile& file, std::string_view name, UserNameCache& users);
+    static ResponseDirectoryEntry FromDir(const VirtualDirectory& dir, std::string_view name, UserNameCache& users);
 
     FileName name;
     FileID fid;
@@ -93,10 +181,47 @@ struct ResponseDirectoryEntry final
     uint64_t unixLastEdit = 0;
     uint64_t unixLastAccess = 0;
     uint64_t unixCreation = 0;
+    uint64_t lastEditUnixNanos = 0; // Changes with every write - seconds can't tell writes in the same second apart
 
     uint64_t sizeBytes = 0;
 };
 
+struct ResponseChange final
+{
+    uint64_t sequence = 0;
+    FixedString<8> operation; // "add", "delete", "rename", "resize" or "move"
+    FileID fid;
+    FileID parent; // Parent after the change
+};
+
+// Clients take the sequence before walking the tree - changes made during the walk are then applied again
+struct ResponseChanges final
+{
+    uint64_t sequence = 0; // Continue after this sequence
+    bool resync = false;   // Changes after the sent sequence are not known - the tree has to be walked again
+    bool more = false;     // Not all changes were sent
+    std::vector<ResponseChange> changes;
+};
+
+struct ResponseTreeHash final
+{
+    FileID fid;
+    FixedString<24> hash; // Equal hashes mean equal subtrees
+};
+
+// Clients compare the hash with their own tree - on a mismatch they only descend into the differing subdirectories
+struct ResponseTreeHashes final
+{
+    FixedString<24> hash;               // Hash of the directory
+    std::vector<ResponseTreeHash> dirs; // Hashes of its direct subdirectories - files are compared by listing it
+};
+
+struct ResponseResolvedPath final
+{
+    bool found = false;
+    ResponseDirectoryEntry entry{}; // Only set if found
+};
+
 //===== User =====//
 
 struct SessionInfo final
@@ -230,6 +230,13 @@ void ServerEndpoint::EndRequest(uWS::HttpResponse<true>* res, const int code, co
     {
         func(res);
     }
+
+    // No body and no Content-Length - a 304 would otherwise announce the validated body as empty
+    if(code == 204 || code == 304) [[unlikely]]
+    {
+        res->endWithoutBody(std::nullopt, close);
+        return;
+    }
     res->end(data, close);
 }
 
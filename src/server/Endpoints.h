@@ -25,7 +25,7 @@ struct ServerEndpoint
     using ResponseFunc = void (*)(uWS::HttpResponse<true>* res);
 
     // Ends the request with the given parameters - optionally executes the given function before ending
-    // Callback is needed as writing any header sets status to "200OK"
+    // Callback is needed as writing any header sets status to "200OK" - data is ignored for 204 and 304
     static void EndRequest(uWS::HttpResponse<true>* res, int code, std::string_view data = {}, bool close = false,
                            ResponseFunc func = nullptr);
 
@@ -104,6 +104,29 @@ struct FileDownloadEndpoint final : ServerEndpoint
     static void handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req);
 };
 
+//===== Resumable Uploads =====//
+
+struct UploadCreateEndpoint final : ServerEndpoint
+{
+    static void handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req);
+};
+
+// Data of the body is written at the offset of the "upload-offset" header - into the part of the "upload-part" header
+struct UploadChunkEndpoint final : ServerEndpoint
+{
+    static void handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req);
+};
+
+struct UploadOffsetEndpoint final : ServerEndpoint
+{
+    static void handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req);
+};
+
+struct UploadFinishEndpoint final : ServerEndpoint
+{
+    static void handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req);
+};
+
 //===== Directories =====//
 
 struct DirCreateEndpoint final : ServerEndpoint
@@ -121,6 +144,41 @@ struct DirLookupEndpoint final : ServerEndpoint
     static void handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req);
 };
 
+// Resolves a batch of paths to their files/dirs - meant for sync clients
+struct PathResolveEndpoint final : ServerEndpoint
+{
+    static void handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req);
+};
+
+struct SearchEndpoint final : ServerEndpoint
+{
+    static void handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req);
+};
+
+// Renames a file or dir
+struct RenameEndpoint final : ServerEndpoint
+{
+    static void handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req);
+};
+
+// Moves a file or dir into another dir of the same endpoint
+struct MoveEndpoint final : ServerEndpoint
+{
+    static void handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req);
+};
+
+// Changes of an endpoint since a sequence - meant for sync clients
+struct ChangesEndpoint final : ServerEndpoint
+{
+    static void handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req);
+};
+
+// Merkle hashes of a directory and its subdirectories - meant for sync clients
+struct TreeHashesEndpoint final : ServerEndpoint
+{
+    static void handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req);
+};
+
 struct DirRootsEndpoint final : ServerEndpoint
 {
     static void handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req);
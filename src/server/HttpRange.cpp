@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <charconv>
+#include "config.h"
+#include "server/HttpRange.h"
+
+namespace tpunkt
+{
+
+namespace
+{
+std::string_view Trim(std::string_view str)
+{
+    while(!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+    {
+        str.remove_prefix(1);
+    }
+    while(!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+    {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+// Whole string has to be a number
+bool ParseNumber(const std::string_view str, uint64_t& num)
+{
+    if(str.empty())
+    {
+        return false;
+    }
+    const auto [ ptr, ec ] = std::from_chars(str.data(), str.data() + str.size(), num);
+    return ec == std::errc{} && ptr == str.data() + str.size();
+}
+
+// Returns false if the range is invalid - empty if it's valid but outside the file
+bool ParseSpec(const std::string_view spec, const uint64_t size, ByteRange& range)
+{
+    const auto dash = spec.find('-');
+    if(dash == std::string_view::npos)
+    {
+        return false;
+    }
+
+    const std::string_view first = spec.substr(0, dash);
+    const std::string_view last = spec.substr(dash + 1);
+    if(first.empty()) // Suffix - the last n bytes
+    {
+        uint64_t length = 0;
+        if(!ParseNumber(last, length))
+        {
+            return false;
+        }
+        range.begin = size - std::min(length, size);
+        range.end = size;
+        return true;
+    }
+
+    uint64_t begin = 0;
+    if(!ParseNumber(first, begin))
+    {
+        return false;
+    }
+
+    uint64_t lastByte = UINT64_MAX;
+    if(!last.empty() && (!ParseNumber(last, lastByte) || lastByte < begin))
+    {
+        return false;
+    }
+
+    range.begin = begin;
+    range.end = begin < size ? std::min(lastByte, size - 1) + 1 : begin;
+    return true;
+}
+} // namespace
+
+RangeStatus ParseRange(std::string_view header, const uint64_t size, std::vector<ByteRange>& ranges)
+{
+    ranges.clear();
+
+    constexpr std::string_view unit = "bytes=";
+    if(header.size() <= unit.size() || header.substr(0, unit.size()) != unit)
+    {
+        return RangeStatus::FULL;
+    }
+    header.remove_prefix(unit.size());
+
+    size_t specs = 0;
+    while(!header.empty())
+    {
+        const auto comma = header.find(',');
+        const std::string_view spec = Trim(header.substr(0, comma));
+        header = comma == std::string_view::npos ? std::string_view{} : header.substr(comma + 1);
+        if(spec.empty()) // Empty list elements are allowed
+        {
+            continue;
+        }
+
+        ++specs;
+        ByteRange range;
+        if(specs > TPUNKT_SERVER_DOWNLOAD_MAX_RANGES || !ParseSpec(spec, size, range))
+        {
+            ranges.clear();
+            return RangeStatus::FULL;
+        }
+        if(range.begin < range.end)
+        {
+            ranges.push_back(range);
+        }
+    }
+
+    if(specs == 0)
+    {
+        return RangeStatus::FULL;
+    }
+    if(ranges.empty())
+    {
+        return RangeStatus::UNSATISFIABLE;
+    }
+
+    std::ranges::sort(ranges, [](const ByteRange& lhs, const ByteRange& rhs) { return lhs.begin < rhs.begin; });
+    size_t last = 0;
+    for(size_t i = 1; i < ranges.size(); ++i)
+    {
+        if(ranges[ i ].begin <= ranges[ last ].end)
+        {
+            ranges[ last ].end = std::max(ranges[ last ].end, ranges[ i ].end);
+        }
+        else
+        {
+            ranges[ ++last ] = ranges[ i ];
+        }
+    }
+    ranges.resize(last + 1);
+    return RangeStatus::PARTIAL;
+}
+
+} // namespace tpunkt
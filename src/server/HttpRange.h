@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TPUNKT_HTTP_RANGE_H
+#define TPUNKT_HTTP_RANGE_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace tpunkt
+{
+
+struct ByteRange final
+{
+    uint64_t begin = 0;
+    uint64_t end = 0; // Exclusive
+};
+
+enum class RangeStatus : uint8_t
+{
+    FULL,          // No (usable) range - the whole file is sent
+    PARTIAL,       // Ranges are set
+    UNSATISFIABLE, // None of the ranges is inside the file
+};
+
+// Parses the value of a "Range" header for a file of the given size - only the "bytes" unit is supported
+// Ranges are sorted and overlapping or adjacent ones are merged
+// Invalid headers and more than TPUNKT_SERVER_DOWNLOAD_MAX_RANGES ranges are ignored
+RangeStatus ParseRange(std::string_view header, uint64_t size, std::vector<ByteRange>& ranges);
+
+} // namespace tpunkt
+
+#endif // TPUNKT_HTTP_RANGE_H
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-only
 #include "server/Endpoints.h"
 #include "server/WebServer.h"
+#include "storage/datastore/DataStore.h"
 #include "util/Logging.h"
 
 namespace tpunkt
@@ -25,6 +26,10 @@ void CreateApp(uWS::SSLApp& app)
     app.del("/api/filesystem/file", FileDeleteEndpoint::handle);
     app.post("/api/filesystem/upload", FileUploadEndpoint::handle);
     app.post("/api/filesystem/download", FileDownloadEndpoint::handle);
+    app.post("/api/filesystem/upload/create", UploadCreateEndpoint::handle);
+    app.post("/api/filesystem/upload/chunk", UploadChunkEndpoint::handle);
+    app.post("/api/filesystem/upload/offset", UploadOffsetEndpoint::handle);
+    app.post("/api/filesystem/upload/finish", UploadFinishEndpoint::handle);
 
     // Dirs
     app.post("/api/filesystem/dir", DirCreateEndpoint::handle);
@@ -33,6 +38,12 @@ void CreateApp(uWS::SSLApp& app)
 
     // Filesystem
     app.get("/api/filesystem/roots", DirRootsEndpoint::handle);
+    app.post("/api/filesystem/resolve", PathResolveEndpoint::handle);
+    app.post("/api/filesystem/search", SearchEndpoint::handle);
+    app.post("/api/filesystem/rename", RenameEndpoint::handle);
+    app.post("/api/filesystem/move", MoveEndpoint::handle);
+    app.post("/api/filesystem/changes", ChangesEndpoint::handle);
+    app.post("/api/filesystem/hashes", TreeHashesEndpoint::handle);
 
     // Misc
     app.get("/*", StaticEndpoint::handle);
@@ -49,6 +60,7 @@ void WebThreadFunc(size_t threadNum, const uWS::SocketContextOptions* options, v
 {
     auto& app = GetWebServer().webThreads[ threadNum ].app;
     app = new uWS::SSLApp(*options);
+    DataStore::SetThreadLoop(app->getLoop()); // Datastore callbacks of this thread are completed on its loop
 
     CreateApp(*app);
     app->listen(TPUNKT_SERVER_PORT,
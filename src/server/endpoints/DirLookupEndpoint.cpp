@@ -1,29 +1,128 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <cstdio>
+#include <ankerl/unordered_dense.h>
+#include <sodium/utils.h>
 #include <HttpResponse.h>
 #include <glaze/json/read.hpp>
 #include <glaze/json/write.hpp>
+#include "auth/Authenticator.h"
+#include "datastructures/Timestamp.h"
 #include "server/DTO.h"
 #include "server/DTOMappings.h"
 #include "server/Endpoints.h"
 #include "storage/Storage.h"
+#include "util/Strings.h"
 
 namespace tpunkt
 {
 
+namespace
+{
+using ETag = FixedString<96>;
+
+// Directory versions start at 0 again after a restart - validators of an earlier run never match
+const uint64_t SERVER_RUN = Timestamp::Now().getNanos();
+
+// Strong validator of the listing for the user - the request is part of it, so each page and order has its own
+// Entries name their creator and owner - renaming or removing any user changes the validator too
+// TODO permissions are not part of it - changing rules, groups or limits has to change it once they are implemented
+void GetETag(const uint64_t version, const std::string_view request, ETag& etag)
+{
+    const uint64_t requestHash = ankerl::unordered_dense::hash<std::string_view>{}(request);
+    const uint64_t nameVersion = Authenticator::GetInstance().getUserNameVersion();
+    (void)snprintf(etag.data(), etag.capacity(), "\"%llx-%llx-%llx-%llx\"", static_cast<unsigned long long>(SERVER_RUN),
+                   static_cast<unsigned long long>(version), static_cast<unsigned long long>(nameVersion),
+                   static_cast<unsigned long long>(requestHash));
+}
+
+// Header holds "*" or a list of validators
+bool IsNotModified(const std::string_view ifNoneMatch, const std::string_view etag)
+{
+    return ifNoneMatch == "*" || ifNoneMatch.find(etag) != std::string_view::npos;
+}
+
+// Cursor is sent as "{position}.{key}.{hex name}" - the name is only set for the name order
+bool ParseCursor(const std::string_view& str, DirectoryCursor& cursor)
+{
+    cursor = DirectoryCursor{};
+    if(str.empty())
+    {
+        return true;
+    }
+
+    const auto separator = str.find('.');
+    if(separator == std::string_view::npos)
+    {
+        return false;
+    }
+    const auto nameSeparator = str.find('.', separator + 1);
+    if(!StringToNumber(str.substr(0, separator), cursor.position) ||
+       !StringToNumber(str.substr(separator + 1, nameSeparator - separator - 1), cursor.key))
+    {
+        return false;
+    }
+    if(nameSeparator == std::string_view::npos)
+    {
+        return true;
+    }
+
+    const std::string_view hex = str.substr(nameSeparator + 1);
+    size_t length = 0;
+    if(sodium_hex2bin(cursor.name.udata(), cursor.name.capacity(), hex.data(), hex.size(), nullptr, &length,
+                      nullptr) != 0 ||
+       length * 2 != hex.size())
+    {
+        return false;
+    }
+    cursor.name.data()[ length ] = '\0';
+    return true;
+}
+
+bool ParseSortOrder(const std::string_view& str, DirectorySortOrder& order)
+{
+    if(str.empty())
+    {
+        order = DirectorySortOrder::INSERTION;
+    }
+    else if(str == "name")
+    {
+        order = DirectorySortOrder::NAME;
+    }
+    else if(str == "modified")
+    {
+        order = DirectorySortOrder::MODIFIED;
+    }
+    else if(str == "size")
+    {
+        order = DirectorySortOrder::SIZE;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+} // namespace
+
 void DirLookupEndpoint::handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req)
 {
     // Within a single thread this method is threadsafe
     thread_local std::vector<DTO::ResponseDirectoryEntry> collector;
     thread_local std::string jsonBuffer(TPUNKT_SERVER_JSON_THREAD_BUFFER_START, '0');
+    thread_local FixedString<TPUNKT_SERVER_CURSOR_LEN> nextCursorStr;
+    thread_local ETag etag;
 
    TPUNKT_MACROS_AUTH_USER()
 
     collector.clear();
     jsonBuffer.clear();
 
+    // Request is only valid until handle returns
+    const ETag ifNoneMatch{GetHeader(req, "if-none-match")};
+
     res->onData(
-        [ res, user ](std::string_view data, const bool isLast)
+        [ res, user, ifNoneMatch ](std::string_view data, const bool isLast)
         {
             if(!isLast) // Too long
             {
@@ -47,7 +146,46 @@ void DirLookupEndpoint::handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* r
                 return;
             }
 
-            status = endpoint->dirGetEntries(user, request.directory, collector);
+            DirectoryCursor cursor;
+            if(!ParseCursor(request.cursor.view(), cursor))
+            {
+                EndRequest(res, 400, "Invalid cursor");
+                return;
+            }
+
+            DirectorySortOrder order{};
+            if(!ParseSortOrder(request.sortBy.view(), order))
+            {
+                EndRequest(res, 400, "Invalid sort order");
+                return;
+            }
+
+            // Version is taken before the entries - a change in between only makes the validator outdated
+            uint64_t version = 0;
+            status = endpoint->dirGetVersion(user, request.directory, version);
+            if(status != StorageStatus::OK)
+            {
+                EndRequest(res, 400, GetStorageStatusStr(status));
+                return;
+            }
+
+            GetETag(version, data, etag);
+            const auto writeETag = [](uWS::HttpResponse<true>* res) { res->writeHeader("ETag", etag.view()); };
+            // 304 instead of the 412 of RFC 9110 for a POST - the listing only reads and clients keep the page
+            if(!ifNoneMatch.isEmpty() && IsNotModified(ifNoneMatch.view(), etag.view()))
+            {
+                EndRequest(res, 304, {}, false, writeETag);
+                return;
+            }
+
+            uint32_t limit = TPUNKT_SERVER_DIR_LOOKUP_MAX_ENTRIES;
+            if(request.limit != 0 && request.limit < limit)
+            {
+                limit = request.limit;
+            }
+
+            status = endpoint->dirGetEntries(user, request.directory, order, request.descending, limit, cursor,
+                                             collector);
             if(status != StorageStatus::OK)
             {
                 EndRequest(res, 400, GetStorageStatusStr(status));
@@ -61,7 +199,26 @@ void DirLookupEndpoint::handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* r
                 return;
             }
 
-            EndRequest(res, 200, jsonBuffer.c_str());
+            if(cursor.position == 0)
+            {
+                EndRequest(res, 200, jsonBuffer.c_str(), false, writeETag);
+                return;
+            }
+
+            // More entries left - client continues with the given cursor
+            const int written = snprintf(nextCursorStr.data(), nextCursorStr.capacity(), "%llu.%llu.",
+                                         static_cast<unsigned long long>(cursor.position),
+                                         static_cast<unsigned long long>(cursor.key));
+            const std::string_view name = cursor.name.view();
+            const size_t left = nextCursorStr.capacity() - static_cast<size_t>(written);
+            (void)sodium_bin2hex(nextCursorStr.data() + written, left,
+                                 reinterpret_cast<const unsigned char*>(name.data()), name.size());
+            EndRequest(res, 200, jsonBuffer.c_str(), false,
+                       [](uWS::HttpResponse<true>* res)
+                       {
+                           res->writeHeader("ETag", etag.view());
+                           res->writeHeader("Next-Cursor", nextCursorStr.view());
+                       });
         });
 
     res->onAborted([ res ]() { EndRequest(res, 500, "Server Error"); });
@@ -1,7 +1,10 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <cstdio>
 #include <HttpResponse.h>
+#include <sodium/randombytes.h>
 #include "server/Endpoints.h"
+#include "server/HttpRange.h"
 #include "storage/Storage.h"
 #include "storage/StorageTransaction.h"
 #include "server/DTOMappings.h"
@@ -9,6 +12,53 @@
 namespace tpunkt
 {
 
+namespace
+{
+using ETag = FixedString<64>;
+
+thread_local ETag etag;
+thread_local FixedString<64> contentRange;
+thread_local std::vector<ByteRange> ranges;
+
+// Strong validator of the content - changes with every write of the file
+void GetETag(const FileID file, const DTO::ResponseDirectoryEntry& info, ETag& tag)
+{
+    (void)snprintf(tag.data(), tag.capacity(), "\"%x-%x-%llx-%llx\"", static_cast<unsigned>(file.getEndpoint()),
+                   static_cast<unsigned>(file.getUID()), static_cast<unsigned long long>(info.sizeBytes),
+                   static_cast<unsigned long long>(info.lastEditUnixNanos));
+}
+
+void GetContentRange(const ByteRange& range, const uint64_t size, FixedString<64>& str)
+{
+    (void)snprintf(str.data(), str.capacity(), "bytes %llu-%llu/%llu", static_cast<unsigned long long>(range.begin),
+                   static_cast<unsigned long long>(range.end - 1), static_cast<unsigned long long>(size));
+}
+
+// Each range becomes a part of a multipart/byteranges body - returns the length of the body
+uint64_t GetParts(const uint64_t size, const std::string_view boundary, std::vector<ReadPart>& parts,
+                  std::string& trailer)
+{
+    uint64_t length = 0;
+    for(const ByteRange& range : ranges)
+    {
+        GetContentRange(range, size, contentRange);
+        std::string prefix{"\r\n--"};
+        prefix.append(boundary);
+        prefix.append("\r\nContent-Type: application/octet-stream\r\nContent-Range: ");
+        prefix.append(contentRange.view());
+        prefix.append("\r\n\r\n");
+
+        length += prefix.size() + (range.end - range.begin);
+        parts.push_back(ReadPart{.begin = range.begin, .end = range.end, .prefix = std::move(prefix)});
+    }
+
+    trailer = "\r\n--";
+    trailer.append(boundary);
+    trailer.append("--\r\n");
+    return length + trailer.size();
+}
+} // namespace
+
 void FileDownloadEndpoint::handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req)
 {
     TPUNKT_MACROS_AUTH_USER()
@@ -28,6 +78,48 @@ void FileDownloadEndpoint::handle(uWS::HttpResponse<true>* res, uWS::HttpRequest
         return;
     }
 
+    DTO::ResponseDirectoryEntry info{};
+    status = endpoint->infoFile(user, file, info);
+    if(status != StorageStatus::OK)
+    {
+        EndRequest(res, 400, GetStorageStatusStr(status));
+        return;
+    }
+    const uint64_t size = info.sizeBytes;
+    GetETag(file, info, etag);
+
+    // Ranges only apply to the version the client has - otherwise it gets the whole file
+    auto rangeStatus = RangeStatus::FULL;
+    const std::string_view ifRange = GetHeader(req, "if-range");
+    if(ifRange.empty() || ifRange == etag.view())
+    {
+        rangeStatus = ParseRange(GetHeader(req, "range"), size, ranges);
+    }
+
+    if(rangeStatus == RangeStatus::UNSATISFIABLE)
+    {
+        (void)snprintf(contentRange.data(), contentRange.capacity(), "bytes */%llu",
+                       static_cast<unsigned long long>(size));
+        EndRequest(res, 416, {}, false,
+                   [](uWS::HttpResponse<true>* res) { res->writeHeader("Content-Range", contentRange.view()); });
+        return;
+    }
+
+    std::vector<ReadPart> parts;
+    std::string trailer;
+    FixedString<32> boundary;
+    uint64_t length = size;
+    if(rangeStatus == RangeStatus::PARTIAL && ranges.size() == 1)
+    {
+        parts.push_back(ReadPart{.begin = ranges[ 0 ].begin, .end = ranges[ 0 ].end, .prefix = {}});
+        length = ranges[ 0 ].end - ranges[ 0 ].begin;
+    }
+    else if(rangeStatus == RangeStatus::PARTIAL)
+    {
+        (void)snprintf(boundary.data(), boundary.capacity(), "tp%08x%08x", randombytes_random(),
+                       randombytes_random());
+        length = GetParts(size, boundary.view(), parts, trailer);
+    }
 
     ResultCb callback = [ res ](bool success)
     {
@@ -36,11 +128,11 @@ void FileDownloadEndpoint::handle(uWS::HttpResponse<true>* res, uWS::HttpRequest
             EndRequest(res, 400, "File write failed");
         }
     };
-    auto transaction = std::make_shared<ReadFileTransaction>(callback, res, file);
+    auto transaction = std::make_shared<ReadFileTransaction>(callback, res, file, std::move(parts), std::move(trailer));
     status = endpoint->fileRead(user, file, *transaction.get());
     if(status != StorageStatus::OK)
     {
-        EndRequest(res, 400, GetStorageStatusStr(status));
+        EndRequest(res, status == StorageStatus::ERR_UPLOAD_PENDING ? 409 : 400, GetStorageStatusStr(status));
         return;
     }
 
@@ -50,17 +142,27 @@ void FileDownloadEndpoint::handle(uWS::HttpResponse<true>* res, uWS::HttpRequest
         return;
     }
 
-    DTO::ResponseDirectoryEntry info{};
-    status = endpoint->infoFile(user, file, info);
-    if(status != StorageStatus::OK)
+    if(rangeStatus == RangeStatus::PARTIAL)
     {
-        EndRequest(res, 400, GetStorageStatusStr(status));
-        return;
+        res->writeStatus("206 Partial Content");
     }
-
     res->writeHeader("Content-Disposition", std::string{"attachment; filename="} + std::string{info.name.view()});
-    res->writeHeader("Content-Type", "application/octet-stream");
-    res->writeHeader("Content-Length", std::to_string(info.sizeBytes));
+    res->writeHeader("Accept-Ranges", "bytes");
+    res->writeHeader("ETag", etag.view());
+    if(rangeStatus == RangeStatus::PARTIAL && ranges.size() > 1)
+    {
+        res->writeHeader("Content-Type", std::string{"multipart/byteranges; boundary="} + std::string{boundary.view()});
+    }
+    else
+    {
+        res->writeHeader("Content-Type", "application/octet-stream");
+        if(rangeStatus == RangeStatus::PARTIAL)
+        {
+            GetContentRange(ranges[ 0 ], size, contentRange);
+            res->writeHeader("Content-Range", contentRange.view());
+        }
+    }
+    res->writeHeader("Content-Length", std::to_string(length));
 
     transaction->readFile();
 
@@ -71,7 +173,8 @@ void FileDownloadEndpoint::handle(uWS::HttpResponse<true>* res, uWS::HttpRequest
             return true;
         });
 
-    res->onAborted([ res ] { EndRequest(res, 500, "Server Error"); });
+    // Response is freed after this - reads still in flight must not touch it
+    res->onAborted([ transaction ] { transaction->abort(); });
 }
 
 } // namespace tpunkt
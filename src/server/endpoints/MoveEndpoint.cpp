@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <HttpResponse.h>
+#include <glaze/json/read.hpp>
+#include "server/DTO.h"
+#include "server/DTOMappings.h"
+#include "server/Endpoints.h"
+#include "storage/Storage.h"
+
+namespace tpunkt
+{
+
+void MoveEndpoint::handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req)
+{
+    TPUNKT_MACROS_AUTH_USER()
+
+    res->onData(
+        [ res, user ](std::string_view data, const bool isLast)
+        {
+            if(!isLast) // Too long
+            {
+                EndRequest(res, 431, "Sent data too large");
+                return;
+            }
+
+            DTO::RequestMove request;
+            const auto error = glz::read_json(request, data);
+            if(error)
+            {
+                EndRequest(res, 400, "Sent bad JSON");
+                return;
+            }
+
+            // Moving between endpoints would have to copy the data
+            if(request.file.getEndpoint() != request.directory.getEndpoint())
+            {
+                EndRequest(res, 400, "Can't move between endpoints");
+                return;
+            }
+
+            StorageEndpoint* endpoint = nullptr;
+            auto status = Storage::GetInstance().endpointGet(user, request.file.getEndpoint(), endpoint);
+            if(status != StorageStatus::OK)
+            {
+                EndRequest(res, 400, GetStorageStatusStr(status));
+                return;
+            }
+
+            if(request.file.isFile())
+            {
+                status = endpoint->fileMove(user, request.file, request.directory);
+            }
+            else
+            {
+                status = endpoint->dirMove(user, request.file, request.directory);
+            }
+
+            if(status != StorageStatus::OK)
+            {
+                EndRequest(res, 400, GetStorageStatusStr(status));
+                return;
+            }
+
+            EndRequest(res, 200, "OK");
+        });
+
+    res->onAborted([ res ]() { EndRequest(res, 500, "Server Error"); });
+}
+
+} // namespace tpunkt
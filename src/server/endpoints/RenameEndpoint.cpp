@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <HttpResponse.h>
+#include <glaze/json/read.hpp>
+#include "server/DTO.h"
+#include "server/DTOMappings.h"
+#include "server/Endpoints.h"
+#include "storage/Storage.h"
+
+namespace tpunkt
+{
+
+void RenameEndpoint::handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req)
+{
+    TPUNKT_MACROS_AUTH_USER()
+
+    res->onData(
+        [ res, user ](std::string_view data, const bool isLast)
+        {
+            if(!isLast) // Too long
+            {
+                EndRequest(res, 431, "Sent data too large");
+                return;
+            }
+
+            DTO::RequestRename request;
+            const auto error = glz::read_json(request, data);
+            if(error)
+            {
+                EndRequest(res, 400, "Sent bad JSON");
+                return;
+            }
+
+            StorageEndpoint* endpoint = nullptr;
+            auto status = Storage::GetInstance().endpointGet(user, request.file.getEndpoint(), endpoint);
+            if(status != StorageStatus::OK)
+            {
+                EndRequest(res, 400, GetStorageStatusStr(status));
+                return;
+            }
+
+            if(request.file.isFile())
+            {
+                status = endpoint->fileRename(user, request.file, request.name);
+            }
+            else
+            {
+                status = endpoint->dirRename(user, request.file, request.name);
+            }
+
+            if(status != StorageStatus::OK)
+            {
+                EndRequest(res, 400, GetStorageStatusStr(status));
+                return;
+            }
+
+            EndRequest(res, 200, "OK");
+        });
+
+    res->onAborted([ res ]() { EndRequest(res, 500, "Server Error"); });
+}
+
+} // namespace tpunkt
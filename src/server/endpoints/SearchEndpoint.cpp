@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cstdio>
+#include <HttpResponse.h>
+#include <glaze/json/read.hpp>
+#include <glaze/json/write.hpp>
+#include "server/DTO.h"
+#include "server/DTOMappings.h"
+#include "server/Endpoints.h"
+#include "storage/Storage.h"
+#include "util/Strings.h"
+
+namespace tpunkt
+{
+
+void SearchEndpoint::handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req)
+{
+    // Within a single thread this method is threadsafe
+    thread_local std::vector<DTO::ResponseDirectoryEntry> collector;
+    thread_local std::string jsonBuffer(TPUNKT_SERVER_JSON_THREAD_BUFFER_START, '0');
+    thread_local NameSearchQuery query;
+    thread_local FixedString<24> nextCursorStr;
+
+    TPUNKT_MACROS_AUTH_USER()
+
+    collector.clear();
+    jsonBuffer.clear();
+
+    res->onData(
+        [ res, user ](std::string_view data, const bool isLast)
+        {
+            if(!isLast) // Too long
+            {
+                EndRequest(res, 431, "Sent data too large");
+                return;
+            }
+
+            DTO::RequestSearch request;
+            auto error = glz::read_json(request, data);
+            if(error)
+            {
+                EndRequest(res, 400, "Sent bad JSON");
+                return;
+            }
+
+            if(!VirtualNameSearch::PrepareQuery(request.query.view(), request.prefix, query))
+            {
+                EndRequest(res, 400, "Query too short");
+                return;
+            }
+
+            uint64_t cursor = 0;
+            if(!request.cursor.view().empty() && !StringToNumber(request.cursor.view(), cursor))
+            {
+                EndRequest(res, 400, "Invalid cursor");
+                return;
+            }
+
+            StorageEndpoint* endpoint = nullptr;
+            auto status = Storage::GetInstance().endpointGet(user, request.directory.getEndpoint(), endpoint);
+            if(status != StorageStatus::OK)
+            {
+                EndRequest(res, 400, GetStorageStatusStr(status));
+                return;
+            }
+
+            uint32_t limit = TPUNKT_SERVER_SEARCH_MAX_ENTRIES;
+            if(request.limit != 0 && request.limit < limit)
+            {
+                limit = request.limit;
+            }
+
+            status = endpoint->search(user, request.directory, query, limit, cursor, collector);
+            if(status != StorageStatus::OK)
+            {
+                EndRequest(res, 400, GetStorageStatusStr(status));
+                return;
+            }
+
+            error = glz::write_json(collector, jsonBuffer);
+            if(error)
+            {
+                EndRequest(res, 500, "Bad generated JSON");
+                return;
+            }
+
+            if(cursor == 0)
+            {
+                EndRequest(res, 200, jsonBuffer.c_str());
+                return;
+            }
+
+            // More matches left - client continues with the given cursor
+            (void)snprintf(nextCursorStr.data(), nextCursorStr.capacity(), "%llu",
+                           static_cast<unsigned long long>(cursor));
+            EndRequest(res, 200, jsonBuffer.c_str(), false,
+                       [](uWS::HttpResponse<true>* res) { res->writeHeader("Next-Cursor", nextCursorStr.view()); });
+        });
+
+    res->onAborted([ res ]() { EndRequest(res, 500, "Server Error"); });
+}
+
+} // namespace tpunkt
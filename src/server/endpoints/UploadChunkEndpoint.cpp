@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <memory>
+#include <vector>
+#include <HttpResponse.h>
+#include <glaze/json/write.hpp>
+#include "server/DTO.h"
+#include "server/DTOMappings.h"
+#include "server/Endpoints.h"
+#include "storage/Storage.h"
+#include "util/Strings.h"
+
+namespace tpunkt
+{
+
+namespace
+{
+thread_local std::string jsonBuffer(TPUNKT_SERVER_JSON_THREAD_BUFFER_START, '0');
+
+// Writes of a chunk are in flight together - the response is sent once all of them are settled
+struct ChunkRequest final
+{
+    DTO::ResponseUploadPart response; // Offset of the next write
+    size_t pendingBytes = 0;          // Copied by the datastore until the write completes
+    uint32_t pending = 0;
+    bool isComplete = false;          // Whole body is received
+    bool isEnded = false;             // Response is sent
+    bool isPaused = false;            // Receiving waits for writes to complete
+};
+
+void EndChunk(uWS::HttpResponse<true>* res, ChunkRequest& chunk, const int code, const std::string_view data = {})
+{
+    if(chunk.isEnded)
+    {
+        return;
+    }
+    chunk.isEnded = true;
+    ServerEndpoint::EndRequest(res, code, data);
+}
+
+void EndChunkWithOffset(uWS::HttpResponse<true>* res, ChunkRequest& chunk, const int code)
+{
+    jsonBuffer.clear();
+    const auto error = glz::write_json(chunk.response, jsonBuffer);
+    if(error)
+    {
+        EndChunk(res, chunk, 500, "Bad generated JSON");
+        return;
+    }
+    EndChunk(res, chunk, code, jsonBuffer.c_str());
+}
+} // namespace
+
+void UploadChunkEndpoint::handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req)
+{
+    TPUNKT_MACROS_AUTH_USER()
+
+    const FileID file = FileID::FromString(GetHeader(req, "file"));
+    if(!file.isValid() || file.isDirectory())
+    {
+        EndRequest(res, 400, "Invalid file");
+        return;
+    }
+
+    // Uploads of a single part don't need to send it
+    const UploadID upload = ParseUploadID(GetHeader(req, "upload-id"));
+    const std::string_view partStr = GetHeader(req, "upload-part");
+    uint64_t part = 0;
+    uint64_t offset = 0;
+    if(upload == UploadID::INVALID || !StringToNumber(GetHeader(req, "upload-offset"), offset) ||
+       (!partStr.empty() && (!StringToNumber(partStr, part) || part >= TPUNKT_STORAGE_UPLOAD_MAX_PARTS)))
+    {
+        EndRequest(res, 400, "Invalid upload");
+        return;
+    }
+
+    StorageEndpoint* endpoint = nullptr;
+    const auto status = Storage::GetInstance().endpointGet(user, file.getEndpoint(), endpoint);
+    if(status != StorageStatus::OK)
+    {
+        EndRequest(res, 400, "Invalid endpoint");
+        return;
+    }
+
+    auto chunk = std::make_shared<ChunkRequest>();
+    chunk->response.part = static_cast<uint32_t>(part);
+    chunk->response.offset = offset;
+
+    res->onData(
+        [ res, user, endpoint, file, upload, chunk ](const std::string_view data, const bool isLast)
+        {
+            if(chunk->isEnded)
+            {
+                return;
+            }
+
+            if(!data.empty())
+            {
+                const size_t size = data.size();
+                const auto callback = [ res, chunk, size ](const bool success)
+                {
+                    --chunk->pending;
+                    chunk->pendingBytes -= size;
+                    if(chunk->isPaused && !chunk->isEnded && chunk->pendingBytes < TPUNKT_SERVER_UPLOAD_MAX_PENDING)
+                    {
+                        chunk->isPaused = false;
+                        res->resume();
+                    }
+
+                    if(!success)
+                    {
+                        EndChunk(res, *chunk, 500, "File write failed");
+                    }
+                    else if(chunk->isComplete && chunk->pending == 0)
+                    {
+                        EndChunkWithOffset(res, *chunk, 200);
+                    }
+                };
+
+                ++chunk->pending;
+                chunk->pendingBytes += size;
+                const auto status = endpoint->uploadWrite(user, file, upload, chunk->response.part,
+                                                          chunk->response.offset, data, callback);
+                if(status == StorageStatus::ERR_UPLOAD_OFFSET) // Client continues at the committed offset
+                {
+                    --chunk->pending;
+                    chunk->pendingBytes -= size;
+                    uint64_t partSize = 0;
+                    std::vector<uint64_t> offsets;
+                    (void)endpoint->uploadGetOffsets(user, file, upload, partSize, offsets);
+                    if(chunk->response.part < offsets.size())
+                    {
+                        chunk->response.offset = offsets[ chunk->response.part ];
+                    }
+                    EndChunkWithOffset(res, *chunk, 409);
+                    return;
+                }
+                if(status != StorageStatus::OK)
+                {
+                    --chunk->pending;
+                    chunk->pendingBytes -= size;
+                    EndChunk(res, *chunk, 404, GetStorageStatusStr(status));
+                    return;
+                }
+                chunk->response.offset += size;
+
+                // Stops receiving until the datastore caught up - the copies of the writes don't pile up
+                if(!isLast && chunk->pendingBytes >= TPUNKT_SERVER_UPLOAD_MAX_PENDING)
+                {
+                    chunk->isPaused = true;
+                    res->pause();
+                }
+            }
+
+            if(isLast)
+            {
+                chunk->isComplete = true;
+                if(chunk->pending == 0)
+                {
+                    EndChunkWithOffset(res, *chunk, 200);
+                }
+            }
+        });
+
+    res->onAborted([ res, chunk ] { EndChunk(res, *chunk, 500, "Server Error"); });
+}
+
+} // namespace tpunkt
@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <HttpResponse.h>
+#include <glaze/json/read.hpp>
+#include "server/DTO.h"
+#include "server/DTOMappings.h"
+#include "server/Endpoints.h"
+#include "storage/Storage.h"
+
+namespace tpunkt
+{
+
+void UploadFinishEndpoint::handle(uWS::HttpResponse<true>* res, uWS::HttpRequest* req)
+{
+    TPUNKT_MACROS_AUTH_USER()
+
+    res->onData(
+        [ res, user ](std::string_view data, const bool isLast)
+        {
+            if(!isLast) // Too long
+            {
+                EndRequest(res, 431, "Sent data too large");
+                return;
+            }
+
+            DTO::RequestUpload request;
+            auto error = glz::read_json(request, data);
+            if(error)
+            {
+                EndRequest(res, 400, "Sent bad JSON");
+                return;
+            }
+
+            StorageEndpoint* endpoint = nullptr;
+            auto status = Storage::GetInstance().endpointGet(user, request.file.getEndpoint(), endpoint);
+            if(status != StorageStatus::OK)
+            {
+                EndRequest(res, 400, GetStorageStatusStr(status));
+                return;
+            }
+
+            const auto callback = [ res ](const bool success)
+            {
+                if(success)
+                {
+                    EndRequest(res, 200);
+                }
+                else
+                {
+                    EndRequest(res, 500, "File commit failed");
+                }
+            };
+            status = endpoint->uploadFinish(user, request.file, ParseUploadID(request.upload.view()), callback);
+            if(status == StorageStatus::ERR_UPLOAD_OFFSET)
+            {
+                EndRequest(res, 409, GetStorageStatusStr(status));
+            }
+            else if(status != StorageStatus::OK)
+            {
+                EndRequest(res, 404, GetStorageStatusStr(status));
+            }
+        });
+
+    res->onAborted([ res ]() { EndRequest(res, 500, "Server Error"); });
+}
+
+} // namespace tpunkt
@@ -1,8 +1,17 @@
-
 // SPDX-License-Identifier: GPL-3.0-only
 
 #include "storage/EndpointStats.h"
 
 namespace tpunkt
 {
+
+double EndpointStats::getDedupRatio() const
+{
+    if(storedBytes == 0)
+    {
+        return 1.0;
+    }
+    return static_cast<double>(fileBytes) / static_cast<double>(storedBytes);
 }
+
+} // namespace tpunkt
@@ -3,6 +3,7 @@
 #ifndef TPUNKT_ENDPOINTSTATS_H
 #define TPUNKT_ENDPOINTSTATS_H
 
+#include <cstdint>
 
 namespace tpunkt
 {
@@ -10,6 +11,14 @@ namespace tpunkt
 // Tracks current actions, users and misc stats (access count, ...)
 struct EndpointStats final
 {
+    uint64_t fileBytes = 0;     // Size of all files
+    uint64_t storedBytes = 0;   // Size of the file data on disk - less than the files if deduplicated
+    uint64_t chunks = 0;        // Unique chunks on disk - 0 if not deduplicated
+    uint64_t receivedBytes = 0; // Written to files since startup - 0 if not deduplicated
+    uint64_t writtenBytes = 0;  // Written to new chunks since startup - 0 if not deduplicated
+
+    // Size of the files per stored byte
+    [[nodiscard]] double getDedupRatio() const;
 };
 
 } // namespace tpunkt
@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-only
 #include "auth/Authenticator.h"
+#include "crypto/CryptoContext.h"
 #include "instance/InstanceConfig.h"
 #include "storage/Storage.h"
 #include "util/Wrapper.h"
@@ -42,7 +43,8 @@ StorageStatus Storage::getRoots(UserID user, std::vector<DTO::ResponseDirectoryI
     // TODO fix
     for(StorageEndpoint& endpoint : endpoints)
     {
-        roots.push_back(DTO::ResponseDirectoryInfo::FromDir(endpoint.virtualFilesystem.getRoot()));
+        const VirtualDirectory& root = endpoint.virtualFilesystem.getRoot();
+        roots.push_back(DTO::ResponseDirectoryInfo::FromDir(root, endpoint.virtualFilesystem.getName(root)));
     }
 
     return StorageStatus::OK;
@@ -59,6 +61,14 @@ StorageStatus Storage::endpointCreate(const UserID actor, const StorageEndpointC
         return StorageStatus::ERR_NO_ADMIN;
     }
 
+    // Chunk names are keyed by the master key - never store plain files in a deduplicating endpoint instead
+    if(info.type == StorageEndpointType::LOCAL_FILE_SYSTEM_DEDUP && !GetCryptoContext().hasMasterKey())
+    {
+        LOG_ERROR("No master key - deduplicating endpoint can't be opened");
+        LOG_EVENT_FILESYS(actor, FAIL_UNSPECIFIED, FilesystemEventData{});
+        return StorageStatus::ERR_UNSUCCESSFUL;
+    }
+
     const auto eid = static_cast<EndpointID>(endpointID++);
     if(StorageEndpoint::CreateDirs(eid))
     {
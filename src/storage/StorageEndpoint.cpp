@@ -1,9 +1,14 @@
 // SPDX-License-Identifier: GPL-3.0-only
 #include <cstdio>
+#include <sodium/randombytes.h>
+#include "crypto/CryptoContext.h"
 #include "crypto/WrappedKey.h"
+#include "instance/TaskManager.h"
 #include "storage/StorageTransaction.h"
 #include "datastructures/FixedString.h"
+#include "storage/datastore/DedupFileSystem.h"
 #include "storage/datastore/LocalFileSystem.h"
+#include "storage/datastore/UringFileSystem.h"
 #include "storage/StorageEndpoint.h"
 #include "uac/UserAccessControl.h"
 #include "util/Logging.h"
@@ -37,10 +42,49 @@ const char* GetStorageStatusStr(const StorageStatus status)
             return "No such directory";
         case StorageStatus::ERR_NO_UNIQUE_NAME:
             return "No unique name";
+        case StorageStatus::ERR_NO_SUCH_UPLOAD:
+            return "No such upload";
+        case StorageStatus::ERR_UPLOAD_OFFSET:
+            return "Chunk doesn't continue upload";
+        case StorageStatus::ERR_UPLOAD_PENDING:
+            return "Upload not finished";
     }
     return nullptr;
 }
 
+namespace
+{
+const char* GetChangeOperationStr(const JournalOperation operation)
+{
+    switch(operation)
+    {
+        case JournalOperation::FILE_ADD:
+        case JournalOperation::DIR_ADD:
+            return "add";
+        case JournalOperation::FILE_DELETE:
+        case JournalOperation::DIR_DELETE:
+        case JournalOperation::DIR_TOMBSTONE:
+            return "delete";
+        case JournalOperation::FILE_RENAME:
+        case JournalOperation::DIR_RENAME:
+            return "rename";
+        case JournalOperation::FILE_RESIZE:
+            return "resize";
+        case JournalOperation::FILE_MOVE:
+        case JournalOperation::DIR_MOVE:
+            return "move";
+    }
+    return "";
+}
+
+FixedString<64> GetEndpointDir(const EndpointID endpoint)
+{
+    FixedString<64> dir;
+    (void)snprintf(dir.data(), dir.capacity(), "%s/%d", TPUNKT_STORAGE_ENDPOINT_DIR, static_cast<int>(endpoint));
+    return dir;
+}
+} // namespace
+
 StorageEndpointData::StorageEndpointData(const StorageEndpointCreateInfo& info, UserID creator, EndpointID endpoint)
     : name(info.name), maxSize(info.maxSize), type(info.type), creator(creator), endpoint(endpoint)
 {
@@ -49,8 +93,41 @@ StorageEndpointData::StorageEndpointData(const StorageEndpointCreateInfo& info,
 StorageEndpoint::StorageEndpoint(const StorageEndpointCreateInfo& info, const EndpointID endpoint, const UserID creator)
     : virtualFilesystem(DirectoryCreationInfo{
           .name = info.name, .creator = creator, .parent = FileID::Root(endpoint), .maxSize = info.maxSize}),
+      persistence(GetEndpointDir(endpoint).c_str(),
+                  GetCryptoContext().deriveKey("tpvfsjnl", static_cast<uint64_t>(endpoint)),
+                  [ this ] { taskQueue(TaskName{"VFS Compaction"}, [ this ] { compact(); }); }),
       data(info, creator, endpoint)
 {
+    // Keys derived without a master key would be known to everyone
+    bool isRestored = false;
+    if(!GetCryptoContext().hasMasterKey())
+    {
+        LOG_ERROR("No master key - filesystem of endpoint %d is not persisted", static_cast<int>(endpoint));
+    }
+    else
+    {
+        isRestored = persistence.load(virtualFilesystem);
+        if(!isRestored)
+        {
+            LOG_ERROR("Filesystem of endpoint %d could not be fully restored", static_cast<int>(endpoint));
+        }
+        virtualFilesystem.setPersistence(&persistence);
+    }
+
+    // Earlier changes need a resync - without the journal sequences start past any of an earlier run
+    const uint64_t origin = isRestored ? persistence.getSequence() : Timestamp::Now().getNanos();
+    virtualFilesystem.changesReset(origin);
+    virtualFilesystem.setNameCompactionRequest(
+        [ this ]
+        {
+            taskQueue(TaskName{"VFS Name Compaction"},
+                      [ this ]
+                      {
+                          CooperativeSpinlockGuard guard{lock, true};
+                          virtualFilesystem.compactNames();
+                      });
+        });
+
     switch(info.type)
     {
         case StorageEndpointType::LOCAL_FILE_SYSTEM:
@@ -59,6 +136,40 @@ StorageEndpoint::StorageEndpoint(const StorageEndpointCreateInfo& info, const En
         case StorageEndpointType::REMOTE_FILE_SYSTEM:
             LOG_CRITICAL("REMOTE_FILE_SYSTEM Not supported");
             break;
+        case StorageEndpointType::LOCAL_FILE_SYSTEM_URING:
+            if(UringFileSystemDatastore::IsSupported())
+            {
+                dataStore = new UringFileSystemDatastore(endpoint);
+            }
+            else
+            {
+                LOG_WARNING("io_uring not supported - using blocking file access for endpoint %d",
+                            static_cast<int>(endpoint));
+                dataStore = new LocalFileSystemDatastore(endpoint);
+            }
+            break;
+        case StorageEndpointType::LOCAL_FILE_SYSTEM_DEDUP:
+            if(!GetCryptoContext().hasMasterKey()) // Chunk names are keyed by it - refused by Storage
+            {
+                LOG_CRITICAL("No master key - deduplicating endpoint %d can't be opened", static_cast<int>(endpoint));
+            }
+            else
+            {
+                auto* store = new DedupFileSystemDatastore(
+                    endpoint, GetCryptoContext().deriveKey("tpdedupk", static_cast<uint64_t>(endpoint)));
+                store->setGarbageRequest(
+                    [ this, store ]
+                    { taskQueue(TaskName{"Datastore Chunk GC"}, [ store ] { store->collectGarbage(); }); });
+                dataStore = store;
+                dedupStore = store;
+            }
+            break;
+    }
+
+    // Deletions interrupted by a restart are continued
+    if(virtualFilesystem.hasTombstones())
+    {
+        reclaimQueue();
     }
 
     // TODO remove
@@ -67,43 +178,43 @@ StorageEndpoint::StorageEndpoint(const StorageEndpointCreateInfo& info, const En
     fileCreate(UserID::SERVER, virtualFilesystem.getRoot().getID(), fileInfo, newFile);
 }
 
-StorageStatus StorageEndpoint::fileCreate(UserID actor, FileID dir, const FileCreationInfo& info, FileID& newFile)
+StorageEndpoint::~StorageEndpoint()
 {
-    constexpr EventAction action = EventAction::FileSystemFileCreate;
-    SpinlockGuard guard{lock};
-    if(!IsValidFilename(info.name))
+    // Running tasks might queue others - no new ones after this
+    std::vector<TaskID> running;
     {
-        LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
-        return StorageStatus::ERR_INVALID_FILE_NAME;
+        SpinlockGuard guard{taskLock};
+        isClosing = true;
+        running.swap(tasks);
     }
-
-    if(GetUAC().userCanAction(actor, dir, PermissionFlag::CREATE) != UACStatus::OK)
+    for(const TaskID task : running)
     {
-        LOG_EVENT_FILESYS(actor, FAIL_NO_UAC, FilesystemEventData{});
-        return StorageStatus::ERR_NO_UAC_PERM;
+        GetTaskManager().taskCancel(task);
     }
 
-    VirtualDirectory* directory = virtualFilesystem.findDir(dir);
-    if(directory == nullptr)
+    // Uploads don't survive a restart - their files would stay without data
+    for(auto& [ upload, session ] : uploads)
     {
-        LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
-        return StorageStatus::ERR_NO_SUCH_DIR;
+        uploadRevert(session);
     }
+    uploads.clear();
+    uploadFiles.clear();
 
-    if(!directory->fileAdd(info, newFile))
-    {
-        LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
-        return StorageStatus::ERR_NO_UNIQUE_NAME;
-    }
+    delete dataStore;
+    dataStore = nullptr;
+    dedupStore = nullptr;
+}
 
-    LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
-    return StorageStatus::OK;
+StorageStatus StorageEndpoint::fileCreate(UserID actor, FileID dir, const FileCreationInfo& info, FileID& newFile)
+{
+    CooperativeSpinlockGuard guard{lock, true};
+    return fileAdd(actor, dir, info, newFile);
 }
 
 StorageStatus StorageEndpoint::fileDelete(UserID actor, FileID file)
 {
     constexpr EventAction action = EventAction::FileSystemFileDelete;
-    SpinlockGuard guard{lock};
+    CooperativeSpinlockGuard guard{lock, true};
 
     if(GetUAC().userCanAction(actor, file, PermissionFlag::DELETE) != UACStatus::OK)
     {
@@ -111,14 +222,13 @@ StorageStatus StorageEndpoint::fileDelete(UserID actor, FileID file)
         return StorageStatus::ERR_NO_UAC_PERM;
     }
 
-    VirtualDirectory* directory = virtualFilesystem.findContainingDir(file);
-    if(directory == nullptr)
+    if(virtualFilesystem.findContainingDir(file) == nullptr)
     {
         LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
         return StorageStatus::ERR_NO_SUCH_DIR;
     }
 
-    if(!directory->fileDelete(file))
+    if(!virtualFilesystem.fileDelete(file))
     {
         LOG_EVENT_FILESYS(actor, FAIL_UNSPECIFIED, FilesystemEventData{});
         return StorageStatus::ERR_UNSUCCESSFUL;
@@ -131,7 +241,7 @@ StorageStatus StorageEndpoint::fileDelete(UserID actor, FileID file)
 StorageStatus StorageEndpoint::fileWrite(UserID actor, FileID file, WriteFileTransaction& transaction)
 {
     constexpr EventAction action = EventAction::FilesystemFileWrite;
-    SpinlockGuard guard{lock};
+    CooperativeSpinlockGuard guard{lock, true};
 
     if(GetUAC().userCanAction(actor, file, PermissionFlag::WRITE) != UACStatus::OK)
     {
@@ -146,7 +256,13 @@ StorageStatus StorageEndpoint::fileWrite(UserID actor, FileID file, WriteFileTra
         return StorageStatus::ERR_NO_SUCH_FILE;
     }
 
-    transaction.init(*dataStore, virtualFilesystem);
+    if(uploadFiles.contains(file))
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
+        return StorageStatus::ERR_UPLOAD_PENDING;
+    }
+
+    transaction.init(*dataStore, virtualFilesystem, lock);
     LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
     return StorageStatus::OK;
 }
@@ -154,7 +270,7 @@ StorageStatus StorageEndpoint::fileWrite(UserID actor, FileID file, WriteFileTra
 StorageStatus StorageEndpoint::fileRead(UserID actor, FileID file, ReadFileTransaction& transaction)
 {
     constexpr EventAction action = EventAction::FilesystemFileRead;
-    SpinlockGuard guard{lock};
+    CooperativeSpinlockGuard guard{lock, false};
 
     if(GetUAC().userCanAction(actor, file, PermissionFlag::READ) != UACStatus::OK)
     {
@@ -169,7 +285,286 @@ StorageStatus StorageEndpoint::fileRead(UserID actor, FileID file, ReadFileTrans
         return StorageStatus::ERR_NO_SUCH_FILE;
     }
 
-    transaction.init(*dataStore, virtualFilesystem);
+    // Data is only there once the upload is finished - its size already is
+    if(uploadFiles.contains(file))
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
+        return StorageStatus::ERR_UPLOAD_PENDING;
+    }
+
+    (void)virtualFilesystem.fileAccess(file);
+    transaction.init(*dataStore, virtualFilesystem, lock);
+    LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
+    return StorageStatus::OK;
+}
+
+StorageStatus StorageEndpoint::fileRename(UserID actor, FileID file, const FileName& name)
+{
+    constexpr EventAction action = EventAction::FilesystemFileRename;
+    CooperativeSpinlockGuard guard{lock, true};
+    if(!IsValidFilename(name))
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
+        return StorageStatus::ERR_INVALID_FILE_NAME;
+    }
+
+    if(GetUAC().userCanAction(actor, file, PermissionFlag::WRITE) != UACStatus::OK)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_UAC, FilesystemEventData{});
+        return StorageStatus::ERR_NO_UAC_PERM;
+    }
+
+    if(virtualFilesystem.findFile(file) == nullptr)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
+        return StorageStatus::ERR_NO_SUCH_FILE;
+    }
+
+    if(!virtualFilesystem.fileRename(file, name))
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
+        return StorageStatus::ERR_NO_UNIQUE_NAME;
+    }
+
+    LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
+    return StorageStatus::OK;
+}
+
+StorageStatus StorageEndpoint::fileMove(UserID actor, FileID file, FileID dir)
+{
+    constexpr EventAction action = EventAction::FilesystemFileMove;
+    CooperativeSpinlockGuard guard{lock, true};
+
+    if(GetUAC().userCanAction(actor, file, PermissionFlag::DELETE) != UACStatus::OK ||
+       GetUAC().userCanAction(actor, dir, PermissionFlag::CREATE) != UACStatus::OK)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_UAC, FilesystemEventData{});
+        return StorageStatus::ERR_NO_UAC_PERM;
+    }
+
+    const VirtualFile* virtualFile = virtualFilesystem.findFile(file);
+    if(virtualFile == nullptr)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
+        return StorageStatus::ERR_NO_SUCH_FILE;
+    }
+
+    if(virtualFilesystem.findDir(dir) == nullptr)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
+        return StorageStatus::ERR_NO_SUCH_DIR;
+    }
+
+    const VirtualFile* existing = virtualFilesystem.findFileByName(dir, virtualFilesystem.getName(*virtualFile));
+    if(existing != nullptr && existing != virtualFile)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
+        return StorageStatus::ERR_NO_UNIQUE_NAME;
+    }
+
+    // Only fails if a size limit of the new parents would be exceeded
+    if(!virtualFilesystem.fileMove(file, dir))
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_UNSPECIFIED, FilesystemEventData{});
+        return StorageStatus::ERR_UNSUCCESSFUL;
+    }
+
+    LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
+    return StorageStatus::OK;
+}
+
+StorageStatus StorageEndpoint::uploadCreate(UserID actor, FileID dir, const FileCreationInfo& info,
+                                            const uint64_t size, const uint64_t partSize, UploadID& upload,
+                                            FileID& newFile)
+{
+    constexpr EventAction action = EventAction::FilesystemUploadCreate;
+    UploadSession session{};
+    if(!session.init(size, partSize))
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
+        return StorageStatus::ERR_UNSUCCESSFUL;
+    }
+
+    {
+        // File is refused for reads and writes from its creation on - it has no data until the upload is finished
+        CooperativeSpinlockGuard guard{lock, true};
+        if(uploadFiles.size() >= TPUNKT_STORAGE_UPLOAD_MAX_SESSIONS)
+        {
+            LOG_EVENT_FILESYS(actor, FAIL_UNSPECIFIED, FilesystemEventData{});
+            return StorageStatus::ERR_UNSUCCESSFUL;
+        }
+
+        const auto status = fileAdd(actor, dir, info, newFile);
+        if(status != StorageStatus::OK)
+        {
+            LOG_EVENT_FILESYS(actor, FAIL_UNSPECIFIED, FilesystemEventData{});
+            return status;
+        }
+
+        // Known sizes are checked against the limits right away - parts are written in any order
+        if(size != 0 && !virtualFilesystem.fileChangeSize(newFile, size))
+        {
+            (void)virtualFilesystem.fileDelete(newFile);
+            LOG_EVENT_FILESYS(actor, FAIL_UNSPECIFIED, FilesystemEventData{});
+            return StorageStatus::ERR_UNSUCCESSFUL;
+        }
+        uploadFiles.insert(newFile);
+    }
+
+    session.file = newFile;
+    session.owner = actor;
+    session.expiration = Timestamp::Now(TPUNKT_STORAGE_UPLOAD_TIMEOUT);
+    const auto createCallback = [](const bool success)
+    {
+        if(!success)
+        {
+            LOG_WARNING("Creating data of upload failed");
+        }
+    };
+    if(!dataStore->createFile(newFile.getUID(), createCallback) ||
+       !dataStore->initWrite(newFile.getUID(), session.handle))
+    {
+        uploadRevert(session);
+        {
+            CooperativeSpinlockGuard guard{lock, true};
+            uploadFiles.erase(newFile);
+        }
+        LOG_EVENT_FILESYS(actor, FAIL_UNSPECIFIED, FilesystemEventData{});
+        return StorageStatus::ERR_UNSUCCESSFUL;
+    }
+
+    CooperativeSpinlockGuard guard{lock, true};
+
+    // Random so ids of other uploads can't be guessed
+    do
+    {
+        randombytes_buf(&upload, sizeof(upload));
+    } while(upload == UploadID::INVALID || uploads.contains(upload));
+    uploads.emplace(upload, std::move(session));
+
+    // Runs from the first upload on - abandoned ones are removed even if the endpoint is idle after
+    if(!uploadSweepStarted)
+    {
+        static_assert(TPUNKT_STORAGE_UPLOAD_SWEEP_INTERVAL * 1'000'000U <= UINT32_MAX);
+        uploadSweepStarted = true;
+        taskQueue(TaskName{"VFS Upload Expiry"}, [ this ] { uploadExpire(); },
+                  static_cast<uint32_t>(TPUNKT_STORAGE_UPLOAD_SWEEP_INTERVAL * 1'000'000U));
+    }
+    LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
+    return StorageStatus::OK;
+}
+
+StorageStatus StorageEndpoint::uploadWrite(UserID actor, FileID file, UploadID upload, const uint32_t part,
+                                           const uint64_t offset, const std::string_view data, ResultCb callback)
+{
+    constexpr EventAction action = EventAction::FilesystemUploadWrite;
+    WriteHandle handle;
+    {
+        CooperativeSpinlockGuard guard{lock, true};
+        UploadSession* session = uploadFind(actor, file, upload);
+        if(session == nullptr || part >= session->parts.size())
+        {
+            LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
+            return StorageStatus::ERR_NO_SUCH_UPLOAD;
+        }
+
+        UploadPart& uploadPart = session->parts[ part ];
+        if(uploadPart.hasFailed || offset != uploadPart.received || data.size() > uploadPart.end - offset)
+        {
+            LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
+            return StorageStatus::ERR_UPLOAD_OFFSET;
+        }
+
+        // Checked before every write if the size is not known - stops the upload as soon as a limit is reached
+        if(session->size == 0 && !virtualFilesystem.fileChangeSize(file, offset + data.size()))
+        {
+            LOG_EVENT_FILESYS(actor, FAIL_UNSPECIFIED, FilesystemEventData{});
+            return StorageStatus::ERR_UNSUCCESSFUL;
+        }
+
+        uploadPart.received += data.size();
+        ++uploadPart.pending;
+        session->expiration = Timestamp::Now(TPUNKT_STORAGE_UPLOAD_TIMEOUT);
+        handle = session->handle;
+        handle.tempPosition = offset;
+    }
+
+    // Written without blocking the filesystem - the copied handle only carries the position of this write
+    const auto writeCallback = [ this, upload, part, callback ](const bool success)
+    {
+        uploadWritten(upload, part, success);
+        callback(success);
+    };
+    (void)dataStore->writeFile(handle, false, reinterpret_cast<const unsigned char*>(data.data()), data.size(),
+                               writeCallback);
+    LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
+    return StorageStatus::OK;
+}
+
+StorageStatus StorageEndpoint::uploadGetOffsets(UserID actor, FileID file, UploadID upload, uint64_t& partSize,
+                                                std::vector<uint64_t>& offsets)
+{
+    constexpr EventAction action = EventAction::FilesystemUploadInfo;
+    CooperativeSpinlockGuard guard{lock, true};
+
+    const UploadSession* session = uploadFind(actor, file, upload);
+    if(session == nullptr)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
+        return StorageStatus::ERR_NO_SUCH_UPLOAD;
+    }
+
+    partSize = session->partSize;
+    offsets.clear();
+    for(const UploadPart& part : session->parts)
+    {
+        offsets.push_back(part.committed);
+    }
+    LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
+    return StorageStatus::OK;
+}
+
+StorageStatus StorageEndpoint::uploadFinish(UserID actor, FileID file, UploadID upload, ResultCb callback)
+{
+    constexpr EventAction action = EventAction::FilesystemUploadFinish;
+    WriteHandle handle;
+    {
+        CooperativeSpinlockGuard guard{lock, true};
+        const UploadSession* session = uploadFind(actor, file, upload);
+        if(session == nullptr)
+        {
+            LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
+            return StorageStatus::ERR_NO_SUCH_UPLOAD;
+        }
+
+        if(!session->isComplete())
+        {
+            LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
+            return StorageStatus::ERR_UPLOAD_OFFSET;
+        }
+
+        handle = session->handle;
+        handle.done = true;
+        uploads.erase(upload);
+    }
+
+    // Parts only ever wrote the temp file - the file changes at once with the rename of the commit
+    const auto commitCallback = [ this, file, callback ](const bool success)
+    {
+        // Nothing valid is behind the announced size - the handle is already closed by the commit
+        if(!success)
+        {
+            UploadSession failed{};
+            failed.file = file;
+            uploadRevert(failed);
+        }
+        {
+            CooperativeSpinlockGuard guard{lock, true};
+            uploadFiles.erase(file);
+        }
+        callback(success);
+    };
+    (void)dataStore->closeWrite(handle, false, commitCallback);
     LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
     return StorageStatus::OK;
 }
@@ -177,6 +572,7 @@ StorageStatus StorageEndpoint::fileRead(UserID actor, FileID file, ReadFileTrans
 StorageStatus StorageEndpoint::dirCreate(UserID actor, FileID dir, const DirectoryCreationInfo& info)
 {
     constexpr EventAction action = EventAction::FilesystemDirCreate;
+    CooperativeSpinlockGuard guard{lock, true};
     if(!IsValidFilename(info.name))
     {
         LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
@@ -189,15 +585,14 @@ StorageStatus StorageEndpoint::dirCreate(UserID actor, FileID dir, const Directo
         return StorageStatus::ERR_NO_UAC_PERM;
     }
 
-    VirtualDirectory* directory = virtualFilesystem.findDir(dir);
-    if(directory == nullptr)
+    if(virtualFilesystem.findDir(dir) == nullptr)
     {
         LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
         return StorageStatus::ERR_NO_SUCH_DIR;
     }
 
     FileID newId{};
-    if(!directory->dirAdd(info, newId))
+    if(!virtualFilesystem.dirAdd(dir, info, newId))
     {
         LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
         return StorageStatus::ERR_NO_UNIQUE_NAME;
@@ -210,7 +605,7 @@ StorageStatus StorageEndpoint::dirCreate(UserID actor, FileID dir, const Directo
 StorageStatus StorageEndpoint::dirDelete(UserID actor, FileID dir)
 {
     constexpr EventAction action = EventAction::FileSystemDirDelete;
-    SpinlockGuard guard{lock};
+    CooperativeSpinlockGuard guard{lock, true};
 
     if(GetUAC().userCanAction(actor, dir, PermissionFlag::DELETE) != UACStatus::OK)
     {
@@ -218,28 +613,133 @@ StorageStatus StorageEndpoint::dirDelete(UserID actor, FileID dir)
         return StorageStatus::ERR_NO_UAC_PERM;
     }
 
-    VirtualDirectory* directory = virtualFilesystem.findContainingDir(dir);
-    if(directory == nullptr)
+    if(virtualFilesystem.findContainingDir(dir) == nullptr)
     {
         LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
         return StorageStatus::ERR_NO_SUCH_DIR;
     }
 
-    if(!directory->dirDelete(dir))
+    if(!virtualFilesystem.dirTombstone(dir))
     {
         LOG_EVENT_FILESYS(actor, FAIL_UNSPECIFIED, FilesystemEventData{});
         return StorageStatus::ERR_UNSUCCESSFUL;
     }
 
+    reclaimQueue();
+    LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
+    return StorageStatus::OK;
+}
+
+StorageStatus StorageEndpoint::dirRename(UserID actor, FileID dir, const FileName& name)
+{
+    constexpr EventAction action = EventAction::FilesystemDirRename;
+    CooperativeSpinlockGuard guard{lock, true};
+    if(!IsValidFilename(name))
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
+        return StorageStatus::ERR_INVALID_FILE_NAME;
+    }
+
+    if(GetUAC().userCanAction(actor, dir, PermissionFlag::WRITE) != UACStatus::OK)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_UAC, FilesystemEventData{});
+        return StorageStatus::ERR_NO_UAC_PERM;
+    }
+
+    if(virtualFilesystem.findDir(dir) == nullptr)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
+        return StorageStatus::ERR_NO_SUCH_DIR;
+    }
+
+    if(!virtualFilesystem.dirRename(dir, name))
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
+        return StorageStatus::ERR_NO_UNIQUE_NAME;
+    }
+
     LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
     return StorageStatus::OK;
 }
 
-StorageStatus StorageEndpoint::dirGetEntries(UserID actor, FileID dir,
+StorageStatus StorageEndpoint::dirMove(UserID actor, FileID dir, FileID newParent)
+{
+    constexpr EventAction action = EventAction::FilesystemDirMove;
+    CooperativeSpinlockGuard guard{lock, true};
+
+    if(GetUAC().userCanAction(actor, dir, PermissionFlag::DELETE) != UACStatus::OK ||
+       GetUAC().userCanAction(actor, newParent, PermissionFlag::CREATE) != UACStatus::OK)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_UAC, FilesystemEventData{});
+        return StorageStatus::ERR_NO_UAC_PERM;
+    }
+
+    const VirtualDirectory* directory = virtualFilesystem.findDir(dir);
+    if(directory == nullptr || virtualFilesystem.findDir(newParent) == nullptr)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
+        return StorageStatus::ERR_NO_SUCH_DIR;
+    }
+
+    const FileName name{virtualFilesystem.getName(*directory)};
+    const VirtualDirectory* existing = virtualFilesystem.findDirByName(newParent, name);
+    if(existing != nullptr && existing != directory)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
+        return StorageStatus::ERR_NO_UNIQUE_NAME;
+    }
+
+    // Fails for the root, moves below itself or if a size limit of the new parents would be exceeded
+    if(!virtualFilesystem.dirMove(dir, newParent))
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
+        return StorageStatus::ERR_UNSUCCESSFUL;
+    }
+
+    LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
+    return StorageStatus::OK;
+}
+
+StorageStatus StorageEndpoint::dirGetEntries(UserID actor, FileID dir, const DirectorySortOrder order,
+                                             const bool descending, const uint32_t limit, DirectoryCursor& cursor,
                                              std::vector<DTO::ResponseDirectoryEntry>& entries)
 {
     constexpr EventAction action = EventAction::FilesystemDirLookup;
-    SpinlockGuard guard{lock};
+
+    // Only the first sorted listing of a directory needs the lock exclusive - it builds the sort index
+    for(const bool exclusive : {false, true})
+    {
+        CooperativeSpinlockGuard guard{lock, exclusive};
+        if(GetUAC().userCanAction(actor, dir, PermissionFlag::READ) != UACStatus::OK)
+        {
+            LOG_EVENT_FILESYS(actor, FAIL_NO_UAC, FilesystemEventData{});
+            return StorageStatus::ERR_NO_UAC_PERM;
+        }
+
+        const VirtualDirectory* directory = virtualFilesystem.findDir(dir);
+        if(directory == nullptr)
+        {
+            LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
+            return StorageStatus::ERR_NO_SUCH_DIR;
+        }
+
+        if(!exclusive && order != DirectorySortOrder::INSERTION && !virtualFilesystem.hasSortIndex(*directory))
+        {
+            continue;
+        }
+
+        (void)virtualFilesystem.dirAccess(dir);
+        (void)virtualFilesystem.collectEntries(*directory, order, descending, limit, cursor, entries);
+        LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
+        return StorageStatus::OK;
+    }
+    return StorageStatus::ERR_UNSUCCESSFUL;
+}
+
+StorageStatus StorageEndpoint::dirGetVersion(UserID actor, const FileID dir, uint64_t& version)
+{
+    constexpr EventAction action = EventAction::FilesystemDirLookup;
+    CooperativeSpinlockGuard guard{lock, false};
     if(GetUAC().userCanAction(actor, dir, PermissionFlag::READ) != UACStatus::OK)
     {
         LOG_EVENT_FILESYS(actor, FAIL_NO_UAC, FilesystemEventData{});
@@ -253,7 +753,139 @@ StorageStatus StorageEndpoint::dirGetEntries(UserID actor, FileID dir,
         return StorageStatus::ERR_NO_SUCH_DIR;
     }
 
-    directory->collectEntries(entries);
+    version = directory->getVersion();
+    return StorageStatus::OK;
+}
+
+StorageStatus StorageEndpoint::pathResolve(UserID actor, FileID dir, const std::vector<std::string>& paths,
+                                           std::vector<DTO::ResponseResolvedPath>& results)
+{
+    constexpr EventAction action = EventAction::FilesystemPathResolve;
+    CooperativeSpinlockGuard guard{lock, false};
+    if(GetUAC().userCanAction(actor, dir, PermissionFlag::READ) != UACStatus::OK)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_UAC, FilesystemEventData{});
+        return StorageStatus::ERR_NO_UAC_PERM;
+    }
+
+    if(virtualFilesystem.findDir(dir) == nullptr)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
+        return StorageStatus::ERR_NO_SUCH_DIR;
+    }
+
+    results.clear();
+    results.resize(paths.size());
+    for(size_t i = 0; i < paths.size(); ++i)
+    {
+        const FileID fid = virtualFilesystem.resolvePath(dir, paths[ i ]);
+        if(!fid.isValid() || GetUAC().userCanAction(actor, fid, PermissionFlag::READ) != UACStatus::OK)
+        {
+            continue; // Not distinguished - doesn't reveal what the user can't see
+        }
+
+        auto& result = results[ i ];
+        result.found = true;
+        if(fid.isFile())
+        {
+            const VirtualFile& file = *virtualFilesystem.findFile(fid);
+            result.entry = DTO::ResponseDirectoryEntry::FromFile(file, virtualFilesystem.getName(file));
+        }
+        else
+        {
+            const VirtualDirectory& directory = *virtualFilesystem.findDir(fid);
+            result.entry = DTO::ResponseDirectoryEntry::FromDir(directory, virtualFilesystem.getName(directory));
+        }
+    }
+
+    LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
+    return StorageStatus::OK;
+}
+
+StorageStatus StorageEndpoint::search(UserID actor, FileID dir, const NameSearchQuery& query, const uint32_t limit,
+                                      uint64_t& cursor, std::vector<DTO::ResponseDirectoryEntry>& entries)
+{
+    constexpr EventAction action = EventAction::FilesystemSearch;
+    CooperativeSpinlockGuard guard{lock, false};
+    if(GetUAC().userCanAction(actor, dir, PermissionFlag::READ) != UACStatus::OK)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_UAC, FilesystemEventData{});
+        return StorageStatus::ERR_NO_UAC_PERM;
+    }
+
+    const auto canRead = [ actor ](const FileID fid)
+    { return GetUAC().userCanAction(actor, fid, PermissionFlag::READ) == UACStatus::OK; };
+    if(!virtualFilesystem.search(dir, query, limit, cursor, canRead, entries))
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
+        return StorageStatus::ERR_NO_SUCH_DIR;
+    }
+
+    LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
+    return StorageStatus::OK;
+}
+
+StorageStatus StorageEndpoint::changesGet(UserID actor, const uint64_t after, const uint32_t limit,
+                                          DTO::ResponseChanges& response)
+{
+    // Within a single thread this method is threadsafe
+    thread_local std::vector<VirtualChange> changes;
+
+    constexpr EventAction action = EventAction::FilesystemChanges;
+    CooperativeSpinlockGuard guard{lock, false};
+    if(GetUAC().userCanAction(actor, virtualFilesystem.getRoot().getID(), PermissionFlag::READ) != UACStatus::OK)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_UAC, FilesystemEventData{});
+        return StorageStatus::ERR_NO_UAC_PERM;
+    }
+
+    const VirtualChangeLog& log = virtualFilesystem.getChanges();
+    response.changes.clear();
+    response.resync = !log.collect(after, limit, changes);
+    response.sequence = response.resync || changes.empty() ? log.getSequence() : changes.back().sequence;
+    response.more = response.sequence != log.getSequence();
+    for(const VirtualChange& change : changes)
+    {
+        response.changes.push_back(DTO::ResponseChange{.sequence = change.sequence,
+                                                       .operation = GetChangeOperationStr(change.operation),
+                                                       .fid = change.fid,
+                                                       .parent = change.parent});
+    }
+
+    LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
+    return StorageStatus::OK;
+}
+
+StorageStatus StorageEndpoint::treeHashesGet(UserID actor, const FileID dir, DTO::ResponseTreeHashes& response)
+{
+    constexpr EventAction action = EventAction::FilesystemTreeHashes;
+    CooperativeSpinlockGuard guard{lock, true};
+    if(GetUAC().userCanAction(actor, dir, PermissionFlag::READ) != UACStatus::OK)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_UAC, FilesystemEventData{});
+        return StorageStatus::ERR_NO_UAC_PERM;
+    }
+
+    uint64_t hash = 0;
+    const VirtualDirectory* directory = virtualFilesystem.findDir(dir);
+    if(directory == nullptr || !virtualFilesystem.getTreeHash(dir, hash))
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
+        return StorageStatus::ERR_NO_SUCH_DIR;
+    }
+
+    response.hash = FixedString<24>{hash};
+    response.dirs.clear();
+    virtualFilesystem.forEachDir(*directory,
+                                 [ & ](const VirtualDirectory& subDir)
+                                 {
+                                     uint64_t subHash = 0;
+                                     virtualFilesystem.getTreeHash(subDir.getID(), subHash);
+                                     auto& entry = response.dirs.emplace_back();
+                                     entry.fid = subDir.getID();
+                                     entry.hash = FixedString<24>{subHash};
+                                 });
+
     LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
     return StorageStatus::OK;
 }
@@ -261,7 +893,7 @@ StorageStatus StorageEndpoint::dirGetEntries(UserID actor, FileID dir,
 StorageStatus StorageEndpoint::infoFile(UserID actor, FileID file, DTO::ResponseDirectoryEntry& info)
 {
     constexpr EventAction action = EventAction::FilesystemFileInfo;
-    SpinlockGuard guard{lock};
+    CooperativeSpinlockGuard guard{lock, false};
 
     if(GetUAC().userCanAction(actor, file, PermissionFlag::READ) != UACStatus::OK)
     {
@@ -276,7 +908,7 @@ StorageStatus StorageEndpoint::infoFile(UserID actor, FileID file, DTO::Response
         return StorageStatus::ERR_NO_SUCH_FILE;
     }
 
-    info = DTO::ResponseDirectoryEntry::FromFile(*virtualFile);
+    info = DTO::ResponseDirectoryEntry::FromFile(*virtualFile, virtualFilesystem.getName(*virtualFile));
     LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
     return StorageStatus::OK;
 }
@@ -286,6 +918,26 @@ const StorageEndpointData& StorageEndpoint::getData() const
     return data;
 }
 
+EndpointStats StorageEndpoint::getStats()
+{
+    EndpointStats stats;
+    if(dedupStore != nullptr)
+    {
+        const DedupStats dedup = dedupStore->getStats();
+        stats.fileBytes = dedup.logicalBytes;
+        stats.storedBytes = dedup.storedBytes;
+        stats.chunks = dedup.chunks;
+        stats.receivedBytes = dedup.receivedBytes;
+        stats.writtenBytes = dedup.writtenBytes;
+        return stats;
+    }
+
+    CooperativeSpinlockGuard guard{lock, false};
+    stats.fileBytes = virtualFilesystem.getRoot().getStats().getTotalSize();
+    stats.storedBytes = stats.fileBytes;
+    return stats;
+}
+
 bool StorageEndpoint::canBeRemoved() const
 {
     return lock.isLocked();
@@ -298,9 +950,7 @@ bool StorageEndpoint::CreateDirs(EndpointID eid)
         return false;
     }
 
-    const auto endpointID = static_cast<int>(eid);
-    FixedString<64> dir;
-    (void)snprintf(dir.data(), dir.capacity(), "%s/%d", TPUNKT_STORAGE_ENDPOINT_DIR, endpointID);
+    const FixedString<64> dir = GetEndpointDir(eid);
     if(!CreateRelDir(dir.c_str(), true))
     {
         RemoveRelDir(TPUNKT_STORAGE_ENDPOINT_DIR);
@@ -317,5 +967,222 @@ bool StorageEndpoint::CreateDirs(EndpointID eid)
     return true;
 }
 
+void StorageEndpoint::compact()
+{
+    VirtualSnapshot tree;
+    uint64_t sequence = 0;
+    {
+        CooperativeSpinlockGuard guard{lock, true};
+        // Snapshot wouldn't know about the deleted nodes - their data would never be removed after a restart
+        if(virtualFilesystem.hasTombstones())
+        {
+            compactionDeferred = true;
+            return;
+        }
+
+        if(!persistence.compactBegin(virtualFilesystem, tree, sequence))
+        {
+            return;
+        }
+    }
+
+    // Nodes are collected from the snapshot and written without blocking the filesystem
+    if(!persistence.compactFinish(*tree, sequence))
+    {
+        LOG_ERROR("Compacting filesystem of endpoint %d failed", static_cast<int>(data.endpoint));
+    }
+}
+
+void StorageEndpoint::taskQueue(const TaskName& name, const std::function<void()>& func, const uint32_t intervalMicros)
+{
+    SpinlockGuard guard{taskLock};
+    if(isClosing)
+    {
+        return;
+    }
+
+    std::erase_if(tasks, [](const TaskID task) { return !GetTaskManager().taskExists(task); }); // Finished
+    if(intervalMicros != 0)
+    {
+        tasks.push_back(GetTaskManager().taskAddPeriodic(UserID::SERVER, name, intervalMicros, [ func ] { func(); }));
+        return;
+    }
+    tasks.push_back(GetTaskManager().taskAdd(UserID::SERVER, name, [ func ] { func(); }));
+}
+
+void StorageEndpoint::reclaim()
+{
+    std::vector<FileID> removedFiles;
+    {
+        CooperativeSpinlockGuard guard{lock, true};
+        reclaimQueued = false;
+        if(virtualFilesystem.dirReclaim(TPUNKT_STORAGE_VFS_RECLAIM_BATCH, removedFiles))
+        {
+            reclaimQueue(); // Lock is released in between
+        }
+        else if(compactionDeferred)
+        {
+            compactionDeferred = false;
+            taskQueue(TaskName{"VFS Compaction"}, [ this ] { compact(); });
+        }
+    }
+
+    // Data is removed without blocking the filesystem
+    for(const FileID file : removedFiles)
+    {
+        (void)dataStore->deleteFile(file.getUID(),
+                                    [](const bool success)
+                                    {
+                                        if(!success)
+                                        {
+                                            LOG_WARNING("Removing data of deleted file failed");
+                                        }
+                                    });
+    }
+}
+
+void StorageEndpoint::reclaimQueue()
+{
+    if(reclaimQueued)
+    {
+        return;
+    }
+    reclaimQueued = true;
+    taskQueue(TaskName{"VFS Reclaim"}, [ this ] { reclaim(); });
+}
+
+StorageStatus StorageEndpoint::fileAdd(UserID actor, FileID dir, const FileCreationInfo& info, FileID& newFile)
+{
+    constexpr EventAction action = EventAction::FileSystemFileCreate;
+    if(!IsValidFilename(info.name))
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
+        return StorageStatus::ERR_INVALID_FILE_NAME;
+    }
+
+    if(GetUAC().userCanAction(actor, dir, PermissionFlag::CREATE) != UACStatus::OK)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_UAC, FilesystemEventData{});
+        return StorageStatus::ERR_NO_UAC_PERM;
+    }
+
+    if(virtualFilesystem.findDir(dir) == nullptr)
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_NO_SUCH_FILE, FilesystemEventData{});
+        return StorageStatus::ERR_NO_SUCH_DIR;
+    }
+
+    if(!virtualFilesystem.fileAdd(dir, info, newFile))
+    {
+        LOG_EVENT_FILESYS(actor, FAIL_INVALID_ARGUMENTS, FilesystemEventData{});
+        return StorageStatus::ERR_NO_UNIQUE_NAME;
+    }
+
+    LOG_EVENT_FILESYS(actor, INFO_SUCCESS, FilesystemEventData{});
+    return StorageStatus::OK;
+}
+
+void StorageEndpoint::uploadExpire()
+{
+    std::vector<UploadSession> expired;
+    {
+        CooperativeSpinlockGuard guard{lock, true};
+        for(auto it = uploads.begin(); it != uploads.end();)
+        {
+            // Writes in flight still use the temp file - removed by a later sweep
+            if(it->second.isSettled() && it->second.isExpired())
+            {
+                uploadFiles.erase(it->second.file);
+                expired.push_back(it->second);
+                it = uploads.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    for(UploadSession& session : expired)
+    {
+        uploadRevert(session);
+    }
+}
+
+UploadSession* StorageEndpoint::uploadFind(const UserID actor, const FileID file, const UploadID upload)
+{
+    const auto it = uploads.find(upload);
+    if(it == uploads.end() || it->second.owner != actor || it->second.file != file)
+    {
+        return nullptr;
+    }
+
+    // Removed by the next sweep
+    if(it->second.isExpired())
+    {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+void StorageEndpoint::uploadWritten(const UploadID upload, const uint32_t part, const bool success)
+{
+    CooperativeSpinlockGuard guard{lock, true};
+    const auto it = uploads.find(upload);
+    if(it == uploads.end())
+    {
+        return;
+    }
+
+    UploadSession& session = it->second;
+    UploadPart& uploadPart = session.parts[ part ];
+    --uploadPart.pending;
+    uploadPart.hasFailed |= !success;
+    if(uploadPart.pending != 0)
+    {
+        return;
+    }
+
+    // Writes since the last commit are discarded - the client continues at the committed offset
+    if(uploadPart.hasFailed)
+    {
+        uploadPart.hasFailed = false;
+        uploadPart.received = uploadPart.committed;
+        if(session.size == 0)
+        {
+            (void)virtualFilesystem.fileChangeSize(session.file, uploadPart.committed);
+        }
+    }
+    else
+    {
+        uploadPart.committed = uploadPart.received;
+    }
+}
+
+void StorageEndpoint::uploadRevert(UploadSession& session)
+{
+    {
+        CooperativeSpinlockGuard guard{lock, true};
+        if(!virtualFilesystem.fileDelete(session.file))
+        {
+            LOG_WARNING("Failed to revert upload: File already deleted");
+        }
+    }
+
+    // Data is removed without blocking the filesystem
+    const auto callback = [](const bool success)
+    {
+        if(!success)
+        {
+            LOG_WARNING("Failed to revert upload: Datastore failed to remove file");
+        }
+    };
+    if(session.handle.isValid())
+    {
+        session.handle.done = true;
+        (void)dataStore->closeWrite(session.handle, true, callback);
+    }
+    (void)dataStore->deleteFile(session.file.getUID(), callback);
+}
 
 } // namespace tpunkt
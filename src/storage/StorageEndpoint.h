@@ -2,11 +2,17 @@
 #ifndef TPUNKT_STORAGE_ENDPOINT_H
 #define TPUNKT_STORAGE_ENDPOINT_H
 
+#include <functional>
+#include <vector>
+#include <ankerl/unordered_dense.h>
 #include "datastructures/FixedString.h"
 #include "datastructures/Spinlock.h"
 #include "server/DTO.h"
+#include "storage/EndpointStats.h"
+#include "storage/UploadSession.h"
 #include "storage/datastore/DataStore.h"
 #include "storage/vfs/VirtualFilesystem.h"
+#include "storage/vfs/VirtualFilesystemPersistence.h"
 
 namespace tpunkt
 {
@@ -25,6 +31,9 @@ enum class StorageStatus : uint8_t
     ERR_INVALID_FILE_NAME,
     ERR_NO_UNIQUE_NAME,
     ERR_NO_SUCH_ENDPOINT, // Endpoint not found
+    ERR_NO_SUCH_UPLOAD,   // Upload not found, expired or of another user
+    ERR_UPLOAD_OFFSET,    // Chunk doesn't continue its part - or the upload is not fully written
+    ERR_UPLOAD_PENDING,   // File is still being uploaded
 };
 
 const char* GetStorageStatusStr(StorageStatus status);
@@ -33,6 +42,8 @@ enum class StorageEndpointType : uint8_t
 {
     LOCAL_FILE_SYSTEM,
     REMOTE_FILE_SYSTEM,
+    LOCAL_FILE_SYSTEM_URING, // Local files through io_uring - falls back to LOCAL_FILE_SYSTEM if not supported
+    LOCAL_FILE_SYSTEM_DEDUP, // Local files cut into chunks - each unique chunk is stored once
 };
 
 struct StorageEndpointCreateInfo final
@@ -53,11 +64,11 @@ struct StorageEndpointData final
     EndpointID endpoint = EndpointID::INVALID;
 };
 
-// Datastore stores its files in /endpoints/{id}
+// Datastore stores its files in /endpoints/{id} - the filesystem is persisted next to it
 struct StorageEndpoint final
 {
     StorageEndpoint(const StorageEndpointCreateInfo& info, EndpointID endpoint, UserID creator);
-    ~StorageEndpoint() = default;
+    ~StorageEndpoint();
     TPUNKT_MACROS_DEL_CTORS(StorageEndpoint);
 
     //===== File Manipulation =====//
@@ -66,13 +77,60 @@ struct StorageEndpoint final
     StorageStatus fileDelete(UserID actor, FileID file);
     StorageStatus fileWrite(UserID actor, FileID file, WriteFileTransaction& transaction);
     StorageStatus fileRead(UserID actor, FileID file, ReadFileTransaction& transaction);
+    StorageStatus fileRename(UserID actor, FileID file, const FileName& name);
+    // Only relinks the file - its data is not touched
+    StorageStatus fileMove(UserID actor, FileID file, FileID dir);
+
+    //===== Uploads =====//
+
+    // Creates the file and starts a resumable upload of its data - chunks can come from any request of the user
+    // Data is split into parts of the given size written independently - see UploadSession::init()
+    StorageStatus uploadCreate(UserID actor, FileID dir, const FileCreationInfo& info, uint64_t size,
+                               uint64_t partSize, UploadID& upload, FileID& newFile);
+    // Writes data of the part at the given offset of the file - has to continue where its last accepted write ended
+    // If OK the result of the write is given to the callback - might be called before the method returns
+    StorageStatus uploadWrite(UserID actor, FileID file, UploadID upload, uint32_t part, uint64_t offset,
+                              std::string_view data, ResultCb callback);
+    // Assigns the committed offset of each part - the next chunk of a part has to start there
+    StorageStatus uploadGetOffsets(UserID actor, FileID file, UploadID upload, uint64_t& partSize,
+                                   std::vector<uint64_t>& offsets);
+    // Commits the written data to the file - all parts have to be written and settled - the upload is gone afterwards
+    // If OK the result of the commit is given to the callback
+    StorageStatus uploadFinish(UserID actor, FileID file, UploadID upload, ResultCb callback);
 
     //===== Dir Manipulation =====//
 
     StorageStatus dirCreate(UserID actor, FileID dir, const DirectoryCreationInfo& info);
+    // Hides the dir with everything below right away - nodes and data are removed by a background task
     StorageStatus dirDelete(UserID actor, FileID dir);
-    // Collects all entries in the given dir (if user has access)
-    StorageStatus dirGetEntries(UserID actor, FileID dir, std::vector<DTO::ResponseDirectoryEntry>& entries);
+    StorageStatus dirRename(UserID actor, FileID dir, const FileName& name);
+    // Only relinks the dir - independent of the size of its subtree
+    StorageStatus dirMove(UserID actor, FileID dir, FileID newParent);
+    // Collects up to limit entries of the given dir after the cursor in the given order (if user has access)
+    // Moves the cursor to the next page - zero if no entries are left
+    StorageStatus dirGetEntries(UserID actor, FileID dir, DirectorySortOrder order, bool descending, uint32_t limit,
+                                DirectoryCursor& cursor, std::vector<DTO::ResponseDirectoryEntry>& entries);
+    // Assigns the version of the directory (if user can read it) - changes whenever an entry of its listing changes
+    StorageStatus dirGetVersion(UserID actor, FileID dir, uint64_t& version);
+    // Resolves each path below the given dir (if user has access) - one result per path in the same order
+    // Paths that don't exist or the user can't read are not found
+    StorageStatus pathResolve(UserID actor, FileID dir, const std::vector<std::string>& paths,
+                              std::vector<DTO::ResponseResolvedPath>& results);
+
+    //===== Search =====//
+
+    // Collects up to limit files and dirs below the given dir whose name matches the query (if user has access)
+    // Matches the user can't read are skipped - moves the cursor to the next page, zero if no matches are left
+    StorageStatus search(UserID actor, FileID dir, const NameSearchQuery& query, uint32_t limit, uint64_t& cursor,
+                         std::vector<DTO::ResponseDirectoryEntry>& entries);
+
+    //===== Changes =====//
+
+    // Collects up to limit changes after the given sequence (if user can read the root) - signals if a resync is needed
+    StorageStatus changesGet(UserID actor, uint64_t after, uint32_t limit, DTO::ResponseChanges& response);
+
+    // Assigns the tree hash of the directory and its direct subdirectories (if user can read it)
+    StorageStatus treeHashesGet(UserID actor, FileID dir, DTO::ResponseTreeHashes& response);
 
     //===== File Info =====//
 
@@ -83,16 +141,53 @@ struct StorageEndpoint final
 
     [[nodiscard]] const StorageEndpointData& getData() const;
 
+    // Sizes of the files and the data stored for them - deduplication stats if the datastore deduplicates
+    [[nodiscard]] EndpointStats getStats();
+
     // True if no active usages
     [[nodiscard]] bool canBeRemoved() const;
 
     static bool CreateDirs(EndpointID eid);
 
   private:
+    // Queues a background task of the endpoint - tasks still queued or running are cancelled on destruction
+    // Runs every interval if one is given
+    void taskQueue(const TaskName& name, const std::function<void()>& func, uint32_t intervalMicros = 0);
+
+    // Writes the filesystem journal into a new snapshot - runs as background task
+    void compact();
+
+    // Removes a batch of deleted nodes and their data - queues itself again until all are removed
+    void reclaim();
+    // Needs the lock
+    void reclaimQueue();
+
+    // Needs the lock - adds the file to the filesystem after checking the name and permissions
+    StorageStatus fileAdd(UserID actor, FileID dir, const FileCreationInfo& info, FileID& newFile);
+
+    // Removes expired uploads and their data - runs as periodic background task
+    void uploadExpire();
+    // Needs the lock - returns nullptr if the upload doesn't exist, expired or belongs to someone else
+    UploadSession* uploadFind(UserID actor, FileID file, UploadID upload);
+    // Settles a write of the part
+    void uploadWritten(UploadID upload, uint32_t part, bool success);
+    // Removes the file of the upload and discards its data - takes the lock
+    void uploadRevert(UploadSession& session);
+
     VirtualFilesystem virtualFilesystem;
+    VirtualFilesystemPersistence persistence;
     StorageEndpointData data;
     DataStore* dataStore = nullptr;
-    Spinlock lock;
+    DedupFileSystemDatastore* dedupStore = nullptr; // Same as the datastore if it deduplicates
+    CooperativeSpinlock lock; // Exclusive for changes of the filesystem - lookups and reads share it
+    ankerl::unordered_dense::map<UploadID, UploadSession> uploads; // Guarded by the lock
+    ankerl::unordered_dense::set<FileID, FileIDHash> uploadFiles;  // Files of the uploads - guarded by the lock
+    bool reclaimQueued = false;
+    bool uploadSweepStarted = false;
+    bool compactionDeferred = false; // Waits for the deleted nodes to be removed
+    std::vector<TaskID> tasks;       // Background tasks that might still use the endpoint
+    Spinlock taskLock;
+    bool isClosing = false;          // No tasks are queued anymore
     friend Storage;
 };
 
@@ -11,10 +11,11 @@ StorageTransaction::StorageTransaction(ResultCb callback, uWS::HttpResponse<true
 {
 }
 
-void StorageTransaction::init(DataStore& store, VirtualFilesystem& vfs)
+void StorageTransaction::init(DataStore& store, VirtualFilesystem& vfs, CooperativeSpinlock& vfsLock)
 {
     datastore = &store;
     filesystem = &vfs;
+    filesystemLock = &vfsLock;
 }
 
 void StorageTransaction::commit()
@@ -2,6 +2,11 @@
 #ifndef TPUNKT_STORAGE_TRANSACTION_H
 #define TPUNKT_STORAGE_TRANSACTION_H
 
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "datastructures/Spinlock.h"
 #include "fwd.h"
 #include "storage/datastore/DataStore.h"
 #include "util/Macros.h"
@@ -16,7 +21,8 @@ struct StorageTransaction
     virtual ~StorageTransaction() = default;
     TPUNKT_MACROS_STRUCT(StorageTransaction);
 
-    void init(DataStore& store, VirtualFilesystem& vfs);
+    // Filesystem is only accessed while holding the given lock of its endpoint
+    void init(DataStore& store, VirtualFilesystem& vfs, CooperativeSpinlock& vfsLock);
 
     // Commit the operation
     virtual void commit();
@@ -28,7 +34,8 @@ struct StorageTransaction
     uWS::Loop* loop = nullptr;
     DataStore* datastore = nullptr;
     VirtualFilesystem* filesystem = nullptr;
-    ResultCb callback;
+    CooperativeSpinlock* filesystemLock = nullptr;
+    std::function<void(bool success)> callback; // Copied - async datastores complete after the caller returned
 
     [[nodiscard]] bool shouldAbort() const;
 
@@ -43,27 +50,54 @@ struct WriteFileTransaction final : StorageTransaction
 
     bool start();
     void commit() override;
+    // Returns false if the data can't be written - also if a directory limit would be exceeded
     bool write(const std::string_view& data, bool isLast);
 
   private:
     WriteHandle handle;
     FileID dir;
     FileID file;
+    uint64_t written = 0;
     TPUNKT_MACROS_STRUCT(WriteFileTransaction);
 };
 
-struct ReadFileTransaction final : StorageTransaction
+// Part of a file sent by a ReadFileTransaction - the prefix is written before its data
+struct ReadPart final
+{
+    size_t begin = 0;
+    size_t end = 0; // Exclusive
+    std::string prefix;
+};
+
+// Must be owned by a shared pointer - reads in flight keep it alive
+struct ReadFileTransaction final : StorageTransaction, std::enable_shared_from_this<ReadFileTransaction>
 {
     ReadFileTransaction(ResultCb callback, uWS::HttpResponse<true>* response, FileID file);
+    // Only sends the given parts in order - the trailer is written after the last
+    ReadFileTransaction(ResultCb callback, uWS::HttpResponse<true>* response, FileID file, std::vector<ReadPart> parts,
+                        std::string trailer);
     ~ReadFileTransaction() override;
 
     bool start();
+    // Reads until the response is backpressured - continues on its own if the datastore completes asynchronously
     bool readFile();
+    // Called once the response is gone - reads in flight only close the handle when they complete
+    void abort();
 
   private:
     bool canReadMore = true;
+    bool isAborted = false;  // Response is freed - must not be touched anymore
+    bool isReading = false;  // A read is in flight
+    bool isStarting = false; // Inside readFile - completions don't start the next read themselves
+    bool isDone = false;
+    bool isPartStarted = false; // Prefix of the current part is written
     FileID file;
     ReadHandle handle;
+    size_t part = 0;
+    std::vector<ReadPart> parts;
+    std::string trailer;
+
+    bool startPart();
     TPUNKT_MACROS_STRUCT(ReadFileTransaction);
 };
 
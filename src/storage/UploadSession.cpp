@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include "config.h"
+#include "storage/UploadSession.h"
+
+namespace tpunkt
+{
+
+UploadIDString GetUploadIDStr(const UploadID upload)
+{
+    UploadIDString str;
+    (void)snprintf(str.data(), str.capacity(), "%016llx", static_cast<unsigned long long>(upload));
+    return str;
+}
+
+UploadID ParseUploadID(const std::string_view str)
+{
+    uint64_t num = 0;
+    const auto [ ptr, ec ] = std::from_chars(str.data(), str.data() + str.size(), num, 16);
+    if(str.size() != 16 || ec != std::errc{} || ptr != str.data() + str.size())
+    {
+        return UploadID::INVALID;
+    }
+    return static_cast<UploadID>(num);
+}
+
+bool UploadSession::init(const uint64_t size, const uint64_t partSize)
+{
+    this->size = size;
+    parts.clear();
+    if(size == 0)
+    {
+        this->partSize = 0;
+        parts.emplace_back();
+        return true;
+    }
+
+    this->partSize = partSize == 0 || partSize > size ? size : partSize;
+    const uint64_t count = size / this->partSize + (size % this->partSize != 0 ? 1 : 0);
+    if(count > TPUNKT_STORAGE_UPLOAD_MAX_PARTS || (count > 1 && this->partSize < TPUNKT_STORAGE_UPLOAD_MIN_PART_SIZE))
+    {
+        return false;
+    }
+
+    parts.resize(count);
+    for(uint64_t i = 0; i < count; ++i)
+    {
+        UploadPart& part = parts[ i ];
+        part.committed = i * this->partSize;
+        part.received = part.committed;
+        part.end = std::min(part.committed + this->partSize, size);
+    }
+    return true;
+}
+
+bool UploadSession::isExpired() const
+{
+    return expiration.isInPast();
+}
+
+bool UploadSession::isSettled() const
+{
+    return std::ranges::all_of(parts, [](const UploadPart& part) { return part.pending == 0; });
+}
+
+bool UploadSession::isComplete() const
+{
+    return std::ranges::all_of(parts,
+                               [ this ](const UploadPart& part)
+                               {
+                                   const bool isWritten = size == 0 || part.committed == part.end;
+                                   return part.pending == 0 && !part.hasFailed && isWritten;
+                               });
+}
+
+} // namespace tpunkt
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TPUNKT_UPLOAD_SESSION_H
+#define TPUNKT_UPLOAD_SESSION_H
+
+#include <string_view>
+#include <vector>
+#include "common/FileID.h"
+#include "datastructures/FixedString.h"
+#include "datastructures/Timestamp.h"
+#include "storage/datastore/DataStore.h"
+
+namespace tpunkt
+{
+
+// Sent as 16 hex characters
+using UploadIDString = FixedString<24>;
+
+UploadIDString GetUploadIDStr(UploadID upload);
+// Returns INVALID if the string is not an upload id
+UploadID ParseUploadID(std::string_view str);
+
+// Range of the file written in order - parts of an upload are written independently
+struct UploadPart final
+{
+    uint64_t end = UINT64_MAX; // Exclusive - open if the size of the upload is not known
+    uint64_t committed = 0;    // All bytes of the part before are written
+    uint64_t received = 0;     // End of the accepted writes - the next chunk of the part has to start here
+    uint32_t pending = 0;      // Writes in flight
+    bool hasFailed = false;    // A write since the last commit failed - its chunk is discarded
+};
+
+// Upload of a single file spread over many requests - data goes into the temp file of the datastore until finished
+// Notes:
+//      - Chunks have to continue where the previous one of their part ended - writes of a chunk are in flight together
+//      - Parts are written at their own offset - chunks of different parts can come from different connections
+//      - Only settled bytes are committed - if a write fails the part falls back to its last committed offset
+//      - Uploads only live in memory - they don't survive a restart
+struct UploadSession final
+{
+    // Splits the upload into parts of the given size - the last might be smaller
+    // If the size is zero a single part grows with the written data
+    // Returns false if the parts are too small or too many
+    bool init(uint64_t size, uint64_t partSize);
+
+    [[nodiscard]] bool isExpired() const;
+    // True if no writes are in flight
+    [[nodiscard]] bool isSettled() const;
+    // True if all parts are fully written and settled
+    [[nodiscard]] bool isComplete() const;
+
+    WriteHandle handle;        // Positions of single writes are set from the offset of their chunk
+    FileID file;
+    UserID owner = UserID::INVALID;
+    uint64_t size = 0;         // Zero if not known
+    uint64_t partSize = 0;     // Part i starts at i * partSize
+    std::vector<UploadPart> parts;
+    Timestamp expiration;      // Renewed with every chunk
+};
+
+} // namespace tpunkt
+
+#endif // TPUNKT_UPLOAD_SESSION_H
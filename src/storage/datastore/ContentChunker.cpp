@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include "config.h"
+#include "storage/datastore/ContentChunker.h"
+
+namespace tpunkt
+{
+
+namespace
+{
+static_assert(std::has_single_bit(TPUNKT_STORAGE_DEDUP_CHUNK_AVG));
+static_assert(TPUNKT_STORAGE_DEDUP_CHUNK_MIN < TPUNKT_STORAGE_DEDUP_CHUNK_AVG &&
+              TPUNKT_STORAGE_DEDUP_CHUNK_AVG < TPUNKT_STORAGE_DEDUP_CHUNK_MAX);
+
+// Fixed values - stored chunks are only found again with the same table
+constexpr std::array<uint64_t, 256> GEAR = []
+{
+    std::array<uint64_t, 256> table{};
+    uint64_t state = 0x74'70'75'6e'6b'74'63'64ULL;
+    for(uint64_t& value : table) // SplitMix64
+    {
+        state += 0x9e3779b97f4a7c15ULL;
+        uint64_t mixed = state;
+        mixed = (mixed ^ (mixed >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+        mixed = (mixed ^ (mixed >> 27U)) * 0x94d049bb133111ebULL;
+        value = mixed ^ (mixed >> 31U);
+    }
+    return table;
+}();
+
+// Top bits depend on the most bytes - a stricter mask before the average size, a looser one after (normalized chunking)
+constexpr int AVG_BITS = std::bit_width(TPUNKT_STORAGE_DEDUP_CHUNK_AVG) - 1;
+constexpr uint64_t MASK_STRICT = ~0ULL << (64 - (AVG_BITS + 2));
+constexpr uint64_t MASK_LOOSE = ~0ULL << (64 - (AVG_BITS - 2));
+} // namespace
+
+size_t FindChunkBoundary(const unsigned char* data, const size_t size)
+{
+    if(size <= TPUNKT_STORAGE_DEDUP_CHUNK_MIN)
+    {
+        return size;
+    }
+
+    const size_t end = std::min(size, TPUNKT_STORAGE_DEDUP_CHUNK_MAX);
+    const size_t normal = std::min(end, TPUNKT_STORAGE_DEDUP_CHUNK_AVG);
+    uint64_t fingerprint = 0;
+    size_t i = TPUNKT_STORAGE_DEDUP_CHUNK_MIN; // Bytes before can't be a boundary - not hashed
+    for(; i < normal; ++i)
+    {
+        fingerprint = (fingerprint << 1U) + GEAR[ data[ i ] ];
+        if((fingerprint & MASK_STRICT) == 0)
+        {
+            return i + 1;
+        }
+    }
+    for(; i < end; ++i)
+    {
+        fingerprint = (fingerprint << 1U) + GEAR[ data[ i ] ];
+        if((fingerprint & MASK_LOOSE) == 0)
+        {
+            return i + 1;
+        }
+    }
+    return end;
+}
+
+} // namespace tpunkt
@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TPUNKT_CONTENT_CHUNKER_H
+#define TPUNKT_CONTENT_CHUNKER_H
+
+#include <cstddef>
+
+namespace tpunkt
+{
+
+// Content defined chunking (FastCDC) - boundaries only depend on the bytes before them
+// Inserting or removing data only changes the chunks around it - boundaries after are found again
+// Returns the length of the first chunk of the data - between TPUNKT_STORAGE_DEDUP_CHUNK_MIN and _MAX
+// Data has to be at least TPUNKT_STORAGE_DEDUP_CHUNK_MAX long - only the rest at the end of a stream may be shorter
+size_t FindChunkBoundary(const unsigned char* data, size_t size);
+
+} // namespace tpunkt
+
+#endif // TPUNKT_CONTENT_CHUNKER_H
@@ -11,6 +11,11 @@
 namespace tpunkt
 {
 
+namespace
+{
+thread_local uWS::Loop* ThreadLoop = nullptr;
+} // namespace
+
 bool ReadHandle::isValid() const
 {
     return fd != -1 && fileID != 0 && buffer != UINT8_MAX;
@@ -42,6 +47,16 @@ DataStore::DataStore(EndpointID endpoint)
                    TPUNKT_STORAGE_DATASTORE_DIR);
 }
 
+void DataStore::SetThreadLoop(uWS::Loop* loop)
+{
+    ThreadLoop = loop;
+}
+
+uWS::Loop* DataStore::GetThreadLoop()
+{
+    return ThreadLoop;
+}
+
 bool DataStore::CreateDirs(EndpointID endpoint)
 {
     FixedString<64> dir;
@@ -47,7 +47,7 @@ struct WriteHandle final
 // Notes:
 //      - Files are only identified by their ID from our side
 //      - Data is given and received encrypted only (assumed)
-//      - Callback might be called before the method returns
+//      - Callback might be called before the method returns - or later on the loop of the calling thread
 //      - Datastore's store their files in /endpoints/{id}/datastore
 //      - Supports partial reads
 //      - This is an ASYNC interface - return true is good request - callback true is good operation
@@ -60,6 +60,11 @@ struct DataStore
 
     static bool CreateDirs(EndpointID endpoint);
 
+    // Event loop of the calling thread - async datastores complete callbacks on the loop that started the operation
+    // Threads without a loop (tasks, tests) get them on the completion thread of the datastore
+    static void SetThreadLoop(uWS::Loop* loop);
+    static uWS::Loop* GetThreadLoop();
+
     virtual bool createFile(uint32_t fileID, ResultCb callback) = 0;
 
     virtual bool deleteFile(uint32_t fileID, ResultCb callback) = 0;
@@ -70,7 +75,7 @@ struct DataStore
     // Handle is only valid if returns true
     virtual bool initRead(uint32_t fileID, size_t begin, size_t end, ReadHandle& handle) = 0;
 
-    // Reads are guaranteed to be sequential
+    // Reads are guaranteed to be sequential - the next read of a handle is only started after the callback
     virtual bool readFile(ReadHandle& handle, size_t chunkSize, ReadCb callback) = 0;
 
     virtual bool closeRead(ReadHandle& handle, ResultCb callback) = 0;
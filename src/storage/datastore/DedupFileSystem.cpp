@@ -0,0 +1,1088 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <mutex>
+#include <sodium/crypto_generichash.h>
+#include <sodium/utils.h>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "datastructures/FixedString.h"
+#include "storage/datastore/ContentChunker.h"
+#include "storage/datastore/DedupFileSystem.h"
+#include "util/Logging.h"
+
+static constexpr int MAX_DIGITS = 14;
+
+#define RET_AND_CB_FALSE()                                                                                             \
+    callback(false);                                                                                                   \
+    return false
+
+#define RET_AND_READ_CB_FALSE()                                                                                        \
+    callback(nullptr, 0, false, true);                                                                                 \
+    return false
+
+namespace tpunkt
+{
+
+// Open write of a file - writes of parallel parts can come from several threads
+struct DedupWriter final
+{
+    std::vector<ChunkRef> chunks;       // Chunks of the new data - their uses are counted until commit or revert
+    std::vector<unsigned char> pending; // Data after the last boundary
+    uint64_t chunkedEnd = 0;            // Data before is stored in chunks
+    uint64_t spoolEnd = 0;              // End of the data in the temp file
+    uint32_t fileID = 0;
+    bool isSpooled = false;             // Writes came out of order - data after the chunks is in the temp file
+    bool hasFailed = false;             // Writing in order stopped - continues once restarted at an earlier offset
+    std::mutex lock; // Held while chunks are stored - blocks instead of spinning through disk I/O
+};
+
+namespace
+{
+using ChunkName = FixedString<96>;
+constexpr const char* CHUNK_DIR = "chunks";
+constexpr size_t CHUNK_SUBDIRS = 256;
+
+// Chunks of a file written as temp are suffixed with its id
+void GetChunkName(const ChunkHash& hash, ChunkName& name, const uint32_t tempFileID = 0)
+{
+    char hex[ sizeof(ChunkHash) * 2 + 1 ];
+    (void)sodium_bin2hex(hex, sizeof(hex), hash.data(), hash.size());
+    if(tempFileID == 0)
+    {
+        (void)snprintf(name.data(), name.capacity(), "%02x/%s", hash[ 0 ], hex);
+    }
+    else
+    {
+        (void)snprintf(name.data(), name.capacity(), "%02x/%s.%u", hash[ 0 ], hex, tempFileID);
+    }
+}
+
+bool IsNumber(const std::string_view str)
+{
+    return !str.empty() && str.find_first_not_of("0123456789") == std::string_view::npos;
+}
+
+bool ReadAt(const int fd, unsigned char* data, size_t size, uint64_t offset)
+{
+    while(size > 0)
+    {
+        const auto read = pread64(fd, data, size, static_cast<int64_t>(offset));
+        if(read <= 0)
+        {
+            if(read == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            LOG_ERROR("Reading file failed: %s", read == 0 ? "File too short" : strerror(errno));
+            return false;
+        }
+        data += read;
+        size -= static_cast<size_t>(read);
+        offset += static_cast<uint64_t>(read);
+    }
+    return true;
+}
+
+bool WriteAt(const int fd, const unsigned char* data, size_t size, uint64_t offset)
+{
+    while(size > 0)
+    {
+        const auto written = pwrite64(fd, data, size, static_cast<int64_t>(offset));
+        if(written == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            LOG_ERROR("Writing file failed: %s", strerror(errno));
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+    return true;
+}
+
+bool ReadManifest(const int fd, std::vector<ChunkRef>& chunks)
+{
+    struct stat fileStat{};
+    if(fstat(fd, &fileStat) == -1 || static_cast<size_t>(fileStat.st_size) % sizeof(ChunkRef) != 0)
+    {
+        LOG_ERROR("Invalid file manifest");
+        return false;
+    }
+
+    const auto size = static_cast<size_t>(fileStat.st_size);
+    chunks.resize(size / sizeof(ChunkRef));
+    auto* data = reinterpret_cast<unsigned char*>(chunks.data());
+    size_t position = 0;
+    while(position < size)
+    {
+        const auto read = pread64(fd, data + position, size - position, static_cast<int64_t>(position));
+        if(read <= 0)
+        {
+            LOG_ERROR("Reading file manifest failed: %s", strerror(errno));
+            return false;
+        }
+        position += static_cast<size_t>(read);
+    }
+    return true;
+}
+
+// Replaces the manifest with a single rename
+bool WriteManifest(const int dirfd, const uint32_t fileID, const std::vector<ChunkRef>& chunks)
+{
+    FixedString<MAX_DIGITS> tempName{fileID, "M"};
+    const int file = openat(dirfd, tempName.c_str(), O_CREAT | O_TRUNC | O_WRONLY, TPUNKT_INSTANCE_FILE_MODE);
+    if(file == -1)
+    {
+        LOG_ERROR("Creating file manifest failed: %s", strerror(errno));
+        return false;
+    }
+
+    const auto* data = reinterpret_cast<const unsigned char*>(chunks.data());
+    bool success = WriteAt(file, data, chunks.size() * sizeof(ChunkRef), 0);
+    success = close(file) == 0 && success;
+
+    FixedString<MAX_DIGITS> name{fileID};
+    if(success && renameat(dirfd, tempName.c_str(), dirfd, name.c_str()) == -1)
+    {
+        LOG_ERROR("Renaming file manifest failed: %s", strerror(errno));
+        success = false;
+    }
+    if(!success)
+    {
+        (void)unlinkat(dirfd, tempName.c_str(), 0);
+    }
+    return success;
+}
+} // namespace
+
+double DedupStats::getRatio() const
+{
+    if(storedBytes == 0)
+    {
+        return 1.0;
+    }
+    return static_cast<double>(logicalBytes) / static_cast<double>(storedBytes);
+}
+
+DedupFileSystemDatastore::DedupFileSystemDatastore(const EndpointID endpoint, const CipherKey& key)
+    : DataStore(endpoint), key(key), dirfd(open(dir.c_str(), O_RDONLY | O_DIRECTORY)), chunkdirfd(-1)
+{
+    if(dirfd == -1)
+    {
+        LOG_ERROR("Opening Datastore base directory failed: %s", strerror(errno));
+        return;
+    }
+
+    if(mkdirat(dirfd, CHUNK_DIR, TPUNKT_INSTANCE_FILE_MODE) == -1 && errno != EEXIST)
+    {
+        LOG_ERROR("Creating chunk directory failed: %s", strerror(errno));
+    }
+    chunkdirfd = openat(dirfd, CHUNK_DIR, O_RDONLY | O_DIRECTORY);
+    if(chunkdirfd == -1)
+    {
+        LOG_ERROR("Opening chunk directory failed: %s", strerror(errno));
+        return;
+    }
+
+    for(size_t i = 0; i < CHUNK_SUBDIRS; ++i)
+    {
+        FixedString<4> subdir;
+        (void)snprintf(subdir.data(), subdir.capacity(), "%02x", static_cast<unsigned>(i));
+        if(mkdirat(chunkdirfd, subdir.c_str(), TPUNKT_INSTANCE_FILE_MODE) == -1 && errno != EEXIST)
+        {
+            LOG_ERROR("Creating chunk directory failed: %s", strerror(errno));
+        }
+    }
+
+    loadIndex();
+}
+
+DedupFileSystemDatastore::~DedupFileSystemDatastore()
+{
+    // Use counts are rebuilt at startup - leftover temp files are removed there
+    for(auto& [ fileID, writer ] : writers)
+    {
+        delete writer;
+    }
+    writers.clear();
+
+    for(Reader& reader : readers)
+    {
+        if(reader.chunkfd != -1)
+        {
+            (void)close(reader.chunkfd);
+            reader.chunkfd = -1;
+        }
+    }
+
+    if(chunkdirfd != -1)
+    {
+        close(chunkdirfd);
+        chunkdirfd = -1;
+    }
+    if(dirfd != -1)
+    {
+        close(dirfd);
+        dirfd = -1;
+    }
+}
+
+void DedupFileSystemDatastore::setGarbageRequest(const std::function<void()>& request)
+{
+    bool shouldRequest = false;
+    {
+        std::lock_guard guard{indexLock};
+        garbageRequest = request;
+        shouldRequest = requestGarbage(); // Unused chunks found at startup
+    }
+    if(shouldRequest)
+    {
+        garbageRequest();
+    }
+}
+
+void DedupFileSystemDatastore::collectGarbage()
+{
+    bool shouldRequest = false;
+    size_t removed = 0;
+    DedupStats current;
+    {
+        std::lock_guard guard{indexLock};
+        garbageRequested = false;
+
+        uint64_t oldestReader = UINT64_MAX;
+        for(const uint64_t readerSequence : readerSequences)
+        {
+            if(readerSequence != 0)
+            {
+                oldestReader = std::min(oldestReader, readerSequence);
+            }
+        }
+
+        size_t i = 0;
+        for(; i < unused.size() && removed < TPUNKT_STORAGE_DEDUP_GC_BATCH; ++i)
+        {
+            // A reader started before might still use it - requested again once the reader is closed
+            if(unused[ i ].sequence > oldestReader)
+            {
+                break;
+            }
+
+            const auto it = index.find(unused[ i ].hash);
+            if(it == index.end() || it->second.uses != 0) // Used again or already removed
+            {
+                continue;
+            }
+
+            // Removed while holding the lock - a writer storing the same chunk again would lose it otherwise
+            ChunkName name;
+            GetChunkName(it->first, name);
+            if(unlinkat(chunkdirfd, name.c_str(), 0) == -1 && errno != ENOENT)
+            {
+                LOG_WARNING("Removing unused chunk failed: %s", strerror(errno));
+            }
+            stats.storedBytes -= it->second.size;
+            --stats.chunks;
+            index.erase(it);
+            ++removed;
+        }
+        unused.erase(unused.begin(), unused.begin() + static_cast<std::ptrdiff_t>(i));
+
+        if(removed == TPUNKT_STORAGE_DEDUP_GC_BATCH)
+        {
+            shouldRequest = requestGarbage();
+        }
+        current = stats;
+    }
+
+    if(shouldRequest)
+    {
+        garbageRequest();
+    }
+    LOG_INFO("Removed %zu unused chunks - %llu chunks with %llu bytes stored - dedup ratio %.2f", removed,
+             static_cast<unsigned long long>(current.chunks), static_cast<unsigned long long>(current.storedBytes),
+             current.getRatio());
+}
+
+DedupStats DedupFileSystemDatastore::getStats()
+{
+    std::lock_guard guard{indexLock};
+    return stats;
+}
+
+bool DedupFileSystemDatastore::createFile(const uint32_t fileID, ResultCb callback)
+{
+    FixedString<MAX_DIGITS> name{fileID};
+    const int file = openat(dirfd, name.c_str(), O_CREAT | O_EXCL | O_WRONLY, TPUNKT_INSTANCE_FILE_MODE);
+    if(file == -1) [[unlikely]]
+    {
+        LOG_ERROR("Creating file failed: %s", strerror(errno));
+        RET_AND_CB_FALSE();
+    }
+
+    if(close(file) == -1) [[unlikely]]
+    {
+        RET_AND_CB_FALSE();
+    }
+
+    callback(true);
+    return true;
+}
+
+bool DedupFileSystemDatastore::deleteFile(const uint32_t fileID, ResultCb callback)
+{
+    FixedString<MAX_DIGITS> name{fileID};
+    const int file = openat(dirfd, name.c_str(), O_RDONLY);
+    if(file == -1)
+    {
+        if(errno == ENOENT) // Never written - nothing to delete
+        {
+            callback(true);
+            return true;
+        }
+        LOG_ERROR("Opening file failed: %s", strerror(errno));
+        RET_AND_CB_FALSE();
+    }
+
+    std::vector<ChunkRef> chunks;
+    const bool isRead = ReadManifest(file, chunks);
+    (void)close(file);
+    if(unlinkat(dirfd, name.c_str(), 0) == -1) [[unlikely]]
+    {
+        LOG_ERROR("Deleting file failed: %s", strerror(errno));
+        RET_AND_CB_FALSE();
+    }
+
+    if(isRead)
+    {
+        releaseChunks(chunks);
+    }
+    callback(true);
+    return true;
+}
+
+//===== Read =====//
+
+bool DedupFileSystemDatastore::initRead(const uint32_t fileID, const size_t begin, const size_t end,
+                                        ReadHandle& handle)
+{
+    if(end != 0 && begin >= end)
+    {
+        LOG_WARNING("Invalid read request");
+        return false;
+    }
+
+    handle.buffer = UINT8_MAX;
+    for(uint8_t i = 0; i < TPUNKT_STORAGE_DATASTORE_MAX_READERS; ++i)
+    {
+        if(buffers[ i ].lock())
+        {
+            handle.buffer = i;
+            break;
+        }
+    }
+
+    if(handle.buffer == UINT8_MAX)
+    {
+        return false;
+    }
+
+    // Registered before the manifest is opened - chunks released by a commit in between stay until closed
+    {
+        std::lock_guard guard{indexLock};
+        readerSequences[ handle.buffer ] = sequence++;
+    }
+
+    FixedString<MAX_DIGITS> name{fileID};
+    Reader& reader = readers[ handle.buffer ];
+    const int file = openat(dirfd, name.c_str(), O_RDONLY);
+    if(file == -1 || !ReadManifest(file, reader.chunks)) [[unlikely]]
+    {
+        if(file == -1)
+        {
+            LOG_ERROR("Opening file failed: %s", strerror(errno));
+        }
+        else
+        {
+            (void)close(file);
+        }
+        bool shouldRequest = false;
+        {
+            std::lock_guard guard{indexLock};
+            readerSequences[ handle.buffer ] = 0;
+            shouldRequest = requestGarbage();
+        }
+        buffers[ handle.buffer ].unlock();
+        handle.buffer = UINT8_MAX;
+        if(shouldRequest)
+        {
+            garbageRequest();
+        }
+        return false;
+    }
+
+    uint64_t size = 0;
+    reader.offsets.resize(reader.chunks.size());
+    for(size_t i = 0; i < reader.chunks.size(); ++i)
+    {
+        reader.offsets[ i ] = size;
+        size += reader.chunks[ i ].size;
+    }
+
+    handle.end = end == 0 ? size : end;
+    handle.position = begin;
+    handle.fd = file;
+    handle.fileID = fileID;
+    return true;
+}
+
+bool DedupFileSystemDatastore::readFile(ReadHandle& handle, const size_t chunkSize, ReadCb callback)
+{
+    if(!handle.isValid())
+    {
+        LOG_ERROR("Passed invalid handle");
+        RET_AND_READ_CB_FALSE();
+    }
+
+    if(handle.isDone())
+    {
+        LOG_WARNING("Passed finished handle");
+        RET_AND_READ_CB_FALSE();
+    }
+
+    auto& buffer = buffers[ handle.buffer ].getBuf();
+    buffer.ensure(chunkSize);
+    Reader& reader = readers[ handle.buffer ];
+
+    // Fills the buffer from as many chunks as needed
+    const auto request = std::min(chunkSize, handle.end - handle.position);
+    size_t filled = 0;
+    while(filled < request)
+    {
+        const auto next = std::ranges::upper_bound(reader.offsets, handle.position);
+        const auto chunk = static_cast<size_t>(next - reader.offsets.begin()) - 1;
+        if(next == reader.offsets.begin() || handle.position - reader.offsets[ chunk ] >= reader.chunks[ chunk ].size)
+        {
+            break; // After the end of the file
+        }
+
+        if(reader.current != chunk)
+        {
+            if(reader.chunkfd != -1)
+            {
+                (void)close(reader.chunkfd);
+            }
+            ChunkName name;
+            GetChunkName(reader.chunks[ chunk ].hash, name);
+            reader.chunkfd = openat(chunkdirfd, name.c_str(), O_RDONLY);
+            reader.current = chunk;
+            if(reader.chunkfd == -1)
+            {
+                LOG_ERROR("Opening chunk failed: %s", strerror(errno));
+                RET_AND_READ_CB_FALSE();
+            }
+        }
+
+        const size_t inChunk = handle.position - reader.offsets[ chunk ];
+        const size_t length = std::min(request - filled, reader.chunks[ chunk ].size - inChunk);
+        const auto read = pread64(reader.chunkfd, buffer.data() + filled, length, static_cast<int64_t>(inChunk));
+        if(read <= 0)
+        {
+            LOG_ERROR("Reading chunk failed: %s", read == 0 ? "Chunk too short" : strerror(errno));
+            RET_AND_READ_CB_FALSE();
+        }
+        filled += static_cast<size_t>(read);
+        handle.position += static_cast<size_t>(read);
+    }
+
+    const bool isLast = filled == 0 || handle.position >= handle.end;
+    if(isLast)
+    {
+        handle.position = SIZE_MAX;
+    }
+
+    callback(buffer.data(), filled, true, isLast);
+    return true;
+}
+
+bool DedupFileSystemDatastore::closeRead(ReadHandle& handle, ResultCb callback)
+{
+    if(!handle.isValid())
+    {
+        RET_AND_CB_FALSE(); // We dont touch as its invalid
+    }
+
+    if(!handle.isDone())
+    {
+        LOG_WARNING("Closing Read prematurely");
+    }
+
+    bool success = true;
+    Reader& reader = readers[ handle.buffer ];
+    if(reader.chunkfd != -1)
+    {
+        (void)close(reader.chunkfd);
+        reader.chunkfd = -1;
+    }
+    reader.current = SIZE_MAX;
+    reader.chunks.clear();
+    reader.offsets.clear();
+
+    if(close(handle.fd) == -1)
+    {
+        LOG_ERROR("Failed to close file: %s", strerror(errno));
+        success = false;
+    }
+    handle.fd = -1;
+
+    bool shouldRequest = false;
+    {
+        std::lock_guard guard{indexLock};
+        readerSequences[ handle.buffer ] = 0;
+        shouldRequest = requestGarbage(); // Chunks might have waited for this reader
+    }
+    buffers[ handle.buffer ].unlock();
+
+    if(shouldRequest)
+    {
+        garbageRequest();
+    }
+    callback(success);
+    return success;
+}
+
+//===== Write =====//
+
+bool DedupFileSystemDatastore::initWrite(const uint32_t fileID, WriteHandle& handle)
+{
+    // Added first - the temp file of a running write is not truncated
+    auto* writer = new DedupWriter{};
+    writer->fileID = fileID;
+    bool isAdded = false;
+    {
+        SpinlockGuard guard{writersLock};
+        isAdded = writers.emplace(fileID, writer).second;
+    }
+    if(!isAdded)
+    {
+        LOG_WARNING("File is already written");
+        delete writer;
+        return false;
+    }
+
+    FixedString<MAX_DIGITS> targetName{fileID};
+    const int target = openat(dirfd, targetName.c_str(), O_RDONLY);
+    int tempFile = -1;
+    if(target == -1) [[unlikely]]
+    {
+        LOG_ERROR("Opening target file failed: %s", strerror(errno));
+    }
+    else
+    {
+        // Only used if writes come out of order
+        FixedString<MAX_DIGITS> tempName{fileID, "T"};
+        tempFile = openat(dirfd, tempName.c_str(), O_CREAT | O_TRUNC | O_RDWR, TPUNKT_INSTANCE_FILE_MODE);
+        if(tempFile == -1) [[unlikely]]
+        {
+            LOG_ERROR("Opening temp file failed: %s", strerror(errno));
+            (void)close(target);
+        }
+    }
+
+    if(tempFile == -1)
+    {
+        SpinlockGuard guard{writersLock};
+        writers.erase(fileID);
+        delete writer;
+        return false;
+    }
+
+    handle.buffer = 0; // Not needed
+    handle.tempPosition = 0;
+    handle.targetfd = target;
+    handle.tempfd = tempFile;
+    handle.fileID = fileID;
+    return true;
+}
+
+bool DedupFileSystemDatastore::writeFile(WriteHandle& handle, const bool isLast, const unsigned char* data,
+                                         const size_t size, ResultCb callback)
+{
+    if(!handle.isValid())
+    {
+        RET_AND_CB_FALSE(); // We dont touch as its invalid
+    }
+
+    if(handle.isDone())
+    {
+        LOG_WARNING("Passed finished handle");
+        RET_AND_CB_FALSE();
+    }
+
+    DedupWriter* writer = nullptr;
+    {
+        SpinlockGuard guard{writersLock};
+        const auto it = writers.find(handle.fileID);
+        if(it != writers.end())
+        {
+            writer = it->second;
+        }
+    }
+    if(writer == nullptr)
+    {
+        RET_AND_CB_FALSE();
+    }
+
+    const uint64_t offset = handle.tempPosition;
+    bool success = true;
+    bool isSpooled = false;
+    {
+        std::lock_guard guard{writer->lock};
+        const uint64_t streamEnd = writer->chunkedEnd + writer->pending.size();
+        if(offset < (writer->isSpooled ? writer->chunkedEnd : streamEnd)) // Retried - the data after is written again
+        {
+            writer->hasFailed = false;
+        }
+
+        if(writer->hasFailed)
+        {
+            success = false;
+        }
+        else if(!writer->isSpooled && offset == streamEnd)
+        {
+            writer->pending.insert(writer->pending.end(), data, data + size);
+            success = storePending(*writer, false);
+            writer->hasFailed = !success;
+        }
+        else
+        {
+            // First write out of order - the data after the chunks goes into the temp file
+            if(!writer->isSpooled)
+            {
+                success = WriteAt(handle.tempfd, writer->pending.data(), writer->pending.size(), writer->chunkedEnd);
+                if(success)
+                {
+                    writer->spoolEnd = streamEnd;
+                    writer->pending.clear();
+                    writer->isSpooled = true;
+                }
+            }
+            // Stored chunks after the offset are overwritten - they move back into the temp file
+            if(success && offset < writer->chunkedEnd)
+            {
+                success = spoolChunks(*writer, handle.tempfd, offset);
+            }
+        }
+
+        isSpooled = writer->isSpooled;
+        if(success && isSpooled)
+        {
+            writer->spoolEnd = std::max(writer->spoolEnd, offset + size);
+        }
+    }
+
+    // Parts write at their own offset - without blocking each other - failed ones are written again by the retry
+    if(success && isSpooled && !WriteAt(handle.tempfd, data, size, offset))
+    {
+        success = false;
+    }
+    if(!success)
+    {
+        RET_AND_CB_FALSE();
+    }
+
+    handle.tempPosition += size;
+    if(isLast)
+    {
+        handle.done = true;
+    }
+
+    callback(true);
+    return true;
+}
+
+bool DedupFileSystemDatastore::closeWrite(WriteHandle& handle, const bool revert, ResultCb callback)
+{
+    if(!handle.isValid())
+    {
+        RET_AND_CB_FALSE(); // We dont touch as its invalid
+    }
+
+    if(!handle.isDone())
+    {
+        LOG_WARNING("Closing unfinished Write");
+    }
+
+    DedupWriter* writer = nullptr;
+    {
+        SpinlockGuard guard{writersLock};
+        const auto it = writers.find(handle.fileID);
+        if(it != writers.end())
+        {
+            writer = it->second;
+            writers.erase(it);
+        }
+    }
+
+    bool success = writer != nullptr;
+    if(writer != nullptr && !revert)
+    {
+        success = !writer->hasFailed && (writer->isSpooled ? storeSpooled(*writer, handle.tempfd)
+                                                           : storePending(*writer, true));
+
+        // Uses of the new chunks move to the manifest - the previous content loses its uses
+        std::vector<ChunkRef> previous;
+        success = success && ReadManifest(handle.targetfd, previous) &&
+                  WriteManifest(dirfd, handle.fileID, writer->chunks);
+        if(success)
+        {
+            releaseChunks(previous);
+        }
+    }
+    if(writer != nullptr && (revert || !success))
+    {
+        releaseChunks(writer->chunks);
+    }
+    delete writer;
+
+    FixedString<MAX_DIGITS> tempName{handle.fileID, "T"};
+    if(unlinkat(dirfd, tempName.c_str(), 0) == -1)
+    {
+        LOG_ERROR("Deleting temp file failed: %s", strerror(errno));
+        success = false;
+    }
+
+    if(close(handle.targetfd) == -1)
+    {
+        LOG_ERROR("Failed to close target file descriptor: %s", strerror(errno));
+        success = false;
+    }
+    handle.targetfd = -1;
+
+    if(close(handle.tempfd) == -1)
+    {
+        LOG_ERROR("Failed to close temp file descriptor: %s", strerror(errno));
+        success = false;
+    }
+    handle.tempfd = -1;
+
+    callback(success);
+    return success;
+}
+
+bool DedupFileSystemDatastore::storeChunk(DedupWriter& writer, const unsigned char* data, const uint32_t size,
+                                          ChunkRef& ref)
+{
+    crypto_generichash(ref.hash.data(), ref.hash.size(), data, size, key.udata(), key.capacity());
+    ref.size = size;
+    {
+        std::lock_guard guard{indexLock};
+        stats.receivedBytes += size;
+        const auto it = index.find(ref.hash);
+        if(it != index.end())
+        {
+            ++it->second.uses;
+            stats.logicalBytes += size;
+            return true;
+        }
+    }
+
+    // Written without blocking the index - only the rename needs it
+    ChunkName tempName;
+    GetChunkName(ref.hash, tempName, writer.fileID);
+    const int file = openat(chunkdirfd, tempName.c_str(), O_CREAT | O_TRUNC | O_WRONLY, TPUNKT_INSTANCE_FILE_MODE);
+    if(file == -1)
+    {
+        LOG_ERROR("Creating chunk failed: %s", strerror(errno));
+        return false;
+    }
+    bool success = WriteAt(file, data, size, 0);
+    success = close(file) == 0 && success;
+
+    if(success)
+    {
+        std::lock_guard guard{indexLock};
+        const auto [ it, isNew ] = index.try_emplace(ref.hash, ChunkInfo{.uses = 0, .size = size});
+        if(!isNew) // Stored by another writer in between
+        {
+            ++it->second.uses;
+            stats.logicalBytes += size;
+        }
+        else
+        {
+            ChunkName name;
+            GetChunkName(ref.hash, name);
+            if(renameat(chunkdirfd, tempName.c_str(), chunkdirfd, name.c_str()) == -1)
+            {
+                LOG_ERROR("Renaming chunk failed: %s", strerror(errno));
+                index.erase(it);
+                success = false;
+            }
+            else
+            {
+                it->second.uses = 1;
+                stats.logicalBytes += size;
+                stats.storedBytes += size;
+                stats.writtenBytes += size;
+                ++stats.chunks;
+                return true;
+            }
+        }
+    }
+
+    (void)unlinkat(chunkdirfd, tempName.c_str(), 0);
+    return success;
+}
+
+bool DedupFileSystemDatastore::storePending(DedupWriter& writer, const bool isFinal)
+{
+    size_t consumed = 0;
+    bool success = true;
+    while(success)
+    {
+        const size_t left = writer.pending.size() - consumed;
+        if(left == 0 || (!isFinal && left < TPUNKT_STORAGE_DEDUP_CHUNK_MAX))
+        {
+            break;
+        }
+
+        const size_t size = FindChunkBoundary(writer.pending.data() + consumed, left);
+        ChunkRef ref;
+        success = storeChunk(writer, writer.pending.data() + consumed, static_cast<uint32_t>(size), ref);
+        if(success)
+        {
+            writer.chunks.push_back(ref);
+            writer.chunkedEnd += size;
+            consumed += size;
+        }
+    }
+
+    writer.pending.erase(writer.pending.begin(), writer.pending.begin() + static_cast<std::ptrdiff_t>(consumed));
+    return success;
+}
+
+bool DedupFileSystemDatastore::spoolChunks(DedupWriter& writer, const int tempfd, const uint64_t offset)
+{
+    std::vector<ChunkRef> spooled;
+    std::vector<unsigned char> data;
+    bool success = true;
+    while(success && writer.chunkedEnd > offset)
+    {
+        const ChunkRef ref = writer.chunks.back();
+        const uint64_t begin = writer.chunkedEnd - ref.size;
+
+        // Still used by the writer - can't be removed while read
+        ChunkName name;
+        GetChunkName(ref.hash, name);
+        const int file = openat(chunkdirfd, name.c_str(), O_RDONLY);
+        if(file == -1)
+        {
+            LOG_ERROR("Opening chunk failed: %s", strerror(errno));
+            success = false;
+            break;
+        }
+        data.resize(ref.size);
+        success = ReadAt(file, data.data(), data.size(), 0) && WriteAt(tempfd, data.data(), data.size(), begin);
+        (void)close(file);
+
+        if(success)
+        {
+            writer.chunks.pop_back();
+            writer.chunkedEnd = begin;
+            spooled.push_back(ref);
+        }
+    }
+
+    releaseChunks(spooled);
+    return success;
+}
+
+bool DedupFileSystemDatastore::storeSpooled(DedupWriter& writer, const int tempfd)
+{
+    // Read back in order - chunks after the stored ones are found like with sequential writes
+    constexpr size_t readSize = TPUNKT_STORAGE_DEDUP_CHUNK_MAX * 4;
+    uint64_t position = writer.chunkedEnd;
+    while(position < writer.spoolEnd)
+    {
+        const size_t begin = writer.pending.size();
+        const auto request = static_cast<size_t>(std::min<uint64_t>(readSize, writer.spoolEnd - position));
+        writer.pending.resize(begin + request);
+        if(!ReadAt(tempfd, writer.pending.data() + begin, request, position))
+        {
+            return false;
+        }
+        position += request;
+
+        if(!storePending(writer, false))
+        {
+            return false;
+        }
+    }
+    return storePending(writer, true);
+}
+
+void DedupFileSystemDatastore::releaseChunks(const std::vector<ChunkRef>& chunks)
+{
+    bool shouldRequest = false;
+    {
+        std::lock_guard guard{indexLock};
+        const uint64_t releaseSequence = sequence++;
+        for(const ChunkRef& ref : chunks)
+        {
+            const auto it = index.find(ref.hash);
+            if(it == index.end() || it->second.uses == 0)
+            {
+                continue;
+            }
+
+            stats.logicalBytes -= ref.size;
+            if(--it->second.uses == 0)
+            {
+                unused.push_back(UnusedChunk{.hash = ref.hash, .sequence = releaseSequence});
+            }
+        }
+        shouldRequest = requestGarbage();
+    }
+
+    if(shouldRequest)
+    {
+        garbageRequest();
+    }
+}
+
+bool DedupFileSystemDatastore::requestGarbage()
+{
+    if(garbageRequested || unused.empty() || !garbageRequest)
+    {
+        return false;
+    }
+    garbageRequested = true;
+    return true;
+}
+
+void DedupFileSystemDatastore::loadIndex()
+{
+    for(size_t i = 0; i < CHUNK_SUBDIRS; ++i)
+    {
+        FixedString<4> subdirName;
+        (void)snprintf(subdirName.data(), subdirName.capacity(), "%02x", static_cast<unsigned>(i));
+        const int subdirfd = openat(chunkdirfd, subdirName.c_str(), O_RDONLY | O_DIRECTORY);
+        DIR* subdir = subdirfd == -1 ? nullptr : fdopendir(subdirfd);
+        if(subdir == nullptr)
+        {
+            LOG_ERROR("Opening chunk directory failed: %s", strerror(errno));
+            if(subdirfd != -1)
+            {
+                (void)close(subdirfd);
+            }
+            continue;
+        }
+
+        while(const dirent* entry = readdir(subdir))
+        {
+            const std::string_view name{entry->d_name};
+            if(name.find('.') != std::string_view::npos)
+            {
+                if(name.size() > sizeof(ChunkHash) * 2) // Temp chunk of an interrupted write
+                {
+                    (void)unlinkat(subdirfd, entry->d_name, 0);
+                }
+                continue;
+            }
+
+            ChunkHash hash{};
+            size_t length = 0;
+            struct stat chunkStat{};
+            if(sodium_hex2bin(hash.data(), hash.size(), name.data(), name.size(), nullptr, &length, nullptr) != 0 ||
+               length != hash.size() || fstatat(subdirfd, entry->d_name, &chunkStat, 0) == -1)
+            {
+                continue;
+            }
+
+            const auto size = static_cast<uint32_t>(chunkStat.st_size);
+            index.emplace(hash, ChunkInfo{.uses = 0, .size = size});
+            stats.storedBytes += size;
+            ++stats.chunks;
+        }
+        (void)closedir(subdir);
+    }
+
+    const int datafd = openat(dirfd, ".", O_RDONLY | O_DIRECTORY);
+    DIR* dataDir = datafd == -1 ? nullptr : fdopendir(datafd);
+    if(dataDir == nullptr)
+    {
+        LOG_ERROR("Opening datastore directory failed: %s", strerror(errno));
+        if(datafd != -1)
+        {
+            (void)close(datafd);
+        }
+        return;
+    }
+
+    size_t missing = 0;
+    std::vector<ChunkRef> chunks;
+    while(const dirent* entry = readdir(dataDir))
+    {
+        const std::string_view name{entry->d_name};
+        if(!IsNumber(name))
+        {
+            const bool isTemp = name.ends_with('T') || name.ends_with('M');
+            if(isTemp && IsNumber(name.substr(0, name.size() - 1))) // Interrupted write
+            {
+                (void)unlinkat(dirfd, entry->d_name, 0);
+            }
+            continue;
+        }
+
+        const int file = openat(dirfd, entry->d_name, O_RDONLY);
+        if(file == -1 || !ReadManifest(file, chunks))
+        {
+            LOG_ERROR("Reading manifest of file %s failed", entry->d_name);
+            if(file != -1)
+            {
+                (void)close(file);
+            }
+            continue;
+        }
+        (void)close(file);
+
+        for(const ChunkRef& ref : chunks)
+        {
+            const auto it = index.find(ref.hash);
+            if(it == index.end())
+            {
+                ++missing;
+                continue;
+            }
+            ++it->second.uses;
+            stats.logicalBytes += ref.size;
+        }
+    }
+    (void)closedir(dataDir);
+
+    if(missing != 0)
+    {
+        LOG_ERROR("%zu chunks of stored files are missing", missing);
+    }
+
+    for(const auto& [ hash, info ] : index)
+    {
+        if(info.uses == 0)
+        {
+            unused.push_back(UnusedChunk{.hash = hash, .sequence = 0});
+        }
+    }
+}
+
+} // namespace tpunkt
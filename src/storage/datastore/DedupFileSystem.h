@@ -0,0 +1,156 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TPUNKT_DEDUP_FILESYSTEM_DATASTORE_H
+#define TPUNKT_DEDUP_FILESYSTEM_DATASTORE_H
+
+#include <array>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <ankerl/unordered_dense.h>
+#include "datastructures/Spinlock.h"
+#include "storage/datastore/DataStore.h"
+
+namespace tpunkt
+{
+
+struct DedupWriter;
+
+// Keyed hash of the content of a chunk - its name on disk
+using ChunkHash = std::array<unsigned char, 32>;
+
+// Hashes are already avalanching
+struct ChunkHashHash final
+{
+    using is_avalanching = void;
+
+    [[nodiscard]] uint64_t operator()(const ChunkHash& hash) const noexcept
+    {
+        uint64_t value = 0;
+        std::memcpy(&value, hash.data(), sizeof(value));
+        return value;
+    }
+};
+
+// Entry of a file manifest - the file is its chunks in order
+struct ChunkRef final
+{
+    ChunkHash hash{};
+    uint32_t size = 0;
+};
+static_assert(sizeof(ChunkRef) == 36); // Written as is
+
+struct DedupStats final
+{
+    uint64_t logicalBytes = 0;  // Size of all files - chunks are counted for every use
+    uint64_t storedBytes = 0;   // Size of all unique chunks on disk
+    uint64_t chunks = 0;        // Unique chunks on disk
+    uint64_t receivedBytes = 0; // Written to files since startup
+    uint64_t writtenBytes = 0;  // Written to new chunks since startup - the rest was already stored
+
+    // Logical size per stored byte
+    [[nodiscard]] double getRatio() const;
+};
+
+// Stores each unique chunk of content once - files are a manifest of their chunks
+// Notes:
+//      - Files are cut into content defined chunks (see FindChunkBoundary()) - named by their keyed hash
+//      - Chunks count their uses by manifests and open writes - unused ones are removed by collectGarbage()
+//      - Writes at the end of the data are chunked right away - only chunks not stored yet are written
+//      - Writes out of order (parallel parts) go into the temp file - it's chunked when committed
+//      - Retried writes before the end go into the temp file too - stored chunks after them are moved back into it
+//      - Committing replaces the manifest with a single rename
+//      - Use counts are rebuilt from the manifests at startup
+//      - Only encrypted data that is the same for the same content deduplicates
+struct DedupFileSystemDatastore final : DataStore
+{
+    DedupFileSystemDatastore(EndpointID endpoint, const CipherKey& key);
+    ~DedupFileSystemDatastore() override;
+
+    // Called when unused chunks can be removed - should run collectGarbage() as background task
+    void setGarbageRequest(const std::function<void()>& request);
+
+    // Removes a batch of unused chunks no reader can still use - requests itself again if more are left
+    void collectGarbage();
+
+    [[nodiscard]] DedupStats getStats();
+
+    bool createFile(uint32_t fileID, ResultCb callback) override;
+
+    bool deleteFile(uint32_t fileID, ResultCb callback) override;
+
+    //===== Read =====//
+
+    bool initRead(uint32_t fileID, size_t begin, size_t end, ReadHandle& handle) override;
+
+    bool readFile(ReadHandle& handle, size_t chunkSize, ReadCb callback) override;
+
+    bool closeRead(ReadHandle& handle, ResultCb callback) override;
+
+    //===== Write =====//
+
+    bool initWrite(uint32_t fileID, WriteHandle& handle) override;
+
+    bool writeFile(WriteHandle& handle, bool isLast, const unsigned char* data, size_t size, ResultCb clb) override;
+
+    bool closeWrite(WriteHandle& handle, bool revert, ResultCb callback) override;
+
+  private:
+    struct ChunkInfo final
+    {
+        uint32_t uses = 0;
+        uint32_t size = 0;
+    };
+
+    // Chunk that became unused - removed once all readers started before are closed
+    struct UnusedChunk final
+    {
+        ChunkHash hash{};
+        uint64_t sequence = 0;
+    };
+
+    struct Reader final
+    {
+        std::vector<ChunkRef> chunks;
+        std::vector<uint64_t> offsets; // Start of each chunk in the file
+        size_t current = SIZE_MAX;     // Chunk of the open file descriptor
+        int chunkfd = -1;
+    };
+
+    // Stores the chunk if it's new - counts a use of it
+    bool storeChunk(DedupWriter& writer, const unsigned char* data, uint32_t size, ChunkRef& ref);
+    // Cuts the pending data of the writer into chunks - the rest is cut too if final
+    bool storePending(DedupWriter& writer, bool isFinal);
+    // Moves the chunks after the offset back into the temp file - needs the writer to be spooled
+    bool spoolChunks(DedupWriter& writer, int tempfd, uint64_t offset);
+    // Chunks the data the writer put into its temp file
+    bool storeSpooled(DedupWriter& writer, int tempfd);
+    // Removes a use of each chunk
+    void releaseChunks(const std::vector<ChunkRef>& chunks);
+    // Needs the index lock - returns true if the request has to be called
+    bool requestGarbage();
+    // Counts the chunks on disk and the uses by manifests
+    void loadIndex();
+
+    ankerl::unordered_dense::map<ChunkHash, ChunkInfo, ChunkHashHash> index; // Guarded by the index lock
+    std::vector<UnusedChunk> unused;                                         // Oldest first
+    DedupStats stats;
+    uint64_t sequence = 1;                                                   // Orders releases and reader starts
+    uint64_t readerSequences[ TPUNKT_STORAGE_DATASTORE_MAX_READERS ]{};      // Zero if the reader is not used
+    bool garbageRequested = false;
+    std::mutex indexLock; // Chunks are renamed and removed while holding it
+
+    ankerl::unordered_dense::map<uint32_t, DedupWriter*> writers; // Open writes by file
+    Spinlock writersLock;
+
+    Reader readers[ TPUNKT_STORAGE_DATASTORE_MAX_READERS ]; // Same slot as the buffer of the handle
+    std::function<void()> garbageRequest;
+    CipherKey key;
+    int dirfd;      // Directory file descriptor - manifests and temp files
+    int chunkdirfd; // Chunks are in subdirectories by their first byte
+};
+
+} // namespace tpunkt
+
+#endif // TPUNKT_DEDUP_FILESYSTEM_DATASTORE_H
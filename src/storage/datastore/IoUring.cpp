@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "storage/datastore/IoUring.h"
+#include "util/Logging.h"
+
+namespace tpunkt
+{
+
+namespace
+{
+int Setup(const uint32_t entries, io_uring_params& params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+}
+
+int Enter(const int fd, const uint32_t toSubmit, const uint32_t minComplete, const uint32_t flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int Register(const int fd, const uint32_t opcode, const void* arg, const uint32_t count)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+template <typename T>
+T* RingField(void* ring, const uint32_t offset)
+{
+    return reinterpret_cast<T*>(static_cast<unsigned char*>(ring) + offset);
+}
+} // namespace
+
+IoUring::~IoUring()
+{
+    if(sqes != nullptr)
+    {
+        munmap(sqes, sqesSize);
+    }
+    if(ringPtr != nullptr)
+    {
+        munmap(ringPtr, ringSize);
+    }
+    if(ringfd != -1)
+    {
+        close(ringfd);
+    }
+}
+
+bool IoUring::init(const uint32_t requested)
+{
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = requested * 2;
+
+    ringfd = Setup(requested, params);
+    if(ringfd == -1)
+    {
+        LOG_WARNING("Creating io_uring failed: %s", strerror(errno));
+        return false;
+    }
+
+    // Needed to have the submission and completion ring in a single mapping (5.4)
+    if((params.features & IORING_FEAT_SINGLE_MMAP) == 0 || (params.features & IORING_FEAT_NODROP) == 0)
+    {
+        LOG_WARNING("io_uring of the kernel is too old");
+        close(ringfd);
+        ringfd = -1;
+        return false;
+    }
+
+    entries = params.sq_entries;
+    const size_t sqSize = params.sq_off.array + (params.sq_entries * sizeof(uint32_t));
+    const size_t cqSize = params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe));
+    ringSize = std::max(sqSize, cqSize);
+    ringPtr = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQ_RING);
+    if(ringPtr == MAP_FAILED)
+    {
+        LOG_ERROR("Mapping io_uring failed: %s", strerror(errno));
+        ringPtr = nullptr;
+        return false;
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqePtr = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQES);
+    if(sqePtr == MAP_FAILED)
+    {
+        LOG_ERROR("Mapping io_uring entries failed: %s", strerror(errno));
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(sqePtr);
+
+    sqHead = RingField<uint32_t>(ringPtr, params.sq_off.head);
+    sqTail = RingField<uint32_t>(ringPtr, params.sq_off.tail);
+    sqMask = RingField<uint32_t>(ringPtr, params.sq_off.ring_mask);
+    sqArray = RingField<uint32_t>(ringPtr, params.sq_off.array);
+    cqHead = RingField<uint32_t>(ringPtr, params.cq_off.head);
+    cqTail = RingField<uint32_t>(ringPtr, params.cq_off.tail);
+    cqMask = RingField<uint32_t>(ringPtr, params.cq_off.ring_mask);
+    cqes = RingField<io_uring_cqe>(ringPtr, params.cq_off.cqes);
+
+    sqLocalTail = *sqTail;
+    return true;
+}
+
+bool IoUring::isValid() const
+{
+    return sqes != nullptr;
+}
+
+bool IoUring::registerBuffers(const iovec* vecs, const uint32_t count)
+{
+    if(Register(ringfd, IORING_REGISTER_BUFFERS, vecs, count) == -1)
+    {
+        LOG_WARNING("Registering io_uring buffers failed: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool IoUring::supportsOps(const uint8_t* ops, const uint32_t count)
+{
+    // Probe has a trailing entry for every possible opcode
+    constexpr size_t maxOps = 256;
+    alignas(io_uring_probe) unsigned char probeData[ sizeof(io_uring_probe) + (maxOps * sizeof(io_uring_probe_op)) ]{};
+    auto* probe = reinterpret_cast<io_uring_probe*>(probeData);
+    if(Register(ringfd, IORING_REGISTER_PROBE, probe, maxOps) == -1)
+    {
+        LOG_WARNING("Probing io_uring opcodes failed: %s", strerror(errno));
+        return false;
+    }
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        if(ops[ i ] > probe->last_op || (probe->ops[ ops[ i ] ].flags & IO_URING_OP_SUPPORTED) == 0)
+        {
+            LOG_WARNING("io_uring of the kernel doesn't support opcode %d", static_cast<int>(ops[ i ]));
+            return false;
+        }
+    }
+    return true;
+}
+
+io_uring_sqe* IoUring::getSqe()
+{
+    const uint32_t head = std::atomic_ref{*sqHead}.load(std::memory_order_acquire);
+    if(sqLocalTail - head >= entries)
+    {
+        return nullptr;
+    }
+
+    const uint32_t index = sqLocalTail & *sqMask;
+    sqArray[ index ] = index;
+    ++sqLocalTail;
+
+    io_uring_sqe* sqe = &sqes[ index ];
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    return sqe;
+}
+
+uint32_t IoUring::getFreeSqes() const
+{
+    return entries - (sqLocalTail - std::atomic_ref{*sqHead}.load(std::memory_order_acquire));
+}
+
+bool IoUring::submit()
+{
+    std::atomic_ref{*sqTail}.store(sqLocalTail, std::memory_order_release);
+
+    // Also covers entries a previous submit didn't get to
+    const uint32_t toSubmit = sqLocalTail - std::atomic_ref{*sqHead}.load(std::memory_order_acquire);
+    if(toSubmit == 0)
+    {
+        return true;
+    }
+
+    int ret = 0;
+    do
+    {
+        ret = Enter(ringfd, toSubmit, 0, 0);
+    } while(ret == -1 && errno == EINTR);
+
+    if(ret == -1)
+    {
+        LOG_ERROR("Submitting to io_uring failed: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool IoUring::wait()
+{
+    int ret = 0;
+    do
+    {
+        ret = Enter(ringfd, 0, 1, IORING_ENTER_GETEVENTS);
+    } while(ret == -1 && errno == EINTR);
+
+    if(ret == -1)
+    {
+        LOG_ERROR("Waiting on io_uring failed: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+} // namespace tpunkt
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TPUNKT_IO_URING_H
+#define TPUNKT_IO_URING_H
+
+#include <atomic>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include "util/Macros.h"
+
+namespace tpunkt
+{
+
+// Minimal io_uring ring on top of the raw syscalls
+// Notes:
+//      - Submissions are NOT threadsafe - must be enforced elsewhere
+//      - Completions must only be consumed by a single thread
+struct IoUring final
+{
+    IoUring() = default;
+    ~IoUring();
+
+    // Returns false if the kernel doesn't support io_uring (or it's disabled)
+    bool init(uint32_t entries);
+
+    [[nodiscard]] bool isValid() const;
+
+    // Registers buffers for fixed reads and writes - index in vecs is the buf_index of the entry
+    bool registerBuffers(const iovec* vecs, uint32_t count);
+
+    // Returns true if the kernel supports all given opcodes (IORING_OP_*)
+    bool supportsOps(const uint8_t* ops, uint32_t count);
+
+    //===== Submission =====//
+
+    // Next free entry (zeroed) - null if the queue is full
+    io_uring_sqe* getSqe();
+
+    [[nodiscard]] uint32_t getFreeSqes() const;
+
+    // Submits all queued entries in a single syscall
+    bool submit();
+
+    //===== Completion =====//
+
+    // Blocks until at least one completion is available
+    bool wait();
+
+    // Calls func for every available completion and frees them - returns the amount
+    template <typename Func>
+    uint32_t forEachCompletion(Func&& func)
+    {
+        uint32_t head = *cqHead;
+        const uint32_t tail = std::atomic_ref{*cqTail}.load(std::memory_order_acquire);
+        uint32_t count = 0;
+        for(; head != tail; ++head, ++count)
+        {
+            func(cqes[ head & *cqMask ]);
+        }
+        std::atomic_ref{*cqHead}.store(head, std::memory_order_release);
+        return count;
+    }
+
+  private:
+    int ringfd = -1;
+    uint32_t entries = 0;
+    uint32_t sqLocalTail = 0; // Entries handed out but not yet submitted are above the shared tail
+    void* ringPtr = nullptr;
+    size_t ringSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    uint32_t* sqHead = nullptr;
+    uint32_t* sqTail = nullptr;
+    uint32_t* sqMask = nullptr;
+    uint32_t* sqArray = nullptr;
+    uint32_t* cqHead = nullptr;
+    uint32_t* cqTail = nullptr;
+    uint32_t* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    TPUNKT_MACROS_STRUCT(IoUring);
+};
+
+} // namespace tpunkt
+
+#endif // TPUNKT_IO_URING_H
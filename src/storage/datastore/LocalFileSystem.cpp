@@ -62,7 +62,7 @@ bool LocalFileSystemDatastore::deleteFile(const uint32_t fileID, ResultCb callba
 {
     FixedString<MAX_DIGITS> name{fileID};
     const int ret = unlinkat(dirfd, name.c_str(), 0);
-    if(ret == -1) [[unlikely]]
+    if(ret == -1 && errno != ENOENT) [[unlikely]] // Never written - nothing to delete
     {
         LOG_ERROR("Deleting file failed: %s", strerror(errno));
         RET_AND_CB_FALSE();
@@ -0,0 +1,642 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <HttpResponse.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "datastructures/FixedString.h"
+#include "storage/datastore/UringFileSystem.h"
+#include "util/Logging.h"
+#include "util/Memory.h"
+
+static constexpr int MAX_DIGITS = 14;
+
+#define RET_AND_CB_FALSE()                                                                                             \
+    callback(false);                                                                                                   \
+    return false
+
+#define RET_AND_READ_CB_FALSE()                                                                                        \
+    callback(nullptr, 0, false, true);                                                                                 \
+    return false
+
+namespace tpunkt
+{
+
+enum class UringOperationType : uint8_t
+{
+    DELETE,
+    READ,
+    WRITE,
+    COMMIT, // Renames the temp file onto the target and closes both
+    REVERT, // Deletes the temp file and closes both
+};
+
+struct UringOperation final
+{
+    UringOperationType type{};
+    bool success = true;
+    uint8_t pending = 1;     // Entries not yet completed
+    int result = 0;          // Result of the read or write
+    uWS::Loop* loop = nullptr;
+    std::function<void(bool success)> resultCb;
+    std::function<void(const unsigned char* data, size_t size, bool success, bool isLast)> readCb;
+
+    // Read and write
+    ReadHandle* readHandle = nullptr;
+    unsigned char* buffer = nullptr;
+    uint8_t bufferIndex = UINT8_MAX;
+    size_t size = 0;
+    size_t offset = 0;
+    std::vector<unsigned char> data; // Copy of the written data
+
+    // Files
+    uint32_t fileID = 0;
+    int fd = -1;
+    int targetfd = -1;
+    FixedString<MAX_DIGITS> name;
+    FixedString<MAX_DIGITS> tempName;
+};
+
+namespace
+{
+uint8_t GetEntryCount(const UringOperation& operation)
+{
+    if(operation.type == UringOperationType::COMMIT || operation.type == UringOperationType::REVERT)
+    {
+        return 3;
+    }
+    return 1;
+}
+
+void Finish(UringOperation* operation)
+{
+    if(operation->type == UringOperationType::READ)
+    {
+        ReadHandle& handle = *operation->readHandle;
+        if(!operation->success)
+        {
+            operation->readCb(nullptr, 0, false, true);
+        }
+        else
+        {
+            const auto read = static_cast<size_t>(operation->result);
+            handle.position += read;
+
+            const bool isLast = (read == 0) || (handle.position >= handle.end);
+            if(isLast)
+            {
+                handle.position = SIZE_MAX;
+            }
+            operation->readCb(operation->buffer, read, true, isLast);
+        }
+    }
+    else if(operation->type == UringOperationType::WRITE)
+    {
+        // Failed to write as many as requested
+        operation->resultCb(operation->success && static_cast<size_t>(operation->result) == operation->size);
+    }
+    else
+    {
+        operation->resultCb(operation->success);
+    }
+    delete operation;
+}
+} // namespace
+
+UringFileSystemDatastore::UringFileSystemDatastore(const EndpointID endpoint)
+    : DataStore(endpoint), dirfd(open(dir.c_str(), O_RDONLY | O_DIRECTORY))
+{
+    if(dirfd == -1)
+    {
+        LOG_ERROR("Opening Datastore base directory failed: %s", strerror(errno));
+    }
+
+    if(!ring.init(TPUNKT_STORAGE_DATASTORE_URING_ENTRIES))
+    {
+        LOG_ERROR("Datastore can't be used without io_uring");
+        return;
+    }
+
+    // Readers each get a fixed part - registered so the kernel doesn't have to map them for every read
+    constexpr size_t readBufferSize = TPUNKT_STORAGE_DATASTORE_MAX_READERS * TPUNKT_STORAGE_DATASTORE_URING_READ_SIZE;
+    readBuffers = TPUNKT_MMAP(readBuffers, readBufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS);
+    iovec vecs[ TPUNKT_STORAGE_DATASTORE_MAX_READERS ];
+    for(size_t i = 0; i < TPUNKT_STORAGE_DATASTORE_MAX_READERS; ++i)
+    {
+        vecs[ i ].iov_base = readBuffers + (i * TPUNKT_STORAGE_DATASTORE_URING_READ_SIZE);
+        vecs[ i ].iov_len = TPUNKT_STORAGE_DATASTORE_URING_READ_SIZE;
+    }
+    hasFixedBuffers = ring.registerBuffers(vecs, TPUNKT_STORAGE_DATASTORE_MAX_READERS);
+
+    completionThread = std::thread([ this ] { completionLoop(); });
+}
+
+UringFileSystemDatastore::~UringFileSystemDatastore()
+{
+    if(completionThread.joinable())
+    {
+        {
+            SpinlockGuard guard{ringLock};
+            queueStop();
+        }
+        completionThread.join();
+    }
+
+    if(readBuffers != nullptr)
+    {
+        TPUNKT_MUNMAP(readBuffers, TPUNKT_STORAGE_DATASTORE_MAX_READERS * TPUNKT_STORAGE_DATASTORE_URING_READ_SIZE);
+        readBuffers = nullptr;
+    }
+
+    if(dirfd != -1)
+    {
+        close(dirfd);
+        dirfd = -1;
+    }
+}
+
+bool UringFileSystemDatastore::IsSupported()
+{
+    // Every opcode queued by the datastore - the ring works on kernels before some of them were added
+    constexpr uint8_t ops[]{IORING_OP_NOP,   IORING_OP_READ,     IORING_OP_READ_FIXED, IORING_OP_WRITE,
+                            IORING_OP_CLOSE, IORING_OP_UNLINKAT, IORING_OP_RENAMEAT};
+    IoUring ring;
+    return ring.init(1) && ring.supportsOps(ops, sizeof(ops));
+}
+
+bool UringFileSystemDatastore::createFile(const uint32_t fileID, ResultCb callback)
+{
+    // Synchronous - callers open the file for writing right after
+    FixedString<MAX_DIGITS> name{fileID};
+    const int file = openat(dirfd, name.c_str(), O_CREAT | O_EXCL | O_WRONLY, TPUNKT_INSTANCE_FILE_MODE);
+    if(file == -1) [[unlikely]]
+    {
+        LOG_ERROR("Creating file failed: %s", strerror(errno));
+        RET_AND_CB_FALSE();
+    }
+
+    if(close(file) == -1) [[unlikely]]
+    {
+        RET_AND_CB_FALSE();
+    }
+
+    callback(true);
+    return true;
+}
+
+bool UringFileSystemDatastore::deleteFile(const uint32_t fileID, ResultCb callback)
+{
+    auto* operation = new UringOperation{};
+    operation->type = UringOperationType::DELETE;
+    operation->resultCb = callback;
+    operation->name = FixedString<MAX_DIGITS>{fileID};
+    if(!queue(operation))
+    {
+        delete operation;
+        RET_AND_CB_FALSE();
+    }
+    return true;
+}
+
+bool UringFileSystemDatastore::initRead(const uint32_t fileID, const size_t begin, const size_t end,
+                                        ReadHandle& handle)
+{
+    if(end != 0 && begin >= end)
+    {
+        LOG_WARNING("Invalid read request");
+        return false;
+    }
+
+    FixedString<MAX_DIGITS> name{fileID};
+    const int file = openat(dirfd, name.c_str(), O_RDONLY);
+    if(file == -1) [[unlikely]]
+    {
+        LOG_ERROR("Opening file failed: %s", strerror(errno));
+        return false;
+    }
+
+    size_t fileEnd = end;
+    if(end == 0)
+    {
+        struct stat fileStat{};
+        if(fstat(file, &fileStat) == -1)
+        {
+            LOG_ERROR("Getting file size failed: %s", strerror(errno));
+            close(file);
+            return false;
+        }
+        fileEnd = static_cast<size_t>(fileStat.st_size);
+    }
+
+    handle.buffer = UINT8_MAX;
+    for(uint8_t i = 0; i < TPUNKT_STORAGE_DATASTORE_MAX_READERS; ++i)
+    {
+        if(buffers[ i ].lock())
+        {
+            handle.buffer = i;
+            break;
+        }
+    }
+
+    if(handle.buffer == UINT8_MAX)
+    {
+        LOG_WARNING("Too many concurrent readers");
+        close(file);
+        return false;
+    }
+
+    handle.end = fileEnd;
+    handle.position = begin;
+    handle.fd = file;
+    handle.fileID = fileID;
+    return true;
+}
+
+bool UringFileSystemDatastore::readFile(ReadHandle& handle, const size_t chunkSize, ReadCb callback)
+{
+    if(!handle.isValid())
+    {
+        LOG_ERROR("Passed invalid handle");
+        RET_AND_READ_CB_FALSE();
+    }
+
+    if(handle.isDone())
+    {
+        LOG_WARNING("Passed finished handle");
+        RET_AND_READ_CB_FALSE();
+    }
+
+    auto* operation = new UringOperation{};
+    operation->type = UringOperationType::READ;
+    operation->readCb = callback;
+    operation->readHandle = &handle;
+    operation->bufferIndex = handle.buffer;
+    operation->buffer = readBuffers + (handle.buffer * TPUNKT_STORAGE_DATASTORE_URING_READ_SIZE);
+    operation->size = std::min({chunkSize, handle.end - handle.position, TPUNKT_STORAGE_DATASTORE_URING_READ_SIZE});
+    operation->offset = handle.position;
+    operation->fd = handle.fd;
+    if(!queue(operation))
+    {
+        delete operation;
+        RET_AND_READ_CB_FALSE();
+    }
+    return true;
+}
+
+bool UringFileSystemDatastore::closeRead(ReadHandle& handle, ResultCb callback)
+{
+    if(!handle.isValid())
+    {
+        RET_AND_CB_FALSE(); // We dont touch as its invalid
+    }
+
+    if(!handle.isDone())
+    {
+        LOG_WARNING("Closing Read prematurely");
+    }
+
+    // No read is in flight anymore - closing doesn't touch the disk
+    bool success = true;
+    if(close(handle.fd) == -1)
+    {
+        LOG_ERROR("Failed to close file: %s", strerror(errno));
+        success = false;
+    }
+    handle.fd = -1;
+    buffers[ handle.buffer ].unlock();
+
+    callback(success);
+    return success;
+}
+
+bool UringFileSystemDatastore::initWrite(const uint32_t fileID, WriteHandle& handle)
+{
+    FixedString<MAX_DIGITS> targetName{fileID};
+    const int target = openat(dirfd, targetName.c_str(), O_WRONLY);
+    if(target == -1) [[unlikely]]
+    {
+        LOG_ERROR("Opening target file failed: %s", strerror(errno));
+        return false;
+    }
+
+    FixedString<MAX_DIGITS> tempName{fileID, "T"};
+    const int tempFile = openat(dirfd, tempName.c_str(), O_CREAT | O_TRUNC | O_WRONLY, TPUNKT_INSTANCE_FILE_MODE);
+    if(tempFile == -1) [[unlikely]]
+    {
+        LOG_ERROR("Opening temp file failed: %s", strerror(errno));
+        close(target);
+        return false;
+    }
+
+    {
+        SpinlockGuard guard{ringLock};
+        (void)writes.try_emplace(fileID); // Kept if a close still waits for writes of the file
+    }
+
+    handle.buffer = 0; // Written data is copied into the operation
+    handle.tempPosition = 0;
+    handle.targetfd = target;
+    handle.tempfd = tempFile;
+    handle.fileID = fileID;
+    return true;
+}
+
+bool UringFileSystemDatastore::writeFile(WriteHandle& handle, const bool isLast, const unsigned char* data,
+                                         const size_t size, ResultCb callback)
+{
+    if(!handle.isValid())
+    {
+        RET_AND_CB_FALSE(); // We dont touch as its invalid
+    }
+
+    if(handle.isDone())
+    {
+        LOG_WARNING("Passed finished handle");
+        RET_AND_CB_FALSE();
+    }
+
+    auto* operation = new UringOperation{};
+    operation->type = UringOperationType::WRITE;
+    operation->resultCb = callback;
+    operation->data.assign(data, data + size);
+    operation->size = size;
+    operation->offset = handle.tempPosition;
+    operation->fileID = handle.fileID;
+    operation->fd = handle.tempfd;
+    if(!queue(operation))
+    {
+        delete operation;
+        RET_AND_CB_FALSE();
+    }
+
+    // Writes can be in flight together - each one knows its position
+    handle.tempPosition += size;
+    if(isLast)
+    {
+        handle.done = true;
+    }
+    return true;
+}
+
+bool UringFileSystemDatastore::closeWrite(WriteHandle& handle, const bool revert, ResultCb callback)
+{
+    if(!handle.isValid())
+    {
+        RET_AND_CB_FALSE(); // We dont touch as its invalid
+    }
+
+    if(!handle.isDone())
+    {
+        LOG_WARNING("Closing unfinished Write");
+    }
+
+    auto* operation = new UringOperation{};
+    operation->type = revert ? UringOperationType::REVERT : UringOperationType::COMMIT;
+    operation->resultCb = callback;
+    operation->name = FixedString<MAX_DIGITS>{handle.fileID};
+    operation->tempName = FixedString<MAX_DIGITS>{handle.fileID, "T"};
+    operation->fileID = handle.fileID;
+    operation->fd = handle.tempfd;
+    operation->targetfd = handle.targetfd;
+    handle.tempfd = -1;
+    handle.targetfd = -1;
+
+    if(!queue(operation))
+    {
+        close(operation->fd);
+        close(operation->targetfd);
+        delete operation;
+        RET_AND_CB_FALSE();
+    }
+    return true;
+}
+
+bool UringFileSystemDatastore::queue(UringOperation* operation)
+{
+    if(!ring.isValid()) [[unlikely]]
+    {
+        return false;
+    }
+
+    operation->loop = GetThreadLoop();
+    operation->pending = GetEntryCount(*operation);
+
+    bool deferFlush = false;
+    {
+        SpinlockGuard guard{ringLock};
+        if(operation->type == UringOperationType::COMMIT || operation->type == UringOperationType::REVERT)
+        {
+            const auto it = writes.find(operation->fileID);
+            if(it != writes.end() && it->second.pending != 0)
+            {
+                it->second.close = operation; // Submitted by the completion of the last write
+                return true;
+            }
+            if(it != writes.end())
+            {
+                writes.erase(it);
+            }
+        }
+
+        if(ring.getFreeSqes() < operation->pending)
+        {
+            ring.submit();
+            if(ring.getFreeSqes() < operation->pending)
+            {
+                LOG_ERROR("Datastore submission queue is full");
+                return false;
+            }
+        }
+
+        prepare(operation);
+        if(operation->type == UringOperationType::WRITE)
+        {
+            ++writes[ operation->fileID ].pending;
+        }
+
+        if(operation->loop == nullptr)
+        {
+            ring.submit();
+        }
+        else if(!flushQueued)
+        {
+            flushQueued = true;
+            deferFlush = true;
+        }
+    }
+
+    // Everything queued until the loop gets to it is submitted with a single syscall
+    if(deferFlush)
+    {
+        operation->loop->defer([ this ] { flush(); });
+    }
+    return true;
+}
+
+void UringFileSystemDatastore::prepare(UringOperation* operation)
+{
+    const auto userData = reinterpret_cast<uintptr_t>(operation);
+    io_uring_sqe* sqe = ring.getSqe();
+    sqe->user_data = userData;
+    switch(operation->type)
+    {
+        case UringOperationType::DELETE:
+            sqe->opcode = IORING_OP_UNLINKAT;
+            sqe->fd = dirfd;
+            sqe->addr = reinterpret_cast<uintptr_t>(operation->name.c_str());
+            break;
+        case UringOperationType::READ:
+            sqe->opcode = hasFixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            sqe->fd = operation->fd;
+            sqe->addr = reinterpret_cast<uintptr_t>(operation->buffer);
+            sqe->len = static_cast<uint32_t>(operation->size);
+            sqe->off = operation->offset;
+            sqe->buf_index = operation->bufferIndex;
+            break;
+        case UringOperationType::WRITE:
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = operation->fd;
+            sqe->addr = reinterpret_cast<uintptr_t>(operation->data.data());
+            sqe->len = static_cast<uint32_t>(operation->size);
+            sqe->off = operation->offset;
+            break;
+        case UringOperationType::COMMIT:
+        case UringOperationType::REVERT:
+        {
+            // All writes of the file are done - the closes run even if the first entry failed
+            sqe->fd = dirfd;
+            sqe->addr = reinterpret_cast<uintptr_t>(operation->tempName.c_str());
+            sqe->flags = IOSQE_IO_HARDLINK;
+            if(operation->type == UringOperationType::COMMIT)
+            {
+                // Replaces the target atomically
+                sqe->opcode = IORING_OP_RENAMEAT;
+                sqe->len = static_cast<uint32_t>(dirfd);
+                sqe->addr2 = reinterpret_cast<uintptr_t>(operation->name.c_str());
+            }
+            else
+            {
+                sqe->opcode = IORING_OP_UNLINKAT;
+            }
+
+            io_uring_sqe* closeTemp = ring.getSqe();
+            closeTemp->opcode = IORING_OP_CLOSE;
+            closeTemp->fd = operation->fd;
+            closeTemp->flags = IOSQE_IO_HARDLINK;
+            closeTemp->user_data = userData;
+
+            io_uring_sqe* closeTarget = ring.getSqe();
+            closeTarget->opcode = IORING_OP_CLOSE;
+            closeTarget->fd = operation->targetfd;
+            closeTarget->user_data = userData;
+            break;
+        }
+    }
+}
+
+void UringFileSystemDatastore::queueStop()
+{
+    io_uring_sqe* sqe = ring.getSqe();
+    if(sqe == nullptr)
+    {
+        ring.submit();
+        sqe = ring.getSqe();
+    }
+    // Drained - only completes after everything submitted before
+    sqe->opcode = IORING_OP_NOP;
+    sqe->flags = IOSQE_IO_DRAIN;
+    sqe->user_data = 0;
+    ring.submit();
+}
+
+void UringFileSystemDatastore::flush()
+{
+    SpinlockGuard guard{ringLock};
+    flushQueued = false;
+    ring.submit();
+}
+
+void UringFileSystemDatastore::writeCompleted(const uint32_t fileID)
+{
+    SpinlockGuard guard{ringLock};
+    const auto it = writes.find(fileID);
+    if(it == writes.end() || --it->second.pending != 0 || it->second.close == nullptr)
+    {
+        return;
+    }
+
+    UringOperation* close = it->second.close;
+    writes.erase(it);
+    if(ring.getFreeSqes() < close->pending)
+    {
+        ring.submit();
+    }
+    prepare(close);
+    ring.submit();
+    hasLateCloses = true;
+}
+
+void UringFileSystemDatastore::complete(UringOperation* operation)
+{
+    if(operation->loop == nullptr)
+    {
+        Finish(operation);
+        return;
+    }
+    operation->loop->defer([ operation ] { Finish(operation); });
+}
+
+void UringFileSystemDatastore::completionLoop()
+{
+    bool isRunning = true;
+    while(isRunning && ring.wait())
+    {
+        ring.forEachCompletion(
+            [ & ](const io_uring_cqe& cqe)
+            {
+                auto* operation = reinterpret_cast<UringOperation*>(cqe.user_data);
+                if(operation == nullptr)
+                {
+                    // Closes submitted by the last writes are waited for too
+                    SpinlockGuard guard{ringLock};
+                    if(hasLateCloses)
+                    {
+                        hasLateCloses = false;
+                        queueStop();
+                        return;
+                    }
+                    isRunning = false;
+                    return;
+                }
+
+                // Deleting a file that was never written is fine - nothing to delete
+                const int result = cqe.res;
+                if(result < 0 && !(operation->type == UringOperationType::DELETE && result == -ENOENT))
+                {
+                    LOG_ERROR("Datastore operation failed: %s", strerror(-result));
+                    operation->success = false;
+                }
+                operation->result = result;
+
+                --operation->pending;
+                if(operation->pending == 0)
+                {
+                    const bool isWrite = operation->type == UringOperationType::WRITE;
+                    const uint32_t fileID = operation->fileID;
+                    complete(operation);
+                    if(isWrite)
+                    {
+                        writeCompleted(fileID);
+                    }
+                }
+            });
+    }
+}
+
+} // namespace tpunkt
@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TPUNKT_URING_FILESYSTEM_DATASTORE_H
+#define TPUNKT_URING_FILESYSTEM_DATASTORE_H
+
+#include <atomic>
+#include <thread>
+#include <ankerl/unordered_dense.h>
+#include "datastructures/Spinlock.h"
+#include "storage/datastore/DataStore.h"
+#include "storage/datastore/IoUring.h"
+
+namespace tpunkt
+{
+
+struct UringOperation;
+
+// Same layout on disk as the LocalFileSystemDatastore - but reads, writes, renames and deletes go through io_uring
+// Notes:
+//      - Callbacks are completed on the loop of the calling thread (see DataStore::SetThreadLoop)
+//      - Entries queued on a loop thread are submitted together at the end of the loop iteration
+//      - Reads go into registered buffers - at most TPUNKT_STORAGE_DATASTORE_URING_READ_SIZE per callback
+//      - Written data is copied - the caller's buffer can be reused after the call
+//      - Committing or reverting a write is submitted once all its writes are completed
+//      - Creating and opening files (initRead, initWrite) stays synchronous - later calls depend on it
+struct UringFileSystemDatastore final : DataStore
+{
+    explicit UringFileSystemDatastore(EndpointID endpoint);
+    ~UringFileSystemDatastore() override;
+
+    // Returns true if io_uring and every opcode the datastore uses are supported on this system
+    static bool IsSupported();
+
+    bool createFile(uint32_t fileID, ResultCb callback) override;
+
+    bool deleteFile(uint32_t fileID, ResultCb callback) override;
+
+    //===== Read =====//
+
+    bool initRead(uint32_t fileID, size_t begin, size_t end, ReadHandle& handle) override;
+
+    bool readFile(ReadHandle& handle, size_t chunkSize, ReadCb callback) override;
+
+    bool closeRead(ReadHandle& handle, ResultCb callback) override;
+
+    //===== Write =====//
+
+    bool initWrite(uint32_t fileID, WriteHandle& handle) override;
+
+    bool writeFile(WriteHandle& handle, bool isLast, const unsigned char* data, size_t size, ResultCb clb) override;
+
+    bool closeWrite(WriteHandle& handle, bool revert, ResultCb callback) override;
+
+  private:
+    struct UringWrite final
+    {
+        uint32_t pending = 0;              // Writes not yet completed
+        UringOperation* close = nullptr;   // Commit or revert waiting for the writes
+    };
+
+    // Queues the entries of the operation - returns false if the queue is full
+    bool queue(UringOperation* operation);
+    // Needs the ring lock - fills the entries of the operation
+    void prepare(UringOperation* operation);
+    // Needs the ring lock - completes only after everything submitted before
+    void queueStop();
+    // Submits all queued entries
+    void flush();
+    // Submits the waiting commit or revert once the last write of the file is completed
+    void writeCompleted(uint32_t fileID);
+    void complete(UringOperation* operation);
+    void completionLoop();
+
+    IoUring ring;
+    Spinlock ringLock;         // Guards submissions and writes - completions are only read by the completion thread
+    ankerl::unordered_dense::map<uint32_t, UringWrite> writes; // Open writes by file
+    bool hasLateCloses = false; // Closes were submitted after the stop was queued
+    bool flushQueued = false;  // A loop already flushes at the end of its iteration
+    bool hasFixedBuffers = false;
+    unsigned char* readBuffers = nullptr;
+    std::thread completionThread;
+    int dirfd;                 // Directory file descriptor
+};
+
+} // namespace tpunkt
+
+#endif // TPUNKT_URING_FILESYSTEM_DATASTORE_H
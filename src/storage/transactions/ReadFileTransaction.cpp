@@ -12,41 +12,116 @@ ReadFileTransaction::ReadFileTransaction(ResultCb callback, uWS::HttpResponse<tr
 {
 }
 
+ReadFileTransaction::ReadFileTransaction(ResultCb callback, uWS::HttpResponse<true>* response, FileID file,
+                                         std::vector<ReadPart> parts, std::string trailer)
+    : StorageTransaction(callback, response), file(file), parts(std::move(parts)), trailer(std::move(trailer))
+{
+}
+
 ReadFileTransaction::~ReadFileTransaction()
 {
-    if(shouldAbort())
+    // Handle is already closed if a later part couldn't be opened
+    if(shouldAbort() && handle.isValid())
     {
-        datastore->closeRead(handle, callback);
+        datastore->closeRead(handle, isAborted ? [](bool) {} : callback);
     }
 }
 
 bool ReadFileTransaction::start()
 {
-    return datastore->initRead(file.getUID(), 0, 0, handle);
+    return startPart();
+}
+
+bool ReadFileTransaction::startPart()
+{
+    isPartStarted = false;
+    if(parts.empty())
+    {
+        return datastore->initRead(file.getUID(), 0, 0, handle);
+    }
+    return datastore->initRead(file.getUID(), parts[ part ].begin, parts[ part ].end, handle);
+}
+
+void ReadFileTransaction::abort()
+{
+    isAborted = true;
+    isDone = true;
+    canReadMore = false;
+    if(!isReading && handle.isValid())
+    {
+        datastore->closeRead(handle, [](bool) {});
+    }
 }
 
 bool ReadFileTransaction::readFile()
 {
-    auto readCallback = [ & ](const unsigned char* data, size_t size, bool success, bool isLast)
+    if(isDone)
+    {
+        return true;
+    }
+
+    auto readCallback = [ self = shared_from_this() ](const unsigned char* data, size_t size, bool success, bool isLast)
     {
+        self->isReading = false;
+        if(self->isAborted) // Completed after the client disconnected
+        {
+            if(self->handle.isValid())
+            {
+                self->datastore->closeRead(self->handle, [](bool) {});
+            }
+            return;
+        }
         if(!success)
         {
-            ServerEndpoint::EndRequest(response, 400, "Read Transaction failed");
+            self->isDone = true;
+            self->canReadMore = false;
+            ServerEndpoint::EndRequest(self->response, 400, "Read Transaction failed");
             return;
         }
-        canReadMore = response->write(std::string_view{reinterpret_cast<const char*>(data), size});
+        self->canReadMore = self->response->write(std::string_view{reinterpret_cast<const char*>(data), size});
         if(isLast)
         {
-            canReadMore = false;
-            datastore->closeRead(handle, callback);
-            response->end();
-            commit();
+            self->datastore->closeRead(self->handle, self->callback);
+            if(self->part + 1 < self->parts.size())
+            {
+                ++self->part;
+                if(!self->startPart())
+                {
+                    self->isDone = true;
+                    self->canReadMore = false;
+                    ServerEndpoint::EndRequest(self->response, 500, "Read Transaction failed");
+                    return;
+                }
+            }
+            else
+            {
+                self->isDone = true;
+                self->canReadMore = false;
+                self->response->end(self->trailer);
+                self->commit();
+                return;
+            }
+        }
+
+        if(!self->isStarting && self->canReadMore)
+        {
+            self->readFile(); // Completed asynchronously - nobody else starts the next read
         }
     };
 
-    while(canReadMore && datastore->readFile(handle, TPUNKT_STORAGE_FILE_CHUNK_SIZE, readCallback))
+    canReadMore = true; // Also called once the response is writable again
+    isStarting = true;
+    while(canReadMore && !isReading)
     {
+        if(!isPartStarted && !parts.empty() && !parts[ part ].prefix.empty())
+        {
+            (void)response->write(parts[ part ].prefix); // Buffered by the response if it's backpressured
+        }
+        isPartStarted = true;
+        isReading = true;
+        (void)datastore->readFile(handle, TPUNKT_STORAGE_FILE_CHUNK_SIZE, readCallback);
     }
+    isStarting = false;
     return true;
 }
 
@@ -16,17 +16,20 @@ WriteFileTransaction::~WriteFileTransaction()
 {
     if(shouldAbort())
     {
-        VirtualDirectory* createDir = filesystem->findDir(dir);
-        if(createDir == nullptr)
         {
-            LOG_WARNING("Failed to revert transaction: Directory already deleted");
-        }
-        else if(!createDir->fileDelete(file))
-        {
-            LOG_WARNING("Failed to revert transaction: Filed already deleted");
+            CooperativeSpinlockGuard guard{*filesystemLock, true};
+            if(filesystem->findDir(dir) == nullptr)
+            {
+                LOG_WARNING("Failed to revert transaction: Directory already deleted");
+            }
+            else if(!filesystem->fileDelete(file))
+            {
+                LOG_WARNING("Failed to revert transaction: Filed already deleted");
+            }
         }
 
-        const auto callback = [ & ](const bool success)
+        // Only captures by value - the datastore might complete after the transaction is gone
+        const auto callback = [ response = response, loop = loop ](const bool success)
         {
             if(!success)
             {
@@ -35,7 +38,7 @@ WriteFileTransaction::~WriteFileTransaction()
             }
             else
             {
-                auto endFunc = [ & ]
+                auto endFunc = [ response ]
                 {
                     response->writeStatus("500");
                     response->end();
@@ -48,7 +51,7 @@ WriteFileTransaction::~WriteFileTransaction()
     }
     else
     {
-        auto endFunc = [ & ]
+        auto endFunc = [ response = response ]
         {
             response->writeStatus("200 OK");
             response->end();
@@ -70,6 +73,16 @@ void WriteFileTransaction::commit()
 
 bool WriteFileTransaction::write(const std::string_view& data, bool isLast)
 {
+    {
+        // Checked before every chunk - stops the upload as soon as a limit is reached
+        CooperativeSpinlockGuard guard{*filesystemLock, true};
+        if(!filesystem->fileChangeSize(file, written + data.size()))
+        {
+            return false;
+        }
+    }
+    written += data.size();
+
     return datastore->writeFile(handle, isLast, reinterpret_cast<const unsigned char*>(data.data()), data.size(),
                                 callback);
 }
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include "storage/vfs/VirtualChangeLog.h"
+
+namespace tpunkt
+{
+
+void VirtualChangeLog::add(const JournalOperation operation, const FileID fid, const FileID parent)
+{
+    if(ring.empty()) [[unlikely]]
+    {
+        ring.resize(TPUNKT_STORAGE_VFS_CHANGE_LOG_SIZE);
+    }
+
+    ++sequence;
+    const VirtualChange change{.sequence = sequence, .fid = fid, .parent = parent, .operation = operation};
+    ring[ sequence % ring.size() ] = change;
+    if(sequence - first >= ring.size())
+    {
+        ++first; // Overwritten
+    }
+}
+
+void VirtualChangeLog::reset(const uint64_t newSequence)
+{
+    sequence = newSequence;
+    first = newSequence + 1;
+}
+
+bool VirtualChangeLog::collect(const uint64_t after, const uint32_t limit, std::vector<VirtualChange>& changes) const
+{
+    changes.clear();
+    if(after > sequence || after + 1 < first)
+    {
+        return false;
+    }
+
+    const uint64_t count = std::min<uint64_t>(sequence - after, limit == 0 ? UINT64_MAX : limit);
+    changes.reserve(count);
+    for(uint64_t i = after + 1; i <= after + count; ++i)
+    {
+        changes.push_back(ring[ i % ring.size() ]);
+    }
+    return true;
+}
+
+uint64_t VirtualChangeLog::getSequence() const
+{
+    return sequence;
+}
+
+} // namespace tpunkt
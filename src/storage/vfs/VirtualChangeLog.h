@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TPUNKT_VIRTUAL_CHANGE_LOG_H
+#define TPUNKT_VIRTUAL_CHANGE_LOG_H
+
+#include <vector>
+#include "common/FileID.h"
+#include "storage/vfs/VirtualFilesystemPersistence.h"
+
+namespace tpunkt
+{
+
+struct VirtualChange final
+{
+    uint64_t sequence = 0;
+    FileID fid;
+    FileID parent; // Parent after the change - invalid for the root
+    JournalOperation operation{};
+};
+
+// Ring of the last TPUNKT_STORAGE_VFS_CHANGE_LOG_SIZE changes of a filesystem - numbered without gaps
+// Lets clients sync in O(changes) - older changes are dropped and need a full resync
+// Not synced == NOT threadsafe
+struct VirtualChangeLog final
+{
+    void add(JournalOperation operation, FileID fid, FileID parent);
+
+    // Drops all changes - the next one gets sequence + 1
+    void reset(uint64_t sequence);
+
+    // Collects up to limit changes after the given sequence - 0 as limit collects all
+    // Returns false if they are not known (anymore) - the client has to resync fully
+    bool collect(uint64_t after, uint32_t limit, std::vector<VirtualChange>& changes) const;
+
+    // Sequence of the last change
+    [[nodiscard]] uint64_t getSequence() const;
+
+  private:
+    std::vector<VirtualChange> ring; // Allocated with the first change
+    uint64_t sequence = 0;
+    uint64_t first = 1; // Oldest change still in the ring
+};
+
+} // namespace tpunkt
+
+#endif // TPUNKT_VIRTUAL_CHANGE_LOG_H
@@ -1,174 +1,22 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
-#include <algorithm>
 #include "storage/Storage.h"
 #include "storage/vfs/VirtualDirectory.h"
 
 namespace tpunkt
 {
 
-VirtualDirectory::VirtualDirectory(const DirectoryCreationInfo& info)
-    : fid(info.parent.getEndpoint(), true),
-      info(FileInfo{.name = info.name, .creator = info.creator, .owner = info.creator}, info.parent),
-      limits(info.maxSize, false)
+VirtualDirectory::VirtualDirectory(const DirectoryCreationInfo& info, const NameRef name)
+    : fid(info.parent.getEndpoint(), true), nameHash(HashFileName(info.name)), name(name),
+      info(NodeInfo{.creator = info.creator, .owner = info.creator}, info.parent), limits(info.maxSize, false)
 {
-    files.reserve(16);
-    dirs.reserve(16);
 }
 
-VirtualFile* VirtualDirectory::findFile(const FileID file)
+void VirtualDirectory::rename(const NameRef newName, const uint64_t newHash)
 {
-    for(auto& child : files)
-    {
-        if(child.getID() == file)
-        {
-            return &child;
-        }
-    }
-    return nullptr;
-}
-
-VirtualDirectory* VirtualDirectory::findDir(const FileID dir)
-{
-    for(auto& subdir : dirs)
-    {
-        if(subdir.getID() == dir)
-        {
-            return &subdir;
-        }
-    }
-    return nullptr;
-}
-
-bool VirtualDirectory::fileAdd(const FileCreationInfo& createInfo, FileID& file)
-{
-    if(fileNameExists(createInfo.name))
-    {
-        return false;
-    }
     onModification();
-    auto& newFile = files.emplace_back(createInfo);
-    file = newFile.getID();
-    return true;
-}
-
-bool VirtualDirectory::fileChangeSize(const FileID file, const uint64_t newFileSize)
-{
-    VirtualFile* changeFile = findFile(file);
-    if(changeFile == nullptr) [[unlikely]]
-    {
-        return false;
-    }
-
-    const uint64_t currFileSize = changeFile->getStats().size;
-    if(currFileSize == newFileSize) [[unlikely]]
-    {
-        return true;
-    }
-
-    if(!canHoldSizeChange(currFileSize, newFileSize)) [[unlikely]]
-    {
-        return false;
-    }
-
-    stats.base.size = stats.base.size - currFileSize + newFileSize;
-    changeFile->stats.size = newFileSize;
-    changeFile->onModification();
-    onModification();
-    return true;
-}
-
-bool VirtualDirectory::fileDelete(const FileID file)
-{
-    return fileDeleteImpl(file);
-}
-
-bool VirtualDirectory::fileDeleteAll()
-{
-    if(!files.empty()) [[likely]]
-    {
-        for(auto& file : files)
-        {
-            fileDeleteImpl(file.getID());
-        }
-        return true;
-    }
-    return false;
-}
-
-bool VirtualDirectory::fileNameExists(const FileName& name) const
-{
-    return std::ranges::any_of(files, [ & ](auto& dir) { return dir.info.name == name; });
-}
-
-// Has no locking
-bool VirtualDirectory::fileDeleteImpl(FileID file)
-{
-    auto* changeFile = findFile(file);
-    if(changeFile == nullptr) [[unlikely]]
-    {
-        return false;
-    }
-
-    const FileStats changeFileStats = changeFile->getStats();
-    if(std::erase_if(files, [ file ](const VirtualFile& f) -> bool { return f.getID() == file; }) > 0)
-    {
-        onModification();
-        stats.base.size -= changeFileStats.size;
-        auto changeFunc = [ & ](VirtualDirectory& dir) -> bool
-        {
-            dir.stats.subDirFileSize -= changeFileStats.size;
-            return true;
-        };
-        // iterateParents(changeFunc);
-        return true;
-    }
-    return false;
-}
-
-//===== Directories =====//
-
-bool VirtualDirectory::dirAdd(const DirectoryCreationInfo& cInfo, FileID& dir)
-{
-    if(dirNameExists(cInfo.name)) [[unlikely]]
-    {
-        return false;
-    }
-
-    onModification();
-    auto& newDirRef = dirs.emplace_back(cInfo);
-    dir = newDirRef.getID();
-
-    return true;
-}
-
-bool VirtualDirectory::dirNameExists(const FileName& name) const
-{
-    return std::ranges::any_of(dirs, [ & ](auto& dir) { return dir.info.base.name == name; });
-}
-
-bool VirtualDirectory::dirDelete(const FileID dir)
-{
-    onAccess();
-    if(!dir.isDirectory())
-    {
-        LOG_WARNING("Calling dirDelete on non-Directory");
-        return false;
-    }
-
-    const auto result = std::erase_if(dirs, [ & ](VirtualDirectory& e)
-                                      { return e.getDirs().empty() && e.getFiles().empty() && e.fid == dir; }) > 0;
-    if(result)
-    {
-        onModification();
-    }
-    return result;
-}
-
-void VirtualDirectory::rename(const FileName& name)
-{
-    onModification();
-    info.base.name = name;
+    name = newName;
+    nameHash = newHash;
 }
 
 const DirectoryStats& VirtualDirectory::getStats() const
@@ -191,40 +39,34 @@ FileID VirtualDirectory::getID() const
     return fid;
 }
 
-std::vector<VirtualFile>& VirtualDirectory::getFiles()
+NameRef VirtualDirectory::getNameRef() const
+{
+    return name;
+}
+
+uint32_t VirtualDirectory::getFileCount() const
 {
-    return files;
+    return files.count;
 }
 
-std::vector<VirtualDirectory>& VirtualDirectory::getDirs()
+uint32_t VirtualDirectory::getDirCount() const
 {
-    return dirs;
+    return dirs.count;
 }
 
-void VirtualDirectory::collectEntries(std::vector<DTO::ResponseDirectoryEntry>& entries) const
+bool VirtualDirectory::isEmpty() const
 {
-    entries.clear();
-    entries.reserve(files.size() + dirs.size() + 1);
-
-    for(const auto& file : files)
-    {
-        entries.push_back(DTO::ResponseDirectoryEntry::FromFile(file));
-    }
-    for(const auto& dir : dirs)
-    {
-        entries.push_back(DTO::ResponseDirectoryEntry::FromDir(dir));
-    }
+    return files.empty() && dirs.empty();
 }
 
-bool VirtualDirectory::canHoldSizeChange(const uint64_t currSize, const uint64_t newSize) const
+uint64_t VirtualDirectory::getVersion() const
 {
-    return (stats.base.size + stats.subDirFileSize - currSize + newSize) < limits.sizeLimit;
+    return version;
 }
 
-void VirtualDirectory::onAccess()
+void VirtualDirectory::onAccess() const
 {
-    stats.base.accessCount++;
-    stats.base.accessed = Timestamp::Now();
+    stats.base.recordAccess();
 }
 
 void VirtualDirectory::onModification()
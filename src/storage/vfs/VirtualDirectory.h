@@ -3,9 +3,9 @@
 #ifndef TPUNKT_VIRTUAL_DIRECTORY_H
 #define TPUNKT_VIRTUAL_DIRECTORY_H
 
-#include <vector>
 #include "common/FileID.h"
 #include "storage/vfs/VirtualFile.h"
+#include "storage/vfs/VirtualNode.h"
 
 namespace tpunkt
 {
@@ -20,20 +20,22 @@ struct DirectoryCreationInfo final
 
 struct DirectoryInfo final
 {
-    FileInfo base;
+    NodeInfo base;
     FileID parent;
 };
 
 struct DirectoryLimits final
 {
-    uint64_t sizeLimit = 0;
+    uint64_t sizeLimit = 0; // Max total size in bytes - 0 means only the limits of the parents apply
     bool isReadOnly = false;
 };
 
 struct DirectoryStats final
 {
-    FileStats base;
+    FileStats base;              // Size of the files directly inside
     uint64_t subDirFileSize = 0; // Size of all files in subdirs
+    uint32_t totalFiles = 0;     // Files in the whole subtree
+    uint32_t totalDirs = 0;      // Dirs in the whole subtree
 
     [[nodiscard]] uint64_t getTotalSize() const
     {
@@ -41,68 +43,46 @@ struct DirectoryStats final
     }
 };
 
+// Children are not stored inside the directory - they are linked nodes in the arenas of the VirtualFilesystem
 struct VirtualDirectory final
 {
-    VirtualDirectory(const DirectoryCreationInfo& info);
-
-    //===== Get =====//
-
-    // Returns nullptr of the element identified by the given id - Only local non-recursive search
-    VirtualFile* findFile(FileID file);
-    VirtualDirectory* findDir(FileID dir);
-
-    //===== Contents =====//
-
-    // Adds a new file to this directory
-    bool fileAdd(const FileCreationInfo& info, FileID& file);
-
-    // Returns true if the size of the given file has changed
-    bool fileChangeSize(FileID file, uint64_t newFileSize);
-
-    // Returns true if the given file is deleted - deletes all its subdirs and subfiles
-    bool fileDelete(FileID fileid);
-    bool fileDeleteAll();
-
-    // Returns true and assigns dir if a new directory was added
-    bool dirAdd(const DirectoryCreationInfo& info, FileID& dir);
-
-    // Returns true if a directory with the given name exists
-    [[nodiscard]] bool dirNameExists(const FileName& name) const;
-    // Returns true if a file with the given name exists
-    [[nodiscard]] bool fileNameExists(const FileName& name) const;
-
-    // Returns true if a directory was removed
-    bool dirDelete(FileID dir);
-
-    //===== Self =====//
-
-    void rename(const FileName& name);
+    VirtualDirectory(const DirectoryCreationInfo& info, NameRef name);
 
     //===== Info =====//
 
     [[nodiscard]] const DirectoryStats& getStats() const;
     [[nodiscard]] const DirectoryLimits& getLimits() const;
+    // Name is resolved through the filesystem
     [[nodiscard]] const DirectoryInfo& getInfo() const;
     [[nodiscard]] FileID getID() const;
-    std::vector<VirtualFile>& getFiles();
-    std::vector<VirtualDirectory>& getDirs();
-    void collectEntries(std::vector<DTO::ResponseDirectoryEntry>& entries) const;
-
-    //===== DTO =====//
+    [[nodiscard]] NameRef getNameRef() const;
+    [[nodiscard]] uint32_t getFileCount() const;
+    [[nodiscard]] uint32_t getDirCount() const;
+    [[nodiscard]] bool isEmpty() const;
+    // Increased whenever an entry of its listing changes - starts at 0 again after a restart
+    [[nodiscard]] uint64_t getVersion() const;
 
   private:
-    [[nodiscard]] bool canHoldSizeChange(uint64_t currSize, uint64_t newSize) const;
+    // Only through the filesystem to keep its name index in sync
+    void rename(NameRef newName, uint64_t newHash);
 
-    void onAccess();
+    void onAccess() const;
     void onModification();
-    bool fileDeleteImpl(FileID file);
 
     FileID fid;
+    uint64_t nameHash = 0;
+    NameRef name;
     DirectoryInfo info;
     DirectoryStats stats;
     DirectoryLimits limits;
-    std::vector<VirtualFile> files;
-    std::vector<VirtualDirectory> dirs;
+    VirtualNodeLinks links;
+    VirtualNodeList files;
+    VirtualNodeList dirs;
+    uint64_t treeHash = 0; // Merkle hash of the subtree - recomputed on request once invalidated
+    uint64_t version = 0;
+    bool hasTreeHash = false;
+    // Structural changes are only done through the VirtualFilesystem - keeps its cache and links in sync
+    friend VirtualFilesystem;
     friend DTO::ResponseDirectoryEntry;
     friend DTO::ResponseDirectoryInfo;
 };
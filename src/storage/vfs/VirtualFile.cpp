@@ -7,25 +7,31 @@
 namespace tpunkt
 {
 
-VirtualFile::VirtualFile(const FileCreationInfo& info)
-    : fid(info.endpoint, false), info(info.name, info.creator, info.creator), stats(Timestamp::Now())
+VirtualFileDetails::VirtualFileDetails(const FileCreationInfo& info)
+    : info(info.creator, info.creator), stats(Timestamp::Now())
 {
 }
 
-void VirtualFile::rename(const FileName& newName)
+VirtualFile::VirtualFile(const FileCreationInfo& info, VirtualFileDetails& details, const NameRef name)
+    : fid(info.endpoint, false), nameHash(HashFileName(info.name)), name(name), details(&details)
 {
-    info.name = newName;
+}
+
+void VirtualFile::rename(const NameRef newName, const uint64_t newHash)
+{
+    name = newName;
+    nameHash = newHash;
     onModification();
 }
 
-const FileInfo& VirtualFile::getInfo() const
+const NodeInfo& VirtualFile::getInfo() const
 {
-    return info;
+    return details->info;
 }
 
 const FileStats& VirtualFile::getStats() const
 {
-    return stats;
+    return details->stats;
 }
 
 FileID VirtualFile::getID() const
@@ -33,18 +39,22 @@ FileID VirtualFile::getID() const
     return fid;
 }
 
+NameRef VirtualFile::getNameRef() const
+{
+    return name;
+}
+
 
-void VirtualFile::onAccess()
+void VirtualFile::onAccess() const
 {
-    stats.accessed = Timestamp::Now();
-    stats.accessCount++;
+    details->stats.recordAccess();
 }
 
 void VirtualFile::onModification()
 {
     onAccess();
-    stats.modified = Timestamp::Now();
-    stats.modificationCount++;
+    details->stats.modified = Timestamp::Now();
+    details->stats.modificationCount++;
 }
 
 } // namespace tpunkt
@@ -2,10 +2,13 @@
 #ifndef TPUNKT_VIRTUAL_FILE_H
 #define TPUNKT_VIRTUAL_FILE_H
 
+#include <atomic>
 #include "common/FileID.h"
 #include "datastructures/FixedString.h"
 #include "datastructures/Timestamp.h"
 #include "fwd.h"
+#include "storage/vfs/VirtualNameArena.h"
+#include "storage/vfs/VirtualNode.h"
 
 namespace tpunkt
 {
@@ -18,6 +21,7 @@ struct FileCreationInfo final
     EndpointID endpoint;
 };
 
+// Full info - as persisted and sent out
 struct FileInfo final
 {
     FileName name;
@@ -25,51 +29,94 @@ struct FileInfo final
     UserID owner = UserID::INVALID;
 };
 
+// Info as stored in the node - the name is interned in the name arena of the filesystem
+struct NodeInfo final
+{
+    UserID creator = UserID::INVALID;
+    UserID owner = UserID::INVALID;
+};
+
+// Access is recorded on read paths that hold the endpoint lock shared - those only touch it through atomics
+// Holders of the exclusive lock can read all fields directly
 struct FileStats final
 {
     Timestamp created;
-    Timestamp modified; // Last time the physical file OR metadata changed
-    Timestamp accessed; // Last time the physical file was sent (or attempted)
+    Timestamp modified;         // Last time the physical file OR metadata changed
+    mutable Timestamp accessed; // Last time the physical file was sent (or attempted)
 
     uint32_t modificationCount = 0;
-    uint32_t accessCount = 0;
+    mutable uint32_t accessCount = 0;
 
     uint64_t size = 0;  // Size in bytes
+
+    // Relaxed - only statistics, nothing is ordered by them
+    void recordAccess() const
+    {
+        std::atomic_ref{accessed}.store(Timestamp::Now(), std::memory_order_relaxed);
+        std::atomic_ref{accessCount}.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] Timestamp getAccessed() const
+    {
+        return std::atomic_ref{accessed}.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint32_t getAccessCount() const
+    {
+        return std::atomic_ref{accessCount}.load(std::memory_order_relaxed);
+    }
 };
 
+static_assert(std::atomic_ref<Timestamp>::is_always_lock_free, "Access must not need a lock");
+
 struct FileHistory final
 {
     bool enabled = false;
 };
 
-struct VirtualFile final
+// Cold part of a file - only read once the file itself is looked at (listings, downloads, persistence)
+struct VirtualFileDetails final
 {
-    explicit VirtualFile(const FileCreationInfo& info);
+    explicit VirtualFileDetails(const FileCreationInfo& info);
 
-    //===== Change =====//
+    NodeInfo info;
+    FileStats stats{};
+    FileHistory history{};
+};
 
-    // Changes the name to the given name
-    // Note: Does NOT rename the physical file
-    void rename(const FileName& newName);
+// Hot part of a file - all that lookups and name checks touch
+// Details live in a separate arena of the filesystem - scans over many files stay in a few cache lines
+struct VirtualFile final
+{
+    VirtualFile(const FileCreationInfo& info, VirtualFileDetails& details, NameRef name);
 
     //===== Info =====//
 
-    [[nodiscard]] const FileInfo& getInfo() const;
+    // Name is resolved through the filesystem
+    [[nodiscard]] const NodeInfo& getInfo() const;
     [[nodiscard]] const FileStats& getStats() const;
     [[nodiscard]] FileID getID() const;
+    [[nodiscard]] NameRef getNameRef() const;
 
   private:
-    void onAccess();
+    // Changes the name to the given name - only through the filesystem to keep its name index in sync
+    // Note: Does NOT rename the physical file
+    void rename(NameRef newName, uint64_t newHash);
+
+    void onAccess() const;
     void onModification();
 
     FileID fid;
-    FileInfo info;
-    FileStats stats{};
-    FileHistory history{};
-    friend VirtualDirectory;
+    uint64_t nameHash = 0;
+    NameRef name;
+    VirtualFileDetails* details;
+    VirtualNodeLinks links;
+    friend VirtualFilesystem;
     friend DTO::ResponseDirectoryEntry;
 };
 
+static_assert(sizeof(VirtualFile) <= 64, "Hot part of a file must fit into a cache line");
+
 } // namespace tpunkt
 
 #endif // TPUNKT_VIRTUAL_FILE_H
@@ -1,107 +1,1897 @@
 // SPDX-License-Identifier: GPL-3.0-only
+#include <algorithm>
+#include <cstring>
+#include "config.h"
+#include "server/DTO.h"
 #include "storage/vfs/VirtualFilesystem.h"
+#include "util/Logging.h"
 
 namespace tpunkt
 {
 
+namespace
+{
+std::string_view NodeName(const VirtualNameArena& names, const VirtualFile& file)
+{
+    return names.get(file.getNameRef());
+}
+
+std::string_view NodeName(const VirtualNameArena& names, const VirtualDirectory& dir)
+{
+    return names.get(dir.getNameRef());
+}
+
+// Cursor position layout: valid bit | dir bit | insertion order (30 bits) | node handle (32 bits)
+constexpr uint64_t CURSOR_VALID_BIT = 1ULL << 63U;
+constexpr uint64_t CURSOR_DIR_BIT = 1ULL << 62U;
+constexpr uint32_t MAX_NODE_ORDER = (1U << 30U) - 1;
+
+DirectoryCursor GetCursor(const bool isDir, const NodeHandle node, const uint32_t order, const uint64_t key,
+                          const std::string_view name = "")
+{
+    const uint64_t dirBit = isDir ? CURSOR_DIR_BIT : 0;
+    const uint64_t position = static_cast<uint64_t>(order) << 32U | static_cast<uint32_t>(node);
+    return DirectoryCursor{.key = key, .position = CURSOR_VALID_BIT | dirBit | position, .name = name};
+}
+
+NodeHandle GetCursorNode(const DirectoryCursor& cursor)
+{
+    return static_cast<NodeHandle>(static_cast<uint32_t>(cursor.position));
+}
+
+// First 8 bytes of the name - compares like the name itself
+uint64_t GetNamePrefix(const std::string_view view)
+{
+    uint64_t prefix = 0;
+    for(size_t i = 0; i < sizeof(uint64_t); ++i)
+    {
+        const auto byte = i < view.size() ? static_cast<unsigned char>(view[ i ]) : 0U;
+        prefix = prefix << 8U | byte;
+    }
+    return prefix;
+}
+
+uint64_t GetSortKey(const VirtualNameArena& names, const VirtualFile& file, const DirectorySortOrder order)
+{
+    switch(order)
+    {
+        case DirectorySortOrder::NAME:
+            return GetNamePrefix(NodeName(names, file));
+        case DirectorySortOrder::MODIFIED:
+            return file.getStats().modified.getNanos();
+        case DirectorySortOrder::SIZE:
+            return file.getStats().size;
+        case DirectorySortOrder::INSERTION:
+            break;
+    }
+    return 0;
+}
+
+uint64_t GetSortKey(const VirtualNameArena& names, const VirtualDirectory& dir, const DirectorySortOrder order)
+{
+    switch(order)
+    {
+        case DirectorySortOrder::NAME:
+            return GetNamePrefix(NodeName(names, dir));
+        case DirectorySortOrder::MODIFIED:
+            return dir.getStats().base.modified.getNanos();
+        case DirectorySortOrder::SIZE:
+            return dir.getStats().getTotalSize();
+        case DirectorySortOrder::INSERTION:
+            break;
+    }
+    return 0;
+}
+
+constexpr std::array SORTED_ORDERS{DirectorySortOrder::NAME, DirectorySortOrder::MODIFIED, DirectorySortOrder::SIZE};
+
+size_t GetSortSlot(const DirectorySortOrder order)
+{
+    return static_cast<size_t>(order) - 1;
+}
+
+// Sort keys a change affects - nodes only move in the orders of those
+constexpr uint8_t SORT_KEY_NAME = 1U << 0U;
+constexpr uint8_t SORT_KEY_MODIFIED = 1U << 1U;
+constexpr uint8_t SORT_KEY_SIZE = 1U << 2U;
+
+uint8_t GetSortKeyBit(const DirectorySortOrder order)
+{
+    return static_cast<uint8_t>(1U << GetSortSlot(order));
+}
+
+DTO::ResponseDirectoryEntry GetEntry(const VirtualNameArena& names, const VirtualFile& file,
+                                     DTO::UserNameCache& users)
+{
+    return DTO::ResponseDirectoryEntry::FromFile(file, NodeName(names, file), users);
+}
+
+DTO::ResponseDirectoryEntry GetEntry(const VirtualNameArena& names, const VirtualDirectory& dir,
+                                     DTO::UserNameCache& users)
+{
+    return DTO::ResponseDirectoryEntry::FromDir(dir, NodeName(names, dir), users);
+}
+
+uint64_t GetIDBits(const FileID fid)
+{
+    return static_cast<uint64_t>(fid.getEndpoint()) << 32U | fid.getUID();
+}
+
+// Digest of the values of one node of the tree hash
+uint64_t HashDigest(const std::array<uint64_t, 4>& values)
+{
+    const std::string_view bytes{reinterpret_cast<const char*>(values.data()), sizeof(values)};
+    return ankerl::unordered_dense::hash<std::string_view>{}(bytes);
+}
+} // namespace
+
 VirtualFile* VirtualFilesystem::findFile(const FileID file)
 {
-    iterationCache.clear();
-    iterationCache.push_back(&root);
+    if(!file.isFile())
+    {
+        return nullptr;
+    }
+    return fileNodes.get(lookup(file));
+}
+
+VirtualDirectory* VirtualFilesystem::findDir(const FileID dir)
+{
+    if(!dir.isDirectory())
+    {
+        return nullptr;
+    }
+    return dirNodes.get(lookup(dir));
+}
+
+VirtualDirectory* VirtualFilesystem::findContainingDir(const FileID file)
+{
+    const NodeHandle node = lookup(file);
+    if(node == NodeHandle::INVALID)
+    {
+        return nullptr;
+    }
+
+    // The root has no parent
+    const NodeHandle parent = file.isDirectory() ? dirNodes[ node ].links.parent : fileNodes[ node ].links.parent;
+    return dirNodes.get(parent);
+}
+
+VirtualDirectory& VirtualFilesystem::getRoot()
+{
+    return dirNodes[ root ];
+}
+
+std::string_view VirtualFilesystem::getName(const VirtualFile& file) const
+{
+    return NodeName(names, file);
+}
+
+std::string_view VirtualFilesystem::getName(const VirtualDirectory& dir) const
+{
+    return NodeName(names, dir);
+}
+
+bool VirtualFilesystem::dirCanHoldSize(const FileID dir, const uint64_t additional) const
+{
+    if(!dir.isDirectory())
+    {
+        return false;
+    }
+
+    const NodeHandle node = lookup(dir);
+    if(!dirNodes.contains(node))
+    {
+        return false;
+    }
+    return canHoldSize(node, additional);
+}
+
+VirtualFile* VirtualFilesystem::findFileByName(const FileID dir, const FileName& name)
+{
+    const NodeHandle dirNode = lookup(dir);
+    const VirtualDirectory* directory = findDir(dir);
+    if(directory == nullptr)
+    {
+        return nullptr;
+    }
+    return fileNodes.get(FindByName(fileNodes, names, directory->files, fileNameIndices, dirNode, name));
+}
+
+VirtualDirectory* VirtualFilesystem::findDirByName(const FileID dir, const FileName& name)
+{
+    const NodeHandle dirNode = lookup(dir);
+    const VirtualDirectory* directory = findDir(dir);
+    if(directory == nullptr)
+    {
+        return nullptr;
+    }
+    return dirNodes.get(FindByName(dirNodes, names, directory->dirs, dirNameIndices, dirNode, name));
+}
+
+FileID VirtualFilesystem::resolvePath(const FileID dir, std::string_view path) const
+{
+    NodeHandle dirNode = lookup(dir);
+    if(dirNodes.get(dirNode) == nullptr || !dir.isDirectory())
+    {
+        return FileID{};
+    }
 
-    while(!iterationCache.empty())
+    const bool onlyDir = !path.empty() && path.back() == '/';
+    while(!path.empty())
     {
-        auto* first = iterationCache.back();
-        iterationCache.pop_back();
+        const auto separator = path.find('/');
+        const std::string_view component = path.substr(0, separator);
+        path = separator == std::string_view::npos ? std::string_view{} : path.substr(separator + 1);
+        if(component.empty()) // Leading, trailing or repeated separators
+        {
+            continue;
+        }
+        if(component.size() > TPUNKT_STORAGE_FILE_LEN)
+        {
+            return FileID{};
+        }
 
-        auto* result = first->findFile(file);
-        if(result != nullptr)
+        const FileName name{component};
+        const VirtualDirectory& directory = dirNodes[ dirNode ];
+        const bool isLast = path.find_first_not_of('/') == std::string_view::npos;
+        if(isLast && !onlyDir)
         {
-            return result;
+            const NodeHandle file = FindByName(fileNodes, names, directory.files, fileNameIndices, dirNode, name);
+            if(file != NodeHandle::INVALID)
+            {
+                return fileNodes[ file ].getID();
+            }
         }
-        for(auto& dir : first->getDirs())
+
+        dirNode = FindByName(dirNodes, names, directory.dirs, dirNameIndices, dirNode, name);
+        if(dirNode == NodeHandle::INVALID)
         {
-            iterationCache.push_back(&dir);
+            return FileID{};
         }
     }
-    return nullptr;
+    return dirNodes[ dirNode ].getID();
 }
 
-VirtualDirectory* VirtualFilesystem::findDir(const FileID dir)
+bool VirtualFilesystem::collectEntries(const VirtualDirectory& dir, const DirectorySortOrder order,
+                                       const bool descending, const uint32_t limit, DirectoryCursor& cursor,
+                                       std::vector<DTO::ResponseDirectoryEntry>& entries)
+{
+    entries.clear();
+    const uint32_t maxEntries = limit == 0 ? UINT32_MAX : limit;
+    entries.reserve(std::min(maxEntries, dir.files.count + dir.dirs.count));
+
+    DTO::UserNameCache users;
+    const NodeHandle dirNode = cache.get(dir.fid);
+    if(order == DirectorySortOrder::INSERTION)
+    {
+        return collectInserted(dir, dirNode, maxEntries, cursor, users, entries);
+    }
+    return collectSorted(dirNode, order, descending, maxEntries, cursor, users, entries);
+}
+
+bool VirtualFilesystem::hasSortIndex(const VirtualDirectory& dir) const
 {
-    if(dir == root.getID())
+    return sortIndices.contains(cache.get(dir.fid));
+}
+
+//===== Access =====//
+
+bool VirtualFilesystem::fileAccess(const FileID file) const
+{
+    const VirtualFile* virtualFile = file.isFile() ? fileNodes.get(lookup(file)) : nullptr;
+    if(virtualFile == nullptr)
+    {
+        return false;
+    }
+    virtualFile->onAccess();
+    return true;
+}
+
+bool VirtualFilesystem::dirAccess(const FileID dir) const
+{
+    const VirtualDirectory* directory = dir.isDirectory() ? dirNodes.get(lookup(dir)) : nullptr;
+    if(directory == nullptr)
     {
-        return &root;
+        return false;
     }
+    directory->onAccess();
+    return true;
+}
 
-    iterationCache.clear();
-    iterationCache.push_back(&root);
+//===== Search =====//
 
-    while(!iterationCache.empty())
+bool VirtualFilesystem::search(const FileID dir, const NameSearchQuery& query, const uint32_t limit, uint64_t& cursor,
+                               const SearchFilter& filter, std::vector<DTO::ResponseDirectoryEntry>& entries) const
+{
+    entries.clear();
+    const NodeHandle dirNode = lookup(dir);
+    if(!dir.isDirectory() || dirNodes.get(dirNode) == nullptr)
     {
-        auto* first = iterationCache.back();
-        iterationCache.pop_back();
+        return false;
+    }
 
-        for(auto& itDir : first->getDirs())
+    DTO::UserNameCache users;
+    const auto isBelow = [ & ](NodeHandle parent)
+    {
+        // Nodes below a tombstone are unlinked from the root
+        if(dirNode == root && tombstones.empty())
         {
-            if(itDir.getID() == dir)
+            return true;
+        }
+        for(; parent != NodeHandle::INVALID; parent = dirNodes[ parent ].links.parent)
+        {
+            if(parent == dirNode)
             {
-                return &itDir;
+                return true;
             }
-            iterationCache.push_back(&itDir);
         }
+        return false;
+    };
+
+    const DirectoryCursor start{.position = cursor, .name = {}};
+    const bool startInDirs = (start.position & CURSOR_DIR_BIT) != 0;
+    const NodeHandle after = (start.position & CURSOR_VALID_BIT) != 0 ? GetCursorNode(start) : NodeHandle::INVALID;
+    const uint32_t maxEntries = limit == 0 ? UINT32_MAX : limit;
+
+    // Returns true if matches are left after the page is full
+    const auto collect =
+        [ & ](const auto& nodes, const VirtualNameSearch& index, const NodeHandle from, const bool isDir)
+    {
+        bool hasMore = false;
+        index.forEachCandidate(query, from,
+                               [ & ](const NodeHandle node)
+                               {
+                                   const auto& element = nodes[ node ];
+                                   if(!VirtualNameSearch::Matches(NodeName(names, element), query) ||
+                                      !isBelow(element.links.parent) || !filter(element.getID()))
+                                   {
+                                       return true;
+                                   }
+                                   if(entries.size() == maxEntries)
+                                   {
+                                       hasMore = true;
+                                       return false;
+                                   }
+                                   entries.push_back(GetEntry(names, element, users));
+                                   cursor = GetCursor(isDir, node, 0, 0).position;
+                                   return true;
+                               });
+        return hasMore;
+    };
+
+    if(!startInDirs && collect(fileNodes, fileSearch, after, false))
+    {
+        return true;
+    }
+    if(collect(dirNodes, dirSearch, startInDirs ? after : NodeHandle::INVALID, true))
+    {
+        return true;
+    }
+    cursor = 0;
+    return true;
+}
+
+//===== Files =====//
+
+bool VirtualFilesystem::fileAdd(const FileID dir, const FileCreationInfo& info, FileID& file)
+{
+    if(!dir.isDirectory())
+    {
+        return false;
+    }
+
+    const NodeHandle dirNode = lookup(dir);
+    VirtualDirectory* directory = dirNodes.get(dirNode);
+    if(directory == nullptr || IsNameTaken(fileNodes, names, directory->files, fileNameIndices, dirNode, info.name))
+    {
+        return false;
+    }
+
+    const NodeHandle node = fileCreate(info);
+    LinkNode(fileNodes, directory->files, dirNode, node);
+    IndexAdd(fileNodes, directory->files, fileNameIndices, dirNode, node);
+    fileSearch.add(node, info.name.view());
+    file = fileNodes[ node ].getID();
+    cache.add(file, node);
+    totalsAdd(dirNode, SubtreeTotals{.files = 1}, true);
+    sortInsert(node, true);
+    touchDir(dirNode);
+    persist(JournalOperation::FILE_ADD, fileNodes[ node ]);
+    return true;
+}
+
+bool VirtualFilesystem::fileDelete(const FileID file)
+{
+    if(!file.isFile())
+    {
+        return false;
+    }
+
+    const NodeHandle node = lookup(file);
+    const VirtualFile* virtualFile = fileNodes.get(node);
+    if(virtualFile == nullptr)
+    {
+        return false;
+    }
+
+    const NodeHandle dirNode = virtualFile->links.parent;
+    VirtualDirectory& directory = dirNodes[ dirNode ];
+    const uint64_t fileSize = virtualFile->details->stats.size;
+    persist(JournalOperation::FILE_DELETE, *virtualFile);
+
+    sortRemove(node, true);
+    UnlinkNode(fileNodes, directory.files, node);
+    IndexRemove(directory.files, fileNameIndices, dirNode, virtualFile->nameHash, node);
+    fileSearch.remove(node, NodeName(names, *virtualFile));
+    fileDestroy(node);
+    cache.remove(file);
+
+    totalsRemove(dirNode, SubtreeTotals{.size = fileSize, .files = 1}, true);
+    touchDir(dirNode);
+    return true;
+}
+
+bool VirtualFilesystem::fileChangeSize(const FileID file, const uint64_t newFileSize)
+{
+    VirtualFile* changeFile = findFile(file);
+    if(changeFile == nullptr) [[unlikely]]
+    {
+        return false;
+    }
+
+    const uint64_t currFileSize = changeFile->details->stats.size;
+    if(currFileSize == newFileSize) [[unlikely]]
+    {
+        return true;
+    }
+
+    const NodeHandle dirNode = changeFile->links.parent;
+    if(newFileSize > currFileSize && !canHoldSize(dirNode, newFileSize - currFileSize)) [[unlikely]]
+    {
+        return false;
+    }
+
+    const NodeHandle node = lookup(file);
+    const SortPosition position = sortFind(node, true, SORT_KEY_SIZE | SORT_KEY_MODIFIED);
+    totalsRemove(dirNode, SubtreeTotals{.size = currFileSize}, true);
+    totalsAdd(dirNode, SubtreeTotals{.size = newFileSize}, true);
+    changeFile->details->stats.size = newFileSize;
+    changeFile->onModification();
+    sortMove(position);
+    touchDir(dirNode);
+    persist(JournalOperation::FILE_RESIZE, *changeFile);
+    return true;
+}
+
+//===== Directories =====//
+
+bool VirtualFilesystem::dirAdd(const FileID dir, const DirectoryCreationInfo& info, FileID& newDir)
+{
+    if(!dir.isDirectory())
+    {
+        return false;
+    }
+
+    const NodeHandle dirNode = lookup(dir);
+    VirtualDirectory* directory = dirNodes.get(dirNode);
+    if(directory == nullptr || IsNameTaken(dirNodes, names, directory->dirs, dirNameIndices, dirNode, info.name))
+    {
+        return false;
+    }
+
+    DirectoryCreationInfo createInfo = info;
+    createInfo.parent = dir;
+    const NodeHandle node = dirNodes.create(createInfo, names.add(info.name.view()));
+    LinkNode(dirNodes, directory->dirs, dirNode, node);
+    IndexAdd(dirNodes, directory->dirs, dirNameIndices, dirNode, node);
+    dirSearch.add(node, info.name.view());
+    newDir = dirNodes[ node ].getID();
+    cache.add(newDir, node);
+    totalsAdd(dirNode, SubtreeTotals{.dirs = 1}, false);
+    sortInsert(node, false);
+    touchDir(dirNode);
+    persist(JournalOperation::DIR_ADD, dirNodes[ node ]);
+    return true;
+}
+
+bool VirtualFilesystem::dirDelete(const FileID dir)
+{
+    if(!dir.isDirectory())
+    {
+        LOG_WARNING("Calling dirDelete on non-Directory");
+        return false;
+    }
+
+    const NodeHandle node = lookup(dir);
+    VirtualDirectory* directory = dirNodes.get(node);
+    if(directory == nullptr || node == root || !directory->isEmpty())
+    {
+        return false;
     }
-    return nullptr;
+
+    const NodeHandle parentNode = directory->links.parent;
+    VirtualDirectory& parent = dirNodes[ parentNode ];
+    persist(JournalOperation::DIR_DELETE, *directory);
+    sortRemove(node, false);
+    UnlinkNode(dirNodes, parent.dirs, node);
+    IndexRemove(parent.dirs, dirNameIndices, parentNode, directory->nameHash, node);
+    dirSearch.remove(node, NodeName(names, *directory));
+    nameRemove(directory->name);
+    treeInvalidate(node); // Handle is reused
+    dirNodes.destroy(node);
+    cache.remove(dir);
+
+    // Handle is reused - never inherit an index
+    fileNameIndices.erase(node);
+    dirNameIndices.erase(node);
+    sortIndices.erase(node);
+
+    totalsRemove(parentNode, SubtreeTotals{.dirs = 1}, false);
+    touchDir(parentNode);
+    return true;
 }
 
-VirtualDirectory* VirtualFilesystem::findContainingDir(FileID file)
+bool VirtualFilesystem::dirTombstone(const FileID dir)
 {
-    iterationCache.clear();
-    iterationCache.push_back(&root);
+    if(!dir.isDirectory())
+    {
+        return false;
+    }
+
+    const NodeHandle node = lookup(dir);
+    VirtualDirectory* directory = dirNodes.get(node);
+    if(directory == nullptr || node == root)
+    {
+        return false;
+    }
+
+    const NodeHandle parentNode = directory->links.parent;
+    VirtualDirectory& parent = dirNodes[ parentNode ];
+    const DirectoryStats& stats = directory->stats;
+    const SubtreeTotals totals{.size = stats.getTotalSize(), .files = stats.totalFiles, .dirs = stats.totalDirs + 1};
+    persist(JournalOperation::DIR_TOMBSTONE, *directory);
+
+    // Unlinked nodes have no parent - everything below is only reachable through the cache
+    treeInvalidate(node);
+    sortRemove(node, false);
+    UnlinkNode(dirNodes, parent.dirs, node);
+    IndexRemove(parent.dirs, dirNameIndices, parentNode, directory->nameHash, node);
+    totalsRemove(parentNode, totals, false);
+    touchDir(parentNode);
+    tombstones.push_back(node);
+    return true;
+}
 
-    while(!iterationCache.empty())
+bool VirtualFilesystem::dirReclaim(const uint32_t limit, std::vector<FileID>& removedFiles)
+{
+    uint32_t removed = 0;
+    while(!tombstones.empty() && removed < limit)
     {
-        auto* first = iterationCache.back();
-        iterationCache.pop_back();
+        // Deepest first dir of the tombstone - its files are removed before the dir itself
+        NodeHandle dirNode = tombstones.back();
+        while(dirNodes[ dirNode ].dirs.first != NodeHandle::INVALID)
+        {
+            dirNode = dirNodes[ dirNode ].dirs.first;
+        }
 
-        auto* fileResult = first->findFile(file);
-        if(fileResult != nullptr) [[unlikely]]
+        VirtualDirectory& directory = dirNodes[ dirNode ];
+        while(directory.files.first != NodeHandle::INVALID && removed < limit)
+        {
+            const NodeHandle node = directory.files.first;
+            const VirtualFile& file = fileNodes[ node ];
+            removedFiles.push_back(file.fid);
+            UnlinkNode(fileNodes, directory.files, node);
+            fileSearch.remove(node, NodeName(names, file));
+            cache.remove(file.fid);
+            fileDestroy(node);
+            ++removed;
+        }
+        if(!directory.files.empty())
         {
-            return first;
+            break;
         }
-        auto* dirResult = first->findDir(file);
-        if(dirResult != nullptr) [[unlikely]]
+
+        // Name and sort index of the dir are dropped with it
+        const NodeHandle parentNode = directory.links.parent;
+        if(parentNode != NodeHandle::INVALID)
         {
-            return first;
+            UnlinkNode(dirNodes, dirNodes[ parentNode ].dirs, dirNode);
         }
-        for(auto& itDir : first->getDirs())
+        else
         {
-            iterationCache.push_back(&itDir);
+            tombstones.pop_back();
         }
+        dirSearch.remove(dirNode, NodeName(names, directory));
+        nameRemove(directory.name);
+        treeInvalidate(dirNode); // Handle is reused
+        cache.remove(directory.fid);
+        dirNodes.destroy(dirNode);
+        fileNameIndices.erase(dirNode);
+        dirNameIndices.erase(dirNode);
+        sortIndices.erase(dirNode);
+        ++removed;
     }
-    return nullptr;
+    return !tombstones.empty();
 }
 
-VirtualDirectory& VirtualFilesystem::getRoot()
+bool VirtualFilesystem::hasTombstones() const
+{
+    return !tombstones.empty();
+}
+
+bool VirtualFilesystem::fileRename(const FileID file, const FileName& name)
 {
-    return root;
+    if(!file.isFile())
+    {
+        return false;
+    }
+
+    const NodeHandle node = lookup(file);
+    VirtualFile* virtualFile = fileNodes.get(node);
+    if(virtualFile == nullptr)
+    {
+        return false;
+    }
+
+    // The name check would find the file itself
+    if(NodeName(names, *virtualFile) == name.view())
+    {
+        return true;
+    }
+
+    const NodeHandle dirNode = virtualFile->links.parent;
+    VirtualDirectory& directory = dirNodes[ dirNode ];
+    if(IsNameTaken(fileNodes, names, directory.files, fileNameIndices, dirNode, name))
+    {
+        return false;
+    }
+
+    const auto iter = fileNameIndices.find(dirNode);
+    if(iter != fileNameIndices.end())
+    {
+        iter->second.remove(virtualFile->nameHash, node);
+    }
+    const SortPosition position = sortFind(node, true, SORT_KEY_NAME | SORT_KEY_MODIFIED);
+    fileSearch.remove(node, NodeName(names, *virtualFile));
+    nameRemove(virtualFile->name);
+    virtualFile->rename(names.add(name.view()), HashFileName(name));
+    fileSearch.add(node, name.view());
+    sortMove(position);
+    IndexAdd(fileNodes, directory.files, fileNameIndices, dirNode, node);
+    touchDir(dirNode);
+    persist(JournalOperation::FILE_RENAME, *virtualFile);
+    return true;
 }
 
-bool VirtualFilesystem::dirCanHoldSize(FileID dir, uint64_t additional)
+bool VirtualFilesystem::dirRename(const FileID dir, const FileName& name)
 {
-    auto* target = findDir(dir);
-    if(target == nullptr)
+    const NodeHandle node = lookup(dir);
+    VirtualDirectory* directory = findDir(dir);
+    if(directory == nullptr)
+    {
+        return false;
+    }
+
+    // The name check would find the directory itself
+    if(NodeName(names, *directory) == name.view())
+    {
+        return true;
+    }
+
+    // The root has no siblings
+    if(node == root)
+    {
+        nameRemove(directory->name);
+        directory->rename(names.add(name.view()), HashFileName(name));
+        treeInvalidate(node);
+        persist(JournalOperation::DIR_RENAME, *directory);
+        return true;
+    }
+
+    const NodeHandle parentNode = directory->links.parent;
+    VirtualDirectory& parent = dirNodes[ parentNode ];
+    if(IsNameTaken(dirNodes, names, parent.dirs, dirNameIndices, parentNode, name))
     {
         return false;
     }
 
-    iterationCache.clear();
-    // VirtualDirectory* parent = target->getInfo().parent;
+    const auto iter = dirNameIndices.find(parentNode);
+    if(iter != dirNameIndices.end())
+    {
+        iter->second.remove(directory->nameHash, node);
+    }
+    const SortPosition position = sortFind(node, false, SORT_KEY_NAME | SORT_KEY_MODIFIED);
+    dirSearch.remove(node, NodeName(names, *directory));
+    nameRemove(directory->name);
+    directory->rename(names.add(name.view()), HashFileName(name));
+    treeInvalidate(node);
+    dirSearch.add(node, name.view());
+    sortMove(position);
+    IndexAdd(dirNodes, parent.dirs, dirNameIndices, parentNode, node);
+    touchDir(parentNode);
+    persist(JournalOperation::DIR_RENAME, *directory);
+    return true;
+}
+
+bool VirtualFilesystem::fileMove(const FileID file, const FileID dir)
+{
+    if(!file.isFile() || !dir.isDirectory())
+    {
+        return false;
+    }
+
+    const NodeHandle node = lookup(file);
+    const NodeHandle newDirNode = lookup(dir);
+    VirtualFile* virtualFile = fileNodes.get(node);
+    VirtualDirectory* newDirectory = dirNodes.get(newDirNode);
+    if(virtualFile == nullptr || newDirectory == nullptr)
+    {
+        return false;
+    }
+
+    const NodeHandle dirNode = virtualFile->links.parent;
+    if(dirNode == newDirNode)
+    {
+        return true;
+    }
+
+    // Directories both are in already hold the size
+    const uint64_t fileSize = virtualFile->details->stats.size;
+    const FileName name{NodeName(names, *virtualFile)};
+    if(IsNameTaken(fileNodes, names, newDirectory->files, fileNameIndices, newDirNode, name) ||
+       !canHoldSize(newDirNode, fileSize, getCommonParent(dirNode, newDirNode)))
+    {
+        return false;
+    }
+
+    VirtualDirectory& directory = dirNodes[ dirNode ];
+    sortRemove(node, true);
+    UnlinkNode(fileNodes, directory.files, node);
+    IndexRemove(directory.files, fileNameIndices, dirNode, virtualFile->nameHash, node);
+    totalsRemove(dirNode, SubtreeTotals{.size = fileSize, .files = 1}, true);
+    touchDir(dirNode);
+
+    LinkNode(fileNodes, newDirectory->files, newDirNode, node);
+    IndexAdd(fileNodes, newDirectory->files, fileNameIndices, newDirNode, node);
+    totalsAdd(newDirNode, SubtreeTotals{.size = fileSize, .files = 1}, true);
+    sortInsert(node, true);
+    touchDir(newDirNode);
+    persist(JournalOperation::FILE_MOVE, *virtualFile);
+    return true;
+}
+
+bool VirtualFilesystem::dirMove(const FileID dir, const FileID newParent)
+{
+    if(!dir.isDirectory() || !newParent.isDirectory())
+    {
+        return false;
+    }
+
+    const NodeHandle node = lookup(dir);
+    const NodeHandle newParentNode = lookup(newParent);
+    VirtualDirectory* directory = dirNodes.get(node);
+    VirtualDirectory* newParentDir = dirNodes.get(newParentNode);
+    if(directory == nullptr || newParentDir == nullptr || node == root)
+    {
+        return false;
+    }
+
+    const NodeHandle parentNode = directory->links.parent;
+    if(parentNode == newParentNode)
+    {
+        return true;
+    }
+
+    // Can't be moved below itself
+    for(NodeHandle parent = newParentNode; parent != NodeHandle::INVALID; parent = dirNodes[ parent ].links.parent)
+    {
+        if(parent == node)
+        {
+            return false;
+        }
+    }
+
+    const DirectoryStats& stats = directory->stats;
+    const SubtreeTotals totals{.size = stats.getTotalSize(), .files = stats.totalFiles, .dirs = stats.totalDirs + 1};
+    const FileName name{NodeName(names, *directory)};
+    if(IsNameTaken(dirNodes, names, newParentDir->dirs, dirNameIndices, newParentNode, name) ||
+       !canHoldSize(newParentNode, totals.size, getCommonParent(parentNode, newParentNode)))
+    {
+        return false;
+    }
+
+    VirtualDirectory& parent = dirNodes[ parentNode ];
+    treeInvalidate(node); // Snapshot knows its parent
+    sortRemove(node, false);
+    UnlinkNode(dirNodes, parent.dirs, node);
+    IndexRemove(parent.dirs, dirNameIndices, parentNode, directory->nameHash, node);
+    totalsRemove(parentNode, totals, false);
+    touchDir(parentNode);
+
+    LinkNode(dirNodes, newParentDir->dirs, newParentNode, node);
+    IndexAdd(dirNodes, newParentDir->dirs, dirNameIndices, newParentNode, node);
+    directory->info.parent = newParent;
+    totalsAdd(newParentNode, totals, false);
+    sortInsert(node, false);
+    touchDir(newParentNode);
+    persist(JournalOperation::DIR_MOVE, *directory);
+    return true;
+}
+
+//===== Persistence =====//
+
+bool VirtualFilesystem::restore(const VirtualNodeState& state)
+{
+    if(!state.fid.isValid() || cache.get(state.fid) != NodeHandle::INVALID)
+    {
+        return false;
+    }
+    FileID::ReserveUID(state.fid.getUID());
+
+    // Root keeps its configured limit
+    if(!state.parent.isValid())
+    {
+        VirtualDirectory& rootDir = dirNodes[ root ];
+        if(!state.fid.isDirectory() || state.fid.getEndpoint() != rootDir.fid.getEndpoint())
+        {
+            return false;
+        }
+        cache.remove(rootDir.fid);
+        rootDir.fid = state.fid;
+        nameRemove(rootDir.name);
+        rootDir.name = names.add(state.info.name.view());
+        rootDir.nameHash = HashFileName(state.info.name);
+        rootDir.info.base = NodeInfo{.creator = state.info.creator, .owner = state.info.owner};
+        rootDir.stats.base = state.stats;
+        rootDir.stats.base.size = 0;
+        cache.add(state.fid, root);
+        treeInvalidate(root);
+        return true;
+    }
+
+    const NodeHandle dirNode = state.parent.isDirectory() ? cache.get(state.parent) : NodeHandle::INVALID;
+    VirtualDirectory* directory = dirNodes.get(dirNode);
+    if(directory == nullptr)
+    {
+        return false;
+    }
+
+    if(state.fid.isDirectory())
+    {
+        if(IsNameTaken(dirNodes, names, directory->dirs, dirNameIndices, dirNode, state.info.name))
+        {
+            return false;
+        }
+
+        const NodeHandle node = dirNodes.create(DirectoryCreationInfo{.name = state.info.name,
+                                                                      .creator = state.info.creator,
+                                                                      .parent = state.parent,
+                                                                      .maxSize = state.sizeLimit},
+                                                names.add(state.info.name.view()));
+        VirtualDirectory& newDir = dirNodes[ node ];
+        newDir.fid = state.fid;
+        newDir.info.base = NodeInfo{.creator = state.info.creator, .owner = state.info.owner};
+        newDir.stats.base = state.stats;
+        newDir.stats.base.size = 0; // Rebuilt from its files
+        LinkNode(dirNodes, directory->dirs, dirNode, node);
+        IndexAdd(dirNodes, directory->dirs, dirNameIndices, dirNode, node);
+        dirSearch.add(node, state.info.name.view());
+        sortInsert(node, false);
+        cache.add(state.fid, node);
+        totalsAdd(dirNode, SubtreeTotals{.dirs = 1}, false);
+        treeInvalidate(dirNode);
+        return true;
+    }
+
+    if(IsNameTaken(fileNodes, names, directory->files, fileNameIndices, dirNode, state.info.name))
+    {
+        return false;
+    }
+
+    const NodeHandle node = fileCreate(FileCreationInfo{
+        .name = state.info.name, .creator = state.info.creator, .endpoint = state.fid.getEndpoint()});
+    VirtualFile& newFile = fileNodes[ node ];
+    newFile.fid = state.fid;
+    newFile.details->info = NodeInfo{.creator = state.info.creator, .owner = state.info.owner};
+    newFile.details->stats = state.stats;
+    LinkNode(fileNodes, directory->files, dirNode, node);
+    IndexAdd(fileNodes, directory->files, fileNameIndices, dirNode, node);
+    fileSearch.add(node, state.info.name.view());
+    sortInsert(node, true);
+    cache.add(state.fid, node);
+    totalsAdd(dirNode, SubtreeTotals{.size = state.stats.size, .files = 1}, true);
+    treeInvalidate(dirNode);
+    return true;
+}
+
+void VirtualFilesystem::collectNodes(std::vector<VirtualNodeState>& nodes) const
+{
+    nodes.clear();
+    nodes.reserve(fileNodes.size() + dirNodes.size());
+
+    // Breadth first - parents are always restored before their children
+    std::vector<NodeHandle> queue;
+    queue.reserve(dirNodes.size());
+    queue.push_back(root);
+    for(size_t i = 0; i < queue.size(); ++i)
+    {
+        const VirtualDirectory& dir = dirNodes[ queue[ i ] ];
+        nodes.push_back(getState(dir));
+        forEachFile(dir, [ & ](const VirtualFile& file) { nodes.push_back(getState(file)); });
+        for(NodeHandle node = dir.dirs.first; node != NodeHandle::INVALID; node = dirNodes[ node ].links.next)
+        {
+            queue.push_back(node);
+        }
+    }
+}
+
+void VirtualFilesystem::setPersistence(VirtualFilesystemPersistence* newPersistence)
+{
+    persistence = newPersistence;
+}
+
+//===== Changes =====//
+
+const VirtualChangeLog& VirtualFilesystem::getChanges() const
+{
+    return changes;
+}
+
+void VirtualFilesystem::changesReset(const uint64_t sequence)
+{
+    changes.reset(sequence);
+}
+
+//===== Snapshots =====//
+
+VirtualSnapshot VirtualFilesystem::takeSnapshot()
+{
+    // Snapshots are held here while the tree is built - holders drop theirs on other threads without the lock
+    ankerl::unordered_dense::map<NodeHandle, VirtualSnapshot, NodeHandleHash> snapshots;
+
+    // Only directories without a snapshot are copied - their parents can't have one either
+    std::vector<NodeHandle> changed;
+    std::vector<NodeHandle> stack{root};
+    while(!stack.empty())
+    {
+        const NodeHandle dir = stack.back();
+        stack.pop_back();
+        const auto iter = dirSnapshots.find(dir);
+        if(iter != dirSnapshots.end())
+        {
+            if(auto snapshot = iter->second.lock())
+            {
+                snapshots.emplace(dir, std::move(snapshot));
+                continue;
+            }
+        }
+        changed.push_back(dir);
+        const VirtualNodeList& dirs = dirNodes[ dir ].dirs;
+        for(NodeHandle node = dirs.first; node != NodeHandle::INVALID; node = dirNodes[ node ].links.next)
+        {
+            stack.push_back(node);
+        }
+    }
+
+    // Children before their parents
+    for(auto iter = changed.rbegin(); iter != changed.rend(); ++iter)
+    {
+        const VirtualDirectory& dir = dirNodes[ *iter ];
+        auto snapshot = std::make_shared<DirectorySnapshot>();
+        snapshot->fid = dir.fid;
+        snapshot->parent = dir.links.parent != NodeHandle::INVALID ? dirNodes[ dir.links.parent ].fid : dir.info.parent;
+        snapshot->info = dir.info.base;
+        snapshot->stats = dir.stats;
+        snapshot->sizeLimit = dir.limits.sizeLimit;
+
+        const std::string_view dirName = NodeName(names, dir);
+        snapshot->name = NameRef{.offset = 0, .length = static_cast<uint32_t>(dirName.size())};
+        snapshot->names.append(dirName);
+        snapshot->files.reserve(dir.files.count);
+        forEachFile(dir,
+                    [ & ](const VirtualFile& file)
+                    {
+                        const std::string_view fileName = NodeName(names, file);
+                        snapshot->files.push_back(FileSnapshot{
+                            .fid = file.fid,
+                            .name = NameRef{.offset = static_cast<uint32_t>(snapshot->names.size()),
+                                            .length = static_cast<uint32_t>(fileName.size())},
+                            .info = file.details->info,
+                            .stats = file.details->stats});
+                        snapshot->names.append(fileName);
+                    });
+
+        snapshot->dirs.reserve(dir.dirs.count);
+        for(NodeHandle node = dir.dirs.first; node != NodeHandle::INVALID; node = dirNodes[ node ].links.next)
+        {
+            snapshot->dirs.push_back(snapshots[ node ]);
+        }
+
+        dirSnapshots[ *iter ] = snapshot;
+        snapshots[ *iter ] = std::move(snapshot);
+    }
+    return snapshots[ root ];
+}
+
+void VirtualFilesystem::treeInvalidate(const NodeHandle dir)
+{
+    bool hasSnapshot = true;
+    for(NodeHandle node = dir; node != NodeHandle::INVALID; node = dirNodes[ node ].links.parent)
+    {
+        if(hasSnapshot)
+        {
+            const auto iter = dirSnapshots.find(node);
+            hasSnapshot = iter != dirSnapshots.end() && !iter->second.expired();
+            if(iter != dirSnapshots.end())
+            {
+                dirSnapshots.erase(iter);
+            }
+        }
+
+        VirtualDirectory& directory = dirNodes[ node ];
+        const bool hadTreeHash = directory.hasTreeHash;
+        directory.hasTreeHash = false;
+        if(!hasSnapshot && !hadTreeHash)
+        {
+            return;
+        }
+    }
+}
+
+//===== Tree Hashes =====//
+
+bool VirtualFilesystem::getTreeHash(const FileID dir, uint64_t& hash)
+{
+    if(!dir.isDirectory())
+    {
+        return false;
+    }
+    const NodeHandle dirNode = lookup(dir);
+    if(dirNode == NodeHandle::INVALID)
+    {
+        return false;
+    }
+
+    // Only directories without a hash are visited - their parents can't have one either
+    std::vector<NodeHandle> changed;
+    std::vector<NodeHandle> stack{dirNode};
+    while(!stack.empty())
+    {
+        const NodeHandle node = stack.back();
+        stack.pop_back();
+        if(dirNodes[ node ].hasTreeHash)
+        {
+            continue;
+        }
+        changed.push_back(node);
+        const VirtualNodeList& dirs = dirNodes[ node ].dirs;
+        for(NodeHandle child = dirs.first; child != NodeHandle::INVALID; child = dirNodes[ child ].links.next)
+        {
+            stack.push_back(child);
+        }
+    }
+
+    // Children before their parents - sum of the child digests so the order of the children doesn't matter
+    for(auto iter = changed.rbegin(); iter != changed.rend(); ++iter)
+    {
+        VirtualDirectory& directory = dirNodes[ *iter ];
+        uint64_t sum = 0;
+        forEachFile(directory,
+                    [ & ](const VirtualFile& file)
+                    {
+                        const FileStats& stats = file.details->stats;
+                        sum += HashDigest({GetIDBits(file.fid), file.nameHash, stats.size, stats.modified.getNanos()});
+                    });
+        forEachDir(directory,
+                   [ & ](const VirtualDirectory& subDir)
+                   {
+                       const uint64_t size = subDir.stats.getTotalSize();
+                       sum += HashDigest({GetIDBits(subDir.fid), subDir.nameHash, size, subDir.treeHash});
+                   });
+        directory.treeHash = HashDigest({sum, directory.files.count, directory.dirs.count, 0});
+        directory.hasTreeHash = true;
+    }
+
+    hash = dirNodes[ dirNode ].treeHash;
+    return true;
+}
+
+//===== Names =====//
+
+void VirtualFilesystem::setNameCompactionRequest(std::function<void()> request)
+{
+    nameCompactionRequest = std::move(request);
+}
+
+void VirtualFilesystem::compactNames()
+{
+    nameCompactionRequested = false;
+    VirtualNameArena compacted;
+    compacted.reserve(names.getUsedBytes());
+    fileNodes.forEach([ & ](NodeHandle, VirtualFile& file) { file.name = compacted.add(names.get(file.name)); });
+    dirNodes.forEach([ & ](NodeHandle, VirtualDirectory& dir) { dir.name = compacted.add(names.get(dir.name)); });
+    names = std::move(compacted);
+}
+
+const VirtualNameArena& VirtualFilesystem::getNames() const
+{
+    return names;
+}
+
+void VirtualFilesystem::nameRemove(NameRef& name)
+{
+    names.remove(name);
+    name = NameRef{}; // Not carried over if compacted right away
+    if(!names.isFragmented() || nameCompactionRequested)
+    {
+        return;
+    }
+
+    if(!nameCompactionRequest)
+    {
+        compactNames();
+        return;
+    }
+    nameCompactionRequested = true;
+    nameCompactionRequest();
+}
+
+VirtualNodeState VirtualFilesystem::getState(const VirtualFile& file) const
+{
+    // Zeroed so no padding bytes end up on disk
+    VirtualNodeState state;
+    memset(static_cast<void*>(&state), 0, sizeof(VirtualNodeState));
+    state.fid = file.fid;
+    state.parent = dirNodes[ file.links.parent ].fid;
+    state.info.name = NodeName(names, file);
+    state.info.creator = file.details->info.creator;
+    state.info.owner = file.details->info.owner;
+    state.stats = file.details->stats;
+    return state;
+}
+
+VirtualNodeState VirtualFilesystem::getState(const VirtualDirectory& dir) const
+{
+    VirtualNodeState state;
+    memset(static_cast<void*>(&state), 0, sizeof(VirtualNodeState));
+    state.fid = dir.fid;
+    state.parent = dir.links.parent != NodeHandle::INVALID ? dirNodes[ dir.links.parent ].fid : dir.info.parent;
+    state.info.name = NodeName(names, dir);
+    state.info.creator = dir.info.base.creator;
+    state.info.owner = dir.info.base.owner;
+    state.stats = dir.stats.base;
+    state.sizeLimit = dir.limits.sizeLimit;
+    return state;
+}
+
+template <typename Node>
+void VirtualFilesystem::persist(const JournalOperation operation, const Node& node)
+{
+    const NodeHandle parent = node.links.parent;
+    changes.add(operation, node.fid, parent != NodeHandle::INVALID ? dirNodes[ parent ].fid : FileID{});
+    if(persistence != nullptr && !persistence->append(operation, getState(node))) [[unlikely]]
+    {
+        LOG_ERROR("Failed to persist filesystem change");
+    }
+}
+
+//===== Listing =====//
+
+bool VirtualFilesystem::collectInserted(const VirtualDirectory& dir, const NodeHandle dirNode, const uint32_t limit,
+                                        DirectoryCursor& cursor, DTO::UserNameCache& users,
+                                        std::vector<DTO::ResponseDirectoryEntry>& entries) const
+{
+    const NodeHandle node = GetCursorNode(cursor);
+    const auto order = static_cast<uint32_t>(cursor.position >> 32U) & MAX_NODE_ORDER;
+
+    NodeHandle file = dir.files.first;
+    NodeHandle subDir = dir.dirs.first;
+    if((cursor.position & CURSOR_DIR_BIT) != 0)
+    {
+        file = NodeHandle::INVALID;
+        subDir = ResumeAfter(dirNodes, dir.dirs, dirNode, node, order);
+    }
+    else if((cursor.position & CURSOR_VALID_BIT) != 0)
+    {
+        file = ResumeAfter(fileNodes, dir.files, dirNode, node, order);
+    }
+
+    NodeHandle last = NodeHandle::INVALID;
+    for(; file != NodeHandle::INVALID && entries.size() < limit; file = fileNodes[ file ].links.next)
+    {
+        entries.push_back(GetEntry(names, fileNodes[ file ], users));
+        last = file;
+    }
+
+    if(file != NodeHandle::INVALID || (subDir != NodeHandle::INVALID && entries.size() == limit))
+    {
+        cursor = GetCursor(false, last, fileNodes[ last ].links.order, 0);
+        return false;
+    }
+
+    for(; subDir != NodeHandle::INVALID && entries.size() < limit; subDir = dirNodes[ subDir ].links.next)
+    {
+        entries.push_back(GetEntry(names, dirNodes[ subDir ], users));
+        last = subDir;
+    }
+
+    if(subDir != NodeHandle::INVALID)
+    {
+        cursor = GetCursor(true, last, dirNodes[ last ].links.order, 0);
+        return false;
+    }
+    cursor = DirectoryCursor{};
+    return true;
+}
+
+bool VirtualFilesystem::collectSorted(const NodeHandle dirNode, const DirectorySortOrder order, const bool descending,
+                                      const uint32_t limit, DirectoryCursor& cursor, DTO::UserNameCache& users,
+                                      std::vector<DTO::ResponseDirectoryEntry>& entries)
+{
+    const SortIndex& index = getSortIndex(dirNode);
+    const std::vector<NodeHandle>& files = index.files[ GetSortSlot(order) ];
+    const std::vector<NodeHandle>& dirs = index.dirs[ GetSortSlot(order) ];
+    const auto at = [ descending ](const std::vector<NodeHandle>& sorted, const size_t i)
+    { return descending ? sorted[ sorted.size() - 1 - i ] : sorted[ i ]; };
+
+    size_t file = 0;
+    size_t subDir = 0;
+    if((cursor.position & CURSOR_DIR_BIT) != 0)
+    {
+        file = files.size();
+        subDir = SortedResume(dirNodes, names, dirs, order, descending, dirNode, cursor);
+    }
+    else if((cursor.position & CURSOR_VALID_BIT) != 0)
+    {
+        file = SortedResume(fileNodes, names, files, order, descending, dirNode, cursor);
+    }
+
+    NodeHandle last = NodeHandle::INVALID;
+    for(; file < files.size() && entries.size() < limit; ++file)
+    {
+        last = at(files, file);
+        entries.push_back(GetEntry(names, fileNodes[ last ], users));
+    }
+
+    if(file < files.size() || (subDir < dirs.size() && entries.size() == limit))
+    {
+        const std::string_view name = order == DirectorySortOrder::NAME ? NodeName(names, fileNodes[ last ]) : "";
+        cursor = GetCursor(false, last, 0, GetSortKey(names, fileNodes[ last ], order), name);
+        return false;
+    }
+
+    for(; subDir < dirs.size() && entries.size() < limit; ++subDir)
+    {
+        last = at(dirs, subDir);
+        entries.push_back(GetEntry(names, dirNodes[ last ], users));
+    }
+
+    if(subDir < dirs.size())
+    {
+        const std::string_view name = order == DirectorySortOrder::NAME ? NodeName(names, dirNodes[ last ]) : "";
+        cursor = GetCursor(true, last, 0, GetSortKey(names, dirNodes[ last ], order), name);
+        return false;
+    }
+    cursor = DirectoryCursor{};
+    return true;
+}
+
+//===== Sort Index =====//
+
+VirtualFilesystem::SortIndex& VirtualFilesystem::getSortIndex(const NodeHandle dir)
+{
+    const auto iter = sortIndices.find(dir);
+    if(iter != sortIndices.end())
+    {
+        return iter->second;
+    }
+
+    const VirtualDirectory& directory = dirNodes[ dir ];
+    SortIndex index;
+    for(const DirectorySortOrder order : SORTED_ORDERS)
+    {
+        std::vector<NodeHandle>& files = index.files[ GetSortSlot(order) ];
+        files.reserve(directory.files.count);
+        for(NodeHandle node = directory.files.first; node != NodeHandle::INVALID; node = fileNodes[ node ].links.next)
+        {
+            files.push_back(node);
+        }
+        std::ranges::sort(files, [ & ](const NodeHandle left, const NodeHandle right)
+                          { return SortLess(fileNodes, names, order, left, right); });
+
+        std::vector<NodeHandle>& dirs = index.dirs[ GetSortSlot(order) ];
+        dirs.reserve(directory.dirs.count);
+        for(NodeHandle node = directory.dirs.first; node != NodeHandle::INVALID; node = dirNodes[ node ].links.next)
+        {
+            dirs.push_back(node);
+        }
+        std::ranges::sort(dirs, [ & ](const NodeHandle left, const NodeHandle right)
+                          { return SortLess(dirNodes, names, order, left, right); });
+    }
+    return sortIndices.emplace(dir, std::move(index)).first->second;
+}
+
+void VirtualFilesystem::sortRemove(const NodeHandle node, const bool isFile)
+{
+    if(sortIndices.empty())
+    {
+        return;
+    }
+
+    const NodeHandle parent = isFile ? fileNodes[ node ].links.parent : dirNodes[ node ].links.parent;
+    const auto iter = sortIndices.find(parent);
+    if(iter == sortIndices.end())
+    {
+        return;
+    }
+
+    for(const DirectorySortOrder order : SORTED_ORDERS)
+    {
+        if(isFile)
+        {
+            SortedRemove(fileNodes, names, iter->second.files[ GetSortSlot(order) ], order, node);
+        }
+        else
+        {
+            SortedRemove(dirNodes, names, iter->second.dirs[ GetSortSlot(order) ], order, node);
+        }
+    }
+}
+
+void VirtualFilesystem::sortInsert(const NodeHandle node, const bool isFile)
+{
+    if(sortIndices.empty())
+    {
+        return;
+    }
+
+    const NodeHandle parent = isFile ? fileNodes[ node ].links.parent : dirNodes[ node ].links.parent;
+    const auto iter = sortIndices.find(parent);
+    if(iter == sortIndices.end())
+    {
+        return;
+    }
+
+    for(const DirectorySortOrder order : SORTED_ORDERS)
+    {
+        if(isFile)
+        {
+            SortedInsert(fileNodes, names, iter->second.files[ GetSortSlot(order) ], order, node);
+        }
+        else
+        {
+            SortedInsert(dirNodes, names, iter->second.dirs[ GetSortSlot(order) ], order, node);
+        }
+    }
+}
+
+VirtualFilesystem::SortPosition VirtualFilesystem::sortFind(const NodeHandle node, const bool isFile,
+                                                            const uint8_t keys)
+{
+    SortPosition position{.node = NodeHandle::INVALID, .index = {}, .isFile = isFile};
+    if(sortIndices.empty())
+    {
+        return position;
+    }
+
+    const NodeHandle parent = isFile ? fileNodes[ node ].links.parent : dirNodes[ node ].links.parent;
+    const auto iter = sortIndices.find(parent);
+    if(iter == sortIndices.end())
+    {
+        return position;
+    }
+
+    position.node = node;
+    for(const DirectorySortOrder order : SORTED_ORDERS)
+    {
+        uint32_t& index = position.index[ GetSortSlot(order) ];
+        if((keys & GetSortKeyBit(order)) == 0)
+        {
+            index = UINT32_MAX;
+        }
+        else if(isFile)
+        {
+            index = SortedFind(fileNodes, names, iter->second.files[ GetSortSlot(order) ], order, node);
+        }
+        else
+        {
+            index = SortedFind(dirNodes, names, iter->second.dirs[ GetSortSlot(order) ], order, node);
+        }
+    }
+    return position;
+}
+
+void VirtualFilesystem::sortMove(const SortPosition& position)
+{
+    if(position.node == NodeHandle::INVALID)
+    {
+        return;
+    }
+
+    const NodeHandle node = position.node;
+    const NodeHandle parent = position.isFile ? fileNodes[ node ].links.parent : dirNodes[ node ].links.parent;
+    const auto iter = sortIndices.find(parent);
+    if(iter == sortIndices.end())
+    {
+        return;
+    }
+
+    for(const DirectorySortOrder order : SORTED_ORDERS)
+    {
+        const uint32_t index = position.index[ GetSortSlot(order) ];
+        if(position.isFile)
+        {
+            SortedMove(fileNodes, names, iter->second.files[ GetSortSlot(order) ], order, node, index);
+        }
+        else
+        {
+            SortedMove(dirNodes, names, iter->second.dirs[ GetSortSlot(order) ], order, node, index);
+        }
+    }
+}
+
+void VirtualFilesystem::touchDir(const NodeHandle dir)
+{
+    treeInvalidate(dir);
+    const SortPosition position = sortFind(dir, false, SORT_KEY_MODIFIED);
+    dirNodes[ dir ].onModification();
+    sortMove(position);
+    listingChanged(dir);
+    listingChanged(dirNodes[ dir ].links.parent);
+}
+
+void VirtualFilesystem::listingChanged(const NodeHandle dir)
+{
+    if(dir != NodeHandle::INVALID)
+    {
+        dirNodes[ dir ].version++;
+    }
+}
+
+template <typename Node>
+bool VirtualFilesystem::SortLess(const NodeArena<Node>& nodes, const VirtualNameArena& names,
+                                 const DirectorySortOrder order, const NodeHandle left, const NodeHandle right)
+{
+    if(order == DirectorySortOrder::NAME)
+    {
+        const int result = NodeName(names, nodes[ left ]).compare(NodeName(names, nodes[ right ]));
+        if(result != 0)
+        {
+            return result < 0;
+        }
+    }
+    else
+    {
+        const uint64_t leftKey = GetSortKey(names, nodes[ left ], order);
+        const uint64_t rightKey = GetSortKey(names, nodes[ right ], order);
+        if(leftKey != rightKey)
+        {
+            return leftKey < rightKey;
+        }
+    }
+    return left < right;
+}
+
+template <typename Node>
+void VirtualFilesystem::SortedInsert(const NodeArena<Node>& nodes, const VirtualNameArena& names,
+                                     std::vector<NodeHandle>& sorted, const DirectorySortOrder order,
+                                     const NodeHandle node)
+{
+    const auto iter = std::ranges::lower_bound(sorted, node, [ & ](const NodeHandle left, const NodeHandle right)
+                                               { return SortLess(nodes, names, order, left, right); });
+    sorted.insert(iter, node);
+}
+
+template <typename Node>
+void VirtualFilesystem::SortedRemove(const NodeArena<Node>& nodes, const VirtualNameArena& names,
+                                     std::vector<NodeHandle>& sorted, const DirectorySortOrder order,
+                                     const NodeHandle node)
+{
+    const auto iter = std::ranges::lower_bound(sorted, node, [ & ](const NodeHandle left, const NodeHandle right)
+                                               { return SortLess(nodes, names, order, left, right); });
+    if(iter != sorted.end() && *iter == node)
+    {
+        sorted.erase(iter);
+        return;
+    }
+
+    LOG_WARNING("Sort index out of order");
+    std::erase(sorted, node);
+}
+
+template <typename Node>
+uint32_t VirtualFilesystem::SortedFind(const NodeArena<Node>& nodes, const VirtualNameArena& names,
+                                       const std::vector<NodeHandle>& sorted, const DirectorySortOrder order,
+                                       const NodeHandle node)
+{
+    const auto iter = std::ranges::lower_bound(sorted, node, [ & ](const NodeHandle left, const NodeHandle right)
+                                               { return SortLess(nodes, names, order, left, right); });
+    if(iter != sorted.end() && *iter == node)
+    {
+        return static_cast<uint32_t>(iter - sorted.begin());
+    }
+
+    LOG_WARNING("Sort index out of order");
+    return static_cast<uint32_t>(sorted.size()); // Inserted again by SortedMove()
+}
+
+template <typename Node>
+void VirtualFilesystem::SortedMove(const NodeArena<Node>& nodes, const VirtualNameArena& names,
+                                   std::vector<NodeHandle>& sorted, const DirectorySortOrder order,
+                                   const NodeHandle node, const uint32_t index)
+{
+    if(index == UINT32_MAX) // Key didn't change
+    {
+        return;
+    }
+    if(index >= sorted.size() || sorted[ index ] != node) [[unlikely]]
+    {
+        std::erase(sorted, node);
+        SortedInsert(nodes, names, sorted, order, node);
+        return;
+    }
+
+    // Entries before and after it are still in order - searched without the node
+    const auto less = [ & ](const NodeHandle left, const NodeHandle right)
+    { return SortLess(nodes, names, order, left, right); };
+    const auto current = sorted.begin() + index;
+    if(current != sorted.begin() && less(node, *(current - 1)))
+    {
+        const auto target = std::lower_bound(sorted.begin(), current, node, less);
+        std::rotate(target, current, current + 1);
+    }
+    else if(current + 1 != sorted.end() && less(*(current + 1), node))
+    {
+        const auto target = std::lower_bound(current + 1, sorted.end(), node, less);
+        std::rotate(current, current + 1, target);
+    }
+}
+
+template <typename Node>
+size_t VirtualFilesystem::SortedResume(const NodeArena<Node>& nodes, const VirtualNameArena& names,
+                                       const std::vector<NodeHandle>& sorted, const DirectorySortOrder order,
+                                       const bool descending, const NodeHandle dir, const DirectoryCursor& cursor)
+{
+    const auto less = [ & ](const NodeHandle left, const NodeHandle right)
+    { return SortLess(nodes, names, order, left, right); };
+
+    // Fast path - the last returned node is still at the same position
+    const NodeHandle node = GetCursorNode(cursor);
+    const Node* last = nodes.get(node);
+    const bool isSameKey = last != nullptr && (order == DirectorySortOrder::NAME
+                                                   ? NodeName(names, *last) == cursor.name.view()
+                                                   : GetSortKey(names, *last, order) == cursor.key);
+    if(isSameKey && last->links.parent == dir)
+    {
+        const auto iter = std::ranges::lower_bound(sorted, node, less);
+        if(iter != sorted.end() && *iter == node)
+        {
+            const auto index = static_cast<size_t>(iter - sorted.begin());
+            return descending ? sorted.size() - index : index + 1;
+        }
+    }
+
+    // Removed or changed since - continue at its key (the full name for the name order)
+    const auto isBefore = [ & ](const NodeHandle handle)
+    {
+        if(order == DirectorySortOrder::NAME)
+        {
+            const int result = NodeName(names, nodes[ handle ]).compare(cursor.name.view());
+            return result < 0 || (result == 0 && handle < node);
+        }
+        const uint64_t key = GetSortKey(names, nodes[ handle ], order);
+        return key < cursor.key || (key == cursor.key && handle < node);
+    };
+    const auto before = static_cast<size_t>(std::ranges::partition_point(sorted, isBefore) - sorted.begin());
+    return descending ? sorted.size() - before : before;
+}
+
+//===== Nodes =====//
+
+NodeHandle VirtualFilesystem::fileCreate(const FileCreationInfo& info)
+{
+    const NodeHandle details = fileDetails.create(info);
+    const NodeHandle node = fileNodes.create(info, fileDetails[ details ], names.add(info.name.view()));
+    if(node != details) [[unlikely]]
+    {
+        LOG_CRITICAL("File arenas out of sync");
+    }
+    return node;
+}
+
+void VirtualFilesystem::fileDestroy(const NodeHandle node)
+{
+    nameRemove(fileNodes[ node ].name);
+    fileNodes.destroy(node);
+    fileDetails.destroy(node);
+}
+
+//===== Totals =====//
+
+bool VirtualFilesystem::canHoldSize(const NodeHandle dir, const uint64_t additional, const NodeHandle until) const
+{
+    for(NodeHandle node = dir; node != until; node = dirNodes[ node ].links.parent)
+    {
+        const VirtualDirectory& directory = dirNodes[ node ];
+        const uint64_t limit = directory.limits.sizeLimit;
+        if(limit != 0 && (additional > limit || directory.stats.getTotalSize() > limit - additional))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+NodeHandle VirtualFilesystem::lookup(const FileID fid) const
+{
+    const NodeHandle node = cache.get(fid);
+    if(tombstones.empty() || node == NodeHandle::INVALID)
+    {
+        return node;
+    }
+
+    // Only nodes still linked to the root are visible
+    NodeHandle dir = fid.isFile() ? fileNodes[ node ].links.parent : node;
+    while(dirNodes[ dir ].links.parent != NodeHandle::INVALID)
+    {
+        dir = dirNodes[ dir ].links.parent;
+    }
+    return dir == root ? node : NodeHandle::INVALID;
+}
+
+NodeHandle VirtualFilesystem::getCommonParent(NodeHandle left, NodeHandle right) const
+{
+    const auto getDepth = [ & ](NodeHandle node)
+    {
+        uint32_t depth = 0;
+        for(; node != root; node = dirNodes[ node ].links.parent)
+        {
+            ++depth;
+        }
+        return depth;
+    };
+
+    uint32_t leftDepth = getDepth(left);
+    uint32_t rightDepth = getDepth(right);
+    for(; leftDepth > rightDepth; --leftDepth)
+    {
+        left = dirNodes[ left ].links.parent;
+    }
+    for(; rightDepth > leftDepth; --rightDepth)
+    {
+        right = dirNodes[ right ].links.parent;
+    }
+    while(left != right)
+    {
+        left = dirNodes[ left ].links.parent;
+        right = dirNodes[ right ].links.parent;
+    }
+    return left;
+}
+
+void VirtualFilesystem::totalsAdd(const NodeHandle dir, const SubtreeTotals& totals, const bool isFile)
+{
+    bool isDirect = true;
+    for(NodeHandle node = dir; node != NodeHandle::INVALID; node = dirNodes[ node ].links.parent)
+    {
+        // Total size is the sort key and listed in the parent
+        const bool isResorted = totals.size != 0;
+        const SortPosition position = isResorted ? sortFind(node, false, SORT_KEY_SIZE) : SortPosition{};
+
+        DirectoryStats& stats = dirNodes[ node ].stats;
+        if(isDirect && isFile)
+        {
+            stats.base.size += totals.size;
+        }
+        else
+        {
+            stats.subDirFileSize += totals.size;
+        }
+        stats.totalFiles += totals.files;
+        stats.totalDirs += totals.dirs;
+        isDirect = false;
+
+        if(isResorted)
+        {
+            sortMove(position);
+            listingChanged(dirNodes[ node ].links.parent);
+        }
+    }
+}
+
+void VirtualFilesystem::totalsRemove(const NodeHandle dir, const SubtreeTotals& totals, const bool isFile)
+{
+    bool isDirect = true;
+    for(NodeHandle node = dir; node != NodeHandle::INVALID; node = dirNodes[ node ].links.parent)
+    {
+        // Total size is the sort key and listed in the parent
+        const bool isResorted = totals.size != 0;
+        const SortPosition position = isResorted ? sortFind(node, false, SORT_KEY_SIZE) : SortPosition{};
+
+        DirectoryStats& stats = dirNodes[ node ].stats;
+        if(isDirect && isFile)
+        {
+            stats.base.size -= totals.size;
+        }
+        else
+        {
+            stats.subDirFileSize -= totals.size;
+        }
+        stats.totalFiles -= totals.files;
+        stats.totalDirs -= totals.dirs;
+        isDirect = false;
+
+        if(isResorted)
+        {
+            sortMove(position);
+            listingChanged(dirNodes[ node ].links.parent);
+        }
+    }
+}
+
+//===== Name Index =====//
+
+template <typename Node>
+NodeHandle VirtualFilesystem::FindByName(const NodeArena<Node>& nodes, const VirtualNameArena& names,
+                                         const VirtualNodeList& list, const NameIndices& indices, const NodeHandle dir,
+                                         const FileName& name)
+{
+    const uint64_t nameHash = HashFileName(name);
+    if(list.count > TPUNKT_STORAGE_VFS_NAME_INDEX_THRESHOLD / 2)
+    {
+        const auto iter = indices.find(dir);
+        if(iter != indices.end())
+        {
+            return iter->second.find(nameHash, [ & ](const NodeHandle node)
+                                     { return NodeName(names, nodes[ node ]) == name.view(); });
+        }
+    }
+
+    for(NodeHandle node = list.first; node != NodeHandle::INVALID; node = nodes[ node ].links.next)
+    {
+        if(nodes[ node ].nameHash == nameHash && NodeName(names, nodes[ node ]) == name.view())
+        {
+            return node;
+        }
+    }
+    return NodeHandle::INVALID;
+}
+
+template <typename Node>
+bool VirtualFilesystem::IsNameTaken(const NodeArena<Node>& nodes, const VirtualNameArena& names,
+                                    const VirtualNodeList& list, const NameIndices& indices, const NodeHandle dir,
+                                    const FileName& name)
+{
+    return FindByName(nodes, names, list, indices, dir, name) != NodeHandle::INVALID;
+}
+
+template <typename Node>
+void VirtualFilesystem::IndexAdd(const NodeArena<Node>& nodes, const VirtualNodeList& list, NameIndices& indices,
+                                 const NodeHandle dir, const NodeHandle node)
+{
+    const auto iter = indices.find(dir);
+    if(iter != indices.end())
+    {
+        iter->second.add(nodes[ node ].nameHash, node);
+        return;
+    }
+
+    if(list.count <= TPUNKT_STORAGE_VFS_NAME_INDEX_THRESHOLD)
+    {
+        return;
+    }
+
+    VirtualNameIndex index;
+    index.reserve(list.count * 2);
+    for(NodeHandle child = list.first; child != NodeHandle::INVALID; child = nodes[ child ].links.next)
+    {
+        index.add(nodes[ child ].nameHash, child);
+    }
+    indices.emplace(dir, std::move(index));
+}
+
+void VirtualFilesystem::IndexRemove(const VirtualNodeList& list, NameIndices& indices, const NodeHandle dir,
+                                    const uint64_t nameHash, const NodeHandle node)
+{
+    const auto iter = indices.find(dir);
+    if(iter == indices.end())
+    {
+        return;
+    }
+
+    if(list.count < TPUNKT_STORAGE_VFS_NAME_INDEX_THRESHOLD / 2)
+    {
+        indices.erase(iter);
+        return;
+    }
+    iter->second.remove(nameHash, node);
+}
+
+//===== Links =====//
+
+template <typename Node>
+void VirtualFilesystem::LinkNode(NodeArena<Node>& nodes, VirtualNodeList& list, const NodeHandle parent,
+                                 const NodeHandle node)
+{
+    // Renumbering is only needed after 2^30 additions to the same list
+    if(list.nextOrder == MAX_NODE_ORDER) [[unlikely]]
+    {
+        list.nextOrder = 0;
+        for(NodeHandle child = list.first; child != NodeHandle::INVALID; child = nodes[ child ].links.next)
+        {
+            nodes[ child ].links.order = ++list.nextOrder;
+        }
+    }
+
+    VirtualNodeLinks& links = nodes[ node ].links;
+    links.parent = parent;
+    links.prev = list.last;
+    links.next = NodeHandle::INVALID;
+    links.order = ++list.nextOrder;
+
+    if(list.last != NodeHandle::INVALID)
+    {
+        nodes[ list.last ].links.next = node;
+    }
+    else
+    {
+        list.first = node;
+    }
+    list.last = node;
+    ++list.count;
+}
+
+template <typename Node>
+NodeHandle VirtualFilesystem::ResumeAfter(const NodeArena<Node>& nodes, const VirtualNodeList& list,
+                                          const NodeHandle dir, const NodeHandle node, const uint32_t order)
+{
+    const Node* last = nodes.get(node);
+    if(last != nullptr && last->links.parent == dir && last->links.order == order)
+    {
+        return last->links.next;
+    }
+
+    // Removed or moved since - continue with the first node linked after it
+    NodeHandle child = list.first;
+    while(child != NodeHandle::INVALID && nodes[ child ].links.order <= order)
+    {
+        child = nodes[ child ].links.next;
+    }
+    return child;
+}
+
+template <typename Node>
+void VirtualFilesystem::UnlinkNode(NodeArena<Node>& nodes, VirtualNodeList& list, const NodeHandle node)
+{
+    VirtualNodeLinks& links = nodes[ node ].links;
+
+    if(links.prev != NodeHandle::INVALID)
+    {
+        nodes[ links.prev ].links.next = links.next;
+    }
+    else
+    {
+        list.first = links.next;
+    }
+
+    if(links.next != NodeHandle::INVALID)
+    {
+        nodes[ links.next ].links.prev = links.prev;
+    }
+    else
+    {
+        list.last = links.prev;
+    }
+
+    links = VirtualNodeLinks{};
+    --list.count;
 }
 
-VirtualFilesystem::VirtualFilesystem(const DirectoryCreationInfo& info) : root(info)
+VirtualFilesystem::VirtualFilesystem(const DirectoryCreationInfo& info)
+    : root(dirNodes.create(info, names.add(info.name.view())))
 {
-    iterationCache.reserve(64);
+    cache.reserve(64);
+    cache.add(dirNodes[ root ].getID(), root);
 }
 
 VirtualFilesystem::~VirtualFilesystem() = default;
@@ -2,20 +2,35 @@
 #ifndef TPUNKT_VIRTUAL_FILESYSTEM_H
 #define TPUNKT_VIRTUAL_FILESYSTEM_H
 
+#include <array>
+#include <functional>
+#include <string_view>
+#include <vector>
+#include "datastructures/NodeArena.h"
 #include "fwd.h"
+#include "storage/vfs/VirtualChangeLog.h"
 #include "storage/vfs/VirtualDirectory.h"
 #include "storage/vfs/VirtualFilesystemCache.h"
+#include "storage/vfs/VirtualFilesystemPersistence.h"
+#include "storage/vfs/VirtualNameSearch.h"
+#include "storage/vfs/VirtualSnapshot.h"
 
 namespace tpunkt
 {
 
+// Owns all files and directories as nodes in two arenas - linked into a tree by handles
+// Pointers to files and directories stay valid until the element is deleted
 // File names must be unique per directory - case-sensitive
 // Not synced == NOT threadsafe
 struct VirtualFilesystem
 {
+    explicit VirtualFilesystem(const DirectoryCreationInfo& info);
+    TPUNKT_MACROS_MOVE_ONLY(VirtualFilesystem);
+    ~VirtualFilesystem();
+
     //===== Lookup =====//
 
-    // Full lookup
+    // Full lookup - resolved through the cache without walking the tree
     VirtualFile* findFile(FileID file);
     VirtualDirectory* findDir(FileID dir);
 
@@ -24,16 +39,324 @@ struct VirtualFilesystem
 
     VirtualDirectory& getRoot();
 
-    bool dirCanHoldSize(FileID dir, uint64_t additional);
+    // Names are interned in the name arena - views stay valid until the next change
+    [[nodiscard]] std::string_view getName(const VirtualFile& file) const;
+    [[nodiscard]] std::string_view getName(const VirtualDirectory& dir) const;
+
+    // Returns true if the directory and all its parents can hold the additional bytes - O(depth)
+    [[nodiscard]] bool dirCanHoldSize(FileID dir, uint64_t additional) const;
+
+    // Exact name lookup of a direct child - O(1) for directories with a name index
+    VirtualFile* findFileByName(FileID dir, const FileName& name);
+    VirtualDirectory* findDirByName(FileID dir, const FileName& name);
+
+    // Resolves a "/" separated path of names below the given directory - O(depth) name lookups
+    // A trailing "/" only matches directories - otherwise a file is preferred over a directory of the same name
+    // Returns an invalid FileID if nothing matches - an empty path (or "/") resolves to the directory itself
+    [[nodiscard]] FileID resolvePath(FileID dir, std::string_view path) const;
+
+    //===== Traversal =====//
+    // Visits the direct children in insertion order - func must not change the structure
+
+    template <typename Func>
+    void forEachFile(const VirtualDirectory& dir, Func&& func) const
+    {
+        for(NodeHandle node = dir.files.first; node != NodeHandle::INVALID; node = fileNodes[ node ].links.next)
+        {
+            func(fileNodes[ node ]);
+        }
+    }
+
+    template <typename Func>
+    void forEachDir(const VirtualDirectory& dir, Func&& func) const
+    {
+        for(NodeHandle node = dir.dirs.first; node != NodeHandle::INVALID; node = dirNodes[ node ].links.next)
+        {
+            func(dirNodes[ node ]);
+        }
+    }
+
+    // Collects up to limit entries after the cursor - files first, then dirs - 0 as limit collects all
+    // Returns true if all entries were collected - else the cursor is moved to the next page
+    // Cursors stay valid while the directory changes - entries added afterward show up on later pages
+    // Sorted orders are kept per directory from its first sorted listing on - descending only applies to them
+    bool collectEntries(const VirtualDirectory& dir, DirectorySortOrder order, bool descending, uint32_t limit,
+                        DirectoryCursor& cursor, std::vector<DTO::ResponseDirectoryEntry>& entries);
+
+    // Returns true if the sorted orders of the directory are indexed
+    // Collecting them doesn't change the filesystem then
+    [[nodiscard]] bool hasSortIndex(const VirtualDirectory& dir) const;
+
+    //===== Access =====//
+
+    // Records a read of the file/dir - only touches atomic statistics, so it's safe with the endpoint lock held shared
+    // Access times are not part of the directory versions - revalidated listings may show older ones
+    // Returns false if it doesn't exist
+    bool fileAccess(FileID file) const;
+    bool dirAccess(FileID dir) const;
+
+    //===== Search =====//
+
+    // Decides if a match is returned - e.g. by access rights
+    using SearchFilter = std::function<bool(FileID)>;
+
+    // Collects up to limit files and dirs below dir whose name matches the query - files first, 0 as limit collects all
+    // Cursor is 0 to start and set to 0 again once all matches were collected - else it points to the next page
+    // Returns false if the directory doesn't exist
+    bool search(FileID dir, const NameSearchQuery& query, uint32_t limit, uint64_t& cursor,
+                const SearchFilter& filter, std::vector<DTO::ResponseDirectoryEntry>& entries) const;
+
+    //===== Manipulation =====//
+    // All structural changes go through the filesystem to keep the cache and links in sync
+
+    // Returns true and assigns file if a new file was added to the given directory
+    bool fileAdd(FileID dir, const FileCreationInfo& info, FileID& file);
+
+    // Returns true if the given file was removed
+    bool fileDelete(FileID file);
+
+    // Returns true if the size of the given file has changed - fails if a limit of its parents would be exceeded
+    bool fileChangeSize(FileID file, uint64_t newFileSize);
+
+    // Returns true and assigns newDir if a new directory was added to the given directory
+    bool dirAdd(FileID dir, const DirectoryCreationInfo& info, FileID& newDir);
+
+    // Returns true if the given (empty) directory was removed
+    bool dirDelete(FileID dir);
+
+    // Hides the directory and everything below it right away - the nodes are removed later by dirReclaim
+    // Returns false for the root - lookups by id are O(depth) while tombstones are left
+    bool dirTombstone(FileID dir);
+
+    // Removes up to limit nodes below tombstones - appends the ids of removed files so their data can be deleted
+    // Returns true if nodes are left
+    bool dirReclaim(uint32_t limit, std::vector<FileID>& removedFiles);
+
+    [[nodiscard]] bool hasTombstones() const;
+
+    // Returns true if the file/dir was renamed - fails if the name is not unique in its directory
+    bool fileRename(FileID file, const FileName& name);
+    bool dirRename(FileID dir, const FileName& name);
+
+    // Returns true if the file/dir was moved into the given directory - only relinks it, the subtree isn't touched
+    // Fails if the name is not unique in the new directory, a limit would be exceeded
+    // or a dir would be moved into itself
+    // O(depth) - independent of the size of the moved subtree
+    bool fileMove(FileID file, FileID dir);
+    bool dirMove(FileID dir, FileID newParent);
+
+    //===== Persistence =====//
+
+    // Restores a persisted node - its parent must already exist - a state without parent replaces the root
+    bool restore(const VirtualNodeState& state);
+
+    // Collects the state of all nodes - every directory comes before its files and subdirectories
+    void collectNodes(std::vector<VirtualNodeState>& nodes) const;
+
+    // All following changes are written to the journal of the given persistence - nullptr to stop
+    void setPersistence(VirtualFilesystemPersistence* newPersistence);
+
+    //===== Changes =====//
+
+    // Every change made through the filesystem is numbered and logged
+    [[nodiscard]] const VirtualChangeLog& getChanges() const;
+
+    // Drops the logged changes - the next change gets sequence + 1
+    void changesReset(uint64_t sequence);
+
+    //===== Snapshots =====//
+
+    // Returns a frozen copy of the whole tree - can be read without any lock while the filesystem changes
+    // Directories that didn't change are shared with earlier snapshots still alive - only changed ones are copied
+    // O(1) if nothing changed since the last snapshot
+    VirtualSnapshot takeSnapshot();
+
+    //===== Tree Hashes =====//
+
+    // Assigns the Merkle hash of the directory - combines the id, name, size and modification time of all files below
+    // Equal hashes mean equal subtrees - clients compare them top-down and only descend into differing directories
+    // Only directories changed since the last call are hashed again - O(1) if nothing changed
+    // Returns false if the directory doesn't exist
+    bool getTreeHash(FileID dir, uint64_t& hash);
+
+    //===== Names =====//
+
+    // Called once the name arena should be compacted - without a request it's compacted right away
+    void setNameCompactionRequest(std::function<void()> request);
+
+    // Moves all names into a new arena without holes - O(n)
+    void compactNames();
+
+    [[nodiscard]] const VirtualNameArena& getNames() const;
 
   private:
-    explicit VirtualFilesystem(const DirectoryCreationInfo& info);
-    TPUNKT_MACROS_MOVE_ONLY(VirtualFilesystem);
-    ~VirtualFilesystem();
+    // Size and count of an element and everything below it - a dir counts itself
+    struct SubtreeTotals final
+    {
+        uint64_t size = 0;
+        uint32_t files = 0;
+        uint32_t dirs = 0;
+    };
+
+    // Files are created and destroyed together with their details - both arenas hand out the same handles
+    NodeHandle fileCreate(const FileCreationInfo& info);
+    void fileDestroy(NodeHandle node);
+
+    // Drops the shared snapshot and the tree hash of the directory and all its parents
+    // Stops at the first one that has neither - a parent can't have one if its subdirectory has none
+    void treeInvalidate(NodeHandle dir);
+
+    // Frees the name - requests compaction once too much of the arena is unused
+    void nameRemove(NameRef& name);
+
+    // Cache lookup that skips nodes below a tombstone
+    [[nodiscard]] NodeHandle lookup(FileID fid) const;
+
+    // Checks dir and its parents up to (excluding) until
+    [[nodiscard]] bool canHoldSize(NodeHandle dir, uint64_t additional, NodeHandle until = NodeHandle::INVALID) const;
+
+    // Returns the deepest directory both are in (or are) - O(depth)
+    [[nodiscard]] NodeHandle getCommonParent(NodeHandle left, NodeHandle right) const;
+
+    [[nodiscard]] VirtualNodeState getState(const VirtualFile& file) const;
+    [[nodiscard]] VirtualNodeState getState(const VirtualDirectory& dir) const;
+
+    // Logs the change and writes it to the journal if persisted
+    template <typename Node>
+    void persist(JournalOperation operation, const Node& node);
+
+    // Adds/removes the totals of an element directly inside dir to dir and all its parents - O(depth)
+    void totalsAdd(NodeHandle dir, const SubtreeTotals& totals, bool isFile);
+    void totalsRemove(NodeHandle dir, const SubtreeTotals& totals, bool isFile);
+
+    //===== Sort Index =====//
+
+    // Children of a directory sorted by each order (NAME, MODIFIED, SIZE) - ties are broken by the handle
+    struct SortIndex final
+    {
+        std::array<std::vector<NodeHandle>, 3> files;
+        std::array<std::vector<NodeHandle>, 3> dirs;
+    };
+    using SortIndices = ankerl::unordered_dense::map<NodeHandle, SortIndex, NodeHandleHash>;
+
+    // Positions of a node in the sort index of its parent - taken before its keys change
+    struct SortPosition final
+    {
+        NodeHandle node = NodeHandle::INVALID; // Invalid if the parent has no sort index
+        std::array<uint32_t, 3> index{};       // Per sorted order - UINT32_MAX if its key doesn't change
+        bool isFile = false;
+    };
+
+    // Returns the sort index of the directory - built on first use
+    SortIndex& getSortIndex(NodeHandle dir);
+
+    // Removes the node from the sort index of its parent before it's unlinked - inserts it again once linked
+    void sortRemove(NodeHandle node, bool isFile);
+    void sortInsert(NodeHandle node, bool isFile);
+
+    // Finds the node in the orders of the keys (SORT_KEY_*) that are about to change - see sortMove()
+    SortPosition sortFind(NodeHandle node, bool isFile, uint8_t keys);
+    // Moves the node to the positions of its changed keys - orders of other keys are not touched
+    void sortMove(const SortPosition& position);
+
+    // Updates the modification time of the directory
+    void touchDir(NodeHandle dir);
+
+    // Increases the version of the directory if it exists - an entry of its listing changed
+    void listingChanged(NodeHandle dir);
+
+    bool collectInserted(const VirtualDirectory& dir, NodeHandle dirNode, uint32_t limit, DirectoryCursor& cursor,
+                         DTO::UserNameCache& users, std::vector<DTO::ResponseDirectoryEntry>& entries) const;
+    bool collectSorted(NodeHandle dirNode, DirectorySortOrder order, bool descending, uint32_t limit,
+                       DirectoryCursor& cursor, DTO::UserNameCache& users,
+                       std::vector<DTO::ResponseDirectoryEntry>& entries);
+
+    template <typename Node>
+    static bool SortLess(const NodeArena<Node>& nodes, const VirtualNameArena& names, DirectorySortOrder order,
+                         NodeHandle left, NodeHandle right);
+
+    template <typename Node>
+    static void SortedInsert(const NodeArena<Node>& nodes, const VirtualNameArena& names,
+                             std::vector<NodeHandle>& sorted, DirectorySortOrder order, NodeHandle node);
+
+    template <typename Node>
+    static void SortedRemove(const NodeArena<Node>& nodes, const VirtualNameArena& names,
+                             std::vector<NodeHandle>& sorted, DirectorySortOrder order, NodeHandle node);
+
+    // Returns the index of the node - UINT32_MAX if it's not found
+    template <typename Node>
+    static uint32_t SortedFind(const NodeArena<Node>& nodes, const VirtualNameArena& names,
+                               const std::vector<NodeHandle>& sorted, DirectorySortOrder order, NodeHandle node);
+
+    // Moves the node from the index to the position of its changed key - only the entries in between are shifted
+    template <typename Node>
+    static void SortedMove(const NodeArena<Node>& nodes, const VirtualNameArena& names, std::vector<NodeHandle>& sorted,
+                           DirectorySortOrder order, NodeHandle node, uint32_t index);
+
+    // Returns how many entries of the sorted list are before the cursor in listing order - O(log n)
+    template <typename Node>
+    static size_t SortedResume(const NodeArena<Node>& nodes, const VirtualNameArena& names,
+                               const std::vector<NodeHandle>& sorted, DirectorySortOrder order, bool descending,
+                               NodeHandle dir, const DirectoryCursor& cursor);
+
+    // Snapshot of each unchanged directory - only kept alive by the snapshots using it
+    // A parent can only have one if all its subdirectories have one
+    using DirectorySnapshots =
+        ankerl::unordered_dense::map<NodeHandle, std::weak_ptr<const DirectorySnapshot>, NodeHandleHash>;
+
+    // Name indices of large directories - keyed by the directory node
+    using NameIndices = ankerl::unordered_dense::map<NodeHandle, VirtualNameIndex, NodeHandleHash>;
+
+    // Returns the child with the given name or NodeHandle::INVALID
+    template <typename Node>
+    static NodeHandle FindByName(const NodeArena<Node>& nodes, const VirtualNameArena& names,
+                                 const VirtualNodeList& list, const NameIndices& indices, NodeHandle dir,
+                                 const FileName& name);
+
+    // Returns true if no child with the given name can be added
+    template <typename Node>
+    static bool IsNameTaken(const NodeArena<Node>& nodes, const VirtualNameArena& names, const VirtualNodeList& list,
+                            const NameIndices& indices, NodeHandle dir, const FileName& name);
+
+    // Indexes a newly linked child - builds the index once the directory grows past the threshold
+    template <typename Node>
+    static void IndexAdd(const NodeArena<Node>& nodes, const VirtualNodeList& list, NameIndices& indices,
+                         NodeHandle dir, NodeHandle node);
+
+    // Removes an unlinked child from the index - drops the index once the directory shrinks below half the threshold
+    static void IndexRemove(const VirtualNodeList& list, NameIndices& indices, NodeHandle dir, uint64_t nameHash,
+                            NodeHandle node);
+
+    // Appends the node to the child list of parent - O(1)
+    template <typename Node>
+    static void LinkNode(NodeArena<Node>& nodes, VirtualNodeList& list, NodeHandle parent, NodeHandle node);
+
+    // Returns the first node after the given position - O(1) if the node at the position still exists
+    template <typename Node>
+    static NodeHandle ResumeAfter(const NodeArena<Node>& nodes, const VirtualNodeList& list, NodeHandle dir,
+                                  NodeHandle node, uint32_t order);
+
+    // Removes the node from the child list of its parent - O(1)
+    template <typename Node>
+    static void UnlinkNode(NodeArena<Node>& nodes, VirtualNodeList& list, NodeHandle node);
 
-    VirtualDirectory root;
-    std::vector<VirtualDirectory*> iterationCache;
-    friend StorageEndpoint;
+    NodeArena<VirtualFile> fileNodes;
+    NodeArena<VirtualFileDetails> fileDetails;
+    NodeArena<VirtualDirectory> dirNodes;
+    VirtualFilesystemCache cache;
+    NameIndices fileNameIndices;
+    NameIndices dirNameIndices;
+    SortIndices sortIndices;
+    VirtualNameSearch fileSearch;
+    VirtualNameSearch dirSearch;
+    DirectorySnapshots dirSnapshots;
+    VirtualChangeLog changes;
+    VirtualNameArena names;
+    std::function<void()> nameCompactionRequest;
+    bool nameCompactionRequested = false;
+    std::vector<NodeHandle> tombstones; // Unlinked dirs whose subtree is not yet removed
+    NodeHandle root = NodeHandle::INVALID;
+    VirtualFilesystemPersistence* persistence = nullptr;
 };
 
 } // namespace tpunkt
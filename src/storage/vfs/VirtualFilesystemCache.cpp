@@ -1,3 +1,38 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 #include "storage/vfs/VirtualFilesystemCache.h"
+
+namespace tpunkt
+{
+
+NodeHandle VirtualFilesystemCache::get(const FileID fid) const
+{
+    const auto iter = cacheMap.find(fid);
+    if(iter == cacheMap.end())
+    {
+        return NodeHandle::INVALID;
+    }
+    return iter->second;
+}
+
+bool VirtualFilesystemCache::add(const FileID fid, const NodeHandle node)
+{
+    return cacheMap.try_emplace(fid, node).second;
+}
+
+bool VirtualFilesystemCache::remove(const FileID fid)
+{
+    return cacheMap.erase(fid) > 0;
+}
+
+void VirtualFilesystemCache::reserve(const uint32_t entries)
+{
+    cacheMap.reserve(entries);
+}
+
+uint32_t VirtualFilesystemCache::size() const
+{
+    return static_cast<uint32_t>(cacheMap.size());
+}
+
+} // namespace tpunkt
@@ -3,38 +3,48 @@
 #ifndef TPUNKT_VIRTUAL_FILESYSTEM_CACHE_H
 #define TPUNKT_VIRTUAL_FILESYSTEM_CACHE_H
 
-#include <list>
 #include <ankerl/unordered_dense.h>
 #include "common/FileID.h"
+#include "datastructures/NodeArena.h"
 #include "fwd.h"
 
 namespace tpunkt
 {
 
-// Saves a quick access position of a file or directory
-// Cache entry is invalidated on: deletion, move
+struct FileIDHash final
+{
+    using is_avalanching = void;
+
+    [[nodiscard]] uint64_t operator()(const FileID& fid) const noexcept
+    {
+        const auto endpoint = static_cast<uint64_t>(fid.getEndpoint());
+        const uint64_t key = (uint64_t{fid.getUID()} << 32U) | (endpoint << 1U) | uint64_t{fid.isDirectory()};
+        return ankerl::unordered_dense::hash<uint64_t>{}(key);
+    }
+};
+
+// Index of every file and directory in the tree - maps its id to its node in the arenas of the filesystem
+// Entry is updated on: add, delete
+// Not synced == NOT threadsafe
 struct VirtualFilesystemCache final
 {
-    VirtualFilesystemCache(uint32_t maxEntries);
+    VirtualFilesystemCache() = default;
 
-    VirtualDirectory* searchDir(FileID dir);
+    // Returns NodeHandle::INVALID if the element is not indexed
+    [[nodiscard]] NodeHandle get(FileID fid) const;
 
-    VirtualFile* searchFile(FileID file);
+    // Returns false if the element is already indexed
+    bool add(FileID fid, NodeHandle node);
 
-    void setMaxSize(uint32_t size);
+    // Returns false if the element was not indexed
+    bool remove(FileID fid);
 
-  private:
-    uint32_t maxEntries;
+    void reserve(uint32_t entries);
 
-    struct CacheEntry final
-    {
-        FileID id;
-        VirtualFile* file;
-        VirtualDirectory* directory;
-    };
+    [[nodiscard]] uint32_t size() const;
 
-    ankerl::unordered_dense::map<FileID, std::list<CacheEntry>::iterator> cacheMap;
-    std::list<CacheEntry> cacheList;
+  private:
+    ankerl::unordered_dense::map<FileID, NodeHandle, FileIDHash> cacheMap;
 };
 
 } // namespace tpunkt
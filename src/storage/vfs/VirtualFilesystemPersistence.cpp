@@ -0,0 +1,529 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "storage/vfs/VirtualFilesystem.h"
+#include "storage/vfs/VirtualFilesystemPersistence.h"
+#include "util/Logging.h"
+
+namespace tpunkt
+{
+
+namespace
+{
+constexpr auto* SNAPSHOT_NAME = "index";
+constexpr auto* SNAPSHOT_TEMP_NAME = "indexT";
+constexpr auto* JOURNAL_NAME = "journal";
+constexpr auto* JOURNAL_OLD_NAME = "journal.old";
+constexpr uint32_t SNAPSHOT_MAGIC = 0x53465654U; // TVFS
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+constexpr mode_t FILE_MODE = S_IRUSR | S_IWUSR;
+
+struct SnapshotHeader final
+{
+    uint32_t magic = SNAPSHOT_MAGIC;
+    uint32_t version = SNAPSHOT_VERSION;
+    uint64_t sequence = 0;
+    uint64_t nodeCount = 0;
+};
+
+size_t GetRecordFrameSize()
+{
+    return BlockCipher::GetEncryptMinLen(sizeof(JournalRecord));
+}
+
+size_t GetChunkPlainSize()
+{
+    return TPUNKT_STORAGE_VFS_SNAPSHOT_CHUNK * sizeof(VirtualNodeState);
+}
+
+// Read only mapping of a whole file - data is nullptr if missing or empty
+struct MappedFile final
+{
+    MappedFile(const int dirfd, const char* name)
+    {
+        const int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+        if(fd == -1)
+        {
+            exists = errno != ENOENT;
+            return;
+        }
+
+        struct stat fileStat{};
+        if(fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+        {
+            size = static_cast<size_t>(fileStat.st_size);
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapped == MAP_FAILED)
+            {
+                LOG_ERROR("Mapping %s failed: %s", name, strerror(errno));
+                size = 0;
+            }
+            else
+            {
+                (void)madvise(mapped, size, MADV_SEQUENTIAL);
+                data = static_cast<const unsigned char*>(mapped);
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if(data != nullptr)
+        {
+            (void)munmap(const_cast<unsigned char*>(data), size);
+        }
+    }
+
+    TPUNKT_MACROS_STRUCT(MappedFile);
+
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    bool exists = true;
+};
+
+bool WriteAll(const int fd, const unsigned char* data, size_t size)
+{
+    while(size > 0)
+    {
+        const ssize_t written = write(fd, data, size);
+        if(written == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if(written <= 0)
+        {
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool ApplyRecord(VirtualFilesystem& filesystem, const JournalRecord& record)
+{
+    const VirtualNodeState& node = record.node;
+    switch(record.operation)
+    {
+        case JournalOperation::FILE_ADD:
+        case JournalOperation::DIR_ADD:
+            return filesystem.restore(node);
+        case JournalOperation::FILE_DELETE:
+            return filesystem.fileDelete(node.fid);
+        case JournalOperation::FILE_RENAME:
+            return filesystem.fileRename(node.fid, node.info.name);
+        case JournalOperation::FILE_RESIZE:
+            return filesystem.fileChangeSize(node.fid, node.stats.size);
+        case JournalOperation::DIR_DELETE:
+            return filesystem.dirDelete(node.fid);
+        case JournalOperation::DIR_RENAME:
+            return filesystem.dirRename(node.fid, node.info.name);
+        case JournalOperation::FILE_MOVE:
+            return filesystem.fileMove(node.fid, node.parent);
+        case JournalOperation::DIR_MOVE:
+            return filesystem.dirMove(node.fid, node.parent);
+        case JournalOperation::DIR_TOMBSTONE:
+            return filesystem.dirTombstone(node.fid);
+    }
+    return false;
+}
+
+} // namespace
+
+VirtualFilesystemPersistence::VirtualFilesystemPersistence(const char* dir, const CipherKey& key,
+                                                           CompactionRequest request)
+    : cipher(key), request(std::move(request)), frame(GetRecordFrameSize()),
+      dirfd(open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC))
+{
+    if(dirfd == -1)
+    {
+        LOG_ERROR("Opening filesystem persistence directory failed: %s", strerror(errno));
+    }
+    syncThread = std::thread([ this ] { syncLoop(); });
+}
+
+VirtualFilesystemPersistence::~VirtualFilesystemPersistence()
+{
+    isRunning = false;
+    if(syncThread.joinable())
+    {
+        syncThread.join();
+    }
+    if(!flush())
+    {
+        LOG_ERROR("Changes of the filesystem are lost");
+    }
+
+    if(journalfd != -1)
+    {
+        close(journalfd);
+    }
+    if(dirfd != -1)
+    {
+        close(dirfd);
+    }
+}
+
+bool VirtualFilesystemPersistence::load(VirtualFilesystem& filesystem)
+{
+    if(dirfd == -1)
+    {
+        return false;
+    }
+
+    // Old journal is left over if a compaction didn't finish - always older than the current one
+    // Without the snapshot the journal can't be applied - kept untouched and nothing new is written
+    if(!loadSnapshot(filesystem))
+    {
+        return false;
+    }
+
+    size_t validSize = 0;
+    bool success = replayJournal(JOURNAL_OLD_NAME, filesystem, validSize);
+    success = replayJournal(JOURNAL_NAME, filesystem, validSize) && success;
+
+    // Journal records refer to the id of the root - a new filesystem starts with a snapshot of it
+    if(faccessat(dirfd, SNAPSHOT_NAME, F_OK, 0) != 0)
+    {
+        std::vector<VirtualNodeState> nodes;
+        filesystem.collectNodes(nodes);
+        success = writeSnapshot(nodes, sequence) && success;
+    }
+    return openJournal(validSize) && success;
+}
+
+bool VirtualFilesystemPersistence::append(const JournalOperation operation, const VirtualNodeState& node)
+{
+    if(journalfd == -1) [[unlikely]]
+    {
+        return false;
+    }
+
+    // Zeroed so no padding bytes end up on disk
+    JournalRecord record;
+    memset(static_cast<void*>(&record), 0, sizeof(JournalRecord));
+    record.sequence = sequence + 1;
+    record.operation = operation;
+    record.node = node;
+
+    const auto* input = reinterpret_cast<const unsigned char*>(&record);
+    if(!cipher.encrypt(input, sizeof(JournalRecord), frame.data(), frame.size())) [[unlikely]]
+    {
+        LOG_ERROR("Encrypting journal record failed");
+        return false;
+    }
+
+    {
+        SpinlockGuard guard{pendingLock};
+        pending.insert(pending.end(), frame.begin(), frame.end());
+    }
+
+    sequence = record.sequence;
+    ++journalRecords;
+    if(journalRecords >= TPUNKT_STORAGE_VFS_JOURNAL_COMPACT_LIMIT && !compactionRequested && !isCompacting && request)
+    {
+        compactionRequested = true;
+        request();
+    }
+    return true;
+}
+
+//===== Compaction =====//
+
+bool VirtualFilesystemPersistence::compactBegin(VirtualFilesystem& filesystem,
+                                                std::shared_ptr<const DirectorySnapshot>& tree,
+                                                uint64_t& snapshotSequence)
+{
+    if(dirfd == -1 || isCompacting.exchange(true))
+    {
+        return false;
+    }
+    compactionRequested = false;
+
+    tree = filesystem.takeSnapshot();
+    snapshotSequence = sequence;
+
+    // Records of the snapshot go into the journal that is rotated
+    std::lock_guard journalGuard{journalLock};
+    if(!flushLocked())
+    {
+        isCompacting = false;
+        return false;
+    }
+
+    // A leftover old journal stays - its records are covered by this snapshot as well
+    if(faccessat(dirfd, JOURNAL_OLD_NAME, F_OK, 0) == 0)
+    {
+        return true;
+    }
+
+    const size_t journalSize = journalRecords * GetRecordFrameSize();
+    if(journalfd != -1)
+    {
+        close(journalfd);
+        journalfd = -1;
+    }
+
+    if(renameat(dirfd, JOURNAL_NAME, dirfd, JOURNAL_OLD_NAME) == -1)
+    {
+        LOG_ERROR("Rotating journal failed: %s", strerror(errno));
+        (void)openJournal(journalSize);
+        isCompacting = false;
+        return false;
+    }
+
+    if(!openJournal(0))
+    {
+        isCompacting = false;
+        return false;
+    }
+    return true;
+}
+
+bool VirtualFilesystemPersistence::compactFinish(const DirectorySnapshot& tree, const uint64_t snapshotSequence)
+{
+    std::vector<VirtualNodeState> nodes;
+    tree.collectNodes(nodes);
+    const bool written = writeSnapshot(nodes, snapshotSequence);
+    if(written && unlinkat(dirfd, JOURNAL_OLD_NAME, 0) == -1 && errno != ENOENT)
+    {
+        LOG_WARNING("Removing compacted journal failed: %s", strerror(errno));
+    }
+    isCompacting = false;
+    return written;
+}
+
+bool VirtualFilesystemPersistence::flush()
+{
+    std::lock_guard guard{journalLock};
+    return flushLocked();
+}
+
+//===== Info =====//
+
+uint64_t VirtualFilesystemPersistence::getSequence() const
+{
+    return sequence;
+}
+
+uint32_t VirtualFilesystemPersistence::getJournalRecords() const
+{
+    return journalRecords;
+}
+
+//===== Private =====//
+
+bool VirtualFilesystemPersistence::loadSnapshot(VirtualFilesystem& filesystem)
+{
+    const MappedFile file{dirfd, SNAPSHOT_NAME};
+    if(file.data == nullptr)
+    {
+        return !file.exists || file.size == 0;
+    }
+
+    const size_t headerFrame = BlockCipher::GetEncryptMinLen(sizeof(SnapshotHeader));
+    const size_t chunkFrame = BlockCipher::GetEncryptMinLen(GetChunkPlainSize());
+
+    SnapshotHeader header{};
+    if(file.size < headerFrame ||
+       !cipher.decrypt(file.data, headerFrame, reinterpret_cast<unsigned char*>(&header), sizeof(SnapshotHeader)))
+    {
+        LOG_ERROR("Filesystem snapshot is damaged or uses a different key");
+        return false;
+    }
+
+    constexpr uint64_t chunkNodes = TPUNKT_STORAGE_VFS_SNAPSHOT_CHUNK;
+    const uint64_t chunks = (header.nodeCount + chunkNodes - 1) / chunkNodes;
+    if(header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION ||
+       file.size != headerFrame + chunks * chunkFrame)
+    {
+        LOG_ERROR("Filesystem snapshot has an unknown format");
+        return false;
+    }
+
+    std::vector<unsigned char> plain(GetChunkPlainSize());
+    uint64_t remaining = header.nodeCount;
+    bool success = true;
+    for(uint64_t i = 0; i < chunks; ++i)
+    {
+        const unsigned char* input = file.data + headerFrame + i * chunkFrame;
+        if(!cipher.decrypt(input, chunkFrame, plain.data(), plain.size()))
+        {
+            LOG_ERROR("Filesystem snapshot chunk %llu is damaged", static_cast<unsigned long long>(i));
+            return false;
+        }
+
+        const auto count = std::min<uint64_t>(remaining, TPUNKT_STORAGE_VFS_SNAPSHOT_CHUNK);
+        for(uint64_t j = 0; j < count; ++j)
+        {
+            VirtualNodeState node;
+            memcpy(&node, plain.data() + j * sizeof(VirtualNodeState), sizeof(VirtualNodeState));
+            success = filesystem.restore(node) && success;
+        }
+        remaining -= count;
+    }
+
+    // Invalid nodes are dropped - the rest stays usable
+    sequence = header.sequence;
+    if(!success)
+    {
+        LOG_WARNING("Filesystem snapshot contained invalid nodes");
+    }
+    return true;
+}
+
+bool VirtualFilesystemPersistence::replayJournal(const char* name, VirtualFilesystem& filesystem, size_t& validSize)
+{
+    validSize = 0;
+    const MappedFile file{dirfd, name};
+    if(file.data == nullptr)
+    {
+        return !file.exists || file.size == 0;
+    }
+
+    const size_t recordFrame = GetRecordFrameSize();
+    const size_t records = file.size / recordFrame;
+    for(size_t i = 0; i < records; ++i)
+    {
+        JournalRecord record;
+        const unsigned char* input = file.data + i * recordFrame;
+        if(!cipher.decrypt(input, recordFrame, reinterpret_cast<unsigned char*>(&record), sizeof(JournalRecord)))
+        {
+            LOG_ERROR("Journal %s is damaged after %zu records", name, i);
+            return false;
+        }
+        validSize += recordFrame;
+
+        // Already part of the snapshot
+        if(record.sequence <= sequence)
+        {
+            continue;
+        }
+
+        if(!ApplyRecord(filesystem, record))
+        {
+            LOG_WARNING("Journal record %llu could not be applied", static_cast<unsigned long long>(record.sequence));
+        }
+        sequence = record.sequence;
+    }
+
+    if(file.size % recordFrame != 0)
+    {
+        LOG_WARNING("Journal %s ends with an incomplete record", name);
+    }
+    return true;
+}
+
+bool VirtualFilesystemPersistence::flushLocked()
+{
+    {
+        SpinlockGuard guard{pendingLock};
+        writing.insert(writing.end(), pending.begin(), pending.end()); // After records of a failed write
+        pending.clear();
+    }
+    if(writing.empty())
+    {
+        return true;
+    }
+    if(journalfd == -1)
+    {
+        return false;
+    }
+
+    // A partly written record would hide all records after it - cut off to retry the whole group
+    struct stat fileStat{};
+    const bool hasSize = fstat(journalfd, &fileStat) == 0;
+    if(!WriteAll(journalfd, writing.data(), writing.size()) || fdatasync(journalfd) == -1) [[unlikely]]
+    {
+        LOG_ERROR("Writing journal failed: %s", strerror(errno));
+        if(hasSize)
+        {
+            (void)ftruncate(journalfd, fileStat.st_size);
+        }
+        return false;
+    }
+    writing.clear();
+    return true;
+}
+
+void VirtualFilesystemPersistence::syncLoop()
+{
+    while(isRunning)
+    {
+        usleep(TPUNKT_STORAGE_VFS_JOURNAL_SYNC_INTERVAL);
+        (void)flush();
+    }
+}
+
+bool VirtualFilesystemPersistence::openJournal(const size_t validSize)
+{
+    journalfd = openat(dirfd, JOURNAL_NAME, O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC, FILE_MODE);
+    if(journalfd == -1)
+    {
+        LOG_ERROR("Opening journal failed: %s", strerror(errno));
+        return false;
+    }
+
+    // Appending after a damaged record would hide everything written from now on
+    struct stat fileStat{};
+    if(fstat(journalfd, &fileStat) == 0 && static_cast<size_t>(fileStat.st_size) != validSize)
+    {
+        if(ftruncate(journalfd, static_cast<off_t>(validSize)) == -1)
+        {
+            LOG_ERROR("Truncating journal failed: %s", strerror(errno));
+            close(journalfd);
+            journalfd = -1;
+            return false;
+        }
+    }
+
+    journalRecords = static_cast<uint32_t>(validSize / GetRecordFrameSize());
+    return true;
+}
+
+bool VirtualFilesystemPersistence::writeSnapshot(const std::vector<VirtualNodeState>& nodes,
+                                                 const uint64_t snapshotSequence) const
+{
+    const int fd = openat(dirfd, SNAPSHOT_TEMP_NAME, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, FILE_MODE);
+    if(fd == -1)
+    {
+        LOG_ERROR("Creating filesystem snapshot failed: %s", strerror(errno));
+        return false;
+    }
+
+    const SnapshotHeader header{.sequence = snapshotSequence, .nodeCount = nodes.size()};
+    std::vector<unsigned char> encrypted(BlockCipher::GetEncryptMinLen(GetChunkPlainSize()));
+    bool success = cipher.encrypt(reinterpret_cast<const unsigned char*>(&header), sizeof(SnapshotHeader),
+                                  encrypted.data(), encrypted.size()) &&
+                   WriteAll(fd, encrypted.data(), BlockCipher::GetEncryptMinLen(sizeof(SnapshotHeader)));
+
+    // Last chunk is zero padded - every chunk has the same size
+    std::vector<unsigned char> plain(GetChunkPlainSize());
+    for(size_t i = 0; success && i < nodes.size(); i += TPUNKT_STORAGE_VFS_SNAPSHOT_CHUNK)
+    {
+        const size_t count = std::min(nodes.size() - i, TPUNKT_STORAGE_VFS_SNAPSHOT_CHUNK);
+        memset(plain.data(), 0, plain.size());
+        memcpy(plain.data(), nodes.data() + i, count * sizeof(VirtualNodeState));
+        success = cipher.encrypt(plain.data(), plain.size(), encrypted.data(), encrypted.size()) &&
+                  WriteAll(fd, encrypted.data(), encrypted.size());
+    }
+
+    success = success && fsync(fd) == 0;
+    close(fd);
+
+    if(!success || renameat(dirfd, SNAPSHOT_TEMP_NAME, dirfd, SNAPSHOT_NAME) == -1)
+    {
+        LOG_ERROR("Writing filesystem snapshot failed: %s", strerror(errno));
+        (void)unlinkat(dirfd, SNAPSHOT_TEMP_NAME, 0);
+        return false;
+    }
+    return true;
+}
+
+} // namespace tpunkt
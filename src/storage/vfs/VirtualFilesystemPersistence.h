@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TPUNKT_VIRTUAL_FILESYSTEM_PERSISTENCE_H
+#define TPUNKT_VIRTUAL_FILESYSTEM_PERSISTENCE_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "common/FileID.h"
+#include "crypto/Ciphers.h"
+#include "datastructures/FixedString.h"
+#include "datastructures/Spinlock.h"
+#include "storage/vfs/VirtualFile.h"
+#include "util/Macros.h"
+
+namespace tpunkt
+{
+
+// State of a single file or directory - unit of the snapshot and the journal
+struct VirtualNodeState final
+{
+    FileID fid;
+    FileID parent;          // FileID::Root() for the root directory
+    FileInfo info;
+    FileStats stats;        // For dirs only the stats of the dir itself - totals are rebuilt on load
+    uint64_t sizeLimit = 0; // Only for dirs
+};
+
+static_assert(std::is_trivially_copyable_v<VirtualNodeState>, "Node state is written as is");
+
+enum class JournalOperation : uint8_t
+{
+    FILE_ADD,      // Full state
+    FILE_DELETE,   // fid
+    FILE_RENAME,   // fid + name
+    FILE_RESIZE,   // fid + size
+    DIR_ADD,       // Full state
+    DIR_DELETE,    // fid
+    DIR_RENAME,    // fid + name
+    FILE_MOVE,     // fid + parent
+    DIR_MOVE,      // fid + parent
+    DIR_TOMBSTONE, // fid - the subtree is removed in the background
+};
+
+struct JournalRecord final
+{
+    uint64_t sequence = 0; // Strictly increasing - records included in the snapshot are skipped
+    JournalOperation operation{};
+    VirtualNodeState node;
+};
+
+// Persists a VirtualFilesystem in the directory of its endpoint
+//      - index       - snapshot of all nodes - encrypted in fixed size chunks and memory mapped on load
+//      - journal     - append-only log of changes after the snapshot - each record is encrypted on its own
+//      - journal.old - journal that is being compacted into a new snapshot
+// Restart reads the snapshot and only replays the changes since the last compaction
+// Records are only encrypted into memory when appended - a sync thread writes and syncs them together every
+// TPUNKT_STORAGE_VFS_JOURNAL_SYNC_INTERVAL, so a change is durable at most one interval after it was made
+// Note: Access statistics are only persisted with snapshots
+// Not synced == access to the journal must be synced with the filesystem
+struct VirtualFilesystemPersistence final
+{
+    // Called when the journal should be compacted - from inside a change
+    using CompactionRequest = std::function<void()>;
+
+    VirtualFilesystemPersistence(const char* dir, const CipherKey& key, CompactionRequest request);
+    ~VirtualFilesystemPersistence();
+
+    // Restores snapshot and journal into the given filesystem (only containing its root) and opens the journal
+    // Returns false if no consistent state could be restored - filesystem then holds all nodes that could be
+    bool load(VirtualFilesystem& filesystem);
+
+    // Returns true if the change was queued for the journal - written by the sync thread
+    bool append(JournalOperation operation, const VirtualNodeState& node);
+
+    // Writes and syncs all appended records - returns false if they couldn't be written, they are retried later
+    bool flush();
+
+    //===== Compaction =====//
+    // Split so that writing the snapshot doesn't block the filesystem
+
+    // Takes a snapshot of the filesystem and starts a new journal - needs to be synced with the filesystem
+    bool compactBegin(VirtualFilesystem& filesystem, std::shared_ptr<const DirectorySnapshot>& tree,
+                      uint64_t& sequence);
+
+    // Writes the nodes of the taken snapshot as new index and removes the compacted journal - no sync needed
+    bool compactFinish(const DirectorySnapshot& tree, uint64_t sequence);
+
+    //===== Info =====//
+
+    [[nodiscard]] uint64_t getSequence() const;
+    [[nodiscard]] uint32_t getJournalRecords() const;
+
+  private:
+    bool loadSnapshot(VirtualFilesystem& filesystem);
+    // Assigns the size of the valid prefix - everything after a damaged record is discarded
+    bool replayJournal(const char* name, VirtualFilesystem& filesystem, size_t& validSize);
+    // Opens the current journal for appending - cuts it to the given size
+    bool openJournal(size_t validSize);
+    bool writeSnapshot(const std::vector<VirtualNodeState>& nodes, uint64_t snapshotSequence) const;
+    // Needs the journal lock
+    bool flushLocked();
+    void syncLoop();
+
+    BlockCipher cipher;
+    CompactionRequest request;
+    std::vector<unsigned char> frame;   // Encrypted journal record
+    std::vector<unsigned char> pending; // Appended records not written yet - guarded by the pending lock
+    std::vector<unsigned char> writing; // Records being written - guarded by the journal lock
+    Spinlock pendingLock;
+    std::mutex journalLock;             // Held while the journal file is written or rotated
+    uint64_t sequence = 0;              // Last appended or loaded sequence
+    uint32_t journalRecords = 0;        // Records in the current journal - including pending ones
+    int dirfd = -1;
+    int journalfd = -1;
+    bool compactionRequested = false;
+    std::atomic<bool> isCompacting{false};
+    std::atomic<bool> isRunning{true};
+    std::thread syncThread;
+    TPUNKT_MACROS_STRUCT(VirtualFilesystemPersistence);
+};
+
+} // namespace tpunkt
+
+#endif // TPUNKT_VIRTUAL_FILESYSTEM_PERSISTENCE_H
@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cstring>
+#include "storage/vfs/VirtualNameArena.h"
+#include "util/Logging.h"
+
+namespace tpunkt
+{
+
+NameRef VirtualNameArena::add(const std::string_view name)
+{
+    if(name.size() > TPUNKT_STORAGE_FILE_LEN) [[unlikely]]
+    {
+        LOG_CRITICAL("Name too long");
+        return NameRef{};
+    }
+
+    const auto length = static_cast<uint32_t>(name.size());
+    std::vector<uint32_t>& slots = freeSlots[ length ];
+    if(!slots.empty())
+    {
+        const uint32_t offset = slots.back();
+        slots.pop_back();
+        unusedBytes -= length;
+        memcpy(bytes.data() + offset, name.data(), length);
+        return NameRef{.offset = offset, .length = length};
+    }
+
+    if(bytes.size() + length > UINT32_MAX) [[unlikely]]
+    {
+        LOG_FATAL("Name arena is full");
+    }
+
+    const auto offset = static_cast<uint32_t>(bytes.size());
+    bytes.insert(bytes.end(), name.begin(), name.end());
+    return NameRef{.offset = offset, .length = length};
+}
+
+void VirtualNameArena::remove(const NameRef ref)
+{
+    if(ref.length == 0)
+    {
+        return;
+    }
+    freeSlots[ ref.length ].push_back(ref.offset);
+    unusedBytes += ref.length;
+}
+
+std::string_view VirtualNameArena::get(const NameRef ref) const
+{
+    return std::string_view{bytes.data() + ref.offset, ref.length};
+}
+
+bool VirtualNameArena::isFragmented() const
+{
+    return unusedBytes >= TPUNKT_STORAGE_VFS_NAME_COMPACT_MIN && unusedBytes * 2 >= bytes.size();
+}
+
+void VirtualNameArena::reserve(const size_t reserveBytes)
+{
+    bytes.reserve(reserveBytes);
+}
+
+size_t VirtualNameArena::getUsedBytes() const
+{
+    return bytes.size() - unusedBytes;
+}
+
+size_t VirtualNameArena::getUnusedBytes() const
+{
+    return unusedBytes;
+}
+
+} // namespace tpunkt
@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TPUNKT_VIRTUAL_NAME_ARENA_H
+#define TPUNKT_VIRTUAL_NAME_ARENA_H
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "fwd.h"
+
+namespace tpunkt
+{
+
+// Position of an interned name inside the name arena of its filesystem
+struct NameRef final
+{
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
+
+// Stores the names of all files and dirs of a filesystem back to back - only the used bytes instead of the max length
+// Freed names are reused by names of the same length - compaction removes the remaining holes
+// Views and refs stay valid until the arena is compacted or grows
+// Not synced == NOT threadsafe
+struct VirtualNameArena final
+{
+    NameRef add(std::string_view name);
+    void remove(NameRef ref);
+
+    [[nodiscard]] std::string_view get(NameRef ref) const;
+
+    // Returns true once enough bytes are unused that compacting pays off
+    [[nodiscard]] bool isFragmented() const;
+
+    void reserve(size_t bytes);
+
+    [[nodiscard]] size_t getUsedBytes() const;
+    [[nodiscard]] size_t getUnusedBytes() const;
+
+  private:
+    std::vector<char> bytes;
+    std::array<std::vector<uint32_t>, TPUNKT_STORAGE_FILE_LEN + 1> freeSlots; // Offsets of freed names by length
+    size_t unusedBytes = 0;
+};
+
+} // namespace tpunkt
+
+#endif // TPUNKT_VIRTUAL_NAME_ARENA_H
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <array>
+#include "storage/vfs/VirtualNameSearch.h"
+
+namespace tpunkt
+{
+
+namespace
+{
+// Marks the start and end of a name - never part of a valid name
+constexpr char NAME_START = '\x01';
+constexpr char NAME_END = '\x02';
+
+using NameTrigrams = std::array<uint32_t, TPUNKT_STORAGE_FILE_LEN>;
+
+char ToLower(const char c)
+{
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+uint32_t GetTrigram(const std::string_view str, const size_t pos)
+{
+    const auto byte = [ & ](const size_t i) { return static_cast<uint32_t>(static_cast<unsigned char>(str[ i ])); };
+    return byte(pos) << 16U | byte(pos + 1) << 8U | byte(pos + 2);
+}
+
+// Collects the distinct trigrams of the marked and lowercased name - returns their count
+size_t GetNameTrigrams(const std::string_view name, NameTrigrams& trigrams)
+{
+    std::array<char, TPUNKT_STORAGE_FILE_LEN + 2> marked{};
+    size_t length = 0;
+    marked[ length++ ] = NAME_START;
+    for(const char c : name)
+    {
+        marked[ length++ ] = ToLower(c);
+    }
+    marked[ length++ ] = NAME_END;
+
+    const std::string_view markedView{marked.data(), length};
+    size_t count = 0;
+    for(size_t i = 0; i + 3 <= length; ++i)
+    {
+        trigrams[ count++ ] = GetTrigram(markedView, i);
+    }
+    std::sort(trigrams.begin(), trigrams.begin() + count);
+    return static_cast<size_t>(std::unique(trigrams.begin(), trigrams.begin() + count) - trigrams.begin());
+}
+} // namespace
+
+void VirtualNameSearch::add(const NodeHandle node, const std::string_view name)
+{
+    NameTrigrams trigrams;
+    const size_t count = GetNameTrigrams(name, trigrams);
+    const auto handle = static_cast<uint32_t>(node);
+    for(size_t i = 0; i < count; ++i)
+    {
+        std::vector<uint32_t>& list = postings[ trigrams[ i ] ];
+        if(list.empty() || list.back() < handle) // New handles mostly come last
+        {
+            list.push_back(handle);
+            continue;
+        }
+
+        const auto iter = std::ranges::lower_bound(list, handle);
+        if(*iter != handle)
+        {
+            list.insert(iter, handle);
+        }
+    }
+}
+
+void VirtualNameSearch::remove(const NodeHandle node, const std::string_view name)
+{
+    NameTrigrams trigrams;
+    const size_t count = GetNameTrigrams(name, trigrams);
+    const auto handle = static_cast<uint32_t>(node);
+    for(size_t i = 0; i < count; ++i)
+    {
+        const auto listIter = postings.find(trigrams[ i ]);
+        if(listIter == postings.end())
+        {
+            continue;
+        }
+
+        std::vector<uint32_t>& list = listIter->second;
+        const auto iter = std::ranges::lower_bound(list, handle);
+        if(iter != list.end() && *iter == handle)
+        {
+            list.erase(iter);
+        }
+        if(list.empty())
+        {
+            postings.erase(listIter);
+        }
+    }
+}
+
+bool VirtualNameSearch::PrepareQuery(const std::string_view text, const bool prefix, NameSearchQuery& query)
+{
+    query.text.clear();
+    query.trigrams.clear();
+    query.prefix = prefix;
+    if(text.empty() || text.size() > TPUNKT_STORAGE_FILE_LEN)
+    {
+        return false;
+    }
+
+    if(prefix)
+    {
+        query.text.push_back(NAME_START);
+    }
+    for(const char c : text)
+    {
+        query.text.push_back(ToLower(c));
+    }
+    if(query.text.size() < 3)
+    {
+        return false;
+    }
+
+    for(size_t i = 0; i + 3 <= query.text.size(); ++i)
+    {
+        query.trigrams.push_back(GetTrigram(query.text, i));
+    }
+    std::ranges::sort(query.trigrams);
+    const auto duplicates = std::ranges::unique(query.trigrams);
+    query.trigrams.erase(duplicates.begin(), duplicates.end());
+
+    if(prefix)
+    {
+        query.text.erase(0, 1);
+    }
+    return true;
+}
+
+bool VirtualNameSearch::Matches(const std::string_view name, const NameSearchQuery& query)
+{
+    std::array<char, TPUNKT_STORAGE_FILE_LEN> lowered{};
+    for(size_t i = 0; i < name.size(); ++i)
+    {
+        lowered[ i ] = ToLower(name[ i ]);
+    }
+
+    const std::string_view loweredView{lowered.data(), name.size()};
+    if(query.prefix)
+    {
+        return loweredView.starts_with(query.text);
+    }
+    return loweredView.find(query.text) != std::string_view::npos;
+}
+
+} // namespace tpunkt
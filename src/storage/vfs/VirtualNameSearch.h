@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TPUNKT_VIRTUAL_NAME_SEARCH_H
+#define TPUNKT_VIRTUAL_NAME_SEARCH_H
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ankerl/unordered_dense.h>
+#include "datastructures/NodeArena.h"
+#include "fwd.h"
+
+namespace tpunkt
+{
+
+// Search query lowercased (ASCII) with its trigrams - bytes outside ASCII are compared as is
+struct NameSearchQuery final
+{
+    std::string text;
+    std::vector<uint32_t> trigrams;
+    bool prefix = false; // Name has to start with the text - otherwise contain it
+};
+
+// Trigram index over the names of one kind of node (files or dirs) - case-insensitive
+// Each name is indexed with a start and end marker - prefix queries and short names have trigrams as well
+// Trigrams only preselect candidates - their names still have to be matched
+// Not synced == NOT threadsafe
+struct VirtualNameSearch final
+{
+    void add(NodeHandle node, std::string_view name);
+    void remove(NodeHandle node, std::string_view name);
+
+    // Returns false if the query can't be searched - substring queries need 3 characters, prefix queries 2
+    static bool PrepareQuery(std::string_view text, bool prefix, NameSearchQuery& query);
+
+    // Returns true if the name contains (or starts with) the query
+    static bool Matches(std::string_view name, const NameSearchQuery& query);
+
+    // Calls func for every node after the given one (in increasing handle order) that has all trigrams
+    // Stops early if func returns false
+    template <typename Func>
+    void forEachCandidate(const NameSearchQuery& query, NodeHandle after, Func&& func) const
+    {
+        thread_local std::vector<const std::vector<uint32_t>*> lists;
+        lists.clear();
+        for(const uint32_t trigram : query.trigrams)
+        {
+            const auto iter = postings.find(trigram);
+            if(iter == postings.end())
+            {
+                return; // No name has it
+            }
+            lists.push_back(&iter->second);
+        }
+        if(lists.empty())
+        {
+            return;
+        }
+
+        // Walk the shortest list - the others are only probed
+        std::ranges::sort(lists, {}, [](const auto* list) { return list->size(); });
+        const std::vector<uint32_t>& shortest = *lists.front();
+        auto iter = shortest.begin();
+        if(after != NodeHandle::INVALID)
+        {
+            iter = std::ranges::upper_bound(shortest, static_cast<uint32_t>(after));
+        }
+
+        for(; iter != shortest.end(); ++iter)
+        {
+            const uint32_t node = *iter;
+            const bool hasAll = std::all_of(lists.begin() + 1, lists.end(), [ & ](const auto* list)
+                                            { return std::ranges::binary_search(*list, node); });
+            if(hasAll && !func(static_cast<NodeHandle>(node)))
+            {
+                return;
+            }
+        }
+    }
+
+  private:
+    // Sorted handles of all nodes whose name has the trigram
+    ankerl::unordered_dense::map<uint32_t, std::vector<uint32_t>> postings;
+};
+
+} // namespace tpunkt
+
+#endif // TPUNKT_VIRTUAL_NAME_SEARCH_H
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TPUNKT_VIRTUAL_NODE_H
+#define TPUNKT_VIRTUAL_NODE_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <ankerl/unordered_dense.h>
+#include "datastructures/FixedString.h"
+#include "datastructures/NodeArena.h"
+#include "fwd.h"
+
+namespace tpunkt
+{
+
+// Intrusive links of a file or directory inside the tree - handles into the arenas of its VirtualFilesystem
+// Siblings are always of the same type (files link to files, dirs to dirs)
+struct VirtualNodeLinks final
+{
+    NodeHandle parent = NodeHandle::INVALID; // Containing directory
+    NodeHandle prev = NodeHandle::INVALID;
+    NodeHandle next = NodeHandle::INVALID;
+    uint32_t order = 0; // Position key inside the child list of the parent - increasing in list order
+};
+
+// Doubly linked list of the children of a directory - in insertion order
+struct VirtualNodeList final
+{
+    NodeHandle first = NodeHandle::INVALID;
+    NodeHandle last = NodeHandle::INVALID;
+    uint32_t count = 0;
+    uint32_t nextOrder = 0; // Order of the last linked node
+
+    [[nodiscard]] bool empty() const
+    {
+        return count == 0;
+    }
+};
+
+// Order of directory listings - files always come before dirs
+enum class DirectorySortOrder : uint8_t
+{
+    INSERTION, // Order the children were added in
+    NAME,
+    MODIFIED,
+    SIZE, // Total size for dirs
+};
+
+// Position after the last returned entry of a listing - zero to start
+struct DirectoryCursor final
+{
+    uint64_t key = 0;      // Sort key of the last entry - not used for the insertion order
+    uint64_t position = 0; // Flags | insertion order | node of the last entry
+    FileName name;         // Name of the last entry - only for the name order
+};
+
+// Computed once when the name of a file or dir is set - compared before the name itself
+inline uint64_t HashFileName(const FileName& name)
+{
+    return ankerl::unordered_dense::hash<std::string_view>{}(name.view());
+}
+
+struct NodeHandleHash final
+{
+    using is_avalanching = void;
+
+    [[nodiscard]] uint64_t operator()(const NodeHandle& handle) const noexcept
+    {
+        return ankerl::unordered_dense::hash<uint32_t>{}(static_cast<uint32_t>(handle));
+    }
+};
+
+// Name hashes are already avalanching
+struct NameHashPassthrough final
+{
+    using is_avalanching = void;
+
+    [[nodiscard]] uint64_t operator()(const uint64_t hash) const noexcept
+    {
+        return hash;
+    }
+};
+
+// Maps the name hash of each child (of one type) of a directory to its node
+// Hashes can collide - matches are confirmed by name and children with a taken hash are kept aside
+struct VirtualNameIndex final
+{
+    void add(const uint64_t hash, const NodeHandle node)
+    {
+        if(!nodes.try_emplace(hash, node).second) [[unlikely]]
+        {
+            collisions.emplace_back(hash, node);
+        }
+    }
+
+    void remove(const uint64_t hash, const NodeHandle node)
+    {
+        const auto iter = nodes.find(hash);
+        if(iter == nodes.end() || iter->second != node)
+        {
+            std::erase(collisions, std::pair{hash, node});
+            return;
+        }
+
+        // Next child with the same hash takes its place
+        const auto other =
+            std::ranges::find_if(collisions, [ hash ](const auto& entry) { return entry.first == hash; });
+        if(other == collisions.end())
+        {
+            nodes.erase(iter);
+            return;
+        }
+        iter->second = other->second;
+        collisions.erase(other);
+    }
+
+    // Returns the child with the hash that matches the name or NodeHandle::INVALID
+    template <typename IsName>
+    [[nodiscard]] NodeHandle find(const uint64_t hash, const IsName& isName) const
+    {
+        const auto iter = nodes.find(hash);
+        if(iter == nodes.end())
+        {
+            return NodeHandle::INVALID;
+        }
+        if(isName(iter->second))
+        {
+            return iter->second;
+        }
+        for(const auto& [ otherHash, node ] : collisions)
+        {
+            if(otherHash == hash && isName(node))
+            {
+                return node;
+            }
+        }
+        return NodeHandle::INVALID;
+    }
+
+    void reserve(const size_t count)
+    {
+        nodes.reserve(count);
+    }
+
+  private:
+    ankerl::unordered_dense::map<uint64_t, NodeHandle, NameHashPassthrough> nodes; // First child with each hash
+    std::vector<std::pair<uint64_t, NodeHandle>> collisions;                        // Other children with a taken hash
+};
+
+} // namespace tpunkt
+
+#endif // TPUNKT_VIRTUAL_NODE_H
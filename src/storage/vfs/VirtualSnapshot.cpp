@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cstring>
+#include "storage/vfs/VirtualSnapshot.h"
+
+namespace tpunkt
+{
+
+namespace
+{
+VirtualNodeState GetState(const FileID fid, const FileID parent, const std::string_view name, const NodeInfo& info,
+                          const FileStats& stats)
+{
+    // Zeroed so no padding bytes end up on disk
+    VirtualNodeState state;
+    memset(static_cast<void*>(&state), 0, sizeof(VirtualNodeState));
+    state.fid = fid;
+    state.parent = parent;
+    state.info.name = name;
+    state.info.creator = info.creator;
+    state.info.owner = info.owner;
+    state.stats = stats;
+    return state;
+}
+} // namespace
+
+std::string_view DirectorySnapshot::getName() const
+{
+    return std::string_view{names}.substr(name.offset, name.length);
+}
+
+std::string_view DirectorySnapshot::getName(const FileSnapshot& file) const
+{
+    return std::string_view{names}.substr(file.name.offset, file.name.length);
+}
+
+void DirectorySnapshot::collectNodes(std::vector<VirtualNodeState>& nodes) const
+{
+    nodes.clear();
+
+    // Breadth first - parents are always restored before their children
+    std::vector<const DirectorySnapshot*> queue;
+    queue.push_back(this);
+    for(size_t i = 0; i < queue.size(); ++i)
+    {
+        const DirectorySnapshot& dir = *queue[ i ];
+        VirtualNodeState& state =
+            nodes.emplace_back(GetState(dir.fid, dir.parent, dir.getName(), dir.info, dir.stats.base));
+        state.sizeLimit = dir.sizeLimit;
+        for(const FileSnapshot& file : dir.files)
+        {
+            nodes.push_back(GetState(file.fid, dir.fid, dir.getName(file), file.info, file.stats));
+        }
+        for(const auto& subDir : dir.dirs)
+        {
+            queue.push_back(subDir.get());
+        }
+    }
+}
+
+} // namespace tpunkt
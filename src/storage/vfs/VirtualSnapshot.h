@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TPUNKT_VIRTUAL_SNAPSHOT_H
+#define TPUNKT_VIRTUAL_SNAPSHOT_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "storage/vfs/VirtualDirectory.h"
+#include "storage/vfs/VirtualFilesystemPersistence.h"
+
+namespace tpunkt
+{
+
+// Frozen state of a file - name is stored in its directory
+struct FileSnapshot final
+{
+    FileID fid;
+    NameRef name;
+    NodeInfo info;
+    FileStats stats;
+};
+
+// Frozen state of a directory and everything below it at the time the snapshot was taken
+// Immutable once created - unchanged subtrees are shared between snapshots through the pointers
+// Threadsafe to read without any lock
+struct DirectorySnapshot final
+{
+    FileID fid;
+    FileID parent;
+    NameRef name;
+    NodeInfo info;
+    DirectoryStats stats;
+    uint64_t sizeLimit = 0;
+    std::vector<FileSnapshot> files;
+    std::vector<std::shared_ptr<const DirectorySnapshot>> dirs;
+    std::string names; // Own name and the names of the files
+
+    [[nodiscard]] std::string_view getName() const;
+    [[nodiscard]] std::string_view getName(const FileSnapshot& file) const;
+
+    // Collects the state of all nodes - every directory comes before its files and subdirectories
+    void collectNodes(std::vector<VirtualNodeState>& nodes) const;
+};
+
+// Point-in-time view of a whole filesystem - released when the last copy is dropped
+using VirtualSnapshot = std::shared_ptr<const DirectorySnapshot>;
+
+} // namespace tpunkt
+
+#endif // TPUNKT_VIRTUAL_SNAPSHOT_H
@@ -0,0 +1,36 @@
+#include <catch_amalgamated.hpp>
+#include <cstring>
+#include <filesystem>
+#include "crypto/CryptoContext.h"
+#include "TestCommons.h"
+
+using namespace tpunkt;
+
+namespace
+{
+bool IsSameKey(CipherKey left, CipherKey right)
+{
+    return std::memcmp(left.udata(), right.udata(), TPUNKT_CRYPTO_KEY_LEN) == 0;
+}
+} // namespace
+
+TEST_CASE("CryptoContext: Master key is created once and kept")
+{
+    namespace fs = std::filesystem;
+    CipherKey first;
+    {
+        TEST_INIT();
+        REQUIRE(crypto.hasMasterKey());
+        first = crypto.deriveKey("testctx1", 1);
+        REQUIRE_FALSE(IsSameKey(crypto.deriveKey("testctx1", 2), first));
+    }
+
+    REQUIRE(fs::file_size(TPUNKT_CRYPTO_MASTER_KEY_FILE) == TPUNKT_CRYPTO_KEY_LEN);
+    const auto perms = fs::status(TPUNKT_CRYPTO_MASTER_KEY_FILE).permissions();
+    REQUIRE((perms & (fs::perms::group_all | fs::perms::others_all)) == fs::perms::none);
+
+    // Same keys after a restart
+    TEST_INIT();
+    REQUIRE(crypto.hasMasterKey());
+    REQUIRE(IsSameKey(crypto.deriveKey("testctx1", 1), first));
+}
@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <catch_amalgamated.hpp>
+#include "datastructures/NodeArena.h"
+#include "TestCommons.h"
+
+using namespace tpunkt;
+
+namespace
+{
+struct Node final
+{
+    explicit Node(const int value) : value(value)
+    {
+        ++alive;
+    }
+    ~Node()
+    {
+        --alive;
+    }
+    Node(const Node&) = delete;
+    Node& operator=(const Node&) = delete;
+
+    int value = 0;
+    static inline int alive = 0;
+};
+} // namespace
+
+TEST_CASE("NodeArena Basic Functionality")
+{
+    TEST_INIT();
+    SECTION("Create and Destroy")
+    {
+        NodeArena<Node, 64> arena;
+        const NodeHandle first = arena.create(1);
+        const NodeHandle second = arena.create(2);
+
+        REQUIRE(arena.size() == 2);
+        REQUIRE(arena.get(first)->value == 1);
+        REQUIRE(arena[ second ].value == 2);
+
+        arena.destroy(first);
+        REQUIRE(arena.size() == 1);
+        REQUIRE_FALSE(arena.contains(first));
+        REQUIRE(arena.get(first) == nullptr);
+        REQUIRE(arena.get(NodeHandle::INVALID) == nullptr);
+
+        // Freed slots are reused first
+        const NodeHandle third = arena.create(3);
+        REQUIRE(third == first);
+        REQUIRE(arena[ third ].value == 3);
+    }
+
+    SECTION("Pointer Stability")
+    {
+        NodeArena<Node, 64> arena;
+        const NodeHandle handle = arena.create(42);
+        const Node* ptr = arena.get(handle);
+
+        for(int i = 0; i < 1000; ++i)
+        {
+            (void)arena.create(i);
+        }
+
+        REQUIRE(arena.capacity() >= 1001);
+        REQUIRE(arena.get(handle) == ptr);
+        REQUIRE(ptr->value == 42);
+    }
+
+    SECTION("Iteration")
+    {
+        NodeArena<Node, 64> arena;
+        std::vector<NodeHandle> handles;
+        for(int i = 0; i < 200; ++i)
+        {
+            handles.push_back(arena.create(i));
+        }
+        for(int i = 0; i < 200; i += 2)
+        {
+            arena.destroy(handles[ i ]);
+        }
+
+        int visited = 0;
+        arena.forEach(
+            [ & ](const NodeHandle handle, const Node& node)
+            {
+                REQUIRE(node.value % 2 == 1);
+                REQUIRE(arena.contains(handle));
+                ++visited;
+            });
+        REQUIRE(visited == 100);
+    }
+
+    SECTION("Destruction")
+    {
+        {
+            NodeArena<Node, 64> arena;
+            for(int i = 0; i < 100; ++i)
+            {
+                (void)arena.create(i);
+            }
+            REQUIRE(Node::alive == 100);
+        }
+        REQUIRE(Node::alive == 0);
+    }
+}
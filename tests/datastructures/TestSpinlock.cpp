@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <array>
 #include <catch_amalgamated.hpp>
 #include <thread>
 #include "datastructures/Spinlock.h"
@@ -157,4 +158,114 @@ TEST_CASE("New readers are blocked when a writer is active")
     // Allow a little tolerance for scheduling delays.
     REQUIRE(elapsed >= 149);
     REQUIRE(readerAcquired.load() == true);
-}
\ No newline at end of file
+}
+TEST_CASE("Readers never see a writer in progress")
+{
+    TEST_INIT();
+    CooperativeSpinlock lock;
+    uint64_t first = 0;
+    uint64_t second = 0;
+    std::atomic<int> torn{0};
+    constexpr int threads = 8;
+    constexpr int ops = 20000;
+
+    std::vector<std::thread> runners;
+    for(int i = 0; i < threads; ++i)
+    {
+        runners.emplace_back(
+            [ &, i ]()
+            {
+                for(int j = 0; j < ops; ++j)
+                {
+                    const bool isWriter = (i + j) % 10 == 0;
+                    CooperativeSpinlockGuard guard(lock, isWriter);
+                    if(isWriter)
+                    {
+                        first++;
+                        second++;
+                    }
+                    else if(first != second)
+                    {
+                        torn++;
+                    }
+                }
+            });
+    }
+    for(auto& t : runners)
+    {
+        t.join();
+    }
+
+    REQUIRE(torn == 0);
+    REQUIRE(first == threads * ops / 10);
+    REQUIRE_FALSE(lock.isLocked());
+}
+
+// Run with "[benchmark]" - mostly reads like the traffic of a storage endpoint
+TEST_CASE("Lock contention", "[.][benchmark]")
+{
+    constexpr int threads = 8;
+    constexpr int ops = 20000;
+    constexpr int writeEvery = 20;
+    std::array<uint64_t, 64> data{};
+
+    const auto run = [ & ](auto&& operation)
+    {
+        std::vector<std::thread> runners;
+        for(int i = 0; i < threads; ++i)
+        {
+            runners.emplace_back(
+                [ &, i ]()
+                {
+                    for(int j = 0; j < ops; ++j)
+                    {
+                        operation((i + j) % writeEvery == 0);
+                    }
+                });
+        }
+        for(auto& t : runners)
+        {
+            t.join();
+        }
+        return data[ 0 ];
+    };
+
+    // A lookup reads a few cache lines - a change writes one
+    const auto access = [ & ](const bool isWrite)
+    {
+        if(isWrite)
+        {
+            data[ 0 ]++;
+            return;
+        }
+        uint64_t sum = 0;
+        for(const uint64_t value : data)
+        {
+            sum += value;
+        }
+        Catch::Benchmark::deoptimize_value(sum);
+    };
+
+    Spinlock spinlock;
+    CooperativeSpinlock cooperative;
+
+    BENCHMARK("Spinlock")
+    {
+        return run(
+            [ & ](const bool isWrite)
+            {
+                SpinlockGuard guard{spinlock};
+                access(isWrite);
+            });
+    };
+
+    BENCHMARK("CooperativeSpinlock")
+    {
+        return run(
+            [ & ](const bool isWrite)
+            {
+                CooperativeSpinlockGuard guard{cooperative, isWrite};
+                access(isWrite);
+            });
+    };
+}
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <atomic>
+#include <catch_amalgamated.hpp>
+#include <thread>
+#include <unistd.h>
+#include "instance/TaskManager.h"
+#include "TestCommons.h"
+
+using namespace tpunkt;
+
+namespace
+{
+bool WaitFor(const std::atomic<int>& value, const int expected)
+{
+    for(int i = 0; i < 5000 && value < expected; ++i)
+    {
+        usleep(1000U);
+    }
+    return value >= expected;
+}
+} // namespace
+
+TEST_CASE("Task Manager")
+{
+    if(std::thread::hardware_concurrency() < 2)
+    {
+        SKIP("No worker threads on a single core");
+    }
+
+    TEST_INIT();
+    TaskManager manager{};
+
+    SECTION("Tasks queue themselves again")
+    {
+        // Adding from inside a running task must not invalidate the task of the worker
+        std::atomic<int> runs = 0;
+        std::function<void()> requeue = [ & ]
+        {
+            if(++runs < 200)
+            {
+                manager.taskAdd(UserID::SERVER, TaskName{"Requeue"}, [ & ] { requeue(); });
+            }
+        };
+        manager.taskAdd(UserID::SERVER, TaskName{"Requeue"}, [ & ] { requeue(); });
+        REQUIRE(WaitFor(runs, 200));
+
+        // Finished tasks are removed
+        std::vector<DTO::TaskInfo> infos;
+        for(int i = 0; i < 1000; ++i)
+        {
+            infos.clear();
+            REQUIRE(manager.infoTasks(UserID::SERVER, infos));
+            if(infos.empty())
+            {
+                break;
+            }
+            usleep(1000U);
+        }
+        REQUIRE(infos.empty());
+    }
+
+    SECTION("Periodic tasks run until cancelled")
+    {
+        std::atomic<int> runs = 0;
+        const TaskID task = manager.taskAddPeriodic(UserID::SERVER, TaskName{"Periodic"}, 1000, [ & ] { ++runs; });
+        REQUIRE(WaitFor(runs, 3));
+        REQUIRE(manager.taskExists(task));
+
+        manager.taskCancel(task);
+        REQUIRE_FALSE(manager.taskExists(task));
+        const int cancelledRuns = runs;
+        usleep(20'000U);
+        REQUIRE(runs == cancelledRuns);
+    }
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <catch_amalgamated.hpp>
+#include "server/HttpRange.h"
+#include "TestCommons.h"
+
+using namespace tpunkt;
+
+TEST_CASE("HTTP Range")
+{
+    std::vector<ByteRange> ranges;
+
+    SECTION("Single ranges")
+    {
+        REQUIRE(ParseRange("bytes=0-99", 1000, ranges) == RangeStatus::PARTIAL);
+        REQUIRE(ranges.size() == 1);
+        REQUIRE(ranges[ 0 ].begin == 0);
+        REQUIRE(ranges[ 0 ].end == 100);
+
+        REQUIRE(ParseRange("bytes=900-", 1000, ranges) == RangeStatus::PARTIAL);
+        REQUIRE(ranges[ 0 ].begin == 900);
+        REQUIRE(ranges[ 0 ].end == 1000);
+
+        REQUIRE(ParseRange("bytes=-100", 1000, ranges) == RangeStatus::PARTIAL);
+        REQUIRE(ranges[ 0 ].begin == 900);
+        REQUIRE(ranges[ 0 ].end == 1000);
+
+        // Clamped to the file
+        REQUIRE(ParseRange("bytes=500-5000", 1000, ranges) == RangeStatus::PARTIAL);
+        REQUIRE(ranges[ 0 ].end == 1000);
+        REQUIRE(ParseRange("bytes=-5000", 1000, ranges) == RangeStatus::PARTIAL);
+        REQUIRE(ranges[ 0 ].begin == 0);
+    }
+
+    SECTION("Multiple ranges")
+    {
+        REQUIRE(ParseRange("bytes=500-599, 0-9,-10", 1000, ranges) == RangeStatus::PARTIAL);
+        REQUIRE(ranges.size() == 3);
+        REQUIRE(ranges[ 0 ].begin == 0);
+        REQUIRE(ranges[ 1 ].begin == 500);
+        REQUIRE(ranges[ 2 ].begin == 990);
+
+        // Overlapping and adjacent ranges are merged
+        REQUIRE(ParseRange("bytes=0-9,5-19,20-29,100-", 1000, ranges) == RangeStatus::PARTIAL);
+        REQUIRE(ranges.size() == 2);
+        REQUIRE(ranges[ 0 ].begin == 0);
+        REQUIRE(ranges[ 0 ].end == 30);
+        REQUIRE(ranges[ 1 ].begin == 100);
+
+        // Ranges outside the file are dropped
+        REQUIRE(ParseRange("bytes=2000-3000,0-0", 1000, ranges) == RangeStatus::PARTIAL);
+        REQUIRE(ranges.size() == 1);
+        REQUIRE(ranges[ 0 ].end == 1);
+    }
+
+    SECTION("Unsatisfiable")
+    {
+        REQUIRE(ParseRange("bytes=1000-", 1000, ranges) == RangeStatus::UNSATISFIABLE);
+        REQUIRE(ParseRange("bytes=-0", 1000, ranges) == RangeStatus::UNSATISFIABLE);
+        REQUIRE(ParseRange("bytes=0-", 0, ranges) == RangeStatus::UNSATISFIABLE);
+        REQUIRE(ranges.empty());
+    }
+
+    SECTION("Ignored")
+    {
+        REQUIRE(ParseRange("", 1000, ranges) == RangeStatus::FULL);
+        REQUIRE(ParseRange("items=0-5", 1000, ranges) == RangeStatus::FULL);
+        REQUIRE(ParseRange("bytes=", 1000, ranges) == RangeStatus::FULL);
+        REQUIRE(ParseRange("bytes=5-1", 1000, ranges) == RangeStatus::FULL);
+        REQUIRE(ParseRange("bytes=a-5", 1000, ranges) == RangeStatus::FULL);
+        REQUIRE(ParseRange("bytes=0-5,x", 1000, ranges) == RangeStatus::FULL);
+        REQUIRE(ranges.empty());
+
+        std::string many = "bytes=0-0";
+        for(size_t i = 1; i <= TPUNKT_SERVER_DOWNLOAD_MAX_RANGES; ++i)
+        {
+            many += "," + std::to_string(i * 10) + "-" + std::to_string(i * 10);
+        }
+        REQUIRE(ParseRange(many, 1000, ranges) == RangeStatus::FULL);
+    }
+}
@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <catch_amalgamated.hpp>
+#include "storage/UploadSession.h"
+#include "TestCommons.h"
+
+using namespace tpunkt;
+
+TEST_CASE("Upload Session")
+{
+    SECTION("Upload ids")
+    {
+        const auto upload = static_cast<UploadID>(0x0123456789abcdefULL);
+        const UploadIDString str = GetUploadIDStr(upload);
+        REQUIRE(str.view() == "0123456789abcdef");
+        REQUIRE(ParseUploadID(str.view()) == upload);
+
+        // Always 16 digits
+        REQUIRE(GetUploadIDStr(static_cast<UploadID>(0xff)).view() == "00000000000000ff");
+        REQUIRE(ParseUploadID("00000000000000ff") == static_cast<UploadID>(0xff));
+    }
+
+    SECTION("Invalid upload ids")
+    {
+        REQUIRE(ParseUploadID("") == UploadID::INVALID);
+        REQUIRE(ParseUploadID("ff") == UploadID::INVALID);
+        REQUIRE(ParseUploadID("0123456789abcdef0") == UploadID::INVALID);
+        REQUIRE(ParseUploadID("0123456789abcdeg") == UploadID::INVALID);
+        REQUIRE(ParseUploadID("-123456789abcdef") == UploadID::INVALID);
+    }
+
+    SECTION("Expiration")
+    {
+        UploadSession session{};
+        session.expiration = Timestamp::Now(TPUNKT_STORAGE_UPLOAD_TIMEOUT);
+        REQUIRE_FALSE(session.isExpired());
+        session.expiration.zero();
+        REQUIRE(session.isExpired());
+    }
+
+    SECTION("Parts")
+    {
+        constexpr uint64_t partSize = TPUNKT_STORAGE_UPLOAD_MIN_PART_SIZE;
+        UploadSession session{};
+        REQUIRE(session.init(partSize * 3 + 10, partSize));
+        REQUIRE(session.parts.size() == 4);
+        REQUIRE(session.parts[ 1 ].committed == partSize);
+        REQUIRE(session.parts[ 1 ].end == partSize * 2);
+        REQUIRE(session.parts[ 3 ].received == partSize * 3);
+        REQUIRE(session.parts[ 3 ].end == partSize * 3 + 10);
+
+        // Complete once every part is written up to its end
+        REQUIRE(session.isSettled());
+        REQUIRE_FALSE(session.isComplete());
+        for(UploadPart& part : session.parts)
+        {
+            part.committed = part.end;
+        }
+        REQUIRE(session.isComplete());
+        ++session.parts[ 2 ].pending;
+        REQUIRE_FALSE(session.isSettled());
+        REQUIRE_FALSE(session.isComplete());
+
+        // Single parts
+        REQUIRE(session.init(100, 0));
+        REQUIRE(session.parts.size() == 1);
+        REQUIRE(session.parts[ 0 ].end == 100);
+        REQUIRE(session.init(100, UINT64_MAX));
+        REQUIRE(session.parts.size() == 1);
+
+        // Unknown size - complete once settled
+        REQUIRE(session.init(0, partSize));
+        REQUIRE(session.parts.size() == 1);
+        REQUIRE(session.parts[ 0 ].end == UINT64_MAX);
+        REQUIRE(session.isComplete());
+    }
+
+    SECTION("Invalid parts")
+    {
+        UploadSession session{};
+        REQUIRE_FALSE(session.init(TPUNKT_STORAGE_UPLOAD_MIN_PART_SIZE * 2, TPUNKT_STORAGE_UPLOAD_MIN_PART_SIZE - 1));
+        REQUIRE_FALSE(session.init(TPUNKT_STORAGE_UPLOAD_MIN_PART_SIZE * (TPUNKT_STORAGE_UPLOAD_MAX_PARTS + 1),
+                                   TPUNKT_STORAGE_UPLOAD_MIN_PART_SIZE));
+    }
+}
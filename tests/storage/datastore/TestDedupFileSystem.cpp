@@ -0,0 +1,274 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <catch_amalgamated.hpp>
+#include <filesystem>
+#include <random>
+#include <string>
+#include "storage/datastore/ContentChunker.h"
+#include "storage/datastore/DedupFileSystem.h"
+#include "TestCommons.h"
+
+using namespace tpunkt;
+
+namespace
+{
+namespace fs = std::filesystem;
+const std::string dedupDir = "./endpoints/1/datastore/";
+constexpr size_t writeSize = 40'000;
+
+std::string RandomData(const size_t size, const uint32_t seed)
+{
+    std::mt19937 random{seed};
+    std::string data(size, '\0');
+    for(char& c : data)
+    {
+        c = static_cast<char>(random() & 0xFF);
+    }
+    return data;
+}
+
+bool Create(DataStore& store, const uint32_t fileID)
+{
+    bool success = false;
+    store.createFile(fileID, [ & ](const bool result) { success = result; });
+    return success;
+}
+
+// Writes the data in order - or part by part from the last to the first
+bool Write(DataStore& store, const uint32_t fileID, const std::string& data, const bool reversed = false)
+{
+    bool success = true;
+    WriteHandle handle;
+    if(!store.initWrite(fileID, handle))
+    {
+        return false;
+    }
+
+    const size_t count = (data.size() + writeSize - 1) / writeSize;
+    for(size_t i = 0; i < count && success; ++i)
+    {
+        const size_t offset = (reversed ? count - 1 - i : i) * writeSize;
+        handle.tempPosition = offset;
+        store.writeFile(handle, i == count - 1, reinterpret_cast<const unsigned char*>(data.data()) + offset,
+                        std::min(writeSize, data.size() - offset), [ & ](const bool result) { success = result; });
+    }
+    return success && store.closeWrite(handle, false, [](bool) {});
+}
+
+bool Read(DataStore& store, const uint32_t fileID, std::string& content)
+{
+    ReadHandle handle;
+    if(!store.initRead(fileID, 0, 0, handle))
+    {
+        return false;
+    }
+
+    bool success = true;
+    bool isDone = false;
+    while(success && !isDone)
+    {
+        store.readFile(handle, TPUNKT_STORAGE_FILE_CHUNK_SIZE,
+                       [ & ](const unsigned char* data, const size_t size, const bool result, const bool isLast)
+                       {
+                           content.append(reinterpret_cast<const char*>(data), size);
+                           success = result;
+                           isDone = isLast;
+                       });
+    }
+    return store.closeRead(handle, [](bool) {}) && success;
+}
+
+bool Delete(DataStore& store, const uint32_t fileID)
+{
+    bool success = false;
+    store.deleteFile(fileID, [ & ](const bool result) { success = result; });
+    return success;
+}
+} // namespace
+
+TEST_CASE("Content defined chunks")
+{
+    const std::string data = RandomData(1'000'000, 1);
+    const auto* begin = reinterpret_cast<const unsigned char*>(data.data());
+
+    // Boundaries after an insertion are found again
+    std::string changed = data;
+    changed.insert(300'000, "Inserted");
+    const auto* changedBegin = reinterpret_cast<const unsigned char*>(changed.data());
+
+    size_t position = 0;
+    std::vector<size_t> boundaries;
+    while(position < data.size())
+    {
+        const size_t size = FindChunkBoundary(begin + position, data.size() - position);
+        REQUIRE(size <= TPUNKT_STORAGE_DEDUP_CHUNK_MAX);
+        REQUIRE((size >= TPUNKT_STORAGE_DEDUP_CHUNK_MIN || position + size == data.size()));
+        position += size;
+        boundaries.push_back(position);
+    }
+    REQUIRE(boundaries.size() > 4);
+
+    position = 0;
+    size_t shared = 0;
+    while(position < changed.size())
+    {
+        position += FindChunkBoundary(changedBegin + position, changed.size() - position);
+        if(position > 300'000 && std::ranges::binary_search(boundaries, position - 8))
+        {
+            ++shared;
+        }
+    }
+    REQUIRE(shared >= boundaries.size() / 2);
+}
+
+TEST_CASE("Deduplicating File System")
+{
+    fs::create_directories(dedupDir);
+    TEST_INIT();
+    const CipherKey key{"0123456789abcdef0123456789abcdef"};
+    auto* store = new DedupFileSystemDatastore(EndpointID{1}, key);
+    bool isGarbageRequested = false;
+    store->setGarbageRequest([ & ] { isGarbageRequested = true; });
+
+    const std::string data = RandomData(1'000'000, 2);
+
+    SECTION("Same content is stored once")
+    {
+        for(const uint32_t fileID : {1U, 2U, 3U, 4U})
+        {
+            REQUIRE(Create(*store, fileID));
+        }
+        REQUIRE(Write(*store, 1, data));
+        REQUIRE(Write(*store, 2, data));
+        REQUIRE(Write(*store, 3, data, true)); // Parts out of order are chunked when committed
+
+        DedupStats stats = store->getStats();
+        REQUIRE(stats.logicalBytes == 3 * data.size());
+        REQUIRE(stats.storedBytes == data.size());
+        REQUIRE(stats.writtenBytes == data.size());
+        REQUIRE(stats.getRatio() == 3.0);
+        REQUIRE_FALSE(fs::exists(dedupDir + "3T"));
+
+        for(const uint32_t fileID : {1U, 3U})
+        {
+            std::string content;
+            REQUIRE(Read(*store, fileID, content));
+            REQUIRE(content == data);
+        }
+
+        // Only the chunks around the insertion are new
+        std::string changed = data;
+        changed.insert(500'000, "Inserted");
+        REQUIRE(Write(*store, 4, changed));
+        stats = store->getStats();
+        REQUIRE(stats.storedBytes - data.size() <= 2 * TPUNKT_STORAGE_DEDUP_CHUNK_MAX);
+
+        // Chunks are removed once no file uses them
+        REQUIRE(Delete(*store, 4));
+        REQUIRE(isGarbageRequested);
+        store->collectGarbage();
+        REQUIRE(store->getStats().storedBytes == data.size());
+
+        // Rebuilt from the manifests
+        delete store;
+        store = new DedupFileSystemDatastore(EndpointID{1}, key);
+        REQUIRE(store->getStats().logicalBytes == 3 * data.size());
+        REQUIRE(store->getStats().storedBytes == data.size());
+
+        for(const uint32_t fileID : {1U, 2U, 3U})
+        {
+            REQUIRE(Delete(*store, fileID));
+        }
+        store->collectGarbage();
+        stats = store->getStats();
+        REQUIRE(stats.storedBytes == 0);
+        REQUIRE(stats.chunks == 0);
+    }
+
+    SECTION("Overwrite and revert")
+    {
+        REQUIRE(Create(*store, 5));
+        REQUIRE_FALSE(Create(*store, 5));
+        REQUIRE(Write(*store, 5, data));
+        REQUIRE(Write(*store, 5, RandomData(100'000, 3)));
+        store->collectGarbage();
+        REQUIRE(store->getStats().storedBytes == 100'000);
+
+        WriteHandle handle;
+        REQUIRE(store->initWrite(5, handle));
+        REQUIRE_FALSE(store->initWrite(5, handle)); // Already written
+        store->writeFile(handle, true, reinterpret_cast<const unsigned char*>(data.data()), data.size(), [](bool) {});
+        REQUIRE(store->closeWrite(handle, true, [](bool) {}));
+        store->collectGarbage();
+        REQUIRE(store->getStats().storedBytes == 100'000);
+
+        std::string content;
+        REQUIRE(Read(*store, 5, content));
+        REQUIRE(content == RandomData(100'000, 3));
+        REQUIRE(Delete(*store, 5));
+    }
+
+    SECTION("Retried writes replace the data after them")
+    {
+        REQUIRE(Create(*store, 7));
+        WriteHandle handle;
+        REQUIRE(store->initWrite(7, handle));
+        const auto write = [ & ](const std::string& content, const size_t offset, const size_t size, const bool isLast)
+        {
+            bool success = false;
+            handle.tempPosition = offset;
+            store->writeFile(handle, isLast, reinterpret_cast<const unsigned char*>(content.data()) + offset, size,
+                             [ & ](const bool result) { success = result; });
+            return success;
+        };
+
+        // Stored chunks and pending data after the retry offset are replaced
+        const std::string wrong = RandomData(data.size(), 4);
+        REQUIRE(write(data, 0, 300'000, false));
+        REQUIRE(write(wrong, 300'000, 400'000, false));
+        REQUIRE(write(data, 300'000, 200'000, false));
+        REQUIRE(write(data, 500'000, 500'000, true));
+        REQUIRE(store->closeWrite(handle, false, [](bool) {}));
+
+        std::string content;
+        REQUIRE(Read(*store, 7, content));
+        REQUIRE(content == data);
+        store->collectGarbage();
+        REQUIRE(store->getStats().storedBytes == data.size());
+        REQUIRE(Delete(*store, 7));
+    }
+
+    SECTION("Chunks stay until readers started before are closed")
+    {
+        REQUIRE(Create(*store, 6));
+        REQUIRE(Write(*store, 6, data));
+        ReadHandle handle;
+        REQUIRE(store->initRead(6, 0, 0, handle));
+        REQUIRE(Delete(*store, 6));
+        store->collectGarbage();
+        REQUIRE(store->getStats().storedBytes == data.size());
+
+        std::string content;
+        bool isDone = false;
+        while(!isDone)
+        {
+            store->readFile(handle, TPUNKT_STORAGE_FILE_CHUNK_SIZE,
+                            [ & ](const unsigned char* chunk, const size_t size, const bool success, const bool isLast)
+                            {
+                                REQUIRE(success);
+                                content.append(reinterpret_cast<const char*>(chunk), size);
+                                isDone = isLast;
+                            });
+        }
+        REQUIRE(content == data);
+
+        isGarbageRequested = false;
+        REQUIRE(store->closeRead(handle, [](bool) {}));
+        REQUIRE(isGarbageRequested);
+        store->collectGarbage();
+        REQUIRE(store->getStats().storedBytes == 0);
+    }
+
+    delete store;
+    fs::remove_all("./endpoints");
+}
@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <atomic>
+#include <catch_amalgamated.hpp>
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <string>
+#include "storage/datastore/UringFileSystem.h"
+#include "TestCommons.h"
+
+using namespace tpunkt;
+
+namespace
+{
+namespace fs = std::filesystem;
+const std::string uringDir = "./endpoints/1/datastore/";
+
+// Callbacks come from the completion thread - no loop is registered in tests
+bool Await(std::promise<bool>& done)
+{
+    auto future = done.get_future();
+    return future.wait_for(std::chrono::seconds(5)) == std::future_status::ready && future.get();
+}
+
+bool Create(DataStore& store, const uint32_t fileID)
+{
+    std::promise<bool> done;
+    store.createFile(fileID, [ & ](const bool success) { done.set_value(success); });
+    return Await(done);
+}
+
+bool Delete(DataStore& store, const uint32_t fileID)
+{
+    std::promise<bool> done;
+    store.deleteFile(fileID, [ & ](const bool success) { done.set_value(success); });
+    return Await(done);
+}
+
+bool CloseWrite(DataStore& store, WriteHandle& handle, const bool revert)
+{
+    std::promise<bool> done;
+    store.closeWrite(handle, revert, [ & ](const bool success) { done.set_value(success); });
+    return Await(done);
+}
+
+// Reads until the last chunk - returns false on failure
+bool ReadAll(DataStore& store, ReadHandle& handle, const size_t chunkSize, std::string& content, int& chunks)
+{
+    bool isDone = false;
+    while(!isDone)
+    {
+        std::promise<bool> done;
+        store.readFile(handle, chunkSize,
+                       [ & ](const unsigned char* data, const size_t size, const bool success, const bool isLast)
+                       {
+                           if(success)
+                           {
+                               content.append(reinterpret_cast<const char*>(data), size);
+                           }
+                           isDone = isLast;
+                           done.set_value(success);
+                       });
+        if(!Await(done))
+        {
+            return false;
+        }
+        ++chunks;
+    }
+    return true;
+}
+} // namespace
+
+TEST_CASE("io_uring File System")
+{
+    if(!UringFileSystemDatastore::IsSupported())
+    {
+        SKIP("io_uring not supported");
+    }
+
+    fs::create_directories(uringDir);
+    TEST_INIT();
+    auto* store = new UringFileSystemDatastore(EndpointID{1});
+
+    SECTION("File Creation")
+    {
+        constexpr uint32_t fileID = 13579;
+        REQUIRE(Create(*store, fileID));
+        REQUIRE(fs::exists(uringDir + std::to_string(fileID)));
+        REQUIRE_FALSE(Create(*store, fileID));
+
+        REQUIRE(Delete(*store, fileID));
+        REQUIRE_FALSE(fs::exists(uringDir + std::to_string(fileID)));
+        REQUIRE(Delete(*store, fileID)); // Never written - nothing to delete
+    }
+
+    SECTION("Writes in flight together")
+    {
+        constexpr uint32_t fileID = 24680;
+        REQUIRE(Create(*store, fileID));
+
+        WriteHandle writeHandle;
+        REQUIRE(store->initWrite(fileID, writeHandle));
+
+        // Data is copied - the same buffer is reused for every chunk
+        constexpr int chunkCount = 16;
+        std::string expected;
+        std::string chunk(40'000, ' ');
+        std::promise<bool> results[ chunkCount ];
+        for(int i = 0; i < chunkCount; ++i)
+        {
+            std::fill(chunk.begin(), chunk.end(), static_cast<char>('a' + i));
+            expected += chunk;
+            store->writeFile(writeHandle, i == chunkCount - 1, reinterpret_cast<const unsigned char*>(chunk.data()),
+                             chunk.size(), [ &, i ](const bool success) { results[ i ].set_value(success); });
+        }
+        for(auto& result : results)
+        {
+            REQUIRE(Await(result));
+        }
+        REQUIRE(CloseWrite(*store, writeHandle, false));
+        REQUIRE(fs::file_size(uringDir + std::to_string(fileID)) == expected.size());
+        REQUIRE_FALSE(fs::exists(uringDir + std::to_string(fileID) + "T"));
+
+        // Reads are split at the registered buffer size
+        ReadHandle readHandle;
+        REQUIRE(store->initRead(fileID, 0, 0, readHandle));
+        std::string content;
+        int chunks = 0;
+        REQUIRE(ReadAll(*store, readHandle, TPUNKT_STORAGE_FILE_CHUNK_SIZE, content, chunks));
+        REQUIRE(content == expected);
+        REQUIRE(chunks == static_cast<int>(expected.size() / TPUNKT_STORAGE_DATASTORE_URING_READ_SIZE) + 1);
+        REQUIRE(store->closeRead(readHandle, [](bool) {}));
+
+        // Partial reads
+        REQUIRE(store->initRead(fileID, 39'990, 40'010, readHandle));
+        content.clear();
+        REQUIRE(ReadAll(*store, readHandle, 7, content, chunks));
+        REQUIRE(content == std::string(10, 'a') + std::string(10, 'b'));
+        REQUIRE(store->closeRead(readHandle, [](bool) {}));
+
+        REQUIRE(Delete(*store, fileID));
+    }
+
+    SECTION("Commit waits for writes in flight")
+    {
+        constexpr uint32_t fileID = 13243;
+        REQUIRE(Create(*store, fileID));
+
+        WriteHandle writeHandle;
+        REQUIRE(store->initWrite(fileID, writeHandle));
+        const std::string chunk(100'000, 'x');
+        std::atomic<int> written = 0;
+        for(int i = 0; i < 8; ++i)
+        {
+            store->writeFile(writeHandle, i == 7, reinterpret_cast<const unsigned char*>(chunk.data()), chunk.size(),
+                             [ & ](const bool success) { written += success ? 1 : 0; });
+        }
+        REQUIRE(CloseWrite(*store, writeHandle, false)); // Queued while the writes are still in flight
+        REQUIRE(written == 8);
+        REQUIRE(fs::file_size(uringDir + std::to_string(fileID)) == 8 * chunk.size());
+        REQUIRE(Delete(*store, fileID));
+    }
+
+    SECTION("Revert a write operation")
+    {
+        constexpr uint32_t fileID = 11223;
+        REQUIRE(Create(*store, fileID));
+
+        WriteHandle writeHandle;
+        REQUIRE(store->initWrite(fileID, writeHandle));
+        const char testData[] = "This should be discarded.";
+        std::promise<bool> written;
+        store->writeFile(writeHandle, true, reinterpret_cast<const unsigned char*>(testData), sizeof(testData),
+                         [ & ](const bool success) { written.set_value(success); });
+        REQUIRE(Await(written));
+        REQUIRE(CloseWrite(*store, writeHandle, true));
+        REQUIRE_FALSE(fs::exists(uringDir + std::to_string(fileID) + "T"));
+
+        ReadHandle readHandle;
+        REQUIRE(store->initRead(fileID, 0, 0, readHandle));
+        std::string content;
+        int chunks = 0;
+        REQUIRE(ReadAll(*store, readHandle, 1024, content, chunks));
+        REQUIRE(content.empty());
+        REQUIRE(chunks == 1);
+        REQUIRE(store->closeRead(readHandle, [](bool) {}));
+
+        REQUIRE(Delete(*store, fileID));
+    }
+
+    SECTION("Error Handling")
+    {
+        ReadHandle readHandle;
+        REQUIRE_FALSE(store->initRead(99999, 0, 0, readHandle));
+
+        WriteHandle writeHandle;
+        REQUIRE_FALSE(store->initWrite(99999, writeHandle));
+    }
+
+    delete store;
+    fs::remove_all("./endpoints");
+}
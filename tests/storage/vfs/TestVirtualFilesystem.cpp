@@ -1,13 +1,995 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <algorithm>
+#include <atomic>
+#include <ranges>
+#include <thread>
 #include <catch_amalgamated.hpp>
 #include "TestCommons.h"
 #include "storage/vfs/VirtualFilesystem.h"
 
 using namespace tpunkt;
 
+static VirtualFilesystem CreateFilesystem()
+{
+    return VirtualFilesystem{DirectoryCreationInfo{
+        .name = "Root", .creator = UserID::SERVER, .parent = FileID::Root(EndpointID{1}), .maxSize = 100'000}};
+}
+
+static FileCreationInfo GetFileInfo(const FileName& name)
+{
+    return FileCreationInfo{.name = name, .creator = UserID::SERVER, .endpoint = EndpointID{1}};
+}
+
+static DirectoryCreationInfo GetDirInfo(const FileName& name)
+{
+    return DirectoryCreationInfo{.name = name, .creator = UserID::SERVER, .parent = {}, .maxSize = 100'000};
+}
+
 TEST_CASE("Adding Files")
 {
-    // VirtualFilesystem filesystem;
-    // filesystem.
-}
\ No newline at end of file
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+
+    FileID sub{};
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Sub"), sub));
+    REQUIRE_FALSE(filesystem.dirAdd(root, GetDirInfo("Sub"), sub));
+
+    FileID file{};
+    REQUIRE(filesystem.fileAdd(sub, GetFileInfo("File"), file));
+    REQUIRE_FALSE(filesystem.fileAdd(sub, GetFileInfo("File"), file));
+
+    REQUIRE(filesystem.findDir(sub) != nullptr);
+    REQUIRE(filesystem.findDir(sub)->getID() == sub);
+    REQUIRE(filesystem.findFile(file) != nullptr);
+    REQUIRE(filesystem.findFile(file)->getID() == file);
+    REQUIRE(filesystem.findContainingDir(file)->getID() == sub);
+    REQUIRE(filesystem.findContainingDir(sub)->getID() == root);
+
+    // Wrong type
+    REQUIRE(filesystem.findFile(sub) == nullptr);
+    REQUIRE(filesystem.findDir(file) == nullptr);
+    REQUIRE(filesystem.findFile(FileID{}) == nullptr);
+}
+
+TEST_CASE("Lookup stays valid after removal")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+
+    constexpr int count = 100;
+    std::vector<FileID> files;
+    std::vector<FileID> dirs;
+    for(int i = 0; i < count; ++i)
+    {
+        FileID file{};
+        FileID dir{};
+        REQUIRE(filesystem.fileAdd(root, GetFileInfo(FileName{static_cast<uint64_t>(i)}), file));
+        REQUIRE(filesystem.dirAdd(root, GetDirInfo(FileName{static_cast<uint64_t>(i)}), dir));
+        files.push_back(file);
+        dirs.push_back(dir);
+    }
+
+    // Remove every third - unlinks them from the middle of the child lists
+    for(int i = 0; i < count; i += 3)
+    {
+        REQUIRE(filesystem.fileDelete(files[ i ]));
+        REQUIRE(filesystem.dirDelete(dirs[ i ]));
+        REQUIRE_FALSE(filesystem.fileDelete(files[ i ]));
+        REQUIRE_FALSE(filesystem.dirDelete(dirs[ i ]));
+    }
+
+    for(int i = 0; i < count; ++i)
+    {
+        const bool removed = i % 3 == 0;
+        const VirtualFile* file = filesystem.findFile(files[ i ]);
+        const VirtualDirectory* dir = filesystem.findDir(dirs[ i ]);
+        REQUIRE((file == nullptr) == removed);
+        REQUIRE((dir == nullptr) == removed);
+        if(!removed)
+        {
+            REQUIRE(file->getID() == files[ i ]);
+            REQUIRE(dir->getID() == dirs[ i ]);
+        }
+    }
+
+    // Non-empty dirs can't be removed
+    FileID nested{};
+    REQUIRE(filesystem.fileAdd(dirs[ 1 ], GetFileInfo("Nested"), nested));
+    REQUIRE_FALSE(filesystem.dirDelete(dirs[ 1 ]));
+    REQUIRE(filesystem.findFile(nested) != nullptr);
+}
+
+TEST_CASE("Pointers stay valid while the tree grows")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+
+    FileID sub{};
+    FileID file{};
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Sub"), sub));
+    REQUIRE(filesystem.fileAdd(sub, GetFileInfo("File"), file));
+    const VirtualDirectory* subPtr = filesystem.findDir(sub);
+    const VirtualFile* filePtr = filesystem.findFile(file);
+    const VirtualDirectory* rootPtr = &filesystem.getRoot();
+
+    // Spans multiple arena chunks
+    for(int i = 0; i < 2000; ++i)
+    {
+        FileID added{};
+        REQUIRE(filesystem.fileAdd(root, GetFileInfo(FileName{static_cast<uint64_t>(i)}), added));
+        REQUIRE(filesystem.dirAdd(sub, GetDirInfo(FileName{static_cast<uint64_t>(i)}), added));
+    }
+
+    REQUIRE(filesystem.findDir(sub) == subPtr);
+    REQUIRE(filesystem.findFile(file) == filePtr);
+    REQUIRE(&filesystem.getRoot() == rootPtr);
+    REQUIRE(filePtr->getID() == file);
+    REQUIRE(subPtr->getDirCount() == 2000);
+    REQUIRE(rootPtr->getFileCount() == 2000);
+}
+
+TEST_CASE("Children are visited in insertion order")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+
+    std::vector<FileID> files;
+    for(int i = 0; i < 10; ++i)
+    {
+        FileID file{};
+        REQUIRE(filesystem.fileAdd(root, GetFileInfo(FileName{static_cast<uint64_t>(i)}), file));
+        files.push_back(file);
+    }
+
+    // Remove first, middle and last
+    REQUIRE(filesystem.fileDelete(files[ 0 ]));
+    REQUIRE(filesystem.fileDelete(files[ 5 ]));
+    REQUIRE(filesystem.fileDelete(files[ 9 ]));
+    files.erase(files.begin() + 9);
+    files.erase(files.begin() + 5);
+    files.erase(files.begin());
+
+    std::vector<FileID> visited;
+    filesystem.forEachFile(filesystem.getRoot(), [ & ](const VirtualFile& file) { visited.push_back(file.getID()); });
+    REQUIRE(visited == files);
+    REQUIRE(filesystem.getRoot().getFileCount() == files.size());
+
+    // Root can't be removed
+    REQUIRE_FALSE(filesystem.dirDelete(root));
+}
+
+TEST_CASE("Name lookup in large directories")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+
+    // Well past the index threshold
+    constexpr int count = 1000;
+    std::vector<FileID> files;
+    for(int i = 0; i < count; ++i)
+    {
+        FileID file{};
+        REQUIRE(filesystem.fileAdd(root, GetFileInfo(FileName{static_cast<uint64_t>(i)}), file));
+        files.push_back(file);
+    }
+
+    FileID duplicate{};
+    REQUIRE_FALSE(filesystem.fileAdd(root, GetFileInfo(FileName{uint64_t{500}}), duplicate));
+    for(int i = 0; i < count; ++i)
+    {
+        const VirtualFile* file = filesystem.findFileByName(root, FileName{static_cast<uint64_t>(i)});
+        REQUIRE(file != nullptr);
+        REQUIRE(file->getID() == files[ i ]);
+    }
+    REQUIRE(filesystem.findFileByName(root, "Missing") == nullptr);
+    REQUIRE(filesystem.findDirByName(root, FileName{uint64_t{1}}) == nullptr);
+
+    // Renames keep the index in sync
+    REQUIRE(filesystem.fileRename(files[ 0 ], "Renamed"));
+    REQUIRE_FALSE(filesystem.fileRename(files[ 1 ], "Renamed"));
+    REQUIRE(filesystem.fileRename(files[ 0 ], "Renamed")); // Its own name isn't taken
+    REQUIRE(filesystem.findFileByName(root, FileName{uint64_t{0}}) == nullptr);
+    REQUIRE(filesystem.findFileByName(root, "Renamed")->getID() == files[ 0 ]);
+
+    // Shrink below the threshold - lookups fall back to the children
+    for(int i = 0; i < count - 10; ++i)
+    {
+        REQUIRE(filesystem.fileDelete(files[ i ]));
+    }
+    for(int i = count - 10; i < count; ++i)
+    {
+        REQUIRE(filesystem.findFileByName(root, FileName{static_cast<uint64_t>(i)})->getID() == files[ i ]);
+    }
+    REQUIRE(filesystem.fileAdd(root, GetFileInfo(FileName{uint64_t{0}}), duplicate));
+    REQUIRE_FALSE(filesystem.fileAdd(root, GetFileInfo(FileName{uint64_t{999}}), duplicate));
+}
+
+TEST_CASE("Name index keeps children with the same hash")
+{
+    // Names by node - every node gets the same hash
+    const std::vector<std::string> names{"a", "b", "c"};
+    const auto isName = [ & ](const std::string& name)
+    { return [ &, name ](const NodeHandle node) { return names[ static_cast<uint32_t>(node) ] == name; }; };
+
+    VirtualNameIndex index;
+    for(uint32_t i = 0; i < names.size(); ++i)
+    {
+        index.add(7, NodeHandle{i});
+    }
+    REQUIRE(index.find(7, isName("b")) == NodeHandle{1});
+    REQUIRE(index.find(7, isName("d")) == NodeHandle::INVALID);
+    REQUIRE(index.find(8, isName("a")) == NodeHandle::INVALID);
+
+    // Removing the first one keeps the others
+    index.remove(7, NodeHandle{0});
+    REQUIRE(index.find(7, isName("a")) == NodeHandle::INVALID);
+    REQUIRE(index.find(7, isName("b")) == NodeHandle{1});
+    REQUIRE(index.find(7, isName("c")) == NodeHandle{2});
+    index.remove(7, NodeHandle{2});
+    REQUIRE(index.find(7, isName("b")) == NodeHandle{1});
+    REQUIRE(index.find(7, isName("c")) == NodeHandle::INVALID);
+}
+
+TEST_CASE("Path resolution")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+
+    FileID docs{};
+    FileID sub{};
+    FileID report{};
+    FileID sameName{};
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Docs"), docs));
+    REQUIRE(filesystem.dirAdd(docs, GetDirInfo("Sub"), sub));
+    REQUIRE(filesystem.fileAdd(sub, GetFileInfo("Report"), report));
+    REQUIRE(filesystem.dirAdd(sub, GetDirInfo("Report"), sameName));
+
+    REQUIRE(filesystem.resolvePath(root, "") == root);
+    REQUIRE(filesystem.resolvePath(root, "/") == root);
+    REQUIRE(filesystem.resolvePath(root, "Docs") == docs);
+    REQUIRE(filesystem.resolvePath(root, "/Docs//Sub/") == sub);
+    REQUIRE(filesystem.resolvePath(docs, "Sub/Report") == report);
+
+    // Trailing separator selects the directory
+    REQUIRE(filesystem.resolvePath(root, "Docs/Sub/Report/") == sameName);
+
+    REQUIRE_FALSE(filesystem.resolvePath(root, "Docs/Missing").isValid());
+    REQUIRE_FALSE(filesystem.resolvePath(root, "Docs/Sub/Report/Below").isValid());
+    REQUIRE_FALSE(filesystem.resolvePath(report, "Sub").isValid());
+    REQUIRE_FALSE(filesystem.resolvePath(root, std::string(100, 'a')).isValid());
+}
+
+TEST_CASE("Name search")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+    const auto all = [](FileID) { return true; };
+
+    FileID photos{};
+    FileID other{};
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Photos"), photos));
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Other"), other));
+    for(int i = 0; i < 50; ++i)
+    {
+        FileID file{};
+        const FileName name{static_cast<uint64_t>(i), ".jpg"};
+        REQUIRE(filesystem.fileAdd(i % 2 == 0 ? photos : other, GetFileInfo(name), file));
+    }
+    FileID report{};
+    REQUIRE(filesystem.fileAdd(other, GetFileInfo("Report-Photos.txt"), report));
+
+    NameSearchQuery query;
+    std::vector<DTO::ResponseDirectoryEntry> entries;
+    uint64_t cursor = 0;
+
+    // Case-insensitive substring - files come before dirs
+    REQUIRE(VirtualNameSearch::PrepareQuery("PHOTO", false, query));
+    REQUIRE(filesystem.search(root, query, 0, cursor, all, entries));
+    REQUIRE(entries.size() == 2);
+    REQUIRE(entries[ 0 ].fid == report);
+    REQUIRE(entries[ 1 ].fid == photos);
+    REQUIRE(cursor == 0);
+
+    // Prefix
+    REQUIRE(VirtualNameSearch::PrepareQuery("ph", true, query));
+    REQUIRE(filesystem.search(root, query, 0, cursor, all, entries));
+    REQUIRE(entries.size() == 1);
+    REQUIRE(entries[ 0 ].fid == photos);
+    REQUIRE_FALSE(VirtualNameSearch::PrepareQuery("p", true, query));
+    REQUIRE_FALSE(VirtualNameSearch::PrepareQuery("ph", false, query));
+
+    // Paged and limited to a subtree
+    REQUIRE(VirtualNameSearch::PrepareQuery(".jpg", false, query));
+    size_t found = 0;
+    do
+    {
+        REQUIRE(filesystem.search(photos, query, 7, cursor, all, entries));
+        REQUIRE(entries.size() <= 7);
+        found += entries.size();
+    } while(cursor != 0);
+    REQUIRE(found == 25);
+
+    // Filter
+    REQUIRE(filesystem.search(root, query, 0, cursor, [ & ](FileID fid) { return fid.getUID() % 3 == 0; }, entries));
+    REQUIRE(std::ranges::all_of(entries, [](const auto& entry) { return entry.fid.getUID() % 3 == 0; }));
+
+    // Follows renames and removals
+    REQUIRE(VirtualNameSearch::PrepareQuery("report", true, query));
+    REQUIRE(filesystem.fileRename(report, "Summary.txt"));
+    REQUIRE(filesystem.search(root, query, 0, cursor, all, entries));
+    REQUIRE(entries.empty());
+    REQUIRE(VirtualNameSearch::PrepareQuery("summary", false, query));
+    REQUIRE(filesystem.search(root, query, 0, cursor, all, entries));
+    REQUIRE(entries.size() == 1);
+    REQUIRE(filesystem.fileDelete(report));
+    REQUIRE(filesystem.search(root, query, 0, cursor, all, entries));
+    REQUIRE(entries.empty());
+}
+
+TEST_CASE("Subtree totals and size limits")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem(); // Root limit: 100'000
+    const FileID root = filesystem.getRoot().getID();
+
+    FileID outer{};
+    FileID inner{};
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Outer"), outer));
+    DirectoryCreationInfo innerInfo = GetDirInfo("Inner");
+    innerInfo.maxSize = 0; // Only limited by its parents
+    REQUIRE(filesystem.dirAdd(outer, innerInfo, inner));
+
+    FileID file{};
+    REQUIRE(filesystem.fileAdd(inner, GetFileInfo("File"), file));
+    REQUIRE(filesystem.fileChangeSize(file, 60'000));
+
+    const VirtualDirectory& rootDir = filesystem.getRoot();
+    const VirtualDirectory* innerDir = filesystem.findDir(inner);
+    REQUIRE(innerDir->getStats().base.size == 60'000);
+    REQUIRE(filesystem.findDir(outer)->getStats().subDirFileSize == 60'000);
+    REQUIRE(rootDir.getStats().getTotalSize() == 60'000);
+    REQUIRE(rootDir.getStats().totalFiles == 1);
+    REQUIRE(rootDir.getStats().totalDirs == 2);
+
+    // Limit of the root applies to every dir below it
+    REQUIRE(filesystem.dirCanHoldSize(inner, 40'000));
+    REQUIRE_FALSE(filesystem.dirCanHoldSize(inner, 40'001));
+    FileID second{};
+    REQUIRE(filesystem.fileAdd(root, GetFileInfo("Second"), second));
+    REQUIRE_FALSE(filesystem.fileChangeSize(second, 50'000));
+    REQUIRE(filesystem.fileChangeSize(second, 40'000));
+    REQUIRE_FALSE(filesystem.dirCanHoldSize(outer, 1));
+
+    // Shrinking is always allowed
+    REQUIRE(filesystem.fileChangeSize(file, 10'000));
+    REQUIRE(rootDir.getStats().getTotalSize() == 50'000);
+    REQUIRE(rootDir.getStats().base.size == 40'000);
+
+    REQUIRE(filesystem.fileDelete(file));
+    REQUIRE(filesystem.dirDelete(inner));
+    REQUIRE(rootDir.getStats().getTotalSize() == 40'000);
+    REQUIRE(rootDir.getStats().totalFiles == 1);
+    REQUIRE(rootDir.getStats().totalDirs == 1);
+    REQUIRE(filesystem.findDir(outer)->getStats().getTotalSize() == 0);
+}
+
+TEST_CASE("Paged listing")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+    constexpr auto order = DirectorySortOrder::INSERTION;
+
+    std::vector<FileID> expected;
+    for(int i = 0; i < 10; ++i)
+    {
+        FileID file{};
+        REQUIRE(filesystem.fileAdd(root, GetFileInfo(FileName{static_cast<uint64_t>(i)}), file));
+        expected.push_back(file);
+    }
+    for(int i = 0; i < 5; ++i)
+    {
+        FileID dir{};
+        REQUIRE(filesystem.dirAdd(root, GetDirInfo(FileName{static_cast<uint64_t>(i)}), dir));
+        expected.push_back(dir);
+    }
+
+    std::vector<DTO::ResponseDirectoryEntry> entries;
+    DirectoryCursor cursor;
+    REQUIRE(filesystem.collectEntries(filesystem.getRoot(), order, false, 0, cursor, entries));
+    REQUIRE(entries.size() == expected.size());
+
+    // Page boundary exactly between files and dirs
+    REQUIRE_FALSE(filesystem.collectEntries(filesystem.getRoot(), order, false, 10, cursor, entries));
+    REQUIRE(entries.size() == 10);
+    REQUIRE(entries.back().isFile);
+
+    // Removing the last returned entry doesn't lose the position
+    cursor = DirectoryCursor{};
+    REQUIRE(filesystem.fileDelete(expected[ 9 ]));
+    REQUIRE_FALSE(filesystem.collectEntries(filesystem.getRoot(), order, false, 9, cursor, entries));
+    REQUIRE(filesystem.fileDelete(expected[ 8 ]));
+    expected.erase(expected.begin() + 8, expected.begin() + 10);
+
+    std::vector<FileID> collected;
+    for(const auto& entry : entries)
+    {
+        collected.push_back(entry.fid);
+    }
+    collected.pop_back();
+
+    bool isComplete = false;
+    while(!isComplete)
+    {
+        isComplete = filesystem.collectEntries(filesystem.getRoot(), order, false, 2, cursor, entries);
+        REQUIRE(entries.size() <= 2);
+        for(const auto& entry : entries)
+        {
+            collected.push_back(entry.fid);
+        }
+    }
+    REQUIRE(collected == expected);
+}
+
+static std::vector<uint64_t> CollectSizes(VirtualFilesystem& filesystem, const bool descending, const uint32_t limit)
+{
+    std::vector<uint64_t> sizes;
+    std::vector<DTO::ResponseDirectoryEntry> entries;
+    DirectoryCursor cursor;
+    bool isComplete = false;
+    while(!isComplete)
+    {
+        const VirtualDirectory& root = filesystem.getRoot();
+        isComplete = filesystem.collectEntries(root, DirectorySortOrder::SIZE, descending, limit, cursor, entries);
+        for(const auto& entry : entries)
+        {
+            sizes.push_back(entry.sizeBytes);
+        }
+    }
+    return sizes;
+}
+
+static FileName GetLongName(const int i)
+{
+    std::string name(40, 'x');
+    name += std::to_string(i);
+    return FileName{name.c_str()};
+}
+
+TEST_CASE("Sorted listing")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+
+    std::vector<FileID> files;
+    for(uint64_t i = 0; i < 50; ++i)
+    {
+        FileID file{};
+        REQUIRE(filesystem.fileAdd(root, GetFileInfo(FileName{(i * 7) % 50}), file));
+        REQUIRE(filesystem.fileChangeSize(file, (i * 13) % 50 + 1));
+        files.push_back(file);
+    }
+
+    std::vector<DTO::ResponseDirectoryEntry> entries;
+    DirectoryCursor cursor;
+    REQUIRE(filesystem.collectEntries(filesystem.getRoot(), DirectorySortOrder::NAME, false, 0, cursor, entries));
+    REQUIRE(std::ranges::is_sorted(entries, {}, [](const auto& entry) { return std::string{entry.name.view()}; }));
+
+    // Index is kept up to date after it was built
+    REQUIRE(filesystem.fileChangeSize(files[ 0 ], 1000));
+    REQUIRE(filesystem.fileDelete(files[ 1 ]));
+    FileID added{};
+    REQUIRE(filesystem.fileAdd(root, GetFileInfo("Added"), added));
+    REQUIRE(filesystem.fileChangeSize(files[ 2 ], 3)); // Moves to the front - name order is not touched
+    REQUIRE(filesystem.fileRename(files[ 3 ], "!First"));
+
+    entries.clear();
+    REQUIRE(filesystem.collectEntries(filesystem.getRoot(), DirectorySortOrder::NAME, false, 0, cursor, entries));
+    REQUIRE(std::ranges::is_sorted(entries, {}, [](const auto& entry) { return std::string{entry.name.view()}; }));
+    REQUIRE(entries.front().fid == files[ 3 ]);
+
+    const std::vector<uint64_t> ascending = CollectSizes(filesystem, false, 7);
+    REQUIRE(ascending.size() == 50);
+    REQUIRE(std::ranges::is_sorted(ascending));
+    REQUIRE(ascending.front() == 0);
+    REQUIRE(ascending.back() == 1000);
+
+    const std::vector<uint64_t> descending = CollectSizes(filesystem, true, 7);
+    REQUIRE(std::ranges::equal(descending, std::views::reverse(ascending)));
+
+    // Removing the last returned entry keeps the position
+    cursor = DirectoryCursor{};
+    REQUIRE_FALSE(
+        filesystem.collectEntries(filesystem.getRoot(), DirectorySortOrder::SIZE, false, 10, cursor, entries));
+    REQUIRE(filesystem.fileDelete(entries.back().fid));
+    REQUIRE_FALSE(
+        filesystem.collectEntries(filesystem.getRoot(), DirectorySortOrder::SIZE, false, 10, cursor, entries));
+    REQUIRE(entries.front().sizeBytes >= ascending[ 9 ]);
+    REQUIRE(entries.size() == 10);
+}
+
+TEST_CASE("Sorted listing resumes at the full name")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+    for(int i = 10; i < 30; ++i)
+    {
+        FileID file{};
+        REQUIRE(filesystem.fileAdd(root, GetFileInfo(GetLongName(i)), file));
+    }
+
+    // Names share their first 40 bytes - the removed or renamed last entry is not repeated or skipped
+    for(const bool descending : {false, true})
+    {
+        std::vector<DTO::ResponseDirectoryEntry> entries;
+        DirectoryCursor cursor;
+        REQUIRE_FALSE(
+            filesystem.collectEntries(filesystem.getRoot(), DirectorySortOrder::NAME, descending, 5, cursor, entries));
+        const std::string last{entries.back().name.view()};
+        if(descending)
+        {
+            REQUIRE(filesystem.fileRename(entries.back().fid, GetLongName(99)));
+        }
+        else
+        {
+            REQUIRE(filesystem.fileDelete(entries.back().fid));
+        }
+
+        entries.clear();
+        REQUIRE_FALSE(
+            filesystem.collectEntries(filesystem.getRoot(), DirectorySortOrder::NAME, descending, 5, cursor, entries));
+        const std::string next{entries.front().name.view()};
+        REQUIRE(next == std::string{GetLongName(descending ? 24 : 15).view()});
+        REQUIRE(last == std::string{GetLongName(descending ? 25 : 14).view()});
+    }
+}
+
+TEST_CASE("Name arena")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+    REQUIRE(filesystem.getName(filesystem.getRoot()) == "Root");
+
+    FileID file{};
+    REQUIRE(filesystem.fileAdd(root, GetFileInfo("Name"), file));
+    REQUIRE(filesystem.getName(*filesystem.findFile(file)) == "Name");
+
+    // Freed names are reused by names of the same length
+    const size_t usedBytes = filesystem.getNames().getUsedBytes();
+    REQUIRE(filesystem.fileRename(file, "Same"));
+    REQUIRE(filesystem.getName(*filesystem.findFile(file)) == "Same");
+    REQUIRE(filesystem.getNames().getUsedBytes() == usedBytes);
+    REQUIRE(filesystem.getNames().getUnusedBytes() == 0);
+    REQUIRE(filesystem.findFileByName(root, "Name") == nullptr);
+    REQUIRE(filesystem.findFileByName(root, "Same") != nullptr);
+
+    int requests = 0;
+    filesystem.setNameCompactionRequest([ & ] { ++requests; });
+
+    constexpr int count = 3000;
+    std::vector<FileID> files;
+    for(int i = 0; i < count; ++i)
+    {
+        REQUIRE(filesystem.fileAdd(root, GetFileInfo(GetLongName(i)), files.emplace_back()));
+    }
+    for(int i = 0; i < count; i += 2)
+    {
+        REQUIRE(filesystem.fileDelete(files[ i ]));
+    }
+    for(int i = 0; i < count; i += 4)
+    {
+        REQUIRE(filesystem.fileDelete(files[ i + 1 ]));
+    }
+    REQUIRE(requests == 1); // Requested once until compacted
+    REQUIRE(filesystem.getNames().isFragmented());
+
+    filesystem.compactNames();
+    REQUIRE(filesystem.getNames().getUnusedBytes() == 0);
+    REQUIRE(filesystem.getName(*filesystem.findFile(file)) == "Same");
+    for(int i = 3; i < count; i += 4)
+    {
+        REQUIRE(filesystem.getName(*filesystem.findFile(files[ i ])) == GetLongName(i).view());
+        REQUIRE(filesystem.findFileByName(root, GetLongName(i)) != nullptr);
+    }
+}
+
+TEST_CASE("Snapshots")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+
+    FileID changed{};
+    FileID unchanged{};
+    FileID file{};
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Changed"), changed));
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Unchanged"), unchanged));
+    REQUIRE(filesystem.fileAdd(changed, GetFileInfo("File"), file));
+    REQUIRE(filesystem.fileChangeSize(file, 10));
+
+    const VirtualSnapshot first = filesystem.takeSnapshot();
+    REQUIRE(first->fid == root);
+    REQUIRE(first->getName() == "Root");
+    REQUIRE(first->stats.getTotalSize() == 10);
+    REQUIRE(first->dirs.size() == 2);
+    REQUIRE(first->dirs[ 0 ]->getName() == "Changed");
+    REQUIRE(first->dirs[ 0 ]->getName(first->dirs[ 0 ]->files[ 0 ]) == "File");
+
+    // Nothing changed - same tree
+    REQUIRE(filesystem.takeSnapshot() == first);
+
+    // Snapshot stays as it was while the filesystem changes
+    REQUIRE(filesystem.fileRename(file, "Renamed"));
+    REQUIRE(filesystem.fileChangeSize(file, 20));
+    FileID added{};
+    REQUIRE(filesystem.fileAdd(root, GetFileInfo("Added"), added));
+    REQUIRE(first->stats.getTotalSize() == 10);
+    REQUIRE(first->files.empty());
+    REQUIRE(first->dirs[ 0 ]->getName(first->dirs[ 0 ]->files[ 0 ]) == "File");
+
+    // Only the changed path is copied
+    const VirtualSnapshot second = filesystem.takeSnapshot();
+    REQUIRE(second != first);
+    REQUIRE(second->stats.getTotalSize() == 20);
+    REQUIRE(second->files.size() == 1);
+    REQUIRE(second->dirs[ 0 ] != first->dirs[ 0 ]);
+    REQUIRE(second->dirs[ 0 ]->getName(second->dirs[ 0 ]->files[ 0 ]) == "Renamed");
+    REQUIRE(second->dirs[ 1 ] == first->dirs[ 1 ]);
+
+    // Same nodes as the live filesystem
+    std::vector<VirtualNodeState> expected;
+    std::vector<VirtualNodeState> collected;
+    filesystem.collectNodes(expected);
+    second->collectNodes(collected);
+    REQUIRE(expected.size() == collected.size());
+    for(size_t i = 0; i < expected.size(); ++i)
+    {
+        REQUIRE(expected[ i ].fid == collected[ i ].fid);
+        REQUIRE(expected[ i ].parent == collected[ i ].parent);
+        REQUIRE(expected[ i ].info.name == collected[ i ].info.name);
+        REQUIRE(expected[ i ].stats.size == collected[ i ].stats.size);
+    }
+
+    // Reused handles don't inherit a snapshot
+    REQUIRE(filesystem.dirDelete(unchanged));
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("New"), unchanged));
+    const VirtualSnapshot third = filesystem.takeSnapshot();
+    REQUIRE(third->dirs[ 1 ]->getName() == "New");
+    REQUIRE(third->dirs[ 0 ] == second->dirs[ 0 ]);
+}
+
+TEST_CASE("Moving files and dirs")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+
+    FileID source{};
+    FileID target{};
+    FileID nested{};
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Source"), source));
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Target"), target));
+    REQUIRE(filesystem.dirAdd(source, GetDirInfo("Nested"), nested));
+
+    // Large enough for a name index
+    constexpr uint64_t count = TPUNKT_STORAGE_VFS_NAME_INDEX_THRESHOLD * 2;
+    for(uint64_t i = 0; i < count; ++i)
+    {
+        FileID file{};
+        REQUIRE(filesystem.fileAdd(nested, GetFileInfo(FileName{i}), file));
+        REQUIRE(filesystem.fileChangeSize(file, 10));
+    }
+
+    FileID file{};
+    REQUIRE(filesystem.fileAdd(source, GetFileInfo("File"), file));
+    REQUIRE(filesystem.fileChangeSize(file, 5));
+
+    // Files
+    REQUIRE(filesystem.fileMove(file, target));
+    REQUIRE(filesystem.findContainingDir(file)->getID() == target);
+    REQUIRE(filesystem.findFileByName(source, "File") == nullptr);
+    REQUIRE(filesystem.findFileByName(target, "File") != nullptr);
+    REQUIRE(filesystem.findDir(source)->getStats().getTotalSize() == count * 10);
+    REQUIRE(filesystem.findDir(target)->getStats().getTotalSize() == 5);
+
+    FileID other{};
+    REQUIRE(filesystem.fileAdd(source, GetFileInfo("File"), other));
+    REQUIRE_FALSE(filesystem.fileMove(other, target)); // Name taken
+
+    // Dirs - the subtree moves with it
+    REQUIRE(filesystem.dirMove(nested, target));
+    REQUIRE(filesystem.findContainingDir(nested)->getID() == target);
+    REQUIRE(filesystem.findDir(nested)->getInfo().parent == target);
+    REQUIRE(filesystem.findFileByName(nested, FileName{uint64_t{7}}) != nullptr);
+    REQUIRE(filesystem.findDirByName(target, "Nested") != nullptr);
+    REQUIRE(filesystem.resolvePath(root, "Target/Nested/7") != FileID{});
+
+    const DirectoryStats& sourceStats = filesystem.findDir(source)->getStats();
+    const DirectoryStats& targetStats = filesystem.findDir(target)->getStats();
+    REQUIRE(sourceStats.getTotalSize() == 0);
+    REQUIRE(sourceStats.totalDirs == 0);
+    REQUIRE(sourceStats.totalFiles == 1);
+    REQUIRE(targetStats.getTotalSize() == count * 10 + 5);
+    REQUIRE(targetStats.totalDirs == 1);
+    REQUIRE(targetStats.totalFiles == count + 1);
+    REQUIRE(filesystem.getRoot().getStats().getTotalSize() == count * 10 + 5);
+
+    // Not into itself or below itself - not the root
+    REQUIRE_FALSE(filesystem.dirMove(target, target));
+    REQUIRE_FALSE(filesystem.dirMove(target, nested));
+    REQUIRE_FALSE(filesystem.dirMove(root, source));
+
+    // Size limits only apply to dirs that don't already hold it
+    FileID limited{};
+    REQUIRE(filesystem.dirAdd(root, DirectoryCreationInfo{.name = "Limited", .creator = UserID::SERVER, .maxSize = 100},
+                              limited));
+    REQUIRE_FALSE(filesystem.dirMove(nested, limited));
+    REQUIRE(filesystem.fileMove(file, limited));
+    REQUIRE(filesystem.findDir(limited)->getStats().getTotalSize() == 5);
+}
+
+TEST_CASE("Background directory deletion")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+
+    FileID deleted{};
+    FileID nested{};
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Deleted"), deleted));
+    REQUIRE(filesystem.dirAdd(deleted, GetDirInfo("Nested"), nested));
+
+    std::vector<FileID> files;
+    for(uint64_t i = 0; i < 100; ++i)
+    {
+        REQUIRE(filesystem.fileAdd(i % 2 == 0 ? deleted : nested, GetFileInfo(FileName{i}), files.emplace_back()));
+        REQUIRE(filesystem.fileChangeSize(files.back(), 1));
+    }
+
+    REQUIRE_FALSE(filesystem.dirTombstone(root));
+    REQUIRE(filesystem.dirTombstone(deleted));
+    REQUIRE(filesystem.hasTombstones());
+
+    // Hidden right away
+    REQUIRE(filesystem.findDir(deleted) == nullptr);
+    REQUIRE(filesystem.findDir(nested) == nullptr);
+    REQUIRE(filesystem.findFile(files[ 1 ]) == nullptr);
+    REQUIRE(filesystem.findDirByName(root, "Deleted") == nullptr);
+    REQUIRE(filesystem.resolvePath(root, "Deleted/Nested") == FileID{});
+    REQUIRE_FALSE(filesystem.fileDelete(files[ 0 ]));
+    REQUIRE(filesystem.getRoot().isEmpty());
+    REQUIRE(filesystem.getRoot().getStats().getTotalSize() == 0);
+    REQUIRE(filesystem.getRoot().getStats().totalFiles == 0);
+    REQUIRE(filesystem.getRoot().getStats().totalDirs == 0);
+
+    NameSearchQuery query;
+    REQUIRE(VirtualNameSearch::PrepareQuery("Nes", true, query));
+    uint64_t cursor = 0;
+    std::vector<DTO::ResponseDirectoryEntry> entries;
+    REQUIRE(filesystem.search(root, query, 0, cursor, [](FileID) { return true; }, entries));
+    REQUIRE(entries.empty());
+
+    // The name is free again
+    FileID replaced{};
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Deleted"), replaced));
+
+    // Removed in batches
+    std::vector<FileID> removedFiles;
+    uint32_t batches = 0;
+    while(filesystem.dirReclaim(16, removedFiles))
+    {
+        ++batches;
+    }
+    REQUIRE(batches == 6);
+    REQUIRE_FALSE(filesystem.hasTombstones());
+    REQUIRE(removedFiles.size() == files.size());
+    REQUIRE(std::ranges::is_permutation(removedFiles, files));
+
+    // Handles are reused
+    FileID file{};
+    REQUIRE(filesystem.fileAdd(replaced, GetFileInfo("File"), file));
+    REQUIRE(filesystem.findFile(file) != nullptr);
+    REQUIRE(filesystem.findContainingDir(file)->getID() == replaced);
+    REQUIRE(filesystem.findDir(replaced)->getStats().totalFiles == 1);
+}
+
+TEST_CASE("Change log")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+    const VirtualChangeLog& log = filesystem.getChanges();
+    REQUIRE(log.getSequence() == 0);
+
+    FileID dir{};
+    FileID file{};
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Dir"), dir));
+    REQUIRE(filesystem.fileAdd(root, GetFileInfo("File"), file));
+    REQUIRE(filesystem.fileMove(file, dir));
+    REQUIRE(filesystem.fileRename(file, "Other"));
+    FileID failed{};
+    REQUIRE_FALSE(filesystem.fileAdd(dir, GetFileInfo("Other"), failed)); // Not logged
+    REQUIRE(log.getSequence() == 4);
+
+    std::vector<VirtualChange> changes;
+    REQUIRE(log.collect(0, 0, changes));
+    REQUIRE(changes.size() == 4);
+    REQUIRE(changes[ 0 ].operation == JournalOperation::DIR_ADD);
+    REQUIRE(changes[ 0 ].fid == dir);
+    REQUIRE(changes[ 0 ].parent == root);
+    REQUIRE(changes[ 2 ].operation == JournalOperation::FILE_MOVE);
+    REQUIRE(changes[ 2 ].parent == dir);
+
+    REQUIRE(log.collect(2, 1, changes));
+    REQUIRE(changes.size() == 1);
+    REQUIRE(changes[ 0 ].sequence == 3);
+    REQUIRE(log.collect(4, 0, changes));
+    REQUIRE(changes.empty());
+    REQUIRE_FALSE(log.collect(5, 0, changes)); // Unknown
+
+    // Oldest changes are dropped
+    for(uint64_t i = 0; i < TPUNKT_STORAGE_VFS_CHANGE_LOG_SIZE; ++i)
+    {
+        REQUIRE(filesystem.fileChangeSize(file, i % 2 + 1));
+    }
+    REQUIRE_FALSE(log.collect(3, 0, changes));
+    REQUIRE(log.collect(4, 0, changes));
+    REQUIRE(changes.size() == TPUNKT_STORAGE_VFS_CHANGE_LOG_SIZE);
+    REQUIRE(changes.back().sequence == log.getSequence());
+
+    // Changes before a reset are not known
+    filesystem.changesReset(100'000);
+    REQUIRE_FALSE(log.collect(4, 0, changes));
+    REQUIRE(log.collect(100'000, 0, changes));
+    REQUIRE(changes.empty());
+    REQUIRE(filesystem.dirRename(dir, "Renamed"));
+    REQUIRE(log.collect(100'000, 0, changes));
+    REQUIRE(changes.size() == 1);
+    REQUIRE(changes[ 0 ].sequence == 100'001);
+}
+
+TEST_CASE("Tree hashes")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+
+    FileID left{};
+    FileID right{};
+    FileID nested{};
+    FileID file{};
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Left"), left));
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Right"), right));
+    REQUIRE(filesystem.dirAdd(left, GetDirInfo("Nested"), nested));
+    REQUIRE(filesystem.fileAdd(nested, GetFileInfo("File"), file));
+
+    const auto getHash = [ & ](const FileID dir)
+    {
+        uint64_t hash = 0;
+        REQUIRE(filesystem.getTreeHash(dir, hash));
+        return hash;
+    };
+
+    const uint64_t rootHash = getHash(root);
+    const uint64_t leftHash = getHash(left);
+    const uint64_t rightHash = getHash(right);
+    REQUIRE(rootHash != leftHash);
+    REQUIRE(getHash(root) == rootHash);
+
+    uint64_t hash = 0;
+    REQUIRE_FALSE(filesystem.getTreeHash(file, hash));
+    REQUIRE_FALSE(filesystem.getTreeHash(FileID{}, hash));
+
+    // A change deep down changes all its parents - the other subtrees keep their hash
+    REQUIRE(filesystem.fileChangeSize(file, 10));
+    REQUIRE(getHash(root) != rootHash);
+    REQUIRE(getHash(left) != leftHash);
+    REQUIRE(getHash(right) == rightHash);
+
+    const uint64_t nestedHash = getHash(nested);
+    REQUIRE(filesystem.fileRename(file, "Renamed"));
+    REQUIRE(getHash(nested) != nestedHash);
+
+    // Moving changes both sides
+    const uint64_t movedRootHash = getHash(root);
+    const uint64_t movedLeftHash = getHash(left);
+    REQUIRE(filesystem.fileMove(file, right));
+    REQUIRE(getHash(root) != movedRootHash);
+    REQUIRE(getHash(left) != movedLeftHash);
+    REQUIRE(getHash(right) != rightHash);
+
+    // Deleted subtrees are no longer part of the hash
+    const uint64_t deletedRootHash = getHash(root);
+    REQUIRE(filesystem.dirTombstone(left));
+    REQUIRE(getHash(root) != deletedRootHash);
+    REQUIRE_FALSE(filesystem.getTreeHash(nested, hash));
+}
+
+TEST_CASE("Directory versions")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+
+    FileID outer{};
+    FileID inner{};
+    FileID file{};
+    REQUIRE(filesystem.dirAdd(root, GetDirInfo("Outer"), outer));
+    REQUIRE(filesystem.dirAdd(outer, GetDirInfo("Inner"), inner));
+    REQUIRE(filesystem.fileAdd(inner, GetFileInfo("File"), file));
+
+    const auto getVersion = [ & ](const FileID dir) { return filesystem.findDir(dir)->getVersion(); };
+    const uint64_t rootVersion = getVersion(root);
+    const uint64_t outerVersion = getVersion(outer);
+    const uint64_t innerVersion = getVersion(inner);
+
+    // Listing of outer shows the modification time of inner - root shows the size of outer
+    REQUIRE(filesystem.fileChangeSize(file, 10));
+    REQUIRE(getVersion(inner) != innerVersion);
+    REQUIRE(getVersion(outer) != outerVersion);
+    REQUIRE(getVersion(root) != rootVersion);
+
+    // Nothing listed in root changed
+    const uint64_t renamedRootVersion = getVersion(root);
+    REQUIRE(filesystem.fileRename(file, "Renamed"));
+    REQUIRE(getVersion(root) == renamedRootVersion);
+}
+
+TEST_CASE("Access statistics")
+{
+    TEST_INIT();
+    VirtualFilesystem filesystem = CreateFilesystem();
+    const FileID root = filesystem.getRoot().getID();
+
+    FileID file{};
+    REQUIRE(filesystem.fileAdd(root, GetFileInfo("File"), file));
+    const VirtualFile& virtualFile = *filesystem.findFile(file);
+    const uint32_t modifications = virtualFile.getStats().modificationCount;
+    const uint32_t accesses = virtualFile.getStats().getAccessCount();
+    const uint64_t version = filesystem.getRoot().getVersion();
+
+    // Readers only share the filesystem - assertions are not threadsafe
+    constexpr uint32_t THREADS = 4;
+    constexpr uint32_t READS = 10'000;
+    const VirtualFilesystem& shared = filesystem;
+    std::atomic<uint32_t> failed = 0;
+    std::vector<std::thread> threads;
+    for(uint32_t i = 0; i < THREADS; ++i)
+    {
+        threads.emplace_back(
+            [ & ]()
+            {
+                for(uint32_t j = 0; j < READS; ++j)
+                {
+                    if(!shared.fileAccess(file) || !shared.dirAccess(root))
+                    {
+                        failed++;
+                    }
+                }
+            });
+    }
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    REQUIRE(failed == 0);
+
+    REQUIRE(virtualFile.getStats().getAccessCount() == accesses + THREADS * READS);
+    REQUIRE(filesystem.getRoot().getStats().base.getAccessCount() >= THREADS * READS);
+    REQUIRE(virtualFile.getStats().modificationCount == modifications);
+    REQUIRE(filesystem.getRoot().getVersion() == version);
+    REQUIRE_FALSE(shared.fileAccess(root));
+    REQUIRE_FALSE(shared.dirAccess(file));
+}
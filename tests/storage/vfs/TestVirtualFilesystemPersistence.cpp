@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <filesystem>
+#include <catch_amalgamated.hpp>
+#include "TestCommons.h"
+#include "storage/vfs/VirtualFilesystem.h"
+#include "storage/vfs/VirtualFilesystemPersistence.h"
+
+using namespace tpunkt;
+
+static constexpr auto* TEST_DIR = "./vfsPersistence";
+
+static VirtualFilesystem CreateFilesystem()
+{
+    return VirtualFilesystem{DirectoryCreationInfo{
+        .name = "Root", .creator = UserID::SERVER, .parent = FileID::Root(EndpointID{1}), .maxSize = 100'000}};
+}
+
+static FileCreationInfo GetFileInfo(const FileName& name)
+{
+    return FileCreationInfo{.name = name, .creator = UserID::SERVER, .endpoint = EndpointID{1}};
+}
+
+static DirectoryCreationInfo GetDirInfo(const FileName& name)
+{
+    return DirectoryCreationInfo{.name = name, .creator = UserID::SERVER, .parent = {}, .maxSize = 0};
+}
+
+static void ResetTestDir()
+{
+    std::filesystem::remove_all(TEST_DIR);
+    std::filesystem::create_directory(TEST_DIR);
+}
+
+static void RequireSameTree(VirtualFilesystem& expected, VirtualFilesystem& restored)
+{
+    std::vector<VirtualNodeState> expectedNodes;
+    std::vector<VirtualNodeState> restoredNodes;
+    expected.collectNodes(expectedNodes);
+    restored.collectNodes(restoredNodes);
+
+    REQUIRE(expectedNodes.size() == restoredNodes.size());
+    for(size_t i = 0; i < expectedNodes.size(); ++i)
+    {
+        REQUIRE(expectedNodes[ i ].fid == restoredNodes[ i ].fid);
+        REQUIRE(expectedNodes[ i ].parent == restoredNodes[ i ].parent);
+        REQUIRE(expectedNodes[ i ].info.name == restoredNodes[ i ].info.name);
+        REQUIRE(expectedNodes[ i ].stats.size == restoredNodes[ i ].stats.size);
+    }
+
+    const DirectoryStats& expectedStats = expected.getRoot().getStats();
+    const DirectoryStats& restoredStats = restored.getRoot().getStats();
+    REQUIRE(expectedStats.getTotalSize() == restoredStats.getTotalSize());
+    REQUIRE(expectedStats.totalFiles == restoredStats.totalFiles);
+    REQUIRE(expectedStats.totalDirs == restoredStats.totalDirs);
+}
+
+TEST_CASE("Journal restores all changes")
+{
+    TEST_INIT();
+    ResetTestDir();
+    const CipherKey key = "TestKeyTestKeyTestKeyTestKeyTest";
+
+    VirtualFilesystem filesystem = CreateFilesystem();
+    {
+        VirtualFilesystemPersistence persistence{TEST_DIR, key, {}};
+        REQUIRE(persistence.load(filesystem));
+        filesystem.setPersistence(&persistence);
+
+        const FileID root = filesystem.getRoot().getID();
+        FileID sub{};
+        FileID file{};
+        FileID removed{};
+        REQUIRE(filesystem.dirAdd(root, GetDirInfo("Sub"), sub));
+        REQUIRE(filesystem.fileAdd(sub, GetFileInfo("File"), file));
+        REQUIRE(filesystem.fileAdd(root, GetFileInfo("Removed"), removed));
+        REQUIRE(filesystem.fileChangeSize(file, 500));
+        REQUIRE(filesystem.fileRename(file, "Renamed"));
+        REQUIRE(filesystem.dirRename(sub, "SubRenamed"));
+        REQUIRE(filesystem.fileDelete(removed));
+
+        FileID target{};
+        FileID moved{};
+        REQUIRE(filesystem.dirAdd(root, GetDirInfo("Target"), target));
+        REQUIRE(filesystem.fileAdd(root, GetFileInfo("Moved"), moved));
+        REQUIRE(filesystem.fileMove(moved, target));
+        REQUIRE(filesystem.dirMove(target, sub));
+
+        // Deletion is continued after a restart
+        FileID deleted{};
+        FileID inside{};
+        REQUIRE(filesystem.dirAdd(root, GetDirInfo("Deleted"), deleted));
+        REQUIRE(filesystem.fileAdd(deleted, GetFileInfo("Inside"), inside));
+        REQUIRE(filesystem.dirTombstone(deleted));
+        REQUIRE(persistence.getJournalRecords() == 14);
+        REQUIRE(persistence.flush()); // Written by the sync thread otherwise - or when closed
+        filesystem.setPersistence(nullptr);
+    }
+
+    VirtualFilesystem restored = CreateFilesystem();
+    VirtualFilesystemPersistence persistence{TEST_DIR, key, {}};
+    REQUIRE(persistence.load(restored));
+    REQUIRE(persistence.getSequence() == 14);
+    RequireSameTree(filesystem, restored);
+    REQUIRE(restored.hasTombstones());
+    std::vector<FileID> removedFiles;
+    REQUIRE_FALSE(restored.dirReclaim(16, removedFiles));
+    REQUIRE(removedFiles.size() == 1);
+
+    const FileID sub = filesystem.findDirByName(filesystem.getRoot().getID(), "SubRenamed")->getID();
+    REQUIRE(restored.findDir(sub) != nullptr);
+    REQUIRE(restored.findFileByName(sub, "Renamed") != nullptr);
+    const VirtualDirectory* target = restored.findDirByName(sub, "Target");
+    REQUIRE(target != nullptr);
+    REQUIRE(restored.findFileByName(target->getID(), "Moved") != nullptr);
+    REQUIRE(restored.findFileByName(restored.getRoot().getID(), "Removed") == nullptr);
+
+    // New ids never collide with restored ones
+    FileID newFile{};
+    REQUIRE(restored.fileAdd(sub, GetFileInfo("New"), newFile));
+    REQUIRE(filesystem.findFile(newFile) == nullptr);
+
+    // Different key can't read the journal
+    VirtualFilesystem other = CreateFilesystem();
+    VirtualFilesystemPersistence otherPersistence{TEST_DIR, "OtherKeyOtherKeyOtherKeyOtherKey", {}};
+    REQUIRE_FALSE(otherPersistence.load(other));
+    REQUIRE(other.getRoot().isEmpty());
+}
+
+TEST_CASE("Compaction writes a snapshot")
+{
+    TEST_INIT();
+    ResetTestDir();
+    const CipherKey key = "TestKeyTestKeyTestKeyTestKeyTest";
+
+    VirtualFilesystem filesystem = CreateFilesystem();
+    {
+        VirtualFilesystemPersistence persistence{TEST_DIR, key, {}};
+        REQUIRE(persistence.load(filesystem));
+        filesystem.setPersistence(&persistence);
+
+        // Spans multiple snapshot chunks
+        const FileID root = filesystem.getRoot().getID();
+        FileID dir{};
+        REQUIRE(filesystem.dirAdd(root, GetDirInfo("Dir"), dir));
+        for(int i = 0; i < 600; ++i)
+        {
+            FileID file{};
+            REQUIRE(filesystem.fileAdd(dir, GetFileInfo(FileName{static_cast<uint64_t>(i)}), file));
+            REQUIRE(filesystem.fileChangeSize(file, static_cast<uint64_t>(i % 100)));
+        }
+
+        VirtualSnapshot tree;
+        uint64_t sequence = 0;
+        REQUIRE(persistence.compactBegin(filesystem, tree, sequence));
+        REQUIRE(persistence.getJournalRecords() == 0);
+
+        // Changes during compaction end up in the new journal
+        FileID late{};
+        REQUIRE(filesystem.fileAdd(root, GetFileInfo("Late"), late));
+        REQUIRE(persistence.compactFinish(*tree, sequence));
+        REQUIRE(persistence.getJournalRecords() == 1);
+        filesystem.setPersistence(nullptr);
+    }
+
+    REQUIRE_FALSE(std::filesystem::exists(std::string{TEST_DIR} + "/journal.old"));
+
+    VirtualFilesystem restored = CreateFilesystem();
+    VirtualFilesystemPersistence persistence{TEST_DIR, key, {}};
+    REQUIRE(persistence.load(restored));
+    REQUIRE(persistence.getJournalRecords() == 1);
+    RequireSameTree(filesystem, restored);
+    REQUIRE(restored.findFileByName(restored.getRoot().getID(), "Late") != nullptr);
+}